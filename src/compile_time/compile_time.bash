@@ -0,0 +1,41 @@
+#!/bin/bash
+# Generates a translation unit with many TS_SNPRINTF calls with different
+#  argument lists and reports how long it takes to compile
+#
+#  compile_time.bash [compiler] [calls]
+
+compiler=${1:-g++}
+calls=${2:-1000}
+
+here=$(cd "$(dirname "$0")" && pwd)
+source=$(mktemp --suffix=.cpp)
+trap 'rm -f "$source" "$source.o"' EXIT
+
+specs=(   '%d' '%s' '%u' '%lu' '%f' '%lld' '%llu' '%zu' '%p' '%hhd' '%hd' '%ld' '%c' '%ls' '%Lf' '%x' )
+values=(  'i'  's'  'u'  'lu'  'd'  'll'   'ull'  'z'   'p'  'sc'   'sh'  'l'   'i'  'ws'  'ld'  'u'  )
+
+{
+  echo '#include "'"$here"'/../tsprintf/tsprintf.hpp"'
+  echo 'void compile_time (char * buffer, std::size_t size, int i, unsigned u, unsigned long lu, double d, char const * s, long long ll, unsigned long long ull, std::size_t z, void const * p, signed char sc, short sh, long l, wchar_t const * ws, long double ld)'
+  echo '{'
+
+  seed=1
+  for (( iter = 0; iter < calls; ++iter ))
+  do
+    format=''
+    args=''
+    for (( arg = 0; arg < 1 + iter % 10; ++arg ))
+    do
+      seed=$(( (seed * 1103515245 + 12345) % 2147483648 ))
+      pick=$(( (seed >> 16) % ${#specs[@]} ))
+      format="$format ${specs[pick]}"
+      args="$args, ${values[pick]}"
+    done
+    echo "  TS_SNPRINTF (buffer, size, \"$format\"$args);"
+  done
+
+  echo '}'
+} > "$source"
+
+TIMEFORMAT="$compiler, $calls calls: %R s"
+time "$compiler" -c -O0 -w --std=c++14 "$source" -o "$source.o"
@@ -0,0 +1 @@
+clang++ -g -O3 -Wall -ftemplate-depth=1024 --std=c++14 -pthread contention.cpp -o exe.contention.clang++
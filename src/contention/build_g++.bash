@@ -0,0 +1 @@
+g++ -g -O3 -Wall --std=c++14 -pthread contention.cpp -o exe.contention.g++
@@ -0,0 +1,365 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+// contention - latency of the output paths when many threads use them at once
+//
+//  contention [threads] [calls] [output]   Runs 1, 2, 4 ... threads (up to threads,
+//                                          default the number of cores) making calls
+//                                          calls each (default 200000) to TS_PRINTF,
+//                                          TS_FPRINTF and TS_SNPRINTF. stdout and the
+//                                          TS_FPRINTF stream go to output (default
+//                                          /dev/null, use a tmpfs file like
+//                                          /dev/shm/contention to include the writes)
+//
+// Every call is timed and recorded in a per-thread HDR histogram, the report
+//  has the percentiles of all calls and the throughput of all threads. The
+//  "clock" rows time an empty call, that is the overhead included in every
+//  other latency.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../tsprintf/tsprintf.hpp"
+
+namespace
+{
+  using namespace typesafe_printf;
+
+  using clock_type  = std::chrono::steady_clock;
+  using file_ptr    = std::unique_ptr<std::FILE, int (*) (std::FILE *)>;
+
+  // Log-linear histogram of nanoseconds like HdrHistogram with 3 significant
+  //  digits: values below 2048 have a bucket each, above that every power of
+  //  two is split in 1024 buckets
+  class histogram
+  {
+  public:
+    histogram ()
+      : counts  (sub_bucket_count + max_shift * half_count)
+      , total   (0U)
+      , max     (0U)
+    {
+    }
+
+    void record (std::uint64_t value) noexcept
+    {
+      ++counts[index_of (value)];
+      ++total;
+      max = std::max (max, value);
+    }
+
+    void add (histogram const & other) noexcept
+    {
+      for (auto iter = 0U; iter < counts.size (); ++iter)
+      {
+        counts[iter] += other.counts[iter];
+      }
+      total += other.total;
+      max   = std::max (max, other.max);
+    }
+
+    // The largest value in the bucket of the percentile, like
+    //  HdrHistogram's highest equivalent value
+    std::uint64_t percentile (double p) const noexcept
+    {
+      auto target = static_cast<std::uint64_t> (p / 100.0 * static_cast<double> (total) + 0.5);
+      target = std::max<std::uint64_t> (target, 1U);
+
+      std::uint64_t seen = 0U;
+      for (auto iter = 0U; iter < counts.size (); ++iter)
+      {
+        seen += counts[iter];
+        if (seen >= target)
+        {
+          return std::min (highest_of (iter), max);
+        }
+      }
+
+      return max;
+    }
+
+    std::uint64_t maximum () const noexcept
+    {
+      return max;
+    }
+
+  private:
+    static constexpr unsigned sub_bucket_bits   = 11U;
+    static constexpr unsigned sub_bucket_count  = 1U << sub_bucket_bits;
+    static constexpr unsigned half_count        = sub_bucket_count / 2U;
+    static constexpr unsigned max_shift         = 64U - sub_bucket_bits;
+
+    static unsigned highest_bit (std::uint64_t value) noexcept
+    {
+      auto bit = 0U;
+      while (value >>= 1U)
+      {
+        ++bit;
+      }
+      return bit;
+    }
+
+    static std::size_t index_of (std::uint64_t value) noexcept
+    {
+      if (value < sub_bucket_count)
+      {
+        return static_cast<std::size_t> (value);
+      }
+
+      auto shift = highest_bit (value) - (sub_bucket_bits - 1U);
+      return sub_bucket_count + (shift - 1U) * half_count + static_cast<std::size_t> ((value >> shift) - half_count);
+    }
+
+    static std::uint64_t highest_of (std::size_t index) noexcept
+    {
+      if (index < sub_bucket_count)
+      {
+        return index;
+      }
+
+      auto shift  = static_cast<unsigned> ((index - sub_bucket_count) / half_count) + 1U;
+      auto sub    = static_cast<std::uint64_t> ((index - sub_bucket_count) % half_count) + half_count;
+      return ((sub + 1U) << shift) - 1U;
+    }
+
+    std::vector<std::uint64_t>  counts  ;
+    std::uint64_t               total   ;
+    std::uint64_t               max     ;
+  };
+
+  enum call_kind
+  {
+    ck__clock     ,
+    ck__printf    ,
+    ck__fprintf   ,
+    ck__snprintf  ,
+  };
+
+  char const * const call_names[] =
+  {
+    "clock"       ,
+    "TS_PRINTF"   ,
+    "TS_FPRINTF"  ,
+    "TS_SNPRINTF" ,
+  };
+
+  // Waits for go and then times every call, the clock is read once per call
+  template<typename TCall>
+  void hammer (histogram & h, std::atomic<unsigned> & ready, std::atomic<bool> const & go, unsigned calls, unsigned thread, TCall && call)
+  {
+    ++ready;
+    while (!go.load (std::memory_order_acquire))
+    {
+      std::this_thread::yield ();
+    }
+
+    auto before = clock_type::now ();
+    for (auto iter = 0U; iter < calls; ++iter)
+    {
+      call (thread, iter);
+      auto after = clock_type::now ();
+      h.record (static_cast<std::uint64_t> (std::chrono::duration_cast<std::chrono::nanoseconds> (after - before).count ()));
+      before = after;
+    }
+  }
+
+  struct run_result
+  {
+    histogram latency     ;
+    double    seconds     ;
+  };
+
+  template<typename TCall>
+  run_result run (unsigned threads, unsigned calls, TCall call)
+  {
+    std::vector<histogram>    histograms (threads);
+    std::vector<std::thread>  workers;
+    std::atomic<unsigned>     ready (0U);
+    std::atomic<bool>         go (false);
+
+    for (auto thread = 0U; thread < threads; ++thread)
+    {
+      workers.emplace_back ([&, thread] { hammer (histograms[thread], ready, go, calls, thread, call); });
+    }
+
+    while (ready.load () < threads)
+    {
+      std::this_thread::yield ();
+    }
+
+    auto start = clock_type::now ();
+    go.store (true, std::memory_order_release);
+    for (auto & worker : workers)
+    {
+      worker.join ();
+    }
+    auto stop = clock_type::now ();
+
+    run_result result;
+    for (auto & h : histograms)
+    {
+      result.latency.add (h);
+    }
+    result.seconds = std::chrono::duration<double> (stop - start).count ();
+    return result;
+  }
+
+  // Every kind renders the same typical log line
+  run_result run (call_kind kind, unsigned threads, unsigned calls, std::FILE * stream)
+  {
+    switch (kind)
+    {
+    case ck__clock:
+      return run (threads, calls, [] (unsigned, unsigned) {});
+    case ck__printf:
+      return run (threads, calls, [] (unsigned thread, unsigned iter)
+        {
+          TS_PRINTF ("worker-%02u request %u took %.3f ms status=%d path=%s\n", thread, iter, iter * 0.001, 200, "/api/v1/items");
+        });
+    case ck__fprintf:
+      return run (threads, calls, [stream] (unsigned thread, unsigned iter)
+        {
+          TS_FPRINTF (stream, "worker-%02u request %u took %.3f ms status=%d path=%s\n", thread, iter, iter * 0.001, 200, "/api/v1/items");
+        });
+    case ck__snprintf:
+    default:
+      return run (threads, calls, [] (unsigned thread, unsigned iter)
+        {
+          char buffer[128];
+          TS_SNPRINTF (buffer, sizeof (buffer), "worker-%02u request %u took %.3f ms status=%d path=%s\n", thread, iter, iter * 0.001, 200, "/api/v1/items");
+          // Keeps the call from being optimized away
+          char volatile first = buffer[0];
+          (void) first;
+        });
+    }
+  }
+
+  int usage ()
+  {
+    TS_FPRINTF (
+        stderr
+      , "Usage:\n"
+        "  contention [threads] [calls] [output]\n"
+      );
+    return 2;
+  }
+
+  bool parse_count (char const * text, unsigned & count)
+  {
+    char * end  = nullptr;
+    auto value  = std::strtoul (text, &end, 10);
+    if (*text == '\0' || *end != '\0' || value == 0U || value > 1000000000UL)
+    {
+      return false;
+    }
+    count = static_cast<unsigned> (value);
+    return true;
+  }
+
+  int measure (unsigned max_threads, unsigned calls, char const * output_path)
+  {
+    // The report goes to the original stdout, TS_PRINTF to output_path. Both
+    //  streams append so they don't overwrite each other in a file
+    auto report     = file_ptr (fdopen (dup (STDOUT_FILENO), "w"), &std::fclose);
+    auto truncated  = file_ptr (std::fopen (output_path, "w"), &std::fclose);
+    if (!report || !truncated || !std::freopen (output_path, "a", stdout))
+    {
+      TS_FPRINTF (stderr, "contention: failed to open %s\n", output_path);
+      return 1;
+    }
+
+    auto stream = file_ptr (std::fopen (output_path, "a"), &std::fclose);
+    if (!stream)
+    {
+      TS_FPRINTF (stderr, "contention: failed to open %s\n", output_path);
+      return 1;
+    }
+
+    std::vector<unsigned> thread_counts;
+    for (auto threads = 1U; threads < max_threads; threads *= 2U)
+    {
+      thread_counts.push_back (threads);
+    }
+    thread_counts.push_back (max_threads);
+
+    TS_FPRINTF (report.get (), "%u calls per thread, output to %s, latencies in ns\n\n", calls, output_path);
+    TS_FPRINTF (report.get (), "%-12s %7s %14s %9s %9s %9s %11s\n", "call", "threads", "calls/s", "p50", "p99", "p99.9", "max");
+
+    for (auto kind : { ck__clock, ck__printf, ck__fprintf, ck__snprintf })
+    {
+      for (auto threads : thread_counts)
+      {
+        auto result = run (kind, threads, calls, stream.get ());
+        std::fflush (stdout);
+        std::fflush (stream.get ());
+
+        auto & h = result.latency;
+        TS_FPRINTF (
+            report.get ()
+          , "%-12s %7u %14.0f %9llu %9llu %9llu %11llu\n"
+          , call_names[kind]
+          , threads
+          , static_cast<double> (threads) * calls / result.seconds
+          , static_cast<unsigned long long> (h.percentile (50.0))
+          , static_cast<unsigned long long> (h.percentile (99.0))
+          , static_cast<unsigned long long> (h.percentile (99.9))
+          , static_cast<unsigned long long> (h.maximum ())
+          );
+        std::fflush (report.get ());
+      }
+    }
+
+    return 0;
+  }
+}
+
+int main (int argc, char const * argv[])
+{
+  auto          max_threads = std::max (std::thread::hardware_concurrency (), 1U);
+  auto          calls       = 200000U;
+  char const *  output_path = "/dev/null";
+
+  if (argc > 4)
+  {
+    return usage ();
+  }
+
+  if (argc > 1 && !parse_count (argv[1], max_threads))
+  {
+    return usage ();
+  }
+
+  if (argc > 2 && !parse_count (argv[2], calls))
+  {
+    return usage ();
+  }
+
+  if (argc > 3)
+  {
+    output_path = argv[3];
+  }
+
+  return measure (max_threads, calls, output_path);
+}
@@ -1 +1 @@
-clang++ -g -O3 -Wall -ftemplate-depth=1024 --std=c++14 test_suite.cpp -o exe.tsprintf.clang++
+clang++ -g -O3 -Wall -ftemplate-depth=1024 --std=c++14 -pthread test_suite.cpp -o exe.tsprintf.clang++ -lrt
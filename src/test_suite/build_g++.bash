@@ -1 +1 @@
-g++ -g -O3 -Wall --std=c++14 test_suite.cpp -o exe.tsprintf.g++
+g++ -g -O3 -Wall --std=c++14 -pthread test_suite.cpp -o exe.tsprintf.g++ -lrt
@@ -17,19 +17,157 @@
 #include "stdafx.h"
 
 #include <algorithm>
+#include <atomic>
+#include <climits>
 #include <cstring>
+#include <ctime>
 #include <initializer_list>
 #include <iostream>
 #include <sstream>
+#include <thread>
 #include <tuple>
 #include <vector>
 
 #include "../tsprintf/tsprintf.hpp"
+#include "../tsprintf/tsprintf_arena.hpp"
+#include "../tsprintf/tsprintf_batch.hpp"
+#include "../tsprintf/tsprintf_binlog.hpp"
+#include "../tsprintf/tsprintf_bound.hpp"
+#include "../tsprintf/tsprintf_brace.hpp"
+#include "../tsprintf/tsprintf_constexpr.hpp"
+#include "../tsprintf/tsprintf_csv.hpp"
+#include "../tsprintf/tsprintf_dynamic.hpp"
+#include "../tsprintf/tsprintf_engine.hpp"
+#include "../tsprintf/tsprintf_format.hpp"
+#include "../tsprintf/tsprintf_metrics.hpp"
+#include "../tsprintf/tsprintf_recorder.hpp"
+#include "../tsprintf/tsprintf_rt.hpp"
+#include "../tsprintf/tsprintf_scan.hpp"
+#ifndef _WIN32
+# include "../tsprintf/tsprintf_shm.hpp"
+# include <csignal>
+# include <sys/wait.h>
+#endif
+#include "../tsprintf/tsprintf_structured.hpp"
+#include "../tsprintf/tsprintf_writev.hpp"
 
 
 #define TEST_CASE() TS_PRINTF("%s(%d) : TEST_CASE - %s\n", __FILE__, static_cast<int> (__LINE__), __FUNCTION__)
 #define TEST_EQ(expected, actual) test_eq (__FILE__, __LINE__, expected, #expected, actual, #actual)
 
+// Renders format with the engine and compares it with TS_SPRINTF
+#define TEST_RENDER(format, ...)                                                                          \
+  {                                                                                                       \
+    char expected[256] {};                                                                                \
+    char actual[256]   {};                                                                                \
+    TS_SPRINTF (expected, format, ##__VA_ARGS__);                                                         \
+    format_to<scanner::encode (format)> (actual, sizeof (actual), format, ##__VA_ARGS__);                  \
+    TEST_EQ (expected, actual);                                                                           \
+  }
+
+// Formats at compile time and compares it with TS_SPRINTF
+#define TEST_CONSTEXPR(format, ...)                                                                       \
+  {                                                                                                       \
+    constexpr auto actual = TS_CONSTEXPR_FORMAT (format, ##__VA_ARGS__);                                  \
+    char expected[256] {};                                                                                \
+    TS_SPRINTF (expected, format, ##__VA_ARGS__);                                                         \
+    TEST_EQ (expected, actual.c_str ());                                                                  \
+    TEST_EQ (std::strlen (expected), actual.size ());                                                     \
+  }
+
+// Scans input with TS_SSCANF and compares it with sscanf
+#define TEST_SCAN(type, input, format)                                                                    \
+  {                                                                                                       \
+    type expected {};                                                                                     \
+    type actual   {};                                                                                     \
+    auto expected_count = std::sscanf (input, format, &expected);                                         \
+    auto actual_count   = TS_SSCANF (input, format, &actual);                                             \
+    TEST_EQ (expected_count, actual_count);                                                               \
+    TEST_EQ (expected, actual);                                                                           \
+  }
+
+// Renders format with dynamic_snprintf and compares it with TS_SPRINTF
+#define TEST_DYNAMIC(format, ...)                                                                         \
+  {                                                                                                       \
+    char        expected[256] {};                                                                         \
+    char        actual[256]   {};                                                                         \
+    std::string dynamic       (format);                                                                   \
+    TS_SNPRINTF (expected, sizeof (expected), format, ##__VA_ARGS__);                                     \
+    auto result = typesafe_printf::dynamic_snprintf (actual, sizeof (actual), dynamic.c_str (), ##__VA_ARGS__); \
+    TEST_EQ (static_cast<int> (std::strlen (expected)), result);                                          \
+    TEST_EQ (expected, actual);                                                                           \
+  }
+
+// Renders format with TS_SPRINTF_RT and compares it with TS_SPRINTF, the
+//  realtime path must not allocate
+#define TEST_RT(format, ...)                                                                              \
+  {                                                                                                       \
+    char expected[512] {};                                                                                \
+    char actual[512]   {};                                                                                \
+    TS_SPRINTF (expected, format, ##__VA_ARGS__);                                                         \
+    auto before = allocations.load ();                                                                    \
+    count_allocations = true;                                                                             \
+    auto result = TS_SPRINTF_RT (actual, format, ##__VA_ARGS__);                                          \
+    count_allocations = false;                                                                            \
+    TEST_EQ (before, allocations.load ());                                                                \
+    TEST_EQ (static_cast<int> (std::strlen (expected)), result);                                          \
+    TEST_EQ (expected, actual);                                                                           \
+  }
+
+namespace tests
+{
+  // Set around the calls that must not allocate, malloc and friends are
+  //  interposed below where the C library allows it (glibc)
+  std::atomic<bool>           count_allocations {false};
+  std::atomic<std::uint32_t>  allocations       {0U};
+}
+
+#ifdef __GLIBC__
+extern "C"
+{
+  void * __libc_malloc  (std::size_t);
+  void * __libc_calloc  (std::size_t, std::size_t);
+  void * __libc_realloc (void *, std::size_t);
+  void   __libc_free    (void *);
+
+  void * malloc (std::size_t size) noexcept
+  {
+    if (tests::count_allocations.load (std::memory_order_relaxed))
+    {
+      ++tests::allocations;
+    }
+    return __libc_malloc (size);
+  }
+
+  void * calloc (std::size_t count, std::size_t size) noexcept
+  {
+    if (tests::count_allocations.load (std::memory_order_relaxed))
+    {
+      ++tests::allocations;
+    }
+    return __libc_calloc (count, size);
+  }
+
+  void * realloc (void * p, std::size_t size) noexcept
+  {
+    if (tests::count_allocations.load (std::memory_order_relaxed))
+    {
+      ++tests::allocations;
+    }
+    return __libc_realloc (p, size);
+  }
+
+  void free (void * p) noexcept
+  {
+    if (p && tests::count_allocations.load (std::memory_order_relaxed))
+    {
+      ++tests::allocations;
+    }
+    __libc_free (p);
+  }
+}
+#endif
+
 namespace tests
 {
   using namespace typesafe_printf::details;
@@ -310,6 +448,11 @@ namespace tests
           test_case_t {"%d"         , {tid__int                   }},
           test_case_t {"Hello %lld" , {tid__long_long             }},
           test_case_t {"%+0.0f,%d%%", {tid__double    , tid__int  }},
+          test_case_t {"%*d"        , {tid__int       , tid__int  }},
+          test_case_t {"%-*.*s|%ld" , {tid__int       , tid__int  , tid__char_p , tid__long }},
+          test_case_t {"%Hp|%d"     , {tid__void_p    , tid__size_t , tid__int  }},
+          test_case_t {"%p|%Hd"     , {tid__void_p    , tid__int  }},
+          test_case_t {"%T.3llu|%Tlld", {tid__unsigned_long_long , tid__long_long }},
         };
 
       for (auto && test_case : test_cases)
@@ -329,6 +472,16 @@ namespace tests
       }
     }
 
+    // The printf based macros reject the engine's extensions
+    {
+      TEST_EQ (false, scanner::has_engine_extension ("Hello %d %-*.3s %% %p"));
+      TEST_EQ (false, scanner::has_engine_extension ("100%% Tested, %% Hex"));
+      TEST_EQ (true , scanner::has_engine_extension ("%d %Js"));
+      TEST_EQ (true , scanner::has_engine_extension ("%-8Qs"));
+      TEST_EQ (true , scanner::has_engine_extension ("%Hp|%s"));
+      TEST_EQ (true , scanner::has_engine_extension ("at %T.3llu"));
+    }
+
     {
       std::vector<std::string> argument_type_table
         {
@@ -384,146 +537,2160 @@ namespace tests
     }
   }
 
-  template<typename T>
-  auto unconst (T const * p)
+  void test__engine ()
   {
-    return const_cast<T*> (p);
+    TEST_CASE ();
+
+    {
+      std::vector<std::string> formats
+        {
+          "Hello"               ,
+          "%%"                  ,
+          "%d"                  ,
+          "Hello %lld"          ,
+          "%+0.0f,%d%%"         ,
+          "%hhd %hd %ld %zu %tx",
+          "%-10s|%ls|%p|%Lg"    ,
+          "%*d|%.*s|%-*.*Lf"    ,
+          "%Hp|%Js|%Hd"         ,
+          "%T.3llu|%Tlld"       ,
+          "%n%jd"               ,
+          "%y"                  ,
+          "%5"                  ,
+          "trailing %"          ,
+        };
+
+      for (auto && format : formats)
+      {
+        char buffer[64] = {};
+
+        if (TEST_EQ (true, copy_to_buffer (buffer, format)))
+        {
+          auto expected = decode (scanner::encode (buffer));
+          auto actual   = decode (encode_runtime (buffer));
+
+          TEST_EQ (expected, actual);
+        }
+      }
+    }
+
+    TEST_RENDER ("Hello");
+    TEST_RENDER ("%%d%%");
+    TEST_RENDER ("%d|%5s|%-8.3f|%lld|%c", 42, "abc", 3.14159, -7LL, 65);
+    TEST_RENDER ("%hhu|%hd|%#lx|%zu|%td|%ju", static_cast<unsigned char> (200), static_cast<short> (-3), 255UL, std::size_t (7), std::ptrdiff_t (-9), std::uintmax_t (11));
+    TEST_RENDER ("%Lf|%e|%G", 1.5L, 2.5, 1e-10);
+    TEST_RENDER ("%ls|%lc", L"wide", static_cast<std::wint_t> (L'w'));
+    TEST_RENDER ("[%10ls|%-10ls|%3lc|%-3lc|%ls]", L"wide", L"wide", static_cast<std::wint_t> (L'w'), static_cast<std::wint_t> (L'w'), L"");
+    TEST_RENDER ("%p", static_cast<void const *> (nullptr));
+    TEST_RENDER ("%d|%i|%u|%lld|%llu|%hhd", INT_MIN, 0, UINT_MAX, LLONG_MIN, ULLONG_MAX, static_cast<signed char> (-128));
+    TEST_RENDER ("%s|%c", "plain", 0x41);
+    TEST_RENDER ("[%5d|%-5d|%3c|%-3c|%10u|%-10s|%3s]", -42, 42, 0x41, 0x42, 7U, "left", "toolong");
+    TEST_RENDER ("[%*d|%-*d|%*d|%0*d|%-*s]", 5, 42, 5, 42, -5, 42, 6, -7, 4, "ab");
+    TEST_RENDER ("[%.*s|%.*s|%*.*f|%.*d|%+*d]", 2, "abc", -1, "abc", 8, 2, 3.14159, -1, 0, 4, 3);
+    TEST_RENDER ("[%x|%X|%5x|%-5X|%hhx|%llx|%zx]", 0U, 0xABCDEFU, 0x1FU, 0x1FU, static_cast<unsigned char> (0xFE), ULLONG_MAX, std::size_t (0x1234));
+    TEST_RENDER ("[%p|%20p|%-20p|%p]", static_cast<void const *> (&errors), static_cast<void const *> (&errors), static_cast<void const *> (&errors), static_cast<void const *> (nullptr));
+
+    {
+      int   written = 0;
+      char  buffer[16] {};
+      std::array<arg, 2> args;
+      make_args<scanner::encode ("abc%n%d")> (args, &written, 1234567);
+
+      auto  expected_result = std::snprintf (nullptr, 0, "abc%d", 1234567);
+      auto  actual_result   = render (buffer, 6, "abc%n%d", args.data (), static_cast<size_type> (args.size ()));
+
+      TEST_EQ (expected_result, actual_result);
+      TEST_EQ (3            , written);
+      TEST_EQ ("abc12"      , buffer);
+    }
+
+    {
+      std::array<arg, 1> args;
+      make_args<scanner::encode ("%d")> (args, 1);
+      TEST_EQ (-1, render (nullptr, 0, "%d %d", args.data (), static_cast<size_type> (args.size ())));
+      TEST_EQ (-1, render (nullptr, 0, "%s"   , args.data (), static_cast<size_type> (args.size ())));
+      TEST_EQ (1 , render (nullptr, 0, "%d"   , args.data (), static_cast<size_type> (args.size ())));
+    }
   }
 
-  void test__printf_variants ()
+  std::vector<std::string> read_binlog (std::FILE * log)
+  {
+    using namespace typesafe_printf::binlog;
+
+    std::vector<std::string> result;
+
+    reader r (log);
+    TEST_EQ (true, r.is_valid ());
+
+    record rec;
+    while (r.next (rec))
+    {
+      char buffer[256] {};
+      r.render (rec, buffer, sizeof (buffer));
+      result.push_back (buffer);
+    }
+
+    TEST_EQ (true, r.is_valid ());
+
+    return result;
+  }
+
+  void test__dynamic ()
   {
     TEST_CASE ();
 
-    char buffer[1024] {};
+    char text[] = "text";
 
-    TS_PRINTF   (             "TS_PRINTF\n" );
+    // Twice to go through the cache
+    for (auto iter = 0; iter < 2; ++iter)
+    {
+      TEST_DYNAMIC ("Hello");
+      TEST_DYNAMIC ("%d %s %5.2f %c", 42, "abc", 3.14159, 65);
+      TEST_DYNAMIC ("%s|%p", text, static_cast<void const *> (text));
+      TEST_DYNAMIC ("%zu|%lld|%hhu|%ls", std::size_t (7), -7LL, static_cast<unsigned char> (200), L"wide");
+      TEST_DYNAMIC ("[%-*s|%*.*f]", 6, "cell", 8, 3, 2.5);
+    }
 
-    TS_SPRINTF  (buffer,      "TS_SPRINTF"  );
-    TEST_EQ     ("TS_SPRINTF" ,buffer);
+    {
+      char buffer[16] = "unchanged";
+
+      TEST_EQ (-1, typesafe_printf::dynamic_snprintf (buffer, sizeof (buffer), "%s", 1));
+      TEST_EQ ("", buffer);
+      TEST_EQ (-1, typesafe_printf::dynamic_snprintf (buffer, sizeof (buffer), "%d", 1L));
+      TEST_EQ (-1, typesafe_printf::dynamic_snprintf (buffer, sizeof (buffer), "%d", 1U));
+      TEST_EQ (-1, typesafe_printf::dynamic_snprintf (buffer, sizeof (buffer), "%d %d", 1));
+      TEST_EQ (-1, typesafe_printf::dynamic_snprintf (buffer, sizeof (buffer), "%d", 1, 2));
+      TEST_EQ (-1, typesafe_printf::dynamic_snprintf (buffer, sizeof (buffer), "%y", 1));
+      TEST_EQ (-1, typesafe_printf::dynamic_snprintf (buffer, sizeof (buffer), "100%"));
+      TEST_EQ (-1, typesafe_printf::dynamic_snprintf (buffer, sizeof (buffer), "%p", text));
+      TEST_EQ (-1, typesafe_printf::dynamic_snprintf (buffer, sizeof (buffer), "%*d", 1));
+      TEST_EQ (-1, typesafe_printf::dynamic_snprintf (buffer, sizeof (buffer), "%*d", 1U, 2));
+      // Validated for int but not for long
+      TEST_EQ (1 , typesafe_printf::dynamic_snprintf (buffer, sizeof (buffer), "%d", 1));
+      TEST_EQ (-1, typesafe_printf::dynamic_snprintf (buffer, sizeof (buffer), "%d", 1L));
+    }
 
-    TS_SNPRINTF (buffer, 20,  "TS_SNPRINTF" );
-    TEST_EQ     ("TS_SNPRINTF",buffer);
+    {
+      int         written = 0;
+      char        buffer[16] {};
 
-    TS_FPRINTF  (stdout,      "TS_FPRINTF\n");
+      TEST_EQ (5  , typesafe_printf::dynamic_snprintf (buffer, sizeof (buffer), "abc%n%d", &written, 12));
+      TEST_EQ (3  , written);
+      TEST_EQ ("abc12", buffer);
+    }
 
-    TS_SPRINTF  (buffer,      "TS_SPRINTF: %d\n%s\n",  3, "Hello");
-    TEST_EQ     ("TS_SPRINTF: 3\nHello\n" ,buffer);
+    {
+      std::string first   ("cached %d");
+      std::string second  ("cached %d");
 
-    TS_SPRINTF  (
-        buffer
-      , "This is a long format %s, the purpose is to make sure we don't hit any funny compiler limits.\n"
-        "This is a long format %s, the purpose is to make sure we don't hit any funny compiler limits.\n"
-        "This is a long format %s, the purpose is to make sure we don't hit any funny compiler limits.\n"
-        "This is a long format %s, the purpose is to make sure we don't hit any funny compiler limits.\n"
-        "This is a long format %s, the purpose is to make sure we don't hit any funny compiler limits.\n"
-      , "string"
-      , "string"
-      , "string"
-      , "string"
-      , "string"
-      );
+      std::unique_ptr<parsed_format> uncached;
+      auto parsed_first   = find_format (first.c_str (), uncached);
+      auto parsed_second  = find_format (second.c_str (), uncached);
 
-    using signed_size_t       = typesafe_printf::details::ssize_t   ;
-    using unsigned_ptrdiff_t  = typesafe_printf::details::uptrdiff_t;
+      TEST_EQ (true , parsed_first == parsed_second);
+      TEST_EQ (true , parsed_first == find_format (first.c_str (), uncached));
+      TEST_EQ (false, static_cast<bool> (uncached));
+    }
+  }
 
-    char const *            v_char_p                 = "02"                 ;
-    double                  v_double                 = 0x03                 ;
-    int                     v_int                    = 0x04                 ;
-    int                     nv_int_p                 = 0x05                 ;
-    int *                   v_int_p                  = &nv_int_p            ;
-    std::intmax_t           v_intmax_t               = 0x06                 ;
-    std::intmax_t           nv_intmax_t              = 0x07                 ;
-    std::intmax_t *         v_intmax_t_p             = &nv_intmax_t         ;
-    long                    v_long                   = 0x08                 ;
-    long double             v_long_double            = 0x09                 ;
-    long long               v_long_long              = 0x0A                 ;
-    long long               nv_long_long_p           = 0x0B                 ;
-    long long *             v_long_long_p            = &nv_long_long_p      ;
-    long                    nv_long_p                = 0x0C                 ;
-    long *                  v_long_p                 = &nv_long_p           ;
-    std::ptrdiff_t          v_ptrdiff_t              = 0x0D                 ;
-    std::ptrdiff_t          nv_ptrdiff_t_p           = 0x0E                 ;
-    std::ptrdiff_t *        v_ptrdiff_t_p            = &nv_ptrdiff_t_p      ;
-    short                   v_short                  = 0x0F                 ;
-    short                   nv_short_p               = 0x10                 ;
-    short *                 v_short_p                = &nv_short_p          ;
-    char signed             v_signed_char            = 0x11                 ;
-    char signed             nv_signed_char_p         = 0x12                 ;
-    char signed *           v_signed_char_p          = &nv_signed_char_p    ;
-    signed_size_t           v_signed_size_t          = 0x13                 ;
-    signed_size_t           nv_signed_size_t_p       = 0x14                 ;
-    signed_size_t *         v_signed_size_t_p        = &nv_signed_size_t_p  ;
-    std::size_t             v_size_t                 = 0x15                 ;
-    std::uintmax_t          v_uintmax_t              = 0x16                 ;
-    char unsigned           v_unsigned_char          = 0x17                 ;
-    int unsigned            v_unsigned_int           = 0x18                 ;
-    long unsigned           v_unsigned_long          = 0x19                 ;
-    long long unsigned      v_unsigned_long_long     = 0x1A                 ;
-    unsigned_ptrdiff_t      v_unsigned_ptrdiff_t     = 0x1B                 ;
-    short unsigned          v_unsigned_short         = 0x1C                 ;
-    void const *            v_void_p                 = (void const *)0x1D   ;
-    wchar_t const *         v_wchar_t_p              = L"1E"                ;
-    std::wint_t             v_wint_t                 = 0x1F                 ;
+  void test__bound ()
+  {
+    TEST_CASE ();
 
-    // These are positive test cases making sure valid code compiles.
-    //  As the actual runtime just forwards it to sprintf there's not
-    //  much value in checking the actual sprintf:ing.
+    {
+      auto request = TS_BIND ("[%s %d] %s=%5.1f %%\n", "req-1", 42);
 
-    // char formatters
-    TS_SPRINTF  (buffer,  "%%c: %c, %lc", v_int, v_wint_t);
-    // string formatters
-    TS_SPRINTF  (buffer,  "%%s: %s, %ls", v_char_p, v_wchar_t_p);
-    // integer formatters
-    TS_SPRINTF  (buffer,  "%%d: %hhd, %hd, %d, %ld, %lld, %jd, %zd, %td", v_signed_char, v_short, v_int, v_long, v_long_long, v_intmax_t, v_signed_size_t, v_ptrdiff_t);
-    TS_SPRINTF  (buffer,  "%%i: %hhi, %hi, %i, %li, %lli, %ji, %zi, %ti", v_signed_char, v_short, v_int, v_long, v_long_long, v_intmax_t, v_signed_size_t, v_ptrdiff_t);
-    TS_SPRINTF  (buffer,  "%%o: %hho, %ho, %o, %lo, %llo, %jo, %zo, %to", v_unsigned_char, v_unsigned_short, v_unsigned_int, v_unsigned_long, v_unsigned_long_long, v_uintmax_t, v_size_t, v_unsigned_ptrdiff_t);
-    TS_SPRINTF  (buffer,  "%%x: %hhx, %hx, %x, %lx, %llx, %jx, %zx, %tx", v_unsigned_char, v_unsigned_short, v_unsigned_int, v_unsigned_long, v_unsigned_long_long, v_uintmax_t, v_size_t, v_unsigned_ptrdiff_t);
-    TS_SPRINTF  (buffer,  "%%X: %hhX, %hX, %X, %lX, %llX, %jX, %zX, %tX", v_unsigned_char, v_unsigned_short, v_unsigned_int, v_unsigned_long, v_unsigned_long_long, v_uintmax_t, v_size_t, v_unsigned_ptrdiff_t);
-    TS_SPRINTF  (buffer,  "%%u: %hhu, %hu, %u, %lu, %llu, %ju, %zu, %tu", v_unsigned_char, v_unsigned_short, v_unsigned_int, v_unsigned_long, v_unsigned_long_long, v_uintmax_t, v_size_t, v_unsigned_ptrdiff_t);
-    // floating point formatters
-    TS_SPRINTF  (buffer,  "%%f: %f, %lf, %Lf", v_double, v_double, v_long_double);
-    TS_SPRINTF  (buffer,  "%%F: %F, %lF, %LF", v_double, v_double, v_long_double);
-    TS_SPRINTF  (buffer,  "%%e: %e, %le, %Le", v_double, v_double, v_long_double);
-    TS_SPRINTF  (buffer,  "%%E: %E, %lE, %LE", v_double, v_double, v_long_double);
-    TS_SPRINTF  (buffer,  "%%a: %a, %la, %La", v_double, v_double, v_long_double);
-    TS_SPRINTF  (buffer,  "%%A: %A, %lA, %LA", v_double, v_double, v_long_double);
-    TS_SPRINTF  (buffer,  "%%g: %g, %lg, %Lg", v_double, v_double, v_long_double);
-    TS_SPRINTF  (buffer,  "%%G: %G, %lG, %LG", v_double, v_double, v_long_double);
-    // %n formatters
-    TS_SPRINTF  (buffer,  "%%n: %hhn, %hn, %n, %ln, %lln, %jn, %zn, %tn", v_signed_char_p, v_short_p, v_int_p, v_long_p, v_long_long_p, v_intmax_t_p, v_signed_size_t_p, v_ptrdiff_t_p);
-    // pointer formatters
-    TS_SPRINTF  (buffer,  "%%p: %p", v_void_p);
+      TEST_EQ (std::string ("[req-1 42] "), request.prefix ());
+      TEST_EQ (std::string ("%s=%5.1f %%\n"), std::string (request.rest ()));
 
-    // non-const pointee check
-    TS_SPRINTF  (buffer,  "non-const: %s, %ls, %p", unconst (v_char_p), unconst (v_wchar_t_p), unconst (v_void_p));
-  /*
-  TODO: Figure out a good way to test negative test-cases like below:
+      char expected[64] {};
+      char actual[64]   {};
 
-  TS_PRINTF (
-      "Due to type mismatch compilation stops here... %d\n"
-    , "Because this is not an int"
-    );
+      TS_SPRINTF (expected, "[%s %d] %s=%5.1f %%\n", "req-1", 42, "load", 0.75);
+      auto result = request.snprintf (actual, sizeof (actual), "load", 0.75);
 
-  int v = 0;
-  int const * p = &v;
-  TS_PRINTF ("%n", p);  // p should be non-const *
-  */
+      TEST_EQ (static_cast<int> (std::strlen (expected)), result);
+      TEST_EQ (expected, actual);
+
+      // Truncates like snprintf
+      char small[8] {};
+      TEST_EQ (result, request.snprintf (small, sizeof (small), "load", 0.75));
+      TEST_EQ ("[req-1 ", small);
+    }
+
+    {
+      auto all  = TS_BIND ("%d-%d", 1, 2);
+      auto none = TS_BIND ("%d-%d");
+
+      char buffer[16] {};
+
+      TEST_EQ (std::string ("1-2"), all.prefix ());
+      TEST_EQ (3, all.snprintf (buffer, sizeof (buffer)));
+      TEST_EQ ("1-2", buffer);
+
+      TEST_EQ (std::string (), none.prefix ());
+      TEST_EQ (3, none.snprintf (buffer, sizeof (buffer), 3, 4));
+      TEST_EQ ("3-4", buffer);
+    }
+
+    {
+      // %n after the bound arguments includes the prefix
+      auto  bound   = TS_BIND ("abc%d%n%s", 12);
+      int   written = 0;
+      char  buffer[16] {};
+
+      TEST_EQ (6, bound.snprintf (buffer, sizeof (buffer), &written, "x"));
+      TEST_EQ (5, written);
+      TEST_EQ ("abc12x", buffer);
+    }
+
+    {
+      auto bound = TS_BIND ("%-*s|%*d", 6, "cell");
+
+      char buffer[32] {};
+      TEST_EQ (std::string ("cell  |"), bound.prefix ());
+      TEST_EQ (11, bound.snprintf (buffer, sizeof (buffer), 4, 12));
+      TEST_EQ ("cell  |  12", buffer);
+    }
+
+    {
+      // A long prefix
+      std::string long_text (1000, 'x');
+      auto bound = TS_BIND ("%s:%d", long_text.c_str ());
 
+      TEST_EQ (long_text + ":", bound.prefix ());
+    }
 
+    {
+      // Counts TS_BIND rejects at compile time
+      TEST_EQ (0U   , bind_splits ("%s:%d %% %n"));
+      TEST_EQ (0x2U , bind_splits ("%*d"));
+      TEST_EQ (0x6U , bind_splits ("%*.*f"));
+      TEST_EQ (0x8U , bind_splits ("%s %d %Hp"));
+      TEST_EQ (0x34U, bind_splits ("%d %-*s %*Hp"));
+      TEST_EQ (false, is_split (0x34U, 3U));
+      TEST_EQ (true , is_split (0x34U, 4U));
+      TEST_EQ (false, is_split (~0ULL, 64U));
+    }
   }
-}
 
-int main()
-{
-#ifdef _MSC_VER
-  // to enable %n support in Visual C++
-  _set_printf_count_output (1);
-#endif
+  void test__constexpr ()
+  {
+    TEST_CASE ();
 
-  tests::test__printf_variants  ();
-  tests::test__scanner_literals ();
-  tests::test__scanner_any_of   ();
-  tests::test__scanner          ();
+    TEST_CONSTEXPR ("Hello");
+    TEST_CONSTEXPR ("100%%");
+    TEST_CONSTEXPR ("%s v%d.%d.%d", "tsprintf", 1, 2, 3);
+    TEST_CONSTEXPR ("%d|%i|%u|%lld|%llu", INT_MIN, 0, UINT_MAX, LLONG_MIN, ULLONG_MAX);
+    TEST_CONSTEXPR ("[%5d|%-5d|%05d|%+d|% d|%.3d|%.0d|%+05d]", 42, 42, -42, 42, 42, 7, 0, -3);
+    TEST_CONSTEXPR ("[%x|%X|%#x|%#X|%#o|%o|%#.0o|%08x|%#010x]", 255U, 255U, 255U, 0U, 8U, 8U, 0U, 0xBEEFU, 0xBEEFU);
+    TEST_CONSTEXPR ("[%hhd|%hu|%zu|%jd|%td]", static_cast<signed char> (-5), static_cast<unsigned short> (65535), std::size_t (9), std::intmax_t (-10), std::ptrdiff_t (11));
+    TEST_CONSTEXPR ("[%c|%3c|%-3c]", 'a' + 0, 'b' + 0, 'c' + 0);
+    TEST_CONSTEXPR ("[%10s|%-10s|%.2s|%5.1s]", "right", "left", "cut", "xyz");
+    TEST_CONSTEXPR ("[%*d|%-*d|%*d]", 5, 1, 5, 2, -5, 3);
+    TEST_CONSTEXPR ("[%.*s|%.*s|%*.*d]", 2, "abc", -1, "abc", 6, 3, 4);
+
+    {
+      constexpr auto banner = TS_CONSTEXPR_FORMAT ("%s-%d", "id", 7);
+      static_assert (banner.size () == 4, "Formatted at compile time");
+      static_assert (banner.c_str ()[3] == '7', "Formatted at compile time");
+    }
+  }
+
+  // Straightforward escaping to compare the vectorized one with
+  std::string reference_escape (std::string const & s, bool json)
+  {
+    std::string result;
+    for (auto ch : s)
+    {
+      auto uch = static_cast<unsigned char> (ch);
+      char buffer[8] {};
+      switch (ch)
+      {
+      case '"'  : result += "\\\""; break;
+      case '\\' : result += "\\\\"; break;
+      case '\b' : result += "\\b" ; break;
+      case '\f' : result += "\\f" ; break;
+      case '\n' : result += "\\n" ; break;
+      case '\r' : result += "\\r" ; break;
+      case '\t' : result += "\\t" ; break;
+      case '\a' : result += json ? "\\u0007" : "\\a"; break;
+      case '\v' : result += json ? "\\u000b" : "\\v"; break;
+      default:
+        if (uch < 0x20U || (!json && uch == 0x7FU))
+        {
+          if (json)
+          {
+            TS_SPRINTF (buffer, "\\u%04x", static_cast<unsigned int> (uch));
+          }
+          else
+          {
+            TS_SPRINTF (buffer, "\\%03o", static_cast<unsigned int> (uch));
+          }
+          result += buffer;
+        }
+        else
+        {
+          result += ch;
+        }
+        break;
+      }
+    }
+    return result;
+  }
+
+  void test__escape ()
+  {
+    TEST_CASE ();
+
+    TEST_EQ (std::string ("{\"s\":\"a\\\"b\\\\c\\n\\u0001\"}"), TS_FORMAT ("{\"s\":\"%Js\"}", "a\"b\\c\n\x01"));
+    TEST_EQ (std::string ("\\a\\033\\177\xC3\xA9"), TS_FORMAT ("%Qs", "\a\x1B\x7F\xC3\xA9"));
+    TEST_EQ (std::string ("[]"), TS_FORMAT ("[%Js]", static_cast<char const *> (nullptr)));
+    TEST_EQ (std::string ("1 x 2"), TS_FORMAT ("%d %s %d", 1, "x", 2));
+
+    // Escapes at every position of strings crossing the 16 and 32 char blocks
+    for (auto length = 0U; length < 80U; ++length)
+    {
+      for (auto special : { '"', '\\', '\n', '\x1F', '\x7F', '\x80', ' ' })
+      {
+        for (auto at = 0U; at < length; at += 7U)
+        {
+          std::string text (length, 'a');
+          text[at] = special;
+
+          TEST_EQ (reference_escape (text, true ), TS_FORMAT ("%Js", text.c_str ()));
+          TEST_EQ (reference_escape (text, false), TS_FORMAT ("%Qs", text.c_str ()));
+        }
+      }
+    }
+
+    {
+      char buffer[8] {};
+      TEST_EQ (6      , TS_FORMAT_TO (buffer, sizeof (buffer), "\"%Js\"", "\n\t"));
+      TEST_EQ ("\"\\n\\t\"", buffer);
+      TEST_EQ (8      , TS_FORMAT_TO (buffer, 4, "<%Js>", "\"\"\""));
+      TEST_EQ ("<\\\"", buffer);
+    }
+
+    {
+      char buffer[32] {};
+      // The extensions take no width or precision, the macros reject them at
+      //  compile time, dynamic formats at run time
+      TEST_EQ (false  , has_invalid_extension ("%Js %Qs %Hp %Tllu %T.3lld %T.llu %-8s %%-8Js"));
+      TEST_EQ (true   , has_invalid_extension ("%-8Js"));
+      TEST_EQ (true   , has_invalid_extension ("%.2Qs"));
+      TEST_EQ (true   , has_invalid_extension ("%*Hp"));
+      TEST_EQ (true   , has_invalid_extension ("%Jd"));
+      TEST_EQ (true   , has_invalid_extension ("%5Tllu"));
+      TEST_EQ (true   , has_invalid_extension ("%-Tllu"));
+      TEST_EQ (true   , has_invalid_extension ("%T.10llu"));
+      TEST_EQ (true   , has_invalid_extension ("%Tlu"));
+      TEST_EQ (-1     , typesafe_printf::dynamic_snprintf (buffer, sizeof (buffer), "%-8Js", "x"));
+      TEST_EQ (6      , typesafe_printf::dynamic_snprintf (buffer, sizeof (buffer), "\"%Js\"", "a\nb"));
+      TEST_EQ ("\"a\\nb\"", buffer);
+      TEST_EQ (-1     , typesafe_printf::dynamic_snprintf (buffer, sizeof (buffer), "%Js", 1));
+    }
+  }
+
+  void test__hexdump ()
+  {
+    TEST_CASE ();
+
+    std::vector<unsigned char> bytes (200);
+    for (auto iter = 0U; iter < bytes.size (); ++iter)
+    {
+      bytes[iter] = static_cast<unsigned char> (iter * 37U + 11U);
+    }
+
+    // Sizes around the 16 and 32 byte blocks
+    for (auto size = 0U; size < bytes.size (); size += size < 70U ? 1U : 13U)
+    {
+      std::string expected;
+      for (auto iter = 0U; iter < size; ++iter)
+      {
+        char buffer[3] {};
+        TS_SPRINTF (buffer, "%02x", static_cast<unsigned int> (bytes[iter]));
+        expected += buffer;
+      }
+
+      TEST_EQ (expected, TS_FORMAT ("%Hp", static_cast<void const *> (bytes.data ()), std::size_t (size)));
+    }
+
+    {
+      unsigned char const data[] = { 0xDE, 0xAD, 0xBE, 0xEF };
+      char buffer[6] {};
+
+      // Truncated in the middle of a byte
+      TEST_EQ (10     , TS_FORMAT_TO (buffer, sizeof (buffer), "<%Hp>", static_cast<void const *> (data), sizeof (data)));
+      TEST_EQ ("<dead", buffer);
+      TEST_EQ (5      , TS_FORMAT_TO (buffer, 5, "%Hp|", static_cast<void const *> (data), std::size_t (2)));
+      TEST_EQ ("dead", buffer);
+      TEST_EQ (4      , TS_FORMAT_TO (buffer, 4, "%Hp", static_cast<void const *> (data), std::size_t (2)));
+      TEST_EQ ("dea", buffer);
+
+      TEST_EQ (std::string ("[]"), TS_FORMAT ("[%Hp]", static_cast<void const *> (nullptr), std::size_t (8)));
+      TEST_EQ (std::string ("beef 7"), TS_FORMAT ("%Hp %d", static_cast<void const *> (data + 2), std::size_t (2), 7));
+      TEST_EQ (-1     , typesafe_printf::dynamic_snprintf (buffer, sizeof (buffer), "%8Hp", static_cast<void const *> (data), std::size_t (2)));
+      TEST_EQ (4      , typesafe_printf::dynamic_snprintf (buffer, sizeof (buffer), "%Hp", static_cast<void const *> (data), std::size_t (2)));
+      TEST_EQ (-1     , typesafe_printf::dynamic_snprintf (buffer, sizeof (buffer), "%Hp", static_cast<void const *> (data)));
+    }
+  }
+
+  std::string reference_timestamp (long long ns, std::size_t digits)
+  {
+    auto second   = ns / 1000000000LL;
+    auto fraction = ns % 1000000000LL;
+    if (fraction < 0)
+    {
+      --second;
+      fraction += 1000000000LL;
+    }
+
+    auto t      = static_cast<std::time_t> (second);
+    auto local  = *std::localtime (&t);
+
+    char date[64] {};
+    std::strftime (date, sizeof (date), "%Y-%m-%dT%H:%M:%S", &local);
+
+    char zone[16] {};
+    std::strftime (zone, sizeof (zone), "%z", &local);
+
+    std::string result = date;
+
+    if (digits > 0U)
+    {
+      char sub_second[16] {};
+      TS_SPRINTF (sub_second, ".%09lld", fraction);
+      result.append (sub_second, digits + 1U);
+    }
+
+    result.append (zone, 3);
+    result += ':';
+    result.append (zone + 3, 2);
+
+    return result;
+  }
+
+  void test__timestamp ()
+  {
+    TEST_CASE ();
+
+    // Same second twice, then other seconds to refresh the cached prefix
+    unsigned long long const timestamps[] =
+    {
+      1434895387123456789ULL  ,
+      1434895387987654321ULL  ,
+      1434895388000000001ULL  ,
+      1434895387000000000ULL  ,
+      1735689599999999999ULL  ,
+      0ULL                    ,
+    };
+
+    for (auto ns : timestamps)
+    {
+      auto signed_ns = static_cast<long long> (ns);
+      TEST_EQ (reference_timestamp (signed_ns, 9U), TS_FORMAT ("%Tllu", ns));
+      TEST_EQ (reference_timestamp (signed_ns, 3U), TS_FORMAT ("%T.3llu", ns));
+      TEST_EQ (reference_timestamp (signed_ns, 0U), TS_FORMAT ("%T.llu", ns));
+      TEST_EQ (reference_timestamp (signed_ns, 6U), TS_FORMAT ("%T.6lld", signed_ns));
+      TEST_EQ ("[" + reference_timestamp (signed_ns, 1U) + "] 7", TS_FORMAT ("[%T.1llu] %d", ns, 7));
+    }
+
+    TEST_EQ (reference_timestamp (-1500000000LL, 9U), TS_FORMAT ("%Tlld", -1500000000LL));
+
+    {
+      ::timespec ts {};
+      ts.tv_sec   = 1434895387;
+      ts.tv_nsec  = 5;
+      TEST_EQ (1434895387000000005ULL, typesafe_printf::timestamp_ns (ts));
+    }
+
+    {
+      char buffer[64] {};
+
+      TEST_EQ (-1, typesafe_printf::dynamic_snprintf (buffer, sizeof (buffer), "%5Tllu"  , 1ULL));
+      TEST_EQ (-1, typesafe_printf::dynamic_snprintf (buffer, sizeof (buffer), "%T.10llu", 1ULL));
+      TEST_EQ (-1, typesafe_printf::dynamic_snprintf (buffer, sizeof (buffer), "%Td"     , 1));
+
+      auto expected = reference_timestamp (1434895387123456789LL, 2U);
+      TEST_EQ (static_cast<int> (expected.size ()), TS_FORMAT_TO (buffer, 11, "%T.2llu", 1434895387123456789ULL));
+      TEST_EQ (expected.substr (0, 10), buffer);
+      TEST_EQ (static_cast<int> (expected.size ()), typesafe_printf::dynamic_snprintf (buffer, sizeof (buffer), "%T.2llu", 1434895387123456789ULL));
+      TEST_EQ (expected, buffer);
+    }
+  }
+
+  std::string reference_utf8 (std::wstring const & s)
+  {
+    std::string result;
+
+    for (auto ch : s)
+    {
+      auto code_point = static_cast<std::uint32_t> (ch);
+      if (code_point < 0x80U)
+      {
+        result += static_cast<char> (code_point);
+      }
+      else if (code_point < 0x800U)
+      {
+        result += static_cast<char> (0xC0U | (code_point >> 6));
+        result += static_cast<char> (0x80U | (code_point & 0x3FU));
+      }
+      else if (code_point < 0x10000U)
+      {
+        result += static_cast<char> (0xE0U | (code_point >> 12));
+        result += static_cast<char> (0x80U | ((code_point >> 6) & 0x3FU));
+        result += static_cast<char> (0x80U | (code_point & 0x3FU));
+      }
+      else
+      {
+        result += static_cast<char> (0xF0U | (code_point >> 18));
+        result += static_cast<char> (0x80U | ((code_point >> 12) & 0x3FU));
+        result += static_cast<char> (0x80U | ((code_point >> 6) & 0x3FU));
+        result += static_cast<char> (0x80U | (code_point & 0x3FU));
+      }
+    }
+
+    return result;
+  }
+
+  void test__utf8 ()
+  {
+    TEST_CASE ();
+
+    TEST_EQ (std::string ("h\xC3\xA9\xE2\x82\xAC"), TS_FORMAT ("%ls", L"h\u00E9\u20AC"));
+    TEST_EQ (std::string ("[  \xC3\xA9]"), TS_FORMAT ("[%4lc]", static_cast<std::wint_t> (0xE9)));
+    TEST_EQ (std::string ("\xC3\xA9 "), TS_FORMAT ("%-3ls", L"\u00E9"));
+
+#if WCHAR_MAX > 0xFFFF
+    TEST_EQ (std::string ("\xF0\x9F\x98\x80"), TS_FORMAT ("%ls", L"\U0001F600"));
+
+    // Runs of ASCII of all lengths around the 8 char blocks
+    for (auto run = 0U; run < 40U; ++run)
+    {
+      std::wstring wide;
+      for (auto iter = 0U; iter < 300U; ++iter)
+      {
+        wide += iter % (run + 1U) == run
+          ? static_cast<wchar_t> (iter % 3U == 0U ? 0xE9 : (iter % 3U == 1U ? 0x20AC : 0x1F600))
+          : static_cast<wchar_t> ('a' + iter % 26U)
+          ;
+      }
+
+      auto expected = reference_utf8 (wide);
+      TEST_EQ (expected, TS_FORMAT ("%ls", wide.c_str ()));
+
+      // Truncated in the middle of the text
+      char buffer[101] {};
+      TEST_EQ (static_cast<int> (expected.size ()), TS_FORMAT_TO (buffer, sizeof (buffer), "%ls", wide.c_str ()));
+      TEST_EQ (expected.substr (0, 100), buffer);
+    }
+#endif
+  }
+
+  void test__scan ()
+  {
+    TEST_CASE ();
+
+    {
+      using namespace input_scanner;
+
+      TEST_EQ (0U, encode ("x=%*d %%"));
+      TEST_EQ (merge_type (merge_type (0U, 0, itid__int_p), 1, itid__char_p), encode ("%d %15s"));
+      TEST_EQ (merge_type (merge_type (0U, 0, itid__double_p), 1, itid__signed_char_p), encode ("%*f%lf%hhn"));
+      TEST_EQ (merge_type (0U, 0, itid__error_type), encode ("%s"));
+      TEST_EQ (merge_type (0U, 0, itid__error_type), encode ("%[a-z]"));
+    }
+
+    TEST_SCAN (int                , "42"                  , "%d"    );
+    TEST_SCAN (int                , "  -2147483648"       , "%d"    );
+    TEST_SCAN (int                , "+17abc"              , "%d"    );
+    TEST_SCAN (int                , "abc"                 , "%d"    );
+    TEST_SCAN (int                , ""                    , "%d"    );
+    TEST_SCAN (int                , "   "                 , "%d"    );
+    TEST_SCAN (int                , "0x1F"                , "%i"    );
+    TEST_SCAN (int                , "-017"                , "%i"    );
+    TEST_SCAN (int                , "0x"                  , "%i"    );
+    TEST_SCAN (int                , "12345"               , "%3d"   );
+    TEST_SCAN (unsigned int       , "4294967295"          , "%u"    );
+    TEST_SCAN (unsigned int       , "ff"                  , "%x"    );
+    TEST_SCAN (unsigned int       , "0XfF"                , "%X"    );
+    TEST_SCAN (unsigned int       , "0777"                , "%o"    );
+    TEST_SCAN (short              , "-32768"              , "%hd"   );
+    TEST_SCAN (signed char        , "-128"                , "%hhd"  );
+    TEST_SCAN (unsigned long long , "18446744073709551615", "%llu"  );
+    TEST_SCAN (long long          , "-9223372036854775808", "%lld"  );
+    TEST_SCAN (std::size_t        , "123456789"           , "%zu"   );
+    TEST_SCAN (std::intmax_t      , "-5"                  , "%jd"   );
+    TEST_SCAN (double             , "3.25"                , "%lf"   );
+    TEST_SCAN (double             , "-0.0"                , "%lf"   );
+    TEST_SCAN (double             , "1e"                  , "%lf"   );
+    TEST_SCAN (double             , "1.5e+"               , "%lf"   );
+    TEST_SCAN (double             , ".5"                  , "%lf"   );
+    TEST_SCAN (double             , "."                   , "%lf"   );
+    TEST_SCAN (double             , "12345.678"           , "%5lf"  );
+    TEST_SCAN (double             , "0x1.8p3"             , "%lf"   );
+    TEST_SCAN (double             , "inf"                 , "%lf"   );
+    TEST_SCAN (double             , "1e400"               , "%lf"   );
+    TEST_SCAN (double             , "123456789012345678901234567890", "%lf");
+    TEST_SCAN (float              , "0.1"                 , "%f"    );
+    TEST_SCAN (float              , "3.4028235e38"        , "%f"    );
+    TEST_SCAN (long double        , "0.1"                 , "%Lf"   );
+
+    // Doubles that round trip through %.17g must come back bit identical
+    {
+      auto value = 1.0;
+      for (auto iter = 0; iter < 2000; ++iter)
+      {
+        value = value * 1.37 + (iter % 7) * 0.001;
+        if (value > 1e30)
+        {
+          value = 1.0 / value;
+        }
+
+        char        text[64]  {};
+        char const  * formats[] = { "%.17g", "%.6f", "%.3e", "%.15g" };
+        for (auto format : formats)
+        {
+          std::snprintf (text, sizeof (text), format, iter % 2 == 0 ? value : -value);
+
+          auto    expected  = std::strtod (text, nullptr);
+          double  actual    = 0;
+          TEST_EQ (1, TS_SSCANF (text, "%lf", &actual));
+          TEST_EQ (expected, actual);
+
+          auto    expected_float  = std::strtof (text, nullptr);
+          float   actual_float    = 0;
+          TEST_EQ (1, TS_SSCANF (text, "%f", &actual_float));
+          TEST_EQ (expected_float, actual_float);
+        }
+      }
+    }
+
+    {
+      int     id        = 0;
+      char    name[8]   {};
+      double  score     = 0;
+      int     consumed  = 0;
+
+      TEST_EQ (3    , TS_SSCANF ("id=17 name=alice score=2.5 rest", "id=%d name=%7s score=%lf%n", &id, name, &score, &consumed));
+      TEST_EQ (17   , id);
+      TEST_EQ ("alice", name);
+      TEST_EQ (2.5  , score);
+      TEST_EQ (26   , consumed);
+
+      TEST_EQ (1    , TS_SSCANF ("abcdefghij", "%7s", name));
+      TEST_EQ ("abcdefg", name);
+
+      TEST_EQ (1    , TS_SSCANF ("1 2", "%*d %d", &id));
+      TEST_EQ (2    , id);
+
+      TEST_EQ (0    , TS_SSCANF ("b=1", "a=%d", &id));
+      TEST_EQ (-1   , TS_SSCANF ("a=", "a=%d", &id));
+      TEST_EQ (1    , TS_SSCANF ("100%", "%d%%", &id));
+      TEST_EQ (0    , TS_SSCANF ("200", "%hhd", reinterpret_cast<signed char *> (name)));
+      TEST_EQ (0    , TS_SSCANF ("-1", "%u", reinterpret_cast<unsigned int *> (&id)));
+      TEST_EQ (0    , TS_SSCANF ("99999999999999999999", "%llu", reinterpret_cast<unsigned long long *> (&score)));
+
+      char chars[4] {};
+      TEST_EQ (2    , TS_SSCANF (" xyz", "%c%2c", chars, chars + 1));
+      TEST_EQ (" xy", chars);
+
+      void * pointer = nullptr;
+      char text[32] {};
+      TS_SPRINTF (text, "%p", static_cast<void const *> (&id));
+      TEST_EQ (1    , TS_SSCANF (text, "%p", &pointer));
+      TEST_EQ (static_cast<void *> (&id), pointer);
+
+      std::string line = "7 8";
+      int second = 0;
+      TEST_EQ (2    , TS_SSCANF (line, "%d %d", &id, &second));
+      TEST_EQ (8    , second);
+    }
+
+    {
+      auto file = std::tmpfile ();
+      if (!TEST_EQ (true, file != nullptr))
+      {
+        return;
+      }
+
+      std::fputs ("1 one\n2 two\nthree\n", file);
+      std::rewind (file);
+
+      int   id        = 0;
+      char  name[8]   {};
+
+      TEST_EQ (2    , TS_FSCANF (file, "%d %7s", &id, name));
+      TEST_EQ (1    , id);
+      TEST_EQ (2    , TS_FSCANF (file, "%d %7s", &id, name));
+      TEST_EQ ("two", name);
+      TEST_EQ (0    , TS_FSCANF (file, "%d %7s", &id, name));
+      TEST_EQ (-1   , TS_FSCANF (file, "%d %7s", &id, name));
+
+      std::fclose (file);
+    }
+  }
+
+  std::string read_all (std::FILE * file)
+  {
+    std::string result;
+
+    std::rewind (file);
+
+    char buffer[1024];
+    std::size_t read = 0;
+    while ((read = std::fread (buffer, 1, sizeof (buffer), file)) > 0)
+    {
+      result.append (buffer, read);
+    }
+
+    return result;
+  }
+
+  void test__batch ()
+  {
+    TEST_CASE ();
+
+    {
+      auto file = std::tmpfile ();
+      if (!TEST_EQ (true, file != nullptr))
+      {
+        return;
+      }
+
+      std::string long_name (1000, 'x');
+
+      TS_FPRINTF_BATCH (file)
+      {
+        TEST_EQ (11  , TS_BATCH_PRINTF ("Report %d/%d\n", 1, 2));
+        TEST_EQ (1007, TS_BATCH_PRINTF ("  %s %03u\n", long_name.c_str (), 7U));
+        TEST_EQ (9   , TS_BATCH_PRINTF ("  \"%Js\"\n", "a\"b"));
+        TEST_EQ (4   , typesafe_printf__batch.write ("end\n", 4));
+      }
+
+      TS_FPRINTF (file, "%s\n", "after");
+
+      TEST_EQ ("Report 1/2\n  " + long_name + " 007\n  \"a\\\"b\"\nend\nafter\n", read_all (file));
+
+      std::fclose (file);
+    }
+
+    // Batches from other threads don't interleave
+    {
+      auto file = std::tmpfile ();
+      if (!TEST_EQ (true, file != nullptr))
+      {
+        return;
+      }
+
+      auto writer = [file] (char tag)
+      {
+        for (auto batch = 0; batch < 200; ++batch)
+        {
+          TS_FPRINTF_BATCH (file)
+          {
+            for (auto line = 0; line < 5; ++line)
+            {
+              TS_BATCH_PRINTF ("%c%d\n", static_cast<int> (tag), line);
+            }
+          }
+        }
+      };
+
+      std::thread first  (writer, 'a');
+      std::thread second (writer, 'b');
+      first.join ();
+      second.join ();
+
+      auto text = read_all (file);
+      TEST_EQ (2U * 200U * 5U * 3U, text.size ());
+
+      auto interleaved = 0;
+      for (auto iter = 0U; iter + 15U <= text.size (); iter += 15U)
+      {
+        for (auto line = 0U; line < 5U; ++line)
+        {
+          interleaved += text[iter + line * 3U] != text[iter] || text[iter + line * 3U + 1U] != static_cast<char> ('0' + line) ? 1 : 0;
+        }
+      }
+      TEST_EQ (0, interleaved);
+
+      std::fclose (file);
+    }
+  }
+
+  void test__writev ()
+  {
+    TEST_CASE ();
+
+    auto file = std::tmpfile ();
+    if (!TEST_EQ (true, file != nullptr))
+    {
+      return;
+    }
+
+#ifdef _MSC_VER
+    auto fd = _fileno (file);
+#else
+    auto fd = fileno (file);
+#endif
+
+    std::string expected;
+
+    // Few arguments in a long format
+    TEST_EQ (41, TS_WRITEV (fd, "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n\r\n", static_cast<std::size_t> (1234)));
+    expected += "HTTP/1.1 200 OK\r\nContent-Length: 1234\r\n\r\n";
+
+    TEST_EQ (15, TS_WRITEV (fd, "%5d|%-4s|100%%", 42, "ab"));
+    expected += "   42|ab  |100%";
+
+    TEST_EQ (0, TS_WRITEV (fd, ""));
+
+    // %n counts the chars of the whole call
+    {
+      auto written = 0;
+      TEST_EQ (8, TS_WRITEV (fd, "abc%n%.*f", &written, 3, 1.5));
+      TEST_EQ (3, written);
+      expected += "abc1.500";
+    }
+
+    // More conversions than fit in the scratch area and more segments than
+    //  iovecs, as well as a single conversion larger than the scratch area
+    {
+      std::string long_text (2000, 'y');
+      auto result = TS_WRITEV (fd, "%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%%-%s|%s|%s", long_text.c_str (), "mid", long_text.c_str ());
+      TEST_EQ (40 * 2 + 2000 + 1 + 3 + 1 + 2000, result);
+      for (auto iter = 0; iter < 40; ++iter)
+      {
+        expected += "%-";
+      }
+      expected += long_text + "|mid|" + long_text;
+
+      char buffer[16];
+      for (auto iter = 0; iter < 100; ++iter)
+      {
+        TEST_EQ (6, TS_WRITEV (fd, "<%03d%%>", iter));
+        TS_SPRINTF (buffer, "<%03d%%>", iter);
+        expected += buffer;
+      }
+    }
+
+    TEST_EQ (expected, read_all (file));
+
+    std::fclose (file);
+
+    // Writes to a closed descriptor fail
+    TEST_EQ (-1, TS_WRITEV (-1, "%d", 1));
+  }
+
+  void test__csv ()
+  {
+    TEST_CASE ();
+
+    using namespace typesafe_printf;
+
+    // The scan finds the first special char on either side of the SIMD
+    //  block boundaries
+    {
+      for (auto size = 0U; size < 70U; ++size)
+      {
+        for (auto at = 0U; at <= size; ++at)
+        {
+          std::string text (size, 'x');
+          if (at < size)
+          {
+            text[at] = at % 2U == 0U ? '"' : '\r';
+          }
+          auto begin  = text.data ();
+          auto end    = begin + text.size ();
+          TEST_EQ (at, static_cast<unsigned> (details::find_csv_special (begin, end, csv::cd__csv) - begin));
+        }
+      }
+    }
+
+    // %f columns skip snprintf unless the value is close to a tie
+    {
+      char          buffer[64];
+      char          digits[32];
+      std::uint64_t state = 0x9E3779B97F4A7C15ULL;
+      auto          fast  = 0;
+      for (auto iter = 0; iter < 20000; ++iter)
+      {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+
+        double value;
+        switch (iter % 4)
+        {
+        case 0  : value = static_cast<double> (state % 2000001U) / 1000.0 - 1000.0; break;
+        case 1  : value = static_cast<double> (state % 1000U) / 8.0 - 60.0        ; break;
+        case 2  : value = static_cast<double> (state >> 11) / 9007199254740992.0   ; break;
+        default : value = static_cast<double> (state >> 24) * 0.37 - 1e10         ; break;
+        }
+        auto precision = static_cast<int> ((state >> 5) % 10U);
+
+        auto end    = digits + sizeof (digits);
+        auto first  = details::format_fixed (end, value, precision);
+        if (first)
+        {
+          ++fast;
+          TS_SPRINTF (buffer, "%.*f", precision, value);
+          TEST_EQ (std::string (buffer), std::string (first, end));
+        }
+      }
+      TEST_EQ (true, fast > 15000);
+
+      auto end = digits + sizeof (digits);
+      TEST_EQ (true, details::format_fixed (end, 0.125, 2) == nullptr);
+      TEST_EQ (true, details::format_fixed (end, 1e13, 0) == nullptr);
+      TEST_EQ (true, details::format_fixed (end, std::numeric_limits<double>::quiet_NaN (), 3) == nullptr);
+      TEST_EQ ("-0.000", std::string (details::format_fixed (end, -0.0001, 3), end));
+      TEST_EQ ("3", std::string (details::format_fixed (end, 2.75, 0), end));
+    }
+
+    std::string expected;
+
+    auto file = std::tmpfile ();
+    if (!TEST_EQ (true, file != nullptr))
+    {
+      return;
+    }
+
+#ifdef _MSC_VER
+    auto fd = _fileno (file);
+#else
+    auto fd = fileno (file);
+#endif
+
+    {
+      auto w = TS_CSV_WRITER (fd, csv::cd__csv, "%s,%d,%.3f,%c,%*u,%f,%.f,%+.2f");
+      TEST_EQ (true, w.header ({ "name", "count, total", "ratio", "c", "width", "f", "f0", "signed" }));
+      expected += "name,\"count, total\",ratio,c,width,f,f0,signed\n";
+
+      TEST_EQ (true, w.row ("plain", -42, 0.5, static_cast<int> ('x'), 4, 7U, 0.1, 2.5, 0.125));
+      expected += "plain,-42,0.500,x,   7,0.100000,2,+0.12\n";
+
+      TEST_EQ (true, w.row ("say \"hi\"", 1, 1.0 / 3, static_cast<int> (','), 1, 12U, -1e300, -0.4, 7.0));
+      {
+        // Too large for format_fixed
+        char huge[512];
+        TS_SPRINTF (huge, "%f", -1e300);
+        expected += "\"say \"\"hi\"\"\",1,0.333,\",\",12,";
+        expected += huge;
+        expected += ",-0,+7.00\n";
+      }
+
+      TEST_EQ (true, w.row ("two\nlines", 0, -2.0, static_cast<int> ('"'), 0, 0U, 1e-7, 0.5, -2.675));
+      expected += "\"two\nlines\",0,-2.000,\"\"\"\",0,0.000000,0,-2.67\n";
+
+      TEST_EQ (true, w.row ("", 1000000, 1e6, static_cast<int> ('a'), 0, 1U, 123456.0, 99.5, 1e20));
+      expected += ",1000000,1000000.000,a,1,123456.000000,100,+100000000000000000000.00\n";
+
+      TEST_EQ (5U, w.rows ());
+
+      // Nothing is written before the block is full
+      TEST_EQ (std::string (), read_all (file));
+
+      // Moving keeps the pending rows
+      auto moved (std::move (w));
+      TEST_EQ (5U, moved.rows ());
+      TEST_EQ (true, moved.flush ());
+      TEST_EQ (expected, read_all (file));
+    }
+
+    {
+      auto w = TS_CSV_WRITER (fd, csv::cd__tsv, "%s\t%ld\t%s");
+      w.header ({ "key", "value", "note" });
+      expected += "key\tvalue\tnote\n";
+
+      w.row ("a\tb", 123456789L, "back\\slash");
+      expected += "a\\tb\t123456789\tback\\\\slash\n";
+
+      w.row ("c,d \"e\"", -1L, "cr\r\nlf");
+      expected += "c,d \"e\"\t-1\tcr\\r\\nlf\n";
+    }
+    // The destructor flushes
+    TEST_EQ (expected, read_all (file));
+
+    std::fclose (file);
+
+    // A small block is written out in whole rows, a row larger than the block
+    //  grows it
+    {
+      file = std::tmpfile ();
+      if (!TEST_EQ (true, file != nullptr))
+      {
+        return;
+      }
+#ifdef _MSC_VER
+      fd = _fileno (file);
+#else
+      fd = fileno (file);
+#endif
+
+      expected.clear ();
+
+      std::string long_text (300, 'z');
+      long_text[150] = ',';
+
+      {
+        csv::writer<details::scanner::encode ("%d,%s")> w (fd, csv::cd__csv, "%d,%s", 1U);
+        for (auto iter = 0; iter < 200; ++iter)
+        {
+          auto text = iter == 100 ? long_text : std::string (iter % 7, 'q');
+          TEST_EQ (true, w.row (iter, text.c_str ()));
+          expected += std::to_string (iter) + ",";
+          expected += iter == 100 ? "\"" + text + "\"" : text;
+          expected += "\n";
+
+          // Only whole rows have been written
+          auto written = read_all (file);
+          TEST_EQ (true, written.empty () || written.back () == '\n');
+          TEST_EQ (true, written.size () < expected.size ());
+        }
+        TEST_EQ (200U, w.rows ());
+      }
+      TEST_EQ (expected, read_all (file));
+
+      std::fclose (file);
+    }
+
+    // A failed write is reported
+    {
+      auto w = TS_CSV_WRITER (-1, csv::cd__csv, "%d");
+      TEST_EQ (true, w.row (1));
+      TEST_EQ (false, w.flush ());
+      TEST_EQ (false, w.row (2));
+    }
+  }
+
+  void test__brace ()
+  {
+    TEST_CASE ();
+
+    {
+      // The defaults follow the argument types
+      std::string name  = "query";
+      char        ch    = 'c';
+      TEST_EQ ("query 42 7 3000000000 1099511627776 c true 0.1 2.5", TS_BRACE_FORMAT (
+          "{} {} {} {} {} {} {} {} {}"
+        , name
+        , 42
+        , static_cast<short> (7)
+        , 3000000000U
+        , 1LL << 40
+        , ch
+        , true
+        , 0.1f
+        , 2.5
+        ));
+      TEST_EQ ("-128 255 -1 18446744073709551615", TS_BRACE_FORMAT ("{} {} {} {}", static_cast<signed char> (-128), static_cast<unsigned char> (255), -1L, ~0ULL));
+      TEST_EQ ("no arguments {} 100%", TS_BRACE_FORMAT ("no arguments {{}} 100%"));
+    }
+
+    {
+      // Specs, checked against the printf equivalent
+      char expected[128];
+      TS_SPRINTF (expected, "%-10s|%8d|%+d|%-5s|%5d|%05d|% d", "left", 42, -7, "ab", 12, -12, 3);
+      TEST_EQ (expected, TS_BRACE_FORMAT ("{:<10}|{:>8}|{:+d}|{:5}|{:5}|{:05}|{: }", "left", 42, -7, "ab", 12, -12, 3));
+
+      TS_SPRINTF (expected, "%x|%#X|%o|%lx|%hhx|%-4c|%.2s", ~0U, 255U, 8U, 1UL << 40, static_cast<unsigned char> (0xAB), static_cast<int> ('z'), "abc");
+      TEST_EQ (expected, TS_BRACE_FORMAT ("{:x}|{:#X}|{:o}|{:x}|{:x}|{:4}|{:.2}", -1, 255U, 8, 1L << 40, static_cast<unsigned char> (0xAB), 'z', "abc"));
+
+      TS_SPRINTF (expected, "%.3f|%e|%10.2E|%g|%a|%G", 3.14159, 12345.678, -0.5, 1e-10, 1.0, 1e20);
+      TEST_EQ (expected, TS_BRACE_FORMAT ("{:.3f}|{:e}|{:10.2E}|{}|{:a}|{:G}", 3.14159, 12345.678, -0.5, 1e-10, 1.0, 1e20));
+
+      int value = 0;
+      TS_SPRINTF (expected, "%p|%d|%c", static_cast<void const *> (&value), static_cast<int> ('A'), 66);
+      TEST_EQ (expected, TS_BRACE_FORMAT ("{}|{:d}|{:c}", &value, 'A', 66));
+    }
+
+    {
+      char const *    null_s  = nullptr;
+      wchar_t const * wide    = L"wå";
+      TEST_EQ ("(null)|w\xc3\xa5|(nil)", TS_BRACE_FORMAT ("{}|{}|{}", null_s, wide, nullptr));
+    }
+
+    {
+      char buffer[8];
+      TEST_EQ (13, TS_BRACE_FORMAT_TO (buffer, sizeof (buffer), "{}-{}", "abcdef", 123456));
+      TEST_EQ (std::string ("abcdef-"), buffer);
+      TEST_EQ (2, TS_BRACE_FORMAT_TO (buffer, sizeof (buffer), "{}", 42));
+      TEST_EQ (std::string ("42"), buffer);
+
+      std::string long_text (1000, 'x');
+      TEST_EQ (long_text + "!", TS_BRACE_FORMAT ("{}!", long_text));
+    }
+
+    {
+      auto file = std::tmpfile ();
+      TEST_EQ (true, file != nullptr);
+      if (file)
+      {
+        std::string long_text (300, 'y');
+        TEST_EQ (10 , TS_BRACE_FPRINTF (file, "{:>4}|{:<4}\n", 1, 2));
+        TEST_EQ (301, TS_BRACE_FPRINTF (file, "{}\n", long_text.c_str ()));
+        TEST_EQ ("   1|2   \n" + long_text + "\n", read_all (file));
+        std::fclose (file);
+      }
+    }
+  }
+
+  void test__arena ()
+  {
+    TEST_CASE ();
+
+    using namespace typesafe_printf;
+
+    auto to_string = [] (string_view v)
+    {
+      return std::string (v.data (), v.size ());
+    };
+
+    // Small blocks so the strings spill over several blocks
+    arena         a (16);
+    arena_builder b (a);
+
+    std::vector<string_view> views;
+    std::vector<std::string> expected;
+
+    char buffer[64];
+    for (auto iter = 0; iter < 200; ++iter)
+    {
+      views.push_back (TS_ARENA_FORMAT (b, "tenant-%d:%s", iter, iter % 2 ? "odd" : "even"));
+      TS_SPRINTF (buffer, "tenant-%d:%s", iter, iter % 2 ? "odd" : "even");
+      expected.push_back (buffer);
+    }
+
+    // Earlier strings stay valid as the arena grows
+    for (auto iter = 0U; iter < views.size (); ++iter)
+    {
+      TEST_EQ (expected[iter], to_string (views[iter]));
+      TEST_EQ ('\0', views[iter].data ()[views[iter].size ()]);
+    }
+
+    // A string appended in parts, larger than a block
+    {
+      std::string long_text (5000, 'x');
+      TEST_EQ (21, TS_ARENA_APPEND (b, "GET %s HTTP/1.1\r\n", "/index"));
+      TEST_EQ (5008, TS_ARENA_APPEND (b, "Host: %s\r\n", long_text.c_str ()));
+      b.append ("\r\n", 2U);
+      TEST_EQ (std::string ("GET /index HTTP/1.1\r\n"), to_string (b.view ()).substr (0, 21));
+
+      auto request = b.finish ();
+      TEST_EQ ("GET /index HTTP/1.1\r\nHost: " + long_text + "\r\n\r\n", to_string (request));
+      TEST_EQ (expected.front (), to_string (views.front ()));
+    }
+
+    TEST_EQ (std::string (), to_string (b.finish ()));
+    TEST_EQ (std::string (), to_string (TS_ARENA_FORMAT (b, "")));
+
+    // %n counts the chars of the call
+    {
+      auto written = 0;
+      TEST_EQ (std::string ("abc1.500"), to_string (TS_ARENA_FORMAT (b, "abc%n%.*f", &written, 3, 1.5)));
+      TEST_EQ (3, written);
+    }
+
+    // After a reset the arena reuses its newest block
+    a.reset ();
+    TEST_EQ (static_cast<std::size_t> (0U), a.size ());
+    auto first = TS_ARENA_FORMAT (b, "%d", 1);
+    auto second = TS_ARENA_FORMAT (b, "%d", 22);
+    TEST_EQ (first.data () + 2, second.data ());
+    TEST_EQ (static_cast<std::size_t> (5U), a.size ());
+
+    // An arena on a caller supplied buffer
+    {
+      char stack[32];
+      arena         sa (stack, sizeof (stack));
+      arena_builder sb (sa);
+
+      auto inside = TS_ARENA_FORMAT (sb, "%s=%d", "key", 42);
+      TEST_EQ (stack, inside.data ());
+      TEST_EQ (std::string ("key=42"), to_string (inside));
+
+      std::string long_text (100, 'y');
+      auto outside = TS_ARENA_FORMAT (sb, "%s", long_text.c_str ());
+      TEST_EQ (long_text, to_string (outside));
+      TEST_EQ (std::string ("key=42"), to_string (inside));
+
+      sa.reset ();
+      TEST_EQ (static_cast<std::size_t> (0U), sa.size ());
+      TEST_EQ (long_text, to_string (TS_ARENA_FORMAT (sb, "%s", long_text.c_str ())));
+    }
+  }
+
+  int rt_fd = -1;
+
+  extern "C" void rt_signal_handler (int sig)
+  {
+    TS_DPRINTF_RT (rt_fd, "signal %d after %.3f ms in %ls\n", sig, 12.3456, L"callback");
+  }
+
+  void test__structured ()
+  {
+    TEST_CASE ();
+
+    using namespace typesafe_printf;
+
+    {
+      auto line = [] (output_mode mode)
+      {
+        return TS_STRUCTURED_FORMAT (
+            mode
+          , "Accepted %s:%d (%u)\n"
+          , TS_FIELD ("peer", "10.0.0.1")
+          , TS_FIELD ("port", 8080)
+          , 7U
+          );
+      };
+
+      TEST_EQ ("Accepted 10.0.0.1:8080 (7)\n"                                   , line (om__text)   );
+      TEST_EQ ("{\"msg\":\"Accepted 10.0.0.1:8080 (7)\",\"peer\":\"10.0.0.1\",\"port\":8080}", line (om__json)   );
+      TEST_EQ ("msg=\"Accepted 10.0.0.1:8080 (7)\" peer=10.0.0.1 port=8080"     , line (om__logfmt) );
+    }
+
+    {
+      // Numbers
+      auto nan = std::numeric_limits<double>::quiet_NaN ();
+      auto inf = std::numeric_limits<double>::infinity ();
+      TEST_EQ ("{\"msg\":\"-3 18446744073709551615 0.1\",\"i\":-3,\"u\":18446744073709551615,\"d\":0.1}"
+        , TS_STRUCTURED_FORMAT (om__json, "%d %llu %g", TS_FIELD ("i", -3), TS_FIELD ("u", ~0ULL), TS_FIELD ("d", 0.1)));
+      TEST_EQ ("{\"msg\":\"nan inf 0.333\",\"a\":null,\"b\":null,\"c\":0.3333333333333333}"
+        , TS_STRUCTURED_FORMAT (om__json, "%g %g %.3f", TS_FIELD ("a", nan), TS_FIELD ("b", inf), TS_FIELD ("c", 1.0 / 3.0)));
+      TEST_EQ ("msg=\"nan -inf\" a=NaN b=-Inf"
+        , TS_STRUCTURED_FORMAT (om__logfmt, "%g %g", TS_FIELD ("a", nan), TS_FIELD ("b", -inf)));
+    }
+
+    {
+      // Strings
+      char const *    quoted  = "say \"hi\"\n";
+      char const *    null_s  = nullptr;
+      wchar_t const * wide    = L"w\u00e5";
+      TEST_EQ ("{\"msg\":\"say \\\"hi\\\"\\n|(null)|w\xc3\xa5|x\",\"q\":\"say \\\"hi\\\"\\n\",\"n\":null,\"w\":\"w\xc3\xa5\",\"c\":\"x\"}"
+        , TS_STRUCTURED_FORMAT (om__json, "%s|%s|%ls|%c", TS_FIELD ("q", quoted), TS_FIELD ("n", null_s), TS_FIELD ("w", wide), TS_FIELD ("c", static_cast<int> ('x'))));
+      TEST_EQ ("msg=\"say \\\"hi\\\"\\n|(null)|w\xc3\xa5|x\" q=\"say \\\"hi\\\"\\n\" n= w=w\xc3\xa5 c=x"
+        , TS_STRUCTURED_FORMAT (om__logfmt, "%s|%s|%ls|%c", TS_FIELD ("q", quoted), TS_FIELD ("n", null_s), TS_FIELD ("w", wide), TS_FIELD ("c", static_cast<int> ('x'))));
+      TEST_EQ ("msg=\"a b\" e=\"\" s=\"a b\""
+        , TS_STRUCTURED_FORMAT (om__logfmt, "%s%s", TS_FIELD ("e", ""), TS_FIELD ("s", "a b")));
+    }
+
+    {
+      // Widths, the extensions and %n
+      unsigned char const bytes[] = { 0xDE, 0xAD };
+      int                 written = 0;
+      std::string         text    = "abc";
+      TEST_EQ ("{\"msg\":\"  abc|dead|4|abc\",\"w\":5,\"s\":\"abc\",\"h\":\"dead\",\"len\":2,\"t\":\"abc\"}"
+        , TS_STRUCTURED_FORMAT (
+            om__json
+          , "%*s|%Hp|4%n|%Js"
+          , TS_FIELD ("w", 5)
+          , TS_FIELD ("s", text.c_str ())
+          , TS_FIELD ("h", static_cast<void const *> (bytes))
+          , TS_FIELD ("len", sizeof (bytes))
+          , TS_FIELD ("n", &written)
+          , TS_FIELD ("t", text.c_str ())
+          ));
+      TEST_EQ (12, written);
+
+      // %T is local time
+      auto at = reference_timestamp (1000000000LL, 9U);
+      auto ts = TS_STRUCTURED_FORMAT (om__logfmt, "at %Tllu", TS_FIELD ("at", 1000000000ULL));
+      TEST_EQ ("msg=\"at " + at + "\" at=" + at, ts);
+
+      // The field values can be variables too
+      auto port   = TS_FIELD ("port", 443);
+      TEST_EQ ("msg=443 port=443", TS_STRUCTURED_FORMAT (om__logfmt, "%d", port));
+    }
+
+    {
+      auto file = std::tmpfile ();
+      TEST_EQ (true, file != nullptr);
+      if (file)
+      {
+        TEST_EQ (8  , TS_STRUCTURED_FPRINTF (file, om__text  , "a=%d\n", TS_FIELD ("a", 12345)));
+        TEST_EQ (28 , TS_STRUCTURED_FPRINTF (file, om__json  , "a=%d\n", TS_FIELD ("a", 12345)));
+        TEST_EQ (22 , TS_STRUCTURED_FPRINTF (file, om__logfmt, "a=%d"  , TS_FIELD ("a", 12345)));
+
+        // An empty line is fine in om__text, a failed format isn't
+        //  (snprintf fails on an unpaired surrogate in the C locale)
+        wchar_t const surrogate[] = { static_cast<wchar_t> (0xD800), 0 };
+        TEST_EQ (0  , TS_STRUCTURED_FPRINTF (file, om__text  , ""));
+        TEST_EQ (-1 , TS_STRUCTURED_FPRINTF (file, om__text  , "%ls", surrogate));
+        TEST_EQ (-1 , TS_STRUCTURED_FPRINTF (file, om__json  , "%ls", surrogate));
+        TEST_EQ ("a=12345\n{\"msg\":\"a=12345\",\"a\":12345}\nmsg=\"a=12345\" a=12345\n", read_all (file));
+        std::fclose (file);
+      }
+    }
+  }
+
+  void test__rt ()
+  {
+    TEST_CASE ();
+
+#ifdef __GLIBC__
+    // The interposed allocator sees allocations made by the library
+    {
+      count_allocations = true;
+      std::string allocated (1000, 'x');
+      count_allocations = false;
+      TEST_EQ (true, allocations.load () > 0U);
+      allocations = 0U;
+    }
+#endif
+
+    TEST_RT ("%%|%d|%i|%u", -12, 34, 56U);
+    TEST_RT ("%+05d|%-6i|% d|%.0d|%.5d|%8.3d", 42, -7, 3, 0, -12, 5);
+    TEST_RT ("%lld|%+-25lld|", LLONG_MIN, LLONG_MAX);
+    TEST_RT ("%o|%#o|%#.0o|%x|%#x|%#X|%#010x|%.0x", 8U, 8U, 0U, 255U, 255U, 255U, 255U, 0U);
+    TEST_RT ("%hhd|%hu|%zu|%c|%-5c|", static_cast<signed char> (-3), static_cast<unsigned short> (65535), static_cast<std::size_t> (17), static_cast<int> ('A'), static_cast<int> ('b'));
+    TEST_RT ("%s|%.3s|%10s|%-10s|%10.2s", "hello", "hello", "hi", "hi", "hello");
+    TEST_RT ("%ls|%.2ls|%8ls|%lc", L"wide", L"wide", L"wide", static_cast<wint_t> (L'w'));
+    TEST_RT ("%p|%20p|%-20p|%p", reinterpret_cast<void *> (0x1234abcd), reinterpret_cast<void *> (0x1234abcd), reinterpret_cast<void *> (0x1234abcd), static_cast<void *> (nullptr));
+    TEST_RT ("%*.*f|%-*d|%.*f", 10, 3, 3.14159, 5, 42, -2, 1.5);
+
+    TEST_RT ("%f|%.0f|%.3f|%20.10f|%#.0f|%010.2f", 3.14159, 2.5, -0.0005, 1e10 / 3, 3.0, -1.25);
+    TEST_RT ("%e|%.0e|%#.0e|% E|%-+12.4e|", 123456.789, 5e-324, 1.5, 2.5e300, -0.0);
+    TEST_RT ("%g|%#g|%.17g|%G|%.0g|%012g", 0.0001234, 0.5, 0.1, 1e-10, 95.0, -3.0);
+    TEST_RT ("%a|%A|%.3a|%.0a|%+015a", 1.0, -0.1, 1.0 / 3, 1.5, 4.9e-324);
+    TEST_RT ("%f|%e|%g|%F|%a", 1.0 / 0.0, -1.0 / 0.0, 0.0 / 0.0, 1.0 / 0.0, -1.0 / 0.0);
+    TEST_RT ("%.30f|%f", 0.1, 1.7976931348623157e308);
+    TEST_RT ("%.20e", 2.2250738585072014e-308);
+
+    // Every double needs to round like glibc, not only the ones above
+    {
+      std::uint64_t state   = 0x9E3779B97F4A7C15ULL;
+      auto          mismatch = 0;
+      for (auto iter = 0; iter < 2000; ++iter)
+      {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+
+        double value;
+        std::memcpy (&value, &state, sizeof (value));
+
+        char expected[512];
+        char actual[512];
+
+        TS_SPRINTF (expected, "%.17e|%f|%g|%.3a", value, value, value, value);
+        TS_SPRINTF_RT (actual, "%.17e|%f|%g|%.3a", value, value, value, value);
+        mismatch += std::strcmp (expected, actual) != 0 ? 1 : 0;
+
+        auto scaled = static_cast<double> (static_cast<std::int64_t> (state % 2000000U) - 1000000) / 1000.0;
+        TS_SPRINTF (expected, "%.2f|%.0f|%.1e|%.4g", scaled, scaled, scaled, scaled);
+        TS_SPRINTF_RT (actual, "%.2f|%.0f|%.1e|%.4g", scaled, scaled, scaled, scaled);
+        mismatch += std::strcmp (expected, actual) != 0 ? 1 : 0;
+      }
+      TEST_EQ (0, mismatch);
+    }
+
+    // UTF-8 regardless of the locale, precision doesn't split a char
+    {
+      char buffer[32];
+      TEST_EQ (7, TS_SPRINTF_RT (buffer, "%ls|%.3ls", L"åä", L"åä"));
+      TEST_EQ (std::string ("\xc3\xa5\xc3\xa4|\xc3\xa5"), std::string (buffer));
+    }
+
+    // nullptr as glibc prints it
+    {
+      char buffer[32];
+      TEST_EQ (20, TS_SPRINTF_RT (buffer, "%s|%.3s|%ls|%p", static_cast<char const *> (nullptr), static_cast<char const *> (nullptr), static_cast<wchar_t const *> (nullptr), static_cast<void *> (nullptr)));
+      TEST_EQ (std::string ("(null)||(null)|(nil)"), std::string (buffer));
+    }
+
+    // Truncates like snprintf
+    {
+      char buffer[8];
+      TEST_EQ (11, TS_SPRINTF_RT (buffer, "%s %d", "hello", 12345));
+      TEST_EQ (std::string ("hello 1"), std::string (buffer));
+      TEST_EQ (3, TS_SNPRINTF_RT (buffer, 0U, "%d", 123));
+      TEST_EQ (std::string ("hello 1"), std::string (buffer));
+      TEST_EQ (3, TS_SNPRINTF_RT (buffer, 1U, "%d", 123));
+      TEST_EQ (std::string (), std::string (buffer));
+    }
+
+    // %n counts the chars of the call
+    {
+      char buffer[32];
+      auto written = 0;
+      TEST_EQ (8, TS_SPRINTF_RT (buffer, "abc%n%.*f", &written, 3, 1.5));
+      TEST_EQ (3, written);
+    }
+
+    // Straight to a file descriptor, also from a signal handler
+#ifndef _WIN32
+    {
+      auto file = std::tmpfile ();
+      if (!TEST_EQ (true, file != nullptr))
+      {
+        return;
+      }
+      rt_fd = fileno (file);
+
+      std::string long_text (1000, 'z');
+
+      count_allocations = true;
+
+      auto result = TS_DPRINTF_RT (rt_fd, "%s|%.2f\n", long_text.c_str (), 2.0 / 3);
+
+      struct sigaction action {};
+      action.sa_handler = &rt_signal_handler;
+      sigemptyset (&action.sa_mask);
+      struct sigaction previous {};
+      sigaction (SIGUSR1, &action, &previous);
+      raise (SIGUSR1);
+      sigaction (SIGUSR1, &previous, nullptr);
+
+      count_allocations = false;
+
+      TEST_EQ (1006, result);
+      TEST_EQ (0U, allocations.load ());
+      TEST_EQ (long_text + "|0.67\nsignal " + std::to_string (SIGUSR1) + " after 12.346 ms in callback\n", read_all (file));
+
+      std::fclose (file);
+
+      // Writes to a closed descriptor fail
+      TEST_EQ (-1, TS_DPRINTF_RT (-1, "%d", 1));
+    }
+#endif
+  }
+
+  void test__metrics ()
+  {
+    TEST_CASE ();
+
+    using namespace typesafe_printf;
+
+    metrics::family requests  ("http_requests_total", metrics::mt__counter, "Requests handled\nby \"method\"");
+    metrics::family latency   ("http_latency_seconds", metrics::mt__histogram);
+    metrics::family queue     ("queue_depth", metrics::mt__gauge, "Items \\ queued");
+
+    auto get      = TS_METRIC_SERIES (requests, "{method=\"%s\",code=\"%d\"}", "get", 200);
+    auto odd      = TS_METRIC_SERIES (requests, "{method=\"%s\",code=\"%d\"}", "a\"b\\c\nd", 500);
+    auto bucket   = TS_METRIC_SERIES (latency, "_bucket{le=\"%s\"}", "0.5");
+    auto inf      = TS_METRIC_SERIES (latency, "_bucket{le=\"+Inf\"}");
+    auto sum      = TS_METRIC_SERIES (latency, "_sum");
+    auto depth    = TS_METRIC_SERIES (queue, "");
+
+    TEST_EQ ("http_requests_total{method=\"get\",code=\"200\"} "                , get.prefix ());
+    TEST_EQ ("http_requests_total{method=\"a\\\"b\\\\c\\nd\",code=\"500\"} "    , odd.prefix ());
+    TEST_EQ ("queue_depth "                                                     , depth.prefix ());
+
+    metrics::writer w;
+    for (auto scrape = 0; scrape < 2; ++scrape)
+    {
+      w.clear ();
+      w.family (requests);
+      w.sample (get, 1027U);
+      w.sample (odd, -3LL, 1395066363000LL);
+      w.family (latency);
+      w.sample (bucket, 17);
+      w.sample (inf, 20.0);
+      w.sample (sum, 0.1 + 0.2);
+      w.family (queue);
+      w.sample (depth, std::numeric_limits<double>::quiet_NaN ());
+      w.sample (depth, -std::numeric_limits<double>::infinity ());
+      w.sample (depth, 1e300);
+      w.sample (depth, 2.5f);
+
+      TEST_EQ (
+          "# HELP http_requests_total Requests handled\\nby \"method\"\n"
+          "# TYPE http_requests_total counter\n"
+          "http_requests_total{method=\"get\",code=\"200\"} 1027\n"
+          "http_requests_total{method=\"a\\\"b\\\\c\\nd\",code=\"500\"} -3 1395066363000\n"
+          "# TYPE http_latency_seconds histogram\n"
+          "http_latency_seconds_bucket{le=\"0.5\"} 17\n"
+          "http_latency_seconds_bucket{le=\"+Inf\"} 20\n"
+          "http_latency_seconds_sum 0.30000000000000004\n"
+          "# HELP queue_depth Items \\\\ queued\n"
+          "# TYPE queue_depth gauge\n"
+          "queue_depth NaN\n"
+          "queue_depth -Inf\n"
+          "queue_depth 1e+300\n"
+          "queue_depth 2.5\n"
+        , w.finish ());
+    }
+
+    {
+      metrics::writer om (metrics::ef__openmetrics);
+      om.family (requests);
+      om.sample (get, 1U, 1.5);
+      om.family (queue);
+      TEST_EQ (
+          "# HELP http_requests Requests handled\\nby \\\"method\\\"\n"
+          "# TYPE http_requests counter\n"
+          "http_requests_total{method=\"get\",code=\"200\"} 1 1.5\n"
+          "# HELP queue_depth Items \\\\ queued\n"
+          "# TYPE queue_depth gauge\n"
+          "# EOF\n"
+        , om.finish ());
+    }
+
+    {
+      // A warm writer doesn't allocate
+      metrics::family             f ("series", metrics::mt__gauge);
+      std::vector<metrics::series> all;
+      for (auto iter = 0; iter < 1000; ++iter)
+      {
+        all.push_back (TS_METRIC_SERIES (f, "{id=\"%d\"}", iter));
+      }
+
+      metrics::writer big;
+      auto scrape = [&] ()
+      {
+        big.clear ();
+        big.family (f);
+        for (auto iter = 0U; iter < all.size (); ++iter)
+        {
+          big.sample (all[iter], iter * 0.25);
+        }
+        return big.finish ().size ();
+      };
+
+      auto size = scrape ();
+      auto data = big.text ().data ();
+      TEST_EQ (size, scrape ());
+      TEST_EQ (data, big.text ().data ());
+      TEST_EQ ("series{id=\"999\"} 249.75\n", big.text ().substr (size - 24U));
+    }
+
+    {
+      // Every value reads back
+      metrics::family f ("v", metrics::mt__gauge);
+      auto            v = TS_METRIC_SERIES (f, "");
+
+      std::uint64_t   x = 88172645463325252ULL;
+      auto next = [&x] ()
+      {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        return x;
+      };
+
+      metrics::writer w;
+      auto mismatches = 0;
+      for (auto iter = 0; iter < 20000; ++iter)
+      {
+        auto r      = next ();
+        auto value  =
+            iter % 4 == 0 ? static_cast<double> (r % 100000U) / 1000.0
+          : iter % 4 == 1 ? static_cast<double> (r % 1000U) * 1e-9
+          : iter % 4 == 2 ? static_cast<double> (r >> 11) / 9007199254740992.0 * 1e6
+          : -static_cast<double> (r >> 20) / 7.0
+          ;
+
+        w.clear ();
+        w.sample (v, value);
+        if (std::strtod (w.text ().c_str () + 2, nullptr) != value)
+        {
+          ++mismatches;
+        }
+      }
+      TEST_EQ (0, mismatches);
+
+      w.clear ();
+      w.sample (v, 0.001);
+      w.sample (v, -12.345);
+      w.sample (v, 1e-10);
+      TEST_EQ ("v 0.001\nv -12.345\nv 0.0000000001\n", w.text ());
+    }
+  }
+
+  void test__recorder ()
+  {
+    TEST_CASE ();
+
+    using namespace typesafe_printf;
+
+    // A small ring so the oldest records are overwritten
+    recorder::set_ring_size (1024);
+
+    std::string long_text (1000, 'z');
+
+    std::thread recording ([&long_text] ()
+      {
+        for (auto iter = 0; iter < 100; ++iter)
+        {
+          TS_RECORD ("record %d %s %.1f\n", iter, "abc", iter * 0.5);
+        }
+
+        char const *  v_null_p  = nullptr;
+        auto          written   = 0;
+        TS_RECORD ("null %s%n, wide %ls", v_null_p, &written, L"w\u00e5");
+        TS_RECORD ("long %s", long_text.c_str ());
+      });
+    recording.join ();
+
+    recorder::set_ring_size (recorder::default_ring_size);
+
+    auto file = std::tmpfile ();
+    if (!TEST_EQ (true, file != nullptr))
+    {
+      return;
+    }
+
+    auto records = recorder::dump (file);
+    auto text    = read_all (file);
+    std::fclose (file);
+
+    // Drops the timestamps, 2015-06-21T14:03:07.123456789Z
+    std::vector<std::string> lines;
+    std::istringstream input (text);
+    for (std::string line; std::getline (input, line); )
+    {
+      if (line.compare (0, 4, "--- ") != 0)
+      {
+        TEST_EQ ('Z', line[29]);
+        lines.push_back (line.substr (31));
+      }
+    }
+
+    TEST_EQ (records, lines.size ());
+    TEST_EQ (true, lines.size () > 3U);
+    TEST_EQ (true, lines.size () < 100U);
+
+    auto count = lines.size ();
+    TEST_EQ ("record 99 abc 49.5"                                    , lines[count - 3]);
+    TEST_EQ ("null (null), wide w\xc3\xa5"                           , lines[count - 2]);
+    TEST_EQ ("long " + long_text.substr (0, TYPESAFE_PRINTF__RECORDER_MAX_STRING)   , lines[count - 1]);
+
+    // The oldest surviving records are still in order
+    for (auto iter = 0U; iter + 3U < count; ++iter)
+    {
+      char expected[64];
+      auto record = 100 - static_cast<int> (count - 2U) + static_cast<int> (iter);
+      TS_SPRINTF (expected, "record %d abc %.1f", record, record * 0.5);
+      TEST_EQ (expected, lines[iter]);
+    }
+
+    // The same dump from a signal handler, without allocating
+#ifndef _WIN32
+    {
+      auto signal_file = std::tmpfile ();
+      if (!TEST_EQ (true, signal_file != nullptr))
+      {
+        return;
+      }
+
+      TEST_EQ (true, recorder::dump_on_signal (SIGUSR2, fileno (signal_file)));
+
+      auto before = allocations.load ();
+      count_allocations = true;
+      std::raise (SIGUSR2);
+      count_allocations = false;
+      std::signal (SIGUSR2, SIG_DFL);
+
+      TEST_EQ (before, allocations.load ());
+      TEST_EQ (text, read_all (signal_file));
+
+      std::fclose (signal_file);
+    }
+#endif
+  }
+
+#ifndef _WIN32
+  void test__shm ()
+  {
+    TEST_CASE ();
+
+    using namespace typesafe_printf;
+
+    char name[64];
+    TS_SPRINTF (name, "/tsprintf-test-%d", static_cast<int> (::getpid ()));
+
+    // 64 slots of 56 bytes
+    shm::consumer consumer (name, 64U);
+    TEST_EQ (true, consumer.is_valid ());
+
+    auto decode = [&consumer] (shm::record const & rec)
+    {
+      std::string               format        ;
+      details::encoded_types_t  encoded_types = 0U;
+      details::arg              args[details::max_encoded_types];
+      std::wstring              wide[details::max_encoded_types];
+      details::size_type        arg_count     = 0U;
+      char                      buffer[256]   ;
+
+      if (
+            !consumer.format (rec.format_id, format, encoded_types)
+        ||  !details::get_binlog_args (encoded_types, rec.payload.data (), rec.payload.size (), args, arg_count, wide)
+        ||  details::render (buffer, sizeof (buffer), format.c_str (), args, arg_count) < 0
+        )
+      {
+        return std::string ("(invalid)");
+      }
+
+      return std::string (buffer);
+    };
+
+    // Records enqueued by a process that is killed are still there
+    auto child = ::fork ();
+    if (child == 0)
+    {
+      shm::producer producer (name);
+      for (auto iter = 0; iter < 3; ++iter)
+      {
+        TS_SHM_LOG (producer, "child %d %s %.1f", iter, "abc", iter * 1.5);
+      }
+      TS_SHM_LOG (producer, "spans slots %s", "0123456789012345678901234567890123456789012345678901234567890123456789");
+      std::raise (SIGKILL);
+    }
+
+    auto status = 0;
+    TEST_EQ (child, ::waitpid (child, &status, 0));
+
+    std::vector<std::string> received;
+    shm::record rec;
+    while (consumer.next (rec))
+    {
+      TEST_EQ (static_cast<std::uint32_t> (child), rec.pid);
+      received.push_back (decode (rec));
+    }
+
+    TEST_EQ (4U, received.size ());
+    if (received.size () == 4U)
+    {
+      TEST_EQ ("child 0 abc 0.0", received[0]);
+      TEST_EQ ("child 2 abc 3.0", received[2]);
+      TEST_EQ ("spans slots 0123456789012345678901234567890123456789012345678901234567890123456789", received[3]);
+    }
+
+    // A full ring drops records instead of waiting
+    {
+      shm::producer producer (name);
+      TEST_EQ (true, producer.is_valid ());
+
+      for (auto iter = 0; iter < 100; ++iter)
+      {
+        TS_SHM_LOG (producer, "parent %d", iter);
+      }
+
+      auto dropped = consumer.dropped ();
+      TEST_EQ (true, dropped > 0U);
+
+      auto read = 0U;
+      while (consumer.next (rec))
+      {
+        ++read;
+      }
+      TEST_EQ (100U - dropped, read);
+
+      TS_SHM_LOG (producer, "parent %d", 100);
+      TEST_EQ (true, consumer.next (rec));
+      TEST_EQ ("parent 100", decode (rec));
+    }
+
+    TEST_EQ (false, shm::producer ("/tsprintf-test-missing").is_valid ());
+
+    TEST_EQ (true, consumer.remove ());
+
+    // A producer created before the ring attaches on a later record, and a
+    //  restarted consumer continues with the records enqueued while no
+    //  consumer ran
+    {
+      TS_SPRINTF (name, "/tsprintf-test-%d-restart", static_cast<int> (::getpid ()));
+
+      shm::producer producer (name);
+      TEST_EQ (false, producer.is_valid ());
+
+      auto format_of = [] (shm::consumer const & c, shm::record const & r)
+      {
+        std::string               format        ;
+        details::encoded_types_t  encoded_types = 0U;
+        return c.format (r.format_id, format, encoded_types) ? format : std::string ("(invalid)");
+      };
+
+      {
+        shm::consumer first (name, 64U);
+        TEST_EQ (true, first.is_valid ());
+
+        std::this_thread::sleep_for (shm::attach_interval + std::chrono::milliseconds (20));
+        TS_SHM_LOG (producer, "attached %d", 1);
+        TEST_EQ (true, producer.is_valid ());
+        TEST_EQ (true, first.next (rec));
+        TEST_EQ ("attached %d", format_of (first, rec));
+      }
+
+      TS_SHM_LOG (producer, "between %d", 2);
+
+      shm::consumer restarted (name, 64U);
+      TEST_EQ (true , restarted.is_valid ());
+      TEST_EQ (true , restarted.next (rec));
+      TEST_EQ ("between %d", format_of (restarted, rec));
+
+      TS_SHM_LOG (producer, "after %d", 3);
+      TEST_EQ (true , restarted.next (rec));
+      TEST_EQ ("after %d", format_of (restarted, rec));
+      TEST_EQ (false, restarted.next (rec));
+      TEST_EQ (0U   , restarted.dropped ());
+
+      // A corrupt format table entry isn't read outside the mapping
+      details::shm_mapping corrupt;
+      if (TEST_EQ (true, details::shm_map_existing (corrupt, name)))
+      {
+        corrupt.formats[rec.format_id].text_offset = corrupt.header->text_capacity - 2U;
+        TEST_EQ ("(invalid)", format_of (restarted, rec));
+      }
+
+      TEST_EQ (true , restarted.remove ());
+    }
+  }
+#endif
+
+  void test__binlog ()
+  {
+    TEST_CASE ();
+
+    using namespace typesafe_printf::binlog;
+
+    char const *  v_char_p  = "string";
+    char const *  v_null_p  = nullptr;
+    void const *  v_void_p  = &v_char_p;
+
+    std::vector<std::string> expected;
+    for (auto iter = 0; iter < 3; ++iter)
+    {
+      char buffer[256] {};
+
+      expected.push_back ("Hello\n");
+
+      TS_SPRINTF (buffer, "%d: %s, %.2f, %llx, %c, %Lg, %u", -iter, v_char_p, 3.14159, 0xDEADBEEFULL - iter, static_cast<int> ('X'), 0.5L, 1000U * iter);
+      expected.push_back (buffer);
+
+      TS_SPRINTF (buffer, "%ls %p %s", L"wide", v_void_p, v_null_p);
+      expected.push_back (buffer);
+    }
+
+    std::uint8_t const flags[] = { bf__none, bf__compact, bf__compact | bf__lz4, bf__compact | bf__intern };
+
+    for (auto f : flags)
+    {
+      for (auto block_size : { std::size_t (1), default_block_size })
+      {
+        auto log = std::tmpfile ();
+        if (!TEST_EQ (true, log != nullptr))
+        {
+          return;
+        }
+
+        {
+          writer w (log, f, block_size);
+
+          for (auto iter = 0; iter < 3; ++iter)
+          {
+            TS_BINLOG (w, "Hello\n");
+            TS_BINLOG (w, "%d: %s, %.2f, %llx, %c, %Lg, %u", -iter, v_char_p, 3.14159, 0xDEADBEEFULL - iter, static_cast<int> ('X'), 0.5L, 1000U * iter);
+            TS_BINLOG (w, "%ls %p %s%n", L"wide", v_void_p, v_null_p, static_cast<int *> (nullptr));
+          }
+        }
+
+        std::rewind (log);
+        TEST_EQ (expected, read_binlog (log));
+
+        std::rewind (log);
+        reader      r (log);
+        block_index idx;
+
+        TEST_EQ (true, build_index (r, idx));
+        TEST_EQ (block_size == 1 ? 9U : 1U, idx.blocks.size ());
+
+        auto index_file = std::tmpfile ();
+        if (block_size == 1 && TEST_EQ (true, index_file != nullptr))
+        {
+          TEST_EQ (true, save_index (index_file, r, idx));
+          std::rewind (index_file);
+
+          std::rewind (log);
+          reader      r2 (log);
+          block_index idx2;
+          TEST_EQ (true, load_index (index_file, r2, idx2));
+          TEST_EQ (idx.blocks.size (), idx2.blocks.size ());
+
+          // Every third block holds the second format, read one directly
+          auto id = idx2.blocks[1].format_ids.front ();
+          TEST_EQ (true , idx2.blocks[4].contains (id));
+          TEST_EQ (false, idx2.blocks[5].contains (id));
+
+          record rec;
+          char buffer[256] {};
+          TEST_EQ (true , r2.seek (idx2.blocks[4].offset));
+          TEST_EQ (true , r2.read_block ());
+          TEST_EQ (true , r2.next_in_block (rec));
+          TEST_EQ (false, r2.next_in_block (rec));
+          r2.render (rec, buffer, sizeof (buffer));
+          TEST_EQ (expected[4], std::string (buffer));
+
+          // An index with a corrupt format id is rejected without allocating
+          //  an entry per possible id
+          TEST_EQ (false, r2.define_format (0xFFFFFFFFU, "%d", 0U));
+
+          auto index_bytes = read_all (index_file);
+          index_bytes[12] = index_bytes[13] = index_bytes[14] = index_bytes[15] = '\xFF';
+
+          auto bad_index = std::tmpfile ();
+          if (TEST_EQ (true, bad_index != nullptr))
+          {
+            std::fwrite (index_bytes.data (), 1, index_bytes.size (), bad_index);
+            std::rewind (bad_index);
+
+            std::rewind (log);
+            reader      r3 (log);
+            block_index idx3;
+            TEST_EQ (false, load_index (bad_index, r3, idx3));
+            std::fclose (bad_index);
+          }
+        }
+
+        if (index_file)
+        {
+          std::fclose (index_file);
+        }
+
+        std::fclose (log);
+      }
+    }
+
+    // Monotonic counters compacts to a few bytes per record
+    {
+      long sizes[2] {};
+
+      for (auto iter = 0U; iter < 2; ++iter)
+      {
+        auto log = std::tmpfile ();
+        if (!TEST_EQ (true, log != nullptr))
+        {
+          return;
+        }
+
+        {
+          writer w (log, iter == 0 ? bf__none : bf__compact);
+          for (auto counter = 0ULL; counter < 1000; ++counter)
+          {
+            TS_BINLOG (w, "counter: %llu, %llu\n", counter, counter * 3);
+          }
+        }
+
+        sizes[iter] = std::ftell (log);
+        std::fclose (log);
+      }
+
+      TEST_EQ (true, sizes[1] * 4 < sizes[0]);
+    }
+
+    // Repeated strings are references to the first occurrence in the block,
+    //  whether they are the same pointer or not
+    {
+      char const * const  endpoints[] = { "/api/v1/orders", "/api/v1/customers", "/healthz" };
+      char const * const  statuses[]  = { "OK", "NOT_FOUND", "INTERNAL_ERROR" };
+      char                tenant[32]  ;
+
+      std::vector<std::string> expected_lines;
+      long sizes[2] {};
+
+      for (auto iter = 0U; iter < 2; ++iter)
+      {
+        auto log = std::tmpfile ();
+        if (!TEST_EQ (true, log != nullptr))
+        {
+          return;
+        }
+
+        {
+          writer w (log, iter == 0 ? bf__compact : bf__compact | bf__intern, 4096);
+          for (auto line = 0; line < 1000; ++line)
+          {
+            // The same buffer with changing content
+            TS_SPRINTF (tenant, "tenant-%d", line % 7);
+            TS_BINLOG (w, "%s %s %s %d", endpoints[line % 3], tenant, std::string (statuses[line % 5 % 3]).c_str (), line);
+
+            if (iter == 0)
+            {
+              char buffer[128];
+              TS_SPRINTF (buffer, "%s %s %s %d", endpoints[line % 3], tenant, statuses[line % 5 % 3], line);
+              expected_lines.push_back (buffer);
+            }
+          }
+        }
+
+        sizes[iter] = std::ftell (log);
+
+        std::rewind (log);
+        TEST_EQ (expected_lines, read_binlog (log));
+
+        std::fclose (log);
+      }
+
+      TEST_EQ (true, sizes[1] * 3 < sizes[0]);
+    }
+  }
+
+  template<typename T>
+  auto unconst (T const * p)
+  {
+    return const_cast<T*> (p);
+  }
+
+  void test__printf_variants ()
+  {
+    TEST_CASE ();
+
+    char buffer[1024] {};
+
+    TS_PRINTF   (             "TS_PRINTF\n" );
+
+    TS_SPRINTF  (buffer,      "TS_SPRINTF"  );
+    TEST_EQ     ("TS_SPRINTF" ,buffer);
+
+    TS_SNPRINTF (buffer, 20,  "TS_SNPRINTF" );
+    TEST_EQ     ("TS_SNPRINTF",buffer);
+
+    TS_FPRINTF  (stdout,      "TS_FPRINTF\n");
+
+    TS_SPRINTF  (buffer,      "TS_SPRINTF: %d\n%s\n",  3, "Hello");
+    TEST_EQ     ("TS_SPRINTF: 3\nHello\n" ,buffer);
+
+    TS_SPRINTF  (
+        buffer
+      , "This is a long format %s, the purpose is to make sure we don't hit any funny compiler limits.\n"
+        "This is a long format %s, the purpose is to make sure we don't hit any funny compiler limits.\n"
+        "This is a long format %s, the purpose is to make sure we don't hit any funny compiler limits.\n"
+        "This is a long format %s, the purpose is to make sure we don't hit any funny compiler limits.\n"
+        "This is a long format %s, the purpose is to make sure we don't hit any funny compiler limits.\n"
+      , "string"
+      , "string"
+      , "string"
+      , "string"
+      , "string"
+      );
+
+    using signed_size_t       = typesafe_printf::details::ssize_t   ;
+    using unsigned_ptrdiff_t  = typesafe_printf::details::uptrdiff_t;
+
+    char const *            v_char_p                 = "02"                 ;
+    double                  v_double                 = 0x03                 ;
+    int                     v_int                    = 0x04                 ;
+    int                     nv_int_p                 = 0x05                 ;
+    int *                   v_int_p                  = &nv_int_p            ;
+    std::intmax_t           v_intmax_t               = 0x06                 ;
+    std::intmax_t           nv_intmax_t              = 0x07                 ;
+    std::intmax_t *         v_intmax_t_p             = &nv_intmax_t         ;
+    long                    v_long                   = 0x08                 ;
+    long double             v_long_double            = 0x09                 ;
+    long long               v_long_long              = 0x0A                 ;
+    long long               nv_long_long_p           = 0x0B                 ;
+    long long *             v_long_long_p            = &nv_long_long_p      ;
+    long                    nv_long_p                = 0x0C                 ;
+    long *                  v_long_p                 = &nv_long_p           ;
+    std::ptrdiff_t          v_ptrdiff_t              = 0x0D                 ;
+    std::ptrdiff_t          nv_ptrdiff_t_p           = 0x0E                 ;
+    std::ptrdiff_t *        v_ptrdiff_t_p            = &nv_ptrdiff_t_p      ;
+    short                   v_short                  = 0x0F                 ;
+    short                   nv_short_p               = 0x10                 ;
+    short *                 v_short_p                = &nv_short_p          ;
+    char signed             v_signed_char            = 0x11                 ;
+    char signed             nv_signed_char_p         = 0x12                 ;
+    char signed *           v_signed_char_p          = &nv_signed_char_p    ;
+    signed_size_t           v_signed_size_t          = 0x13                 ;
+    signed_size_t           nv_signed_size_t_p       = 0x14                 ;
+    signed_size_t *         v_signed_size_t_p        = &nv_signed_size_t_p  ;
+    std::size_t             v_size_t                 = 0x15                 ;
+    std::uintmax_t          v_uintmax_t              = 0x16                 ;
+    char unsigned           v_unsigned_char          = 0x17                 ;
+    int unsigned            v_unsigned_int           = 0x18                 ;
+    long unsigned           v_unsigned_long          = 0x19                 ;
+    long long unsigned      v_unsigned_long_long     = 0x1A                 ;
+    unsigned_ptrdiff_t      v_unsigned_ptrdiff_t     = 0x1B                 ;
+    short unsigned          v_unsigned_short         = 0x1C                 ;
+    void const *            v_void_p                 = (void const *)0x1D   ;
+    wchar_t const *         v_wchar_t_p              = L"1E"                ;
+    std::wint_t             v_wint_t                 = 0x1F                 ;
+
+    // These are positive test cases making sure valid code compiles.
+    //  As the actual runtime just forwards it to sprintf there's not
+    //  much value in checking the actual sprintf:ing.
+
+    // char formatters
+    TS_SPRINTF  (buffer,  "%%c: %c, %lc", v_int, v_wint_t);
+    // string formatters
+    TS_SPRINTF  (buffer,  "%%s: %s, %ls", v_char_p, v_wchar_t_p);
+    // integer formatters
+    TS_SPRINTF  (buffer,  "%%d: %hhd, %hd, %d, %ld, %lld, %jd, %zd, %td", v_signed_char, v_short, v_int, v_long, v_long_long, v_intmax_t, v_signed_size_t, v_ptrdiff_t);
+    TS_SPRINTF  (buffer,  "%%i: %hhi, %hi, %i, %li, %lli, %ji, %zi, %ti", v_signed_char, v_short, v_int, v_long, v_long_long, v_intmax_t, v_signed_size_t, v_ptrdiff_t);
+    TS_SPRINTF  (buffer,  "%%o: %hho, %ho, %o, %lo, %llo, %jo, %zo, %to", v_unsigned_char, v_unsigned_short, v_unsigned_int, v_unsigned_long, v_unsigned_long_long, v_uintmax_t, v_size_t, v_unsigned_ptrdiff_t);
+    TS_SPRINTF  (buffer,  "%%x: %hhx, %hx, %x, %lx, %llx, %jx, %zx, %tx", v_unsigned_char, v_unsigned_short, v_unsigned_int, v_unsigned_long, v_unsigned_long_long, v_uintmax_t, v_size_t, v_unsigned_ptrdiff_t);
+    TS_SPRINTF  (buffer,  "%%X: %hhX, %hX, %X, %lX, %llX, %jX, %zX, %tX", v_unsigned_char, v_unsigned_short, v_unsigned_int, v_unsigned_long, v_unsigned_long_long, v_uintmax_t, v_size_t, v_unsigned_ptrdiff_t);
+    TS_SPRINTF  (buffer,  "%%u: %hhu, %hu, %u, %lu, %llu, %ju, %zu, %tu", v_unsigned_char, v_unsigned_short, v_unsigned_int, v_unsigned_long, v_unsigned_long_long, v_uintmax_t, v_size_t, v_unsigned_ptrdiff_t);
+    // floating point formatters
+    TS_SPRINTF  (buffer,  "%%f: %f, %lf, %Lf", v_double, v_double, v_long_double);
+    TS_SPRINTF  (buffer,  "%%F: %F, %lF, %LF", v_double, v_double, v_long_double);
+    TS_SPRINTF  (buffer,  "%%e: %e, %le, %Le", v_double, v_double, v_long_double);
+    TS_SPRINTF  (buffer,  "%%E: %E, %lE, %LE", v_double, v_double, v_long_double);
+    TS_SPRINTF  (buffer,  "%%a: %a, %la, %La", v_double, v_double, v_long_double);
+    TS_SPRINTF  (buffer,  "%%A: %A, %lA, %LA", v_double, v_double, v_long_double);
+    TS_SPRINTF  (buffer,  "%%g: %g, %lg, %Lg", v_double, v_double, v_long_double);
+    TS_SPRINTF  (buffer,  "%%G: %G, %lG, %LG", v_double, v_double, v_long_double);
+    // %n formatters
+    TS_SPRINTF  (buffer,  "%%n: %hhn, %hn, %n, %ln, %lln, %jn, %zn, %tn", v_signed_char_p, v_short_p, v_int_p, v_long_p, v_long_long_p, v_intmax_t_p, v_signed_size_t_p, v_ptrdiff_t_p);
+    // pointer formatters
+    TS_SPRINTF  (buffer,  "%%p: %p", v_void_p);
+
+    // non-const pointee check
+    TS_SPRINTF  (buffer,  "non-const: %s, %ls, %p", unconst (v_char_p), unconst (v_wchar_t_p), unconst (v_void_p));
+  /*
+  TODO: Figure out a good way to test negative test-cases like below:
+
+  TS_PRINTF (
+      "Due to type mismatch compilation stops here... %d\n"
+    , "Because this is not an int"
+    );
+
+  int v = 0;
+  int const * p = &v;
+  TS_PRINTF ("%n", p);  // p should be non-const *
+  */
+
+
+  }
+}
+
+int main()
+{
+#ifdef _MSC_VER
+  // to enable %n support in Visual C++
+  _set_printf_count_output (1);
+#endif
+
+  tests::test__printf_variants  ();
+  tests::test__scanner_literals ();
+  tests::test__scanner_any_of   ();
+  tests::test__scanner          ();
+  tests::test__engine           ();
+  tests::test__dynamic          ();
+  tests::test__bound            ();
+  tests::test__constexpr        ();
+  tests::test__escape           ();
+  tests::test__hexdump          ();
+  tests::test__timestamp        ();
+  tests::test__utf8             ();
+  tests::test__scan             ();
+  tests::test__batch            ();
+  tests::test__writev           ();
+  tests::test__csv              ();
+  tests::test__brace            ();
+  tests::test__arena            ();
+  tests::test__rt               ();
+  tests::test__structured       ();
+  tests::test__metrics          ();
+  tests::test__recorder         ();
+#ifndef _WIN32
+  tests::test__shm              ();
+#endif
+  tests::test__binlog           ();
 
   if (tests::errors == 0)
   {
@@ -0,0 +1,3 @@
+clang++ -g -O3 -Wall -ftemplate-depth=1024 --std=c++14 -x c++-header ../tsprintf/tsprintf_pch.hpp -o tsprintf_pch.hpp.pch
+clang++ -g -O3 -Wall -ftemplate-depth=1024 --std=c++14 -include-pch tsprintf_pch.hpp.pch tslog.cpp -o exe.tslog.clang++
+clang++ -g -O3 -Wall -ftemplate-depth=1024 --std=c++14 -include-pch tsprintf_pch.hpp.pch tslogd.cpp -o exe.tslogd.clang++
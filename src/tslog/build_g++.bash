@@ -0,0 +1,3 @@
+g++ -g -O3 -Wall --std=c++14 -x c++-header ../tsprintf/tsprintf_pch.hpp -o tsprintf_pch.hpp.gch
+g++ -g -O3 -Wall --std=c++14 -I../tsprintf -include tsprintf_pch.hpp tslog.cpp -o exe.tslog.g++
+g++ -g -O3 -Wall --std=c++14 -I../tsprintf -include tsprintf_pch.hpp tslogd.cpp -o exe.tslogd.g++
@@ -0,0 +1,366 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+// tslog - offline decoder and indexer for binary logs written with TS_BINLOG
+//
+//  tslog render  <log>                   Renders all records as text
+//  tslog formats <log>                   Lists the format ids and format strings
+//  tslog index   <log>                   Builds <log>.idx from the block headers
+//  tslog grep    <log> <#id|text>        Renders the records of a format id or of the
+//                                        formats containing text, uses <log>.idx when present
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../tsprintf/tsprintf.hpp"
+#include "../tsprintf/tsprintf_binlog.hpp"
+
+namespace
+{
+  using namespace typesafe_printf;
+
+  using file_ptr = std::unique_ptr<std::FILE, int (*) (std::FILE *)>;
+
+  file_ptr open_file (char const * path, char const * mode)
+  {
+    return file_ptr (std::fopen (path, mode), &std::fclose);
+  }
+
+  std::string index_path (char const * log_path)
+  {
+    return std::string (log_path) + ".idx";
+  }
+
+  // Keeps a format on one line when listing it
+  std::string escape (std::string const & s)
+  {
+    std::string result;
+    for (auto ch : s)
+    {
+      switch (ch)
+      {
+      case '\n': result += "\\n"; break;
+      case '\r': result += "\\r"; break;
+      case '\t': result += "\\t"; break;
+      default  : result += ch   ; break;
+      }
+    }
+    return result;
+  }
+
+  void format_timestamp (char (&buffer) [40], binlog::timestamp_t timestamp)
+  {
+    auto seconds  = static_cast<std::time_t> (timestamp / 1000000000U);
+    auto nanos    = static_cast<unsigned int> (timestamp % 1000000000U);
+
+    std::tm tm {};
+#ifdef _MSC_VER
+    gmtime_s (&tm, &seconds);
+#else
+    gmtime_r (&seconds, &tm);
+#endif
+
+    auto size = std::strftime (buffer, sizeof (buffer), "%Y-%m-%dT%H:%M:%S", &tm);
+    TS_SNPRINTF (buffer + size, sizeof (buffer) - size, ".%09uZ", nanos);
+  }
+
+  class record_printer
+  {
+  public:
+    explicit record_printer (binlog::reader & r)
+      : r       (r)
+      , text    (4096)
+    {
+    }
+
+    bool print (binlog::record const & rec)
+    {
+      auto size = r.render (rec, text.data (), text.size ());
+      if (size < 0)
+      {
+        TS_FPRINTF (stderr, "tslog: record at offset %llu doesn't match format id %u\n", static_cast<unsigned long long> (rec.offset), rec.id);
+        return false;
+      }
+
+      if (static_cast<std::size_t> (size) >= text.size ())
+      {
+        text.resize (static_cast<std::size_t> (size) + 1);
+        r.render (rec, text.data (), text.size ());
+      }
+
+      char timestamp[40];
+      format_timestamp (timestamp, rec.timestamp);
+
+      auto newline = size > 0 && text[size - 1] == '\n' ? "" : "\n";
+      TS_PRINTF ("%s %s%s", timestamp, text.data (), newline);
+
+      return true;
+    }
+
+  private:
+    binlog::reader &    r     ;
+    std::vector<char>   text  ;
+  };
+
+  int render (char const * log_path)
+  {
+    auto log = open_file (log_path, "rb");
+    if (!log)
+    {
+      TS_FPRINTF (stderr, "tslog: failed to open %s\n", log_path);
+      return 1;
+    }
+
+    binlog::reader  r (log.get ());
+    record_printer  printer (r);
+    binlog::record  rec;
+
+    while (r.next (rec))
+    {
+      printer.print (rec);
+    }
+
+    if (!r.is_valid ())
+    {
+      TS_FPRINTF (stderr, "tslog: %s is not a valid binary log (or is truncated)\n", log_path);
+      return 1;
+    }
+
+    return 0;
+  }
+
+  int formats (char const * log_path)
+  {
+    auto log = open_file (log_path, "rb");
+    if (!log)
+    {
+      TS_FPRINTF (stderr, "tslog: failed to open %s\n", log_path);
+      return 1;
+    }
+
+    binlog::reader  r (log.get ());
+    binlog::record  rec;
+    std::vector<unsigned long long> counts;
+
+    while (r.next (rec))
+    {
+      if (rec.id >= counts.size ())
+      {
+        counts.resize (rec.id + 1);
+      }
+      ++counts[rec.id];
+    }
+
+    auto & definitions = r.formats ();
+    for (auto iter = 0U; iter < definitions.size (); ++iter)
+    {
+      if (definitions[iter].is_defined)
+      {
+        auto count = iter < counts.size () ? counts[iter] : 0ULL;
+        TS_PRINTF ("#%u\t%llu\t%s\n", iter, count, escape (definitions[iter].format).c_str ());
+      }
+    }
+
+    return r.is_valid () ? 0 : 1;
+  }
+
+  int index (char const * log_path)
+  {
+    auto log = open_file (log_path, "rb");
+    if (!log)
+    {
+      TS_FPRINTF (stderr, "tslog: failed to open %s\n", log_path);
+      return 1;
+    }
+
+    binlog::reader  r (log.get ());
+    binlog::block_index idx;
+
+    if (!binlog::build_index (r, idx))
+    {
+      TS_FPRINTF (stderr, "tslog: %s is not a valid binary log (or is truncated)\n", log_path);
+      return 1;
+    }
+
+    auto path = index_path (log_path);
+    auto out  = open_file (path.c_str (), "wb");
+    if (!out || !binlog::save_index (out.get (), r, idx))
+    {
+      TS_FPRINTF (stderr, "tslog: failed to write %s\n", path.c_str ());
+      return 1;
+    }
+
+    TS_FPRINTF (stderr, "tslog: indexed %u blocks into %s\n", static_cast<unsigned int> (idx.blocks.size ()), path.c_str ());
+
+    return 0;
+  }
+
+  std::vector<bool> match_formats (binlog::reader const & r, char const * pattern)
+  {
+    auto & definitions = r.formats ();
+    std::vector<bool> result (definitions.size (), false);
+
+    if (pattern[0] == '#')
+    {
+      auto id = static_cast<binlog::format_id> (std::strtoul (pattern + 1, nullptr, 10));
+      if (id >= result.size ())
+      {
+        result.resize (id + 1, false);
+      }
+      result[id] = true;
+    }
+    else
+    {
+      for (auto iter = 0U; iter < definitions.size (); ++iter)
+      {
+        result[iter] = definitions[iter].is_defined && definitions[iter].format.find (pattern) != std::string::npos;
+      }
+    }
+
+    return result;
+  }
+
+  bool is_match (std::vector<bool> const & matches, binlog::format_id id)
+  {
+    return id < matches.size () && matches[id];
+  }
+
+  int grep (char const * log_path, char const * pattern)
+  {
+    auto log = open_file (log_path, "rb");
+    if (!log)
+    {
+      TS_FPRINTF (stderr, "tslog: failed to open %s\n", log_path);
+      return 1;
+    }
+
+    binlog::reader  r (log.get ());
+    record_printer  printer (r);
+    binlog::record  rec;
+    binlog::block_index idx;
+
+    auto path   = index_path (log_path);
+    auto in     = open_file (path.c_str (), "rb");
+
+    if (!in || !binlog::load_index (in.get (), r, idx))
+    {
+      // No index, scan everything
+      TS_FPRINTF (stderr, "tslog: no usable index %s, scanning the whole log\n", path.c_str ());
+
+      std::vector<bool> matches ;
+      std::size_t       known   = 0;
+      while (r.next (rec))
+      {
+        // Format definitions are picked up while reading
+        if (known != r.formats ().size ())
+        {
+          known   = r.formats ().size ();
+          matches = match_formats (r, pattern);
+        }
+
+        if (is_match (matches, rec.id))
+        {
+          printer.print (rec);
+        }
+      }
+
+      return r.is_valid () ? 0 : 1;
+    }
+
+    auto matches  = match_formats (r, pattern);
+    auto scanned  = 0U;
+
+    for (auto && block : idx.blocks)
+    {
+      auto any = std::any_of (block.format_ids.begin (), block.format_ids.end (), [&] (binlog::format_id id) { return is_match (matches, id); });
+      if (!any)
+      {
+        continue;
+      }
+
+      ++scanned;
+
+      if (!r.seek (block.offset) || !r.read_block ())
+      {
+        TS_FPRINTF (stderr, "tslog: failed to read the block at offset %llu in %s\n", static_cast<unsigned long long> (block.offset), log_path);
+        return 1;
+      }
+
+      while (r.next_in_block (rec))
+      {
+        if (is_match (matches, rec.id))
+        {
+          printer.print (rec);
+        }
+      }
+    }
+
+    TS_FPRINTF (stderr, "tslog: scanned %u of %u blocks\n", scanned, static_cast<unsigned int> (idx.blocks.size ()));
+
+    return r.is_valid () ? 0 : 1;
+  }
+
+  int usage ()
+  {
+    TS_FPRINTF (
+        stderr
+      , "Usage:\n"
+        "  tslog render  <log>                   Renders all records as text\n"
+        "  tslog formats <log>                   Lists the format ids and format strings\n"
+        "  tslog index   <log>                   Builds <log>.idx from the block headers\n"
+        "  tslog grep    <log> <#id|text>        Renders the records of a format id or of the\n"
+        "                                        formats containing text\n"
+      );
+    return 2;
+  }
+}
+
+int main (int argc, char const * argv[])
+{
+  if (argc < 3)
+  {
+    return usage ();
+  }
+
+  auto command  = argv[1];
+  auto log_path = argv[2];
+
+  if (std::strcmp (command, "render") == 0 && argc == 3)
+  {
+    return render (log_path);
+  }
+  else if (std::strcmp (command, "formats") == 0 && argc == 3)
+  {
+    return formats (log_path);
+  }
+  else if (std::strcmp (command, "index") == 0 && argc == 3)
+  {
+    return index (log_path);
+  }
+  else if (std::strcmp (command, "grep") == 0 && argc == 4)
+  {
+    return grep (log_path, argv[3]);
+  }
+  else
+  {
+    return usage ();
+  }
+}
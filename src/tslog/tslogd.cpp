@@ -0,0 +1,264 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+// tslogd - consumer for the shared memory log ring written with TS_SHM_LOG
+//
+//  tslogd <name> <log>                   Writes the records to a binary log (render it
+//                                        with tslog)
+//  tslogd <name> <log> --text            Renders the records as text
+//
+// Creates the ring <name> (like /myapp-log), or continues with the ring of an
+//  earlier tslogd, and runs until SIGINT or SIGTERM, then writes what is left
+//  in the ring. The ring stays so the producers keep logging into it until
+//  tslogd is started again.
+
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../tsprintf/tsprintf.hpp"
+#include "../tsprintf/tsprintf_binlog.hpp"
+#include "../tsprintf/tsprintf_shm.hpp"
+
+namespace
+{
+  using namespace typesafe_printf;
+
+  using file_ptr = std::unique_ptr<std::FILE, int (*) (std::FILE *)>;
+
+  volatile std::sig_atomic_t stop_requested = 0;
+
+  extern "C" void request_stop (int)
+  {
+    stop_requested = 1;
+  }
+
+  void format_timestamp (char (&buffer) [40], binlog::timestamp_t timestamp)
+  {
+    auto seconds  = static_cast<std::time_t> (timestamp / 1000000000U);
+    auto nanos    = static_cast<unsigned int> (timestamp % 1000000000U);
+
+    std::tm tm {};
+    gmtime_r (&seconds, &tm);
+
+    auto size = std::strftime (buffer, sizeof (buffer), "%Y-%m-%dT%H:%M:%S", &tm);
+    TS_SNPRINTF (buffer + size, sizeof (buffer) - size, ".%09uZ", nanos);
+  }
+
+  // Maps the format ids of the ring to format ids registered in this process
+  class format_map
+  {
+  public:
+    explicit format_map (shm::consumer const & c)
+      : c (c)
+    {
+    }
+
+    struct entry
+    {
+      bool                      is_known      ;
+      binlog::format_id         id            ;
+      char const *              format        ;
+      details::encoded_types_t  encoded_types ;
+    };
+
+    entry const * find (std::uint32_t shared_id)
+    {
+      if (shared_id < entries.size () && entries[shared_id].is_known)
+      {
+        return &entries[shared_id];
+      }
+
+      // format checks the id against the size of the shared table, the id of
+      //  a garbage record must not size entries
+      std::string               format        ;
+      details::encoded_types_t  encoded_types = 0U;
+      if (!c.format (shared_id, format, encoded_types))
+      {
+        return nullptr;
+      }
+
+      if (shared_id >= entries.size ())
+      {
+        entries.resize (shared_id + 1, entry { false, 0U, nullptr, 0U });
+      }
+
+      // register_format keeps the pointer, the deque doesn't move its strings
+      formats.push_back (std::move (format));
+
+      auto & e          = entries[shared_id];
+      e.format          = formats.back ().c_str ();
+      e.encoded_types   = encoded_types;
+      e.id              = binlog::register_format (e.format, e.encoded_types);
+      e.is_known        = true;
+
+      return &e;
+    }
+
+  private:
+    shm::consumer const &   c       ;
+    std::vector<entry>      entries ;
+    std::deque<std::string> formats ;
+  };
+
+  int serve (char const * name, char const * log_path, bool text)
+  {
+    auto log = file_ptr (std::fopen (log_path, text ? "w" : "wb"), &std::fclose);
+    if (!log)
+    {
+      TS_FPRINTF (stderr, "tslogd: failed to open %s\n", log_path);
+      return 1;
+    }
+
+    shm::consumer c (name);
+    if (!c.is_valid ())
+    {
+      TS_FPRINTF (stderr, "tslogd: failed to create the shared memory %s\n", name);
+      return 1;
+    }
+
+#ifdef TYPESAFE_PRINTF__BINLOG_LZ4
+    auto flags = static_cast<std::uint8_t> (binlog::bf__compact | binlog::bf__intern | binlog::bf__lz4);
+#else
+    auto flags = static_cast<std::uint8_t> (binlog::bf__compact | binlog::bf__intern);
+#endif
+
+    std::unique_ptr<binlog::writer> writer (text ? nullptr : new binlog::writer (log.get (), flags));
+
+    std::signal (SIGINT , &request_stop);
+    std::signal (SIGTERM, &request_stop);
+
+    format_map          formats (c);
+    shm::record         rec;
+    std::vector<char>   rendered (4096);
+    std::wstring        wide[details::max_encoded_types];
+    details::arg        args[details::max_encoded_types];
+    auto                pending   = false;
+    auto                invalid   = 0ULL;
+
+    for (;;)
+    {
+      auto stopping = stop_requested != 0;
+
+      auto received = false;
+      while (c.next (rec))
+      {
+        received = true;
+
+        details::size_type arg_count = 0;
+
+        auto e = formats.find (rec.format_id);
+        if (!e || !details::get_binlog_args (e->encoded_types, rec.payload.data (), rec.payload.size (), args, arg_count, wide))
+        {
+          ++invalid;
+          continue;
+        }
+
+        if (writer)
+        {
+          writer->write_record (e->id, rec.timestamp, args, arg_count);
+          continue;
+        }
+
+        auto size = details::render (rendered.data (), rendered.size (), e->format, args, arg_count);
+        if (size < 0)
+        {
+          ++invalid;
+          continue;
+        }
+
+        if (static_cast<std::size_t> (size) >= rendered.size ())
+        {
+          rendered.resize (static_cast<std::size_t> (size) + 1);
+          details::render (rendered.data (), rendered.size (), e->format, args, arg_count);
+        }
+
+        char timestamp[40];
+        format_timestamp (timestamp, rec.timestamp);
+
+        auto newline = size > 0 && rendered[size - 1] == '\n' ? "" : "\n";
+        TS_FPRINTF (log.get (), "%s [%u] %s%s", timestamp, rec.pid, rendered.data (), newline);
+      }
+
+      pending = pending || received;
+
+      // Writes out what has arrived when the producers go quiet
+      if (!received && pending)
+      {
+        if (writer)
+        {
+          writer->flush ();
+        }
+        std::fflush (log.get ());
+        pending = false;
+      }
+
+      if (stopping)
+      {
+        break;
+      }
+
+      if (!received)
+      {
+        std::this_thread::sleep_for (std::chrono::milliseconds (1));
+      }
+    }
+
+    writer.reset ();
+
+    TS_FPRINTF (
+        stderr
+      , "tslogd: stopped, %llu records dropped by producers, %llu invalid records\n"
+      , static_cast<unsigned long long> (c.dropped ())
+      , invalid
+      );
+
+    return 0;
+  }
+
+  int usage ()
+  {
+    TS_FPRINTF (
+        stderr
+      , "Usage:\n"
+        "  tslogd <name> <log>                   Writes the records to a binary log\n"
+        "  tslogd <name> <log> --text            Renders the records as text\n"
+      );
+    return 2;
+  }
+}
+
+int main (int argc, char const * argv[])
+{
+  if (argc == 3)
+  {
+    return serve (argv[1], argv[2], false);
+  }
+  else if (argc == 4 && std::strcmp (argv[3], "--text") == 0)
+  {
+    return serve (argv[1], argv[2], true);
+  }
+  else
+  {
+    return usage ();
+  }
+}
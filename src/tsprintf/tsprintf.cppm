@@ -0,0 +1,38 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+// The tsprintf module (C++20), import it and include tsprintf_macros.hpp
+//  for the macros:
+//
+//  import tsprintf;
+//  #include "tsprintf_macros.hpp"
+//
+//  TS_PRINTF ("Hello %s\n", name);
+
+module;
+
+#include <cassert>
+#include <cstdio>
+#include <cstdint>
+#include <cwchar>
+#include <type_traits>
+#include <utility>
+
+export module tsprintf;
+
+#define TYPESAFE_PRINTF__EXPORT export
+#include "tsprintf.hpp"
+
@@ -22,9 +22,18 @@
 #include <cstdint>
 #include <cwchar>
 #include <type_traits>
+#include <utility>
 
 #define TYPESAFE_PRINTF__ASSERT assert
 
+// Namespace scope constants have internal linkage unless they are inline,
+//  the module can't export functions that use internal linkage entities
+#ifdef __cpp_inline_variables
+# define TYPESAFE_PRINTF__CONSTANT inline constexpr
+#else
+# define TYPESAFE_PRINTF__CONSTANT constexpr
+#endif
+
 
 #define TYPESAFE_PRINTF__TYPE_MAP(key, value) \
   template<>                                  \
@@ -33,24 +42,14 @@
     using type = value;                       \
   }
 
-#define TS_PRINTF(format, ...)                                                                                    \
-  (void) typesafe_printf::details::check_types<typesafe_printf::details::scanner::encode (format)> (__VA_ARGS__); \
-  printf (format, ##__VA_ARGS__)
-
-// Uses snprintf internally, sprintf is more error-prone
-#define TS_FPRINTF(stream, format, ...)                                                                           \
-  (void) typesafe_printf::details::check_types<typesafe_printf::details::scanner::encode (format)> (__VA_ARGS__); \
-  fprintf (stream, format, ##__VA_ARGS__)
-
-#define TS_SPRINTF(buffer, format, ...)                                                                           \
-  (void) typesafe_printf::details::check_types<typesafe_printf::details::scanner::encode (format)> (__VA_ARGS__); \
-  snprintf (buffer, std::extent<decltype(buffer)>::value, format, ##__VA_ARGS__)
+#include "tsprintf_macros.hpp"
 
-#define TS_SNPRINTF(buffer, buffer_size, format, ...)                                                             \
-  (void) typesafe_printf::details::check_types<typesafe_printf::details::scanner::encode (format)> (__VA_ARGS__); \
-  snprintf (buffer, buffer_size, format, ##__VA_ARGS__)
+// Defined as export by tsprintf.cppm
+#ifndef TYPESAFE_PRINTF__EXPORT
+# define TYPESAFE_PRINTF__EXPORT
+#endif
 
-namespace typesafe_printf
+TYPESAFE_PRINTF__EXPORT namespace typesafe_printf
 {
   namespace details
   {
@@ -98,10 +97,10 @@ namespace typesafe_printf
       tid__wint_t                 = 0x1F  ,
     };
 
-    constexpr encoded_types_t type_id__mask = 0x1F;
-    constexpr size_type       type_id__bits = 5   ;
+    TYPESAFE_PRINTF__CONSTANT encoded_types_t type_id__mask = 0x1F;
+    TYPESAFE_PRINTF__CONSTANT size_type       type_id__bits = 5   ;
 
-    constexpr size_type max_encoded_types   = (sizeof(encoded_types_t) * 8) / type_id__bits;
+    TYPESAFE_PRINTF__CONSTANT size_type max_encoded_types   = (sizeof(encoded_types_t) * 8) / type_id__bits;
 
     template<int n>
     struct matching_int;
@@ -188,14 +187,18 @@ namespace typesafe_printf
     template<encoded_types_t encoded_types>
     using type_id_map_t = typename type_id_map<encoded_types>::type;
 
+    // The size TS_SPRINTF passes to snprintf
+    template<typename TBuffer>
+    using buffer_extent = std::extent<TBuffer>;
+
     namespace scanner
     {
       // union of conversion specifier and argument type chars
-      constexpr char const union_of_cs_at[]         = "AEFGLXacdefghijlnopstuxz";
+      TYPESAFE_PRINTF__CONSTANT char const union_of_cs_at[]         = "AEFGLXacdefghijlnopstuxz";
 
-      constexpr char const union_of_signed_ints[]   = "di"                      ;
-      constexpr char const union_of_unsigned_ints[] = "Xoux"                    ;
-      constexpr char const union_of_floats[]        = "AEFGaefg"                ;
+      TYPESAFE_PRINTF__CONSTANT char const union_of_signed_ints[]   = "di"                      ;
+      TYPESAFE_PRINTF__CONSTANT char const union_of_unsigned_ints[] = "Xoux"                    ;
+      TYPESAFE_PRINTF__CONSTANT char const union_of_floats[]        = "AEFGaefg"                ;
 
       enum conversion_specifier : size_type
       {
@@ -210,7 +213,7 @@ namespace typesafe_printf
         cs__invalid           = 0x7FF   ,
       };
 
-      constexpr size_type conversion_specifier__count = 7;
+      TYPESAFE_PRINTF__CONSTANT size_type conversion_specifier__count = 7;
 
       enum argument_type : size_type
       {
@@ -226,10 +229,10 @@ namespace typesafe_printf
         at__invalid           = 0x7FF   ,
       };
 
-      constexpr size_type argument_type__count = 9;
+      TYPESAFE_PRINTF__CONSTANT size_type argument_type__count = 9;
 
       // Table from: http://en.cppreference.com/w/cpp/io/c/fprintf
-      constexpr type_id const type_ids[conversion_specifier__count][argument_type__count] =
+      TYPESAFE_PRINTF__CONSTANT type_id const type_ids[conversion_specifier__count][argument_type__count] =
       {
 //                    hh                    h                     (none)              l                     ll                        j                 z                       t                         L
 /*c               */{ tid__error_type     , tid__error_type     , tid__int          , tid__wint_t         , tid__error_type         , tid__error_type , tid__error_type       , tid__error_type         , tid__error_type   },
@@ -287,6 +290,49 @@ namespace typesafe_printf
           ;
       }
 
+      // %Hp (hexdump) takes a std::size_t length after the pointer, i is
+      //  the position of the conversion specifier
+      template<size_type N>
+      constexpr bool has_hexdump_flag (char const (&arr) [N], index_type i) noexcept
+      {
+        return i > 0 && i <= N && arr[i - 1] != '%'
+          ? (arr[i - 1] == 'H' ? true : has_hexdump_flag (arr, i - 1))
+          : false
+          ;
+      }
+
+      // %Js, %Qs, %Hp and %Tllu are rendered by the engine, printf would
+      //  print them as text and misread the arguments after them
+      template<size_type N>
+      constexpr bool has_engine_extension (char const (&arr) [N]) noexcept
+      {
+        index_type pos = 0U;
+        while (pos < N && arr[pos] != '\0')
+        {
+          if (arr[pos++] != '%')
+          {
+            continue;
+          }
+
+          if (pos < N && arr[pos] == '%')
+          {
+            ++pos;
+            continue;
+          }
+
+          while (pos < N && arr[pos] != '\0' && !binary_any_of (arr[pos], union_of_cs_at))
+          {
+            auto ch = arr[pos++];
+            if (ch == 'J' || ch == 'Q' || ch == 'H' || ch == 'T')
+            {
+              return true;
+            }
+          }
+        }
+
+        return false;
+      }
+
       // For the parser in general I have opted for as "simple" code as possible
       //  (simple to parse and execute) in the hope that it will impair the
       //  compilation times the least.
@@ -427,10 +473,13 @@ namespace typesafe_printf
         }
       }
 
+      // A * width or precision takes an int argument before the value
       template<size_type N>
       constexpr bool consume_options (
           char const (&arr) [N]
         , index_type & pos
+        , encoded_types_t & encoded_types
+        , size_type & count
         ) noexcept
       {
         while (pos < N && arr[pos] != '\0')
@@ -439,6 +488,10 @@ namespace typesafe_printf
           {
             return true;
           }
+          else if (arr[pos] == '*')
+          {
+            encoded_types = merge_type (encoded_types, count++, tid__int);
+          }
           ++pos;
         }
 
@@ -475,7 +528,7 @@ namespace typesafe_printf
             continue;
           }
 
-          if (!consume_options (arr, pos))
+          if (!consume_options (arr, pos, encoded_types, count))
           {
             // consume options failed
             continue;
@@ -500,6 +553,11 @@ namespace typesafe_printf
           auto type_id = get_type_id (at, cs);
 
           encoded_types = merge_type (encoded_types, count++, type_id);
+
+          if (type_id == tid__void_p && has_hexdump_flag (arr, pos - 1))
+          {
+            encoded_types = merge_type (encoded_types, count++, tid__size_t);
+          }
         }
 
         return encoded_types;
@@ -534,7 +592,10 @@ namespace typesafe_printf
         , index_type i
         ) noexcept
       {
-        return scan (merge_type (ec, count, get_type_id (at, cs)), count + 1, arr, i);
+        return get_type_id (at, cs) == tid__void_p && has_hexdump_flag (arr, i - 1)
+          ? scan (merge_type (merge_type (ec, count, tid__void_p), count + 1, tid__size_t), count + 2, arr, i)
+          : scan (merge_type (ec, count, get_type_id (at, cs)), count + 1, arr, i)
+          ;
       }
 
       template<size_type N>
@@ -623,10 +684,13 @@ namespace typesafe_printf
         , index_type i
         ) noexcept
       {
+        // A * width or precision takes an int argument before the value
         return i < N && arr[i] != 0
-          ? (!binary_any_of (arr[i], union_of_cs_at)
-            ? consume_options (ec, count, arr, i + 1)
-            : parse_argument_type (ec, count, arr, i))
+          ? (arr[i] == '*'
+            ? consume_options (merge_type (ec, count, tid__int), count + 1, arr, i + 1)
+            : (!binary_any_of (arr[i], union_of_cs_at)
+              ? consume_options (ec, count, arr, i + 1)
+              : parse_argument_type (ec, count, arr, i)))
           : error_detected (ec, count, arr, i)
           ;
       }
@@ -708,7 +772,7 @@ namespace typesafe_printf
         , "Malformed format string"
         );
       static_assert (
-          std::is_pod<TArg>::value
+          std::is_trivial<TArg>::value && std::is_standard_layout<TArg>::value
         , "Argument must be a POD type (see argument list)"
         );
       static_assert (
@@ -719,30 +783,37 @@ namespace typesafe_printf
       using type = TExpected;
     };
 
-    template<bool HasMoreEncodedTypes, size_type Pos, encoded_types_t EncodedTypes, typename ...TArgs>
-    struct type_checker;
-
-    template<size_type Pos, typename ...TArgs>
-    struct type_checker<false, Pos, 0U, TArgs...>
+    constexpr size_type encoded_count (encoded_types_t encoded_types) noexcept
     {
-      static_assert (
-          0U == sizeof... (TArgs)
-        , "Too many arguments passed to ts_printf (see format string)"
-        );
+      return encoded_types != 0U
+        ? 1U + encoded_count (encoded_types >> type_id__bits)
+        : 0U
+        ;
+    }
 
-      enum
-      {
-        zero = 0,
-      };
+    template<typename ...TTypes>
+    struct type_list
+    {
     };
 
-    template<size_type Pos, encoded_types_t EncodedTypes>
-    struct type_checker<true, Pos, EncodedTypes>
+    // All arguments are checked side by side instead of one per inheritance
+    //  level. Call sites with the same signature share the checker and the
+    //  error_reporter of an argument is shared by all signatures that have
+    //  the same type at the same position
+    template<bool IsCountMatching, encoded_types_t EncodedTypes, typename TIndices, typename ...TArgs>
+    struct type_checker;
+
+    template<encoded_types_t EncodedTypes, typename TIndices, typename ...TArgs>
+    struct type_checker<false, EncodedTypes, TIndices, TArgs...>
     {
       static_assert (
-          0U == EncodedTypes
+          encoded_count (EncodedTypes) <= sizeof... (TArgs)
         , "Too few arguments passed to ts_printf (see format string)"
         );
+      static_assert (
+          encoded_count (EncodedTypes) >= sizeof... (TArgs)
+        , "Too many arguments passed to ts_printf (see format string)"
+        );
 
       enum
       {
@@ -750,24 +821,25 @@ namespace typesafe_printf
       };
     };
 
-    template<size_type Pos, encoded_types_t EncodedTypes, typename THead, typename ...TTail>
-    struct type_checker<true, Pos, EncodedTypes, THead, TTail...>
-      : type_checker<(EncodedTypes >> type_id__bits) != 0, Pos + 1, (EncodedTypes >> type_id__bits), TTail...>
+    template<encoded_types_t EncodedTypes, std::size_t ...Indices, typename ...TArgs>
+    struct type_checker<true, EncodedTypes, std::index_sequence<Indices...>, TArgs...>
     {
-      enum : encoded_types_t
-      {
-        encoded_type  = EncodedTypes & type_id__mask ,
-      };
-
       // using arg_type = std::decay_t<THead>;
       // std::decay_t doesn't exist in GCC 4.8.1, use std::decay instead
-      using arg_type = typename std::decay<THead>::type;
-      using exp_type = type_id_map_t<encoded_type>;
+      using type = type_list<
+          typename error_reporter<
+              Indices
+            , typename std::decay<TArgs>::type
+            , type_id_map_t<(EncodedTypes >> (Indices * type_id__bits)) & type_id__mask>
+            >::type...
+        >;
 
-      using type    = typename error_reporter<Pos, arg_type, exp_type>::type;
+      enum
+      {
+        zero = 0,
+      };
     };
 
-
     template<encoded_types_t EncodedTypes, typename ...TArgs>
     constexpr int check_types (TArgs && ...args) noexcept
     {
@@ -775,7 +847,12 @@ namespace typesafe_printf
           sizeof... (TArgs) <= details::max_encoded_types
         , "Too many arguments passed to ts_printf (max_encoded_types is the upper limit)"
         );
-      return type_checker<EncodedTypes != 0, 0U, EncodedTypes, TArgs...>::zero;
+      return type_checker<
+          encoded_count (EncodedTypes) == sizeof... (TArgs)
+        , EncodedTypes
+        , std::index_sequence_for<TArgs...>
+        , TArgs...
+        >::zero;
     }
   }
 
@@ -0,0 +1,376 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+#ifndef TYPESAFE_PRINTF__TSPRINTF_ARENA_HPP
+#define TYPESAFE_PRINTF__TSPRINTF_ARENA_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+# include <string_view>
+#endif
+
+#include "tsprintf.hpp"
+#include "tsprintf_engine.hpp"
+
+// An arena_builder formats into a bump-pointer arena instead of allocating
+//  a std::string per call. The strings live until the arena is reset or
+//  destroyed, typically one arena per request
+//
+//  typesafe_printf::arena          a (4096);
+//  typesafe_printf::arena_builder  b (a);
+//
+//  auto key = TS_ARENA_FORMAT (b, "%s:%d", host, port);
+//
+//  TS_ARENA_APPEND (b, "GET %s HTTP/1.1\r\n", path);
+//  for (auto & h : headers)
+//  {
+//    TS_ARENA_APPEND (b, "%s: %s\r\n", h.name, h.value);
+//  }
+//  auto request = b.finish ();
+//
+// The strings are '\0' terminated. Only one builder at a time can build a
+//  string in an arena and the arena can't be used for anything else until
+//  the string is finished
+
+// Returns the string, an empty string if the format fails
+#define TS_ARENA_FORMAT(builder, format, ...)                                                                       \
+  ( (void) typesafe_printf::details::check_types<typesafe_printf::details::scanner::encode (format)> (__VA_ARGS__)  \
+  , (void) TYPESAFE_PRINTF__CHECK_EXTENSIONS (format)                                                               \
+  , (builder).build<typesafe_printf::details::scanner::encode (format)> (format, ##__VA_ARGS__)                   \
+  )
+
+// Returns the number of chars appended or -1
+#define TS_ARENA_APPEND(builder, format, ...)                                                                       \
+  ( (void) typesafe_printf::details::check_types<typesafe_printf::details::scanner::encode (format)> (__VA_ARGS__)  \
+  , (void) TYPESAFE_PRINTF__CHECK_EXTENSIONS (format)                                                               \
+  , (builder).append<typesafe_printf::details::scanner::encode (format)> (format, ##__VA_ARGS__)                   \
+  )
+
+namespace typesafe_printf
+{
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+  using string_view = std::string_view;
+#else
+  // The part of std::string_view the arena needs before C++17
+  class string_view
+  {
+  public:
+    constexpr string_view () noexcept
+      : text    ("")
+      , length  (0U)
+    {
+    }
+
+    constexpr string_view (char const * text, std::size_t length) noexcept
+      : text    (text)
+      , length  (length)
+    {
+    }
+
+    constexpr char const * data () const noexcept
+    {
+      return text;
+    }
+
+    constexpr std::size_t size () const noexcept
+    {
+      return length;
+    }
+
+    constexpr bool empty () const noexcept
+    {
+      return length == 0U;
+    }
+
+    constexpr char const * begin () const noexcept
+    {
+      return text;
+    }
+
+    constexpr char const * end () const noexcept
+    {
+      return text + length;
+    }
+
+    constexpr char operator[] (std::size_t index) const noexcept
+    {
+      return text[index];
+    }
+
+  private:
+    char const *  text    ;
+    std::size_t   length  ;
+  };
+#endif
+
+  class arena
+  {
+  public:
+    // Blocks start at block_size and double up to max_block_size, larger
+    //  requests get a block of their own size
+    explicit arena (std::size_t block_size = 4096U) noexcept
+      : blocks      (nullptr)
+      , current     (nullptr)
+      , end         (nullptr)
+      , block_size  (block_size > 0U ? block_size : 1U)
+      , allocated   (0U)
+    {
+    }
+
+    // The first block is supplied by the caller (like a buffer on the stack),
+    //  the arena only allocates once it's used up
+    arena (char * buffer, std::size_t size, std::size_t block_size = 4096U) noexcept
+      : arena (block_size)
+    {
+      current = buffer;
+      end     = buffer + size;
+    }
+
+    ~arena () noexcept
+    {
+      free_blocks (nullptr);
+    }
+
+    arena (arena const &)             = delete;
+    arena & operator= (arena const &) = delete;
+
+    // Not aligned, the arena is meant for chars
+    char * allocate (std::size_t size)
+    {
+      if (static_cast<std::size_t> (end - current) < size)
+      {
+        new_block (0U, size);
+      }
+
+      auto result = current;
+      current   += size;
+      allocated += size;
+      return result;
+    }
+
+    // Frees everything allocated from the arena but keeps the most recent
+    //  block for the next round so a reused arena stops calling malloc
+    void reset () noexcept
+    {
+      if (blocks)
+      {
+        auto keep = blocks;
+        free_blocks (keep);
+        keep->previous  = nullptr;
+        current         = keep->data ();
+        end             = keep->data () + keep->size;
+      }
+      else
+      {
+        // Only the caller's buffer
+        current -= allocated;
+      }
+      allocated = 0U;
+    }
+
+    // Chars allocated since the last reset
+    std::size_t size () const noexcept
+    {
+      return allocated;
+    }
+
+    // Space after the last allocation, used by arena_builder to render
+    //  without committing
+    char * tail () const noexcept
+    {
+      return current;
+    }
+
+    std::size_t tail_size () const noexcept
+    {
+      return static_cast<std::size_t> (end - current);
+    }
+
+    // Makes room for size more chars after the first keep chars of the tail,
+    //  moving them to a new block if needed. Returns the new tail
+    char * reserve (std::size_t keep, std::size_t size)
+    {
+      if (tail_size () - keep < size)
+      {
+        new_block (keep, keep + size);
+      }
+      return current;
+    }
+
+    void commit (std::size_t size) noexcept
+    {
+      TYPESAFE_PRINTF__ASSERT (size <= tail_size ());
+      current   += size;
+      allocated += size;
+    }
+
+  private:
+    struct block
+    {
+      block *       previous  ;
+      std::size_t   size      ;
+
+      char * data () noexcept
+      {
+        return reinterpret_cast<char *> (this + 1);
+      }
+    };
+
+    static constexpr std::size_t max_block_size = 1024U * 1024U;
+
+    void new_block (std::size_t keep, std::size_t size)
+    {
+      auto data_size  = size > block_size ? size : block_size;
+      auto b          = static_cast<block *> (std::malloc (sizeof (block) + data_size));
+      if (!b)
+      {
+        throw std::bad_alloc ();
+      }
+
+      b->previous = blocks;
+      b->size     = data_size;
+      if (keep > 0U)
+      {
+        std::memcpy (b->data (), current, keep);
+      }
+
+      blocks  = b;
+      current = b->data ();
+      end     = b->data () + data_size;
+
+      if (block_size < max_block_size)
+      {
+        block_size *= 2U;
+      }
+    }
+
+    void free_blocks (block * keep) noexcept
+    {
+      auto b = keep ? keep->previous : blocks;
+      while (b)
+      {
+        auto previous = b->previous;
+        std::free (b);
+        b = previous;
+      }
+
+      if (!keep)
+      {
+        blocks = nullptr;
+      }
+    }
+
+    block *       blocks      ;
+    char *        current     ;
+    char *        end         ;
+    std::size_t   block_size  ;
+    std::size_t   allocated   ;
+  };
+
+  class arena_builder
+  {
+  public:
+    explicit arena_builder (arena & a) noexcept
+      : a       (a)
+      , length  (0U)
+    {
+    }
+
+    arena_builder (arena_builder const &)             = delete;
+    arena_builder & operator= (arena_builder const &) = delete;
+
+    // Use TS_ARENA_APPEND, it checks the arguments
+    template<details::encoded_types_t EncodedTypes, typename ...TArgs>
+    int append (char const * format, TArgs && ...args)
+    {
+      std::array<details::arg, sizeof... (TArgs)> captured;
+      details::make_args<EncodedTypes> (captured, std::forward<TArgs> (args)...);
+      return append_render (format, captured.data (), static_cast<details::size_type> (captured.size ()));
+    }
+
+    void append (char const * text, std::size_t size)
+    {
+      auto tail = a.reserve (length, size + 1U);
+      std::memcpy (tail + length, text, size);
+      length += size;
+    }
+
+    void append (char ch)
+    {
+      append (&ch, 1U);
+    }
+
+    // The string built so far, valid until the next append
+    string_view view () const noexcept
+    {
+      return string_view (length > 0U ? a.tail () : "", length);
+    }
+
+    // Commits the string built so far to the arena and starts a new one
+    string_view finish ()
+    {
+      auto tail = a.reserve (length, 1U);
+      tail[length] = '\0';
+      a.commit (length + 1U);
+
+      string_view result (tail, length);
+      length = 0U;
+      return result;
+    }
+
+    // Use TS_ARENA_FORMAT, it checks the arguments
+    template<details::encoded_types_t EncodedTypes, typename ...TArgs>
+    string_view build (char const * format, TArgs && ...args)
+    {
+      if (append<EncodedTypes> (format, std::forward<TArgs> (args)...) < 0)
+      {
+        length = 0U;
+      }
+      return finish ();
+    }
+
+  private:
+    int append_render (char const * format, details::arg const * args, details::size_type arg_count)
+    {
+      auto tail = a.tail ();
+      auto room = a.tail_size () - length;
+      auto size = details::render (tail + length, room, format, args, arg_count);
+      if (size < 0)
+      {
+        return size;
+      }
+
+      if (static_cast<std::size_t> (size) >= room)
+      {
+        tail = a.reserve (length, static_cast<std::size_t> (size) + 1U);
+        details::render (tail + length, static_cast<std::size_t> (size) + 1U, format, args, arg_count);
+      }
+
+      length += static_cast<std::size_t> (size);
+      return size;
+    }
+
+    arena &       a       ;
+    std::size_t   length  ;
+  };
+}
+
+#endif // TYPESAFE_PRINTF__TSPRINTF_ARENA_HPP
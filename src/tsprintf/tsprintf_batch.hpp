@@ -0,0 +1,149 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+#ifndef TYPESAFE_PRINTF__TSPRINTF_BATCH_HPP
+#define TYPESAFE_PRINTF__TSPRINTF_BATCH_HPP
+
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+#include "tsprintf.hpp"
+#include "tsprintf_engine.hpp"
+
+// TS_FPRINTF_BATCH locks the stream once for a block of output, the
+//  TS_BATCH_PRINTF calls inside it render through the engine and write
+//  without taking the lock again. Other threads can't interleave with the
+//  block, the lock is released when the block is left (also by break,
+//  return or an exception)
+//
+//  TS_FPRINTF_BATCH (stdout)
+//  {
+//    TS_BATCH_PRINTF ("Report for %s\n", name);
+//    for (auto & row : rows)
+//    {
+//      TS_BATCH_PRINTF ("  %-20s %8d\n", row.name, row.count);
+//    }
+//  }
+
+#define TS_FPRINTF_BATCH(stream)                                                                                    \
+  for (typesafe_printf::stream_batch typesafe_printf__batch (stream); typesafe_printf__batch.first_pass (); )
+
+// Returns the number of chars written or -1
+#define TS_BATCH_PRINTF(format, ...)                                                                                \
+  ( (void) typesafe_printf::details::check_types<typesafe_printf::details::scanner::encode (format)> (__VA_ARGS__)  \
+  , (void) TYPESAFE_PRINTF__CHECK_EXTENSIONS (format)                                                               \
+  , typesafe_printf__batch.print<typesafe_printf::details::scanner::encode (format)> (format, ##__VA_ARGS__)       \
+  )
+
+namespace typesafe_printf
+{
+  namespace details
+  {
+    inline void lock_stream (std::FILE * stream) noexcept
+    {
+#ifdef _MSC_VER
+      _lock_file (stream);
+#else
+      flockfile (stream);
+#endif
+    }
+
+    inline void unlock_stream (std::FILE * stream) noexcept
+    {
+#ifdef _MSC_VER
+      _unlock_file (stream);
+#else
+      funlockfile (stream);
+#endif
+    }
+
+    // Requires the stream to be locked by the caller
+    inline std::size_t write_locked (std::FILE * stream, char const * text, std::size_t size) noexcept
+    {
+#if defined(_MSC_VER)
+      return _fwrite_nolock (text, 1, size, stream);
+#elif defined(__GLIBC__)
+      return fwrite_unlocked (text, 1, size, stream);
+#else
+      // The lock is recursive and already held so this doesn't wait
+      return std::fwrite (text, 1, size, stream);
+#endif
+    }
+  }
+
+  class stream_batch
+  {
+  public:
+    explicit stream_batch (std::FILE * stream) noexcept
+      : stream      (stream)
+      , is_first    (true)
+    {
+      details::lock_stream (stream);
+    }
+
+    ~stream_batch () noexcept
+    {
+      details::unlock_stream (stream);
+    }
+
+    stream_batch (stream_batch const &)             = delete;
+    stream_batch & operator= (stream_batch const &) = delete;
+
+    // TS_FPRINTF_BATCH runs its block once
+    bool first_pass () noexcept
+    {
+      auto result = is_first;
+      is_first    = false;
+      return result;
+    }
+
+    int write (char const * text, std::size_t size) noexcept
+    {
+      return details::write_locked (stream, text, size) == size ? static_cast<int> (size) : -1;
+    }
+
+    // Use TS_BATCH_PRINTF, it checks the arguments
+    template<details::encoded_types_t EncodedTypes, typename ...TArgs>
+    int print (char const * format, TArgs && ...args)
+    {
+      std::array<details::arg, sizeof... (TArgs)> captured;
+      details::make_args<EncodedTypes> (captured, std::forward<TArgs> (args)...);
+
+      char buffer[512];
+      auto size = details::render (buffer, sizeof (buffer), format, captured.data (), static_cast<details::size_type> (captured.size ()));
+      if (size < 0)
+      {
+        return size;
+      }
+
+      if (static_cast<std::size_t> (size) < sizeof (buffer))
+      {
+        return write (buffer, static_cast<std::size_t> (size));
+      }
+
+      std::vector<char> large (static_cast<std::size_t> (size) + 1);
+      details::render (large.data (), large.size (), format, captured.data (), static_cast<details::size_type> (captured.size ()));
+      return write (large.data (), static_cast<std::size_t> (size));
+    }
+
+  private:
+    std::FILE * stream    ;
+    bool        is_first  ;
+  };
+}
+
+#endif // TYPESAFE_PRINTF__TSPRINTF_BATCH_HPP
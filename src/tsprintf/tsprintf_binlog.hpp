@@ -0,0 +1,1493 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+#ifndef TYPESAFE_PRINTF__TSPRINTF_BINLOG_HPP
+#define TYPESAFE_PRINTF__TSPRINTF_BINLOG_HPP
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cwchar>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "tsprintf.hpp"
+#include "tsprintf_engine.hpp"
+
+#ifdef TYPESAFE_PRINTF__BINLOG_LZ4
+# include <lz4.h>
+#endif
+
+// Binary logs stores the format id, a timestamp and the raw argument values
+//  instead of the rendered text. Records are grouped in blocks that can be
+//  decoded on their own: the format string and its encoded types are
+//  written the first time a format id is used in a block and the delta
+//  state below starts over in every block. Each block header lists the
+//  format ids of the block so that queries can skip blocks.
+//
+//  Stream layout (all fixed size integers little endian):
+//    header            : "TSBL" u8:version u8:sizeof(long double) u16:0
+//    block             : u8:'B' u8:flags u16:0 u32:raw_size u32:stored_size u32:record_count
+//                        u64:first_timestamp u64:last_timestamp u32:format_count u32[format_count]
+//                        bytes[stored_size] (LZ4 compressed if flags has bf__lz4)
+//
+//  Block content:
+//    format definition : u8:'F' u32:format_id u64:encoded_types u32:size bytes[size]
+//    log record        : u8:'R' u32:format_id u64:timestamp u32:size payload[size]
+//    log record        : u8:'R' v:format_id z:timestamp v:size payload[size]         (bf__compact)
+//
+//  v is a LEB128 varint, z is a zigzag varint of the difference to the previous
+//  value in the block.
+//
+//  Argument payload by type class:
+//    signed/unsigned integers, double, void * : 8 bytes
+//    long double                              : 16 bytes, native representation
+//    char *                                   : u32:size bytes[size] '\0' (size 0xFFFFFFFF is nullptr)
+//    wchar_t *                                : u32:size u32[size]        (size 0xFFFFFFFF is nullptr)
+//    %n                                       : nothing, %n is ignored when rendered
+//
+//  Argument payload by type class (bf__compact):
+//    signed/unsigned integers                 : z, relative the same argument in the previous
+//                                               record with the same format id (per call site)
+//    double, long double                      : as above
+//    void *                                   : v
+//    char *                                   : v:size+1 bytes[size]      (size 0 is nullptr)
+//    wchar_t *                                : v:size+1 v[size]          (size 0 is nullptr)
+//    %n                                       : nothing
+//
+//  char * with bf__intern (only together with bf__compact):
+//    nullptr                                  : v:0
+//    string                                   : v:(size+1)*2 bytes[size]
+//    string seen before in the block          : v:index*2+1
+//  Strings up to 256 chars are added to the dictionary of the block in the
+//  order they appear, until it holds 4096 strings.
+//
+//  Counters and timestamps typically needs 1-2 bytes each with bf__compact.
+//
+//  Define TYPESAFE_PRINTF__BINLOG_LZ4 (and link with liblz4) to enable bf__lz4,
+//  without it blocks are stored uncompressed.
+#define TS_BINLOG(writer, format, ...)                                                                            \
+  (void) typesafe_printf::details::check_types<typesafe_printf::details::scanner::encode (format)> (__VA_ARGS__); \
+  (void) TYPESAFE_PRINTF__CHECK_EXTENSIONS (format);                                                              \
+  static_assert (                                                                                                 \
+      !typesafe_printf::details::has_extension (format, typesafe_printf::details::ext__hexdump)                   \
+    , "%Hp can't be used in binary logs, only the pointer would be stored"                                        \
+    );                                                                                                            \
+  (writer).log<typesafe_printf::details::scanner::encode (format)> (                                              \
+      TYPESAFE_PRINTF__BINLOG_FORMAT_ID (format)                                                                  \
+    , ##__VA_ARGS__                                                                                               \
+    )
+
+// Registers the format once per call site
+#define TYPESAFE_PRINTF__BINLOG_FORMAT_ID(format)                                                                 \
+  [] ()                                                                                                           \
+  {                                                                                                               \
+    static auto const id = typesafe_printf::binlog::register_format (                                             \
+        format                                                                                                    \
+      , typesafe_printf::details::scanner::encode (format)                                                        \
+      );                                                                                                          \
+    return id;                                                                                                    \
+  } ()
+
+namespace typesafe_printf
+{
+  namespace binlog
+  {
+    using format_id       = std::uint32_t;
+    using timestamp_t     = std::uint64_t;  // nanoseconds since the epoch
+    using offset_t        = std::uint64_t;
+
+    constexpr std::uint8_t  stream_version      = 3           ;
+    constexpr std::size_t   default_block_size  = 64U << 10   ;
+
+    enum block_flags : std::uint8_t
+    {
+      bf__none              = 0x0 ,
+      bf__compact           = 0x1 , // varint, zigzag and per call site delta encoding
+      bf__lz4               = 0x2 , // LZ4 compressed blocks
+      bf__intern            = 0x4 , // %s strings repeated in a block are references
+    };
+
+    struct format_definition
+    {
+      std::string                 format        ;
+      details::encoded_types_t    encoded_types ;
+      bool                        is_defined    ;
+      bool                        is_renderable ; // false for %Hp, the pointer doesn't point to anything any more
+    };
+
+    // A log record, the payload holds the raw arguments
+    struct record
+    {
+      format_id                   id            ;
+      timestamp_t                 timestamp     ;
+      offset_t                    offset        ;
+      std::vector<char>           payload       ;
+    };
+  }
+
+  namespace details
+  {
+    constexpr char const    binlog_magic[]      = "TSBL"      ;
+    constexpr char const    binlog_index_magic[]= "TSBI"      ;
+    constexpr std::uint8_t  binlog_tag_block    = 'B'         ;
+    constexpr std::uint8_t  binlog_tag_format   = 'F'         ;
+    constexpr std::uint8_t  binlog_tag_record   = 'R'         ;
+    constexpr std::uint32_t binlog_null_size    = 0xFFFFFFFFU ;
+    constexpr size_type     binlog_long_double_size = 16      ;
+    constexpr size_type     binlog_block_header_size= 36      ;
+    constexpr std::size_t   binlog_max_interned_size= 256     ;
+    constexpr std::size_t   binlog_max_dictionary   = 4096    ;
+    // Limits what a reader accepts from a file, a corrupt id or size must
+    //  not make it allocate gigabytes
+    constexpr std::uint32_t binlog_max_format_id    = 1U << 20;
+    constexpr std::uint32_t binlog_max_format_size  = 1U << 20;
+    constexpr std::uint8_t  binlog_known_flags      = binlog::bf__compact | binlog::bf__lz4 | binlog::bf__intern;
+
+    static_assert (
+        sizeof (long double) <= binlog_long_double_size
+      , "long double is too big for the binary log layout"
+      );
+
+    struct binlog_registered_format
+    {
+      char const *                format        ;
+      encoded_types_t             encoded_types ;
+    };
+
+    struct binlog_format_registry
+    {
+      std::mutex                              lock    ;
+      std::vector<binlog_registered_format>   formats ;
+    };
+
+    inline binlog_format_registry & get_binlog_format_registry ()
+    {
+      static binlog_format_registry registry;
+      return registry;
+    }
+
+    inline void put_u8 (std::vector<char> & buffer, std::uint8_t v)
+    {
+      buffer.push_back (static_cast<char> (v));
+    }
+
+    inline void put_u32 (std::vector<char> & buffer, std::uint32_t v)
+    {
+      char bytes[] =
+        {
+          static_cast<char> (v        ),
+          static_cast<char> (v >> 8   ),
+          static_cast<char> (v >> 16  ),
+          static_cast<char> (v >> 24  ),
+        };
+      buffer.insert (buffer.end (), bytes, bytes + sizeof (bytes));
+    }
+
+    inline void put_u64 (std::vector<char> & buffer, std::uint64_t v)
+    {
+      put_u32 (buffer, static_cast<std::uint32_t> (v      ));
+      put_u32 (buffer, static_cast<std::uint32_t> (v >> 32));
+    }
+
+    inline void patch_u32 (std::vector<char> & buffer, std::size_t pos, std::uint32_t v)
+    {
+      buffer[pos + 0] = static_cast<char> (v        );
+      buffer[pos + 1] = static_cast<char> (v >> 8   );
+      buffer[pos + 2] = static_cast<char> (v >> 16  );
+      buffer[pos + 3] = static_cast<char> (v >> 24  );
+    }
+
+    inline std::uint32_t get_u32 (char const * p) noexcept
+    {
+      auto b = reinterpret_cast<unsigned char const *> (p);
+      return
+          (static_cast<std::uint32_t> (b[0])      )
+        | (static_cast<std::uint32_t> (b[1]) << 8 )
+        | (static_cast<std::uint32_t> (b[2]) << 16)
+        | (static_cast<std::uint32_t> (b[3]) << 24)
+        ;
+    }
+
+    inline std::uint64_t get_u64 (char const * p) noexcept
+    {
+      return static_cast<std::uint64_t> (get_u32 (p)) | (static_cast<std::uint64_t> (get_u32 (p + 4)) << 32);
+    }
+
+    inline void put_binlog_arg (std::vector<char> & buffer, arg const & a)
+    {
+      switch (get_type_class (a.tid))
+      {
+      case tc__signed_integer:
+        put_u64 (buffer, static_cast<std::uint64_t> (a.value.signed_integer));
+        break;
+      case tc__unsigned_integer:
+        put_u64 (buffer, static_cast<std::uint64_t> (a.value.unsigned_integer));
+        break;
+      case tc__double:
+        {
+          std::uint64_t bits;
+          std::memcpy (&bits, &a.value.double_value, sizeof (bits));
+          put_u64 (buffer, bits);
+        }
+        break;
+      case tc__long_double:
+        {
+          char bytes[binlog_long_double_size] {};
+          std::memcpy (bytes, &a.value.long_double_value, sizeof (long double));
+          buffer.insert (buffer.end (), bytes, bytes + sizeof (bytes));
+        }
+        break;
+      case tc__char_p:
+        if (a.value.char_p)
+        {
+          auto size = std::strlen (a.value.char_p);
+          put_u32 (buffer, static_cast<std::uint32_t> (size));
+          buffer.insert (buffer.end (), a.value.char_p, a.value.char_p + size + 1);
+        }
+        else
+        {
+          put_u32 (buffer, binlog_null_size);
+        }
+        break;
+      case tc__wchar_t_p:
+        if (a.value.wchar_t_p)
+        {
+          auto size = std::wcslen (a.value.wchar_t_p);
+          put_u32 (buffer, static_cast<std::uint32_t> (size));
+          for (auto iter = 0U; iter < size; ++iter)
+          {
+            put_u32 (buffer, static_cast<std::uint32_t> (a.value.wchar_t_p[iter]));
+          }
+        }
+        else
+        {
+          put_u32 (buffer, binlog_null_size);
+        }
+        break;
+      case tc__void_p:
+        put_u64 (buffer, static_cast<std::uint64_t> (reinterpret_cast<std::uintptr_t> (a.value.void_p)));
+        break;
+      case tc__chars_written:
+      case tc__invalid:
+        break;
+      }
+    }
+
+    // Decodes a record payload into args, char * arguments point into the
+    //  payload, wchar_t * arguments into wide
+    inline bool get_binlog_args (
+        encoded_types_t     encoded_types
+      , char const *        payload
+      , std::size_t         payload_size
+      , arg *               args
+      , size_type &         arg_count
+      , std::wstring *      wide
+      )
+    {
+      auto end    = payload + payload_size;
+      auto fits   = [&] (std::size_t n) { return static_cast<std::size_t> (end - payload) >= n; };
+
+      arg_count = 0;
+
+      for (auto ti = type_id_at (encoded_types, 0); ti != tid__illegal; ti = type_id_at (encoded_types, arg_count))
+      {
+        auto & a = args[arg_count];
+        a.tid = ti;
+
+        switch (get_type_class (ti))
+        {
+        case tc__signed_integer:
+          if (!fits (8)) return false;
+          a.value.signed_integer = static_cast<std::intmax_t> (get_u64 (payload));
+          payload += 8;
+          break;
+        case tc__unsigned_integer:
+          if (!fits (8)) return false;
+          a.value.unsigned_integer = get_u64 (payload);
+          payload += 8;
+          break;
+        case tc__double:
+          {
+            if (!fits (8)) return false;
+            auto bits = get_u64 (payload);
+            std::memcpy (&a.value.double_value, &bits, sizeof (bits));
+            payload += 8;
+          }
+          break;
+        case tc__long_double:
+          if (!fits (binlog_long_double_size)) return false;
+          std::memcpy (&a.value.long_double_value, payload, sizeof (long double));
+          payload += binlog_long_double_size;
+          break;
+        case tc__char_p:
+          {
+            if (!fits (4)) return false;
+            auto size = get_u32 (payload);
+            payload += 4;
+            if (size == binlog_null_size)
+            {
+              a.value.char_p = nullptr;
+            }
+            else
+            {
+              if (!fits (static_cast<std::size_t> (size) + 1) || payload[size] != '\0') return false;
+              a.value.char_p = payload;
+              payload += size + 1;
+            }
+          }
+          break;
+        case tc__wchar_t_p:
+          {
+            if (!fits (4)) return false;
+            auto size = get_u32 (payload);
+            payload += 4;
+            if (size == binlog_null_size)
+            {
+              a.value.wchar_t_p = nullptr;
+            }
+            else
+            {
+              if (!fits (static_cast<std::size_t> (size) * 4)) return false;
+              auto & w = wide[arg_count];
+              w.resize (size);
+              for (auto iter = 0U; iter < size; ++iter, payload += 4)
+              {
+                w[iter] = static_cast<wchar_t> (get_u32 (payload));
+              }
+              a.value.wchar_t_p = w.c_str ();
+            }
+          }
+          break;
+        case tc__void_p:
+          if (!fits (8)) return false;
+          a.value.void_p = reinterpret_cast<void const *> (static_cast<std::uintptr_t> (get_u64 (payload)));
+          payload += 8;
+          break;
+        case tc__chars_written:
+          a.value.chars_written_p = nullptr;
+          break;
+        case tc__invalid:
+          return false;
+        }
+
+        ++arg_count;
+      }
+
+      return payload == end;
+    }
+
+    constexpr std::uint64_t zigzag (std::int64_t v) noexcept
+    {
+      return (static_cast<std::uint64_t> (v) << 1) ^ static_cast<std::uint64_t> (v >> 63);
+    }
+
+    constexpr std::int64_t unzigzag (std::uint64_t v) noexcept
+    {
+      return static_cast<std::int64_t> ((v >> 1) ^ (0U - (v & 1U)));
+    }
+
+    // The difference is computed modulo 2^64 so any two values works
+    constexpr std::uint64_t zigzag_delta (std::uint64_t v, std::uint64_t previous) noexcept
+    {
+      return zigzag (static_cast<std::int64_t> (v - previous));
+    }
+
+    inline void put_varint (std::vector<char> & buffer, std::uint64_t v)
+    {
+      while (v >= 0x80)
+      {
+        buffer.push_back (static_cast<char> (v | 0x80));
+        v >>= 7;
+      }
+      buffer.push_back (static_cast<char> (v));
+    }
+
+    inline bool get_varint (char const * & p, char const * end, std::uint64_t & v) noexcept
+    {
+      v = 0;
+      for (auto shift = 0U; p < end && shift < 64; shift += 7)
+      {
+        auto b = static_cast<unsigned char> (*p++);
+        v |= static_cast<std::uint64_t> (b & 0x7F) << shift;
+        if ((b & 0x80) == 0)
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // The writer and the reader add the same strings to the dictionary
+    constexpr bool is_interned (std::size_t size, std::size_t dictionary_size) noexcept
+    {
+      return size <= binlog_max_interned_size && dictionary_size < binlog_max_dictionary;
+    }
+
+    // The strings of a block, looked up by pointer first (the same literal
+    //  or the same long-lived string) and then by content
+    class binlog_string_dictionary
+    {
+    public:
+      void put (std::vector<char> & buffer, char const * s)
+      {
+        auto by_pointer = pointers.find (s);
+        if (by_pointer != pointers.end () && matches (by_pointer->second, s))
+        {
+          put_varint (buffer, (static_cast<std::uint64_t> (by_pointer->second) << 1) | 1U);
+          return;
+        }
+
+        auto size       = std::strlen (s);
+        auto hash       = hash_of (s, size);
+        auto by_content = contents.find (hash);
+        if (
+              by_content != contents.end ()
+          &&  entries[by_content->second].size () == size
+          &&  std::memcmp (entries[by_content->second].data (), s, size) == 0
+          )
+        {
+          pointers[s] = by_content->second;
+          put_varint (buffer, (static_cast<std::uint64_t> (by_content->second) << 1) | 1U);
+          return;
+        }
+
+        put_varint (buffer, (static_cast<std::uint64_t> (size) + 1U) << 1);
+        buffer.insert (buffer.end (), s, s + size);
+
+        if (is_interned (size, entries.size ()))
+        {
+          auto index = static_cast<std::uint32_t> (entries.size ());
+          entries.emplace_back (s, size);
+          contents.emplace (hash, index);
+          pointers[s] = index;
+        }
+      }
+
+      void clear ()
+      {
+        entries.clear ();
+        pointers.clear ();
+        contents.clear ();
+      }
+
+    private:
+      bool matches (std::uint32_t index, char const * s) const noexcept
+      {
+        // strncmp stops at the end of a shorter s, memcmp would read past it
+        auto & entry = entries[index];
+        return std::strncmp (entry.data (), s, entry.size ()) == 0 && s[entry.size ()] == '\0';
+      }
+
+      // FNV-1a
+      static std::uint64_t hash_of (char const * s, std::size_t size) noexcept
+      {
+        std::uint64_t hash = 0xCBF29CE484222325ULL;
+        for (auto iter = 0U; iter < size; ++iter)
+        {
+          hash = (hash ^ static_cast<unsigned char> (s[iter])) * 0x100000001B3ULL;
+        }
+        return hash;
+      }
+
+      std::vector<std::string>                              entries   ;
+      std::unordered_map<char const *, std::uint32_t>       pointers  ;
+      std::unordered_map<std::uint64_t, std::uint32_t>      contents  ;
+    };
+
+    inline void put_compact_arg (std::vector<char> & buffer, arg const & a, std::uint64_t & previous, binlog_string_dictionary * dictionary)
+    {
+      switch (get_type_class (a.tid))
+      {
+      case tc__signed_integer:
+        put_varint (buffer, zigzag_delta (static_cast<std::uint64_t> (a.value.signed_integer), previous));
+        previous = static_cast<std::uint64_t> (a.value.signed_integer);
+        break;
+      case tc__unsigned_integer:
+        put_varint (buffer, zigzag_delta (a.value.unsigned_integer, previous));
+        previous = a.value.unsigned_integer;
+        break;
+      case tc__char_p:
+        if (a.value.char_p && dictionary)
+        {
+          dictionary->put (buffer, a.value.char_p);
+        }
+        else if (a.value.char_p)
+        {
+          auto size = std::strlen (a.value.char_p);
+          put_varint (buffer, size + 1);
+          buffer.insert (buffer.end (), a.value.char_p, a.value.char_p + size);
+        }
+        else
+        {
+          put_varint (buffer, 0);
+        }
+        break;
+      case tc__wchar_t_p:
+        if (a.value.wchar_t_p)
+        {
+          auto size = std::wcslen (a.value.wchar_t_p);
+          put_varint (buffer, size + 1);
+          for (auto iter = 0U; iter < size; ++iter)
+          {
+            put_varint (buffer, static_cast<std::uint32_t> (a.value.wchar_t_p[iter]));
+          }
+        }
+        else
+        {
+          put_varint (buffer, 0);
+        }
+        break;
+      case tc__void_p:
+        put_varint (buffer, static_cast<std::uint64_t> (reinterpret_cast<std::uintptr_t> (a.value.void_p)));
+        break;
+      case tc__double:
+      case tc__long_double:
+      case tc__chars_written:
+      case tc__invalid:
+        put_binlog_arg (buffer, a);
+        break;
+      }
+    }
+
+    // Expands a compact payload to the fixed size payload get_binlog_args
+    //  reads, dictionary is the dictionary of the block with bf__intern
+    inline bool expand_compact_payload (
+        encoded_types_t             encoded_types
+      , char const *                payload
+      , std::size_t                 payload_size
+      , std::uint64_t *             previous
+      , std::vector<char> &         result
+      , std::vector<std::string> *  dictionary
+      )
+    {
+      auto end    = payload + payload_size;
+      auto fits   = [&] (std::size_t n) { return static_cast<std::size_t> (end - payload) >= n; };
+
+      std::uint64_t v = 0;
+
+      auto pos = 0U;
+      for (auto ti = type_id_at (encoded_types, 0); ti != tid__illegal; ti = type_id_at (encoded_types, ++pos))
+      {
+        switch (get_type_class (ti))
+        {
+        case tc__signed_integer:
+        case tc__unsigned_integer:
+          if (!get_varint (payload, end, v)) return false;
+          previous[pos] += static_cast<std::uint64_t> (unzigzag (v));
+          put_u64 (result, previous[pos]);
+          break;
+        case tc__double:
+          if (!fits (8)) return false;
+          result.insert (result.end (), payload, payload + 8);
+          payload += 8;
+          break;
+        case tc__long_double:
+          if (!fits (binlog_long_double_size)) return false;
+          result.insert (result.end (), payload, payload + binlog_long_double_size);
+          payload += binlog_long_double_size;
+          break;
+        case tc__char_p:
+          if (!get_varint (payload, end, v)) return false;
+          if (v == 0)
+          {
+            put_u32 (result, binlog_null_size);
+          }
+          else if (dictionary && (v & 1U))
+          {
+            if ((v >> 1) >= dictionary->size ()) return false;
+            auto & entry = (*dictionary)[v >> 1];
+            put_u32 (result, static_cast<std::uint32_t> (entry.size ()));
+            result.insert (result.end (), entry.begin (), entry.end ());
+            result.push_back ('\0');
+          }
+          else
+          {
+            auto size = dictionary ? (v >> 1) - 1 : v - 1;
+            if (!fits (size)) return false;
+            put_u32 (result, static_cast<std::uint32_t> (size));
+            result.insert (result.end (), payload, payload + size);
+            result.push_back ('\0');
+            if (dictionary && is_interned (size, dictionary->size ()))
+            {
+              dictionary->emplace_back (payload, size);
+            }
+            payload += size;
+          }
+          break;
+        case tc__wchar_t_p:
+          if (!get_varint (payload, end, v)) return false;
+          if (v == 0)
+          {
+            put_u32 (result, binlog_null_size);
+          }
+          else
+          {
+            auto size = v - 1;
+            put_u32 (result, static_cast<std::uint32_t> (size));
+            for (auto iter = 0U; iter < size; ++iter)
+            {
+              if (!get_varint (payload, end, v)) return false;
+              put_u32 (result, static_cast<std::uint32_t> (v));
+            }
+          }
+          break;
+        case tc__void_p:
+          if (!get_varint (payload, end, v)) return false;
+          put_u64 (result, v);
+          break;
+        case tc__chars_written:
+          break;
+        case tc__invalid:
+          return false;
+        }
+      }
+
+      return payload == end;
+    }
+
+    inline bool binlog_seek (std::FILE * stream, binlog::offset_t offset) noexcept
+    {
+#ifdef _MSC_VER
+      return _fseeki64 (stream, static_cast<__int64> (offset), SEEK_SET) == 0;
+#else
+      return fseeko (stream, static_cast<off_t> (offset), SEEK_SET) == 0;
+#endif
+    }
+
+    inline binlog::offset_t binlog_tell (std::FILE * stream) noexcept
+    {
+#ifdef _MSC_VER
+      return static_cast<binlog::offset_t> (_ftelli64 (stream));
+#else
+      return static_cast<binlog::offset_t> (ftello (stream));
+#endif
+    }
+
+    inline bool read_exactly (std::FILE * stream, char * buffer, std::size_t size) noexcept
+    {
+      return std::fread (buffer, 1, size, stream) == size;
+    }
+  }
+
+  namespace binlog
+  {
+    // Returns a process-wide id for format, call once per call site
+    //  (TS_BINLOG does that). format must have static storage duration.
+    inline format_id register_format (char const * format, details::encoded_types_t encoded_types)
+    {
+      TYPESAFE_PRINTF__ASSERT (format);
+
+      auto & registry = details::get_binlog_format_registry ();
+      std::lock_guard<std::mutex> guard (registry.lock);
+
+      registry.formats.push_back (details::binlog_registered_format { format, encoded_types });
+      TYPESAFE_PRINTF__ASSERT (registry.formats.size () <= details::binlog_max_format_id);
+      return static_cast<format_id> (registry.formats.size () - 1);
+    }
+
+    inline timestamp_t now () noexcept
+    {
+      using namespace std::chrono;
+      return static_cast<timestamp_t> (duration_cast<nanoseconds> (system_clock::now ().time_since_epoch ()).count ());
+    }
+
+    // Writes a binary log to a stream. A writer is not thread-safe,
+    //  use one writer per thread or serialize access to it.
+    class writer
+    {
+    public:
+      explicit writer (
+          std::FILE *   stream
+        , std::uint8_t  flags       = bf__compact | bf__intern
+        , std::size_t   block_size  = default_block_size
+        )
+        : stream            (stream)
+        , flags             (flags)
+        , block_size        (block_size)
+        , good              (true)
+        , record_count      (0)
+        , first_timestamp   (0)
+        , last_timestamp    (0)
+      {
+        TYPESAFE_PRINTF__ASSERT (stream);
+
+        char header[8] = { 'T', 'S', 'B', 'L', static_cast<char> (stream_version), sizeof (long double), 0, 0 };
+        good = std::fwrite (header, 1, sizeof (header), stream) == sizeof (header);
+
+        block.reserve (block_size + 256);
+      }
+
+      writer (writer const &)             = delete;
+      writer & operator= (writer const &) = delete;
+
+      ~writer ()
+      {
+        flush ();
+      }
+
+      template<details::encoded_types_t EncodedTypes, typename ...TArgs>
+      void log (format_id id, TArgs && ...args)
+      {
+        std::array<details::arg, sizeof... (TArgs)> captured;
+        details::make_args<EncodedTypes> (captured, std::forward<TArgs> (args)...);
+        write_record (id, now (), captured.data (), static_cast<details::size_type> (captured.size ()));
+      }
+
+      void write_record (format_id id, timestamp_t timestamp, details::arg const * args, details::size_type arg_count)
+      {
+        TYPESAFE_PRINTF__ASSERT (arg_count <= details::max_encoded_types);
+
+        if (id >= defined.size () || !defined[id])
+        {
+          define_format (id);
+        }
+
+        if (record_count == 0)
+        {
+          first_timestamp   = timestamp;
+          last_timestamp    = 0;
+        }
+
+        details::put_u8 (block, details::binlog_tag_record);
+
+        if (flags & bf__compact)
+        {
+          details::put_varint (block, id);
+          details::put_varint (block, details::zigzag_delta (timestamp, last_timestamp));
+
+          payload.clear ();
+          auto previous   = previous_values[id].data ();
+          auto dictionary = (flags & bf__intern) ? &strings : nullptr;
+          for (auto iter = 0U; iter < arg_count; ++iter)
+          {
+            details::put_compact_arg (payload, args[iter], previous[iter], dictionary);
+          }
+
+          details::put_varint (block, payload.size ());
+          block.insert (block.end (), payload.begin (), payload.end ());
+        }
+        else
+        {
+          details::put_u32 (block, id);
+          details::put_u64 (block, timestamp);
+
+          auto size_pos = block.size ();
+          details::put_u32 (block, 0);
+
+          for (auto iter = 0U; iter < arg_count; ++iter)
+          {
+            details::put_binlog_arg (block, args[iter]);
+          }
+
+          details::patch_u32 (block, size_pos, static_cast<std::uint32_t> (block.size () - size_pos - 4));
+        }
+
+        ++record_count;
+        last_timestamp = timestamp;
+
+        if (block.size () >= block_size)
+        {
+          seal ();
+        }
+      }
+
+      // Writes the current block (even if it's not full) and flushes the stream
+      bool flush ()
+      {
+        seal ();
+        return good && std::fflush (stream) == 0;
+      }
+
+    private:
+      void define_format (format_id id)
+      {
+        details::binlog_registered_format registered;
+        {
+          auto & registry = details::get_binlog_format_registry ();
+          std::lock_guard<std::mutex> guard (registry.lock);
+          TYPESAFE_PRINTF__ASSERT (id < registry.formats.size ());
+          registered = registry.formats[id];
+        }
+
+        auto size = std::strlen (registered.format);
+
+        details::put_u8   (block, details::binlog_tag_format);
+        details::put_u32  (block, id);
+        details::put_u64  (block, registered.encoded_types);
+        details::put_u32  (block, static_cast<std::uint32_t> (size));
+        block.insert (block.end (), registered.format, registered.format + size);
+
+        if (id >= defined.size ())
+        {
+          defined.resize (id + 1, false);
+          previous_values.resize (id + 1);
+        }
+
+        defined[id] = true;
+        previous_values[id].fill (0);
+        block_formats.push_back (id);
+      }
+
+      void seal ()
+      {
+        if (record_count == 0)
+        {
+          return;
+        }
+
+        // bf__intern needs the varints of bf__compact
+        auto          block_flags = static_cast<std::uint8_t> ((flags & bf__compact) ? flags & (bf__compact | bf__intern) : 0);
+        char const *  stored      = block.data ();
+        auto          stored_size = block.size ();
+
+#ifdef TYPESAFE_PRINTF__BINLOG_LZ4
+        if (flags & bf__lz4)
+        {
+          compressed.resize (static_cast<std::size_t> (LZ4_compressBound (static_cast<int> (block.size ()))));
+          auto size = LZ4_compress_default (
+              block.data ()
+            , compressed.data ()
+            , static_cast<int> (block.size ())
+            , static_cast<int> (compressed.size ())
+            );
+
+          // Incompressible blocks are stored as is
+          if (size > 0 && static_cast<std::size_t> (size) < block.size ())
+          {
+            block_flags |= bf__lz4;
+            stored      = compressed.data ();
+            stored_size = static_cast<std::size_t> (size);
+          }
+        }
+#endif
+
+        std::sort (block_formats.begin (), block_formats.end ());
+
+        header.clear ();
+        details::put_u8   (header, details::binlog_tag_block);
+        details::put_u8   (header, block_flags);
+        details::put_u8   (header, 0);
+        details::put_u8   (header, 0);
+        details::put_u32  (header, static_cast<std::uint32_t> (block.size ()));
+        details::put_u32  (header, static_cast<std::uint32_t> (stored_size));
+        details::put_u32  (header, record_count);
+        details::put_u64  (header, first_timestamp);
+        details::put_u64  (header, last_timestamp);
+        details::put_u32  (header, static_cast<std::uint32_t> (block_formats.size ()));
+        for (auto id : block_formats)
+        {
+          details::put_u32 (header, id);
+        }
+
+        good = good
+          && std::fwrite (header.data (), 1, header.size (), stream) == header.size ()
+          && std::fwrite (stored, 1, stored_size, stream) == stored_size
+          ;
+
+        // The next block starts over
+        for (auto id : block_formats)
+        {
+          defined[id] = false;
+        }
+
+        block_formats.clear ();
+        block.clear ();
+        strings.clear ();
+        record_count = 0;
+      }
+
+      using previous_t = std::array<std::uint64_t, details::max_encoded_types>;
+
+      std::FILE *               stream          ;
+      std::uint8_t              flags           ;
+      std::size_t               block_size      ;
+      bool                      good            ;
+      std::uint32_t             record_count    ;
+      timestamp_t               first_timestamp ;
+      timestamp_t               last_timestamp  ;
+      std::vector<char>         block           ;
+      std::vector<char>         header          ;
+      std::vector<char>         payload         ;
+      std::vector<char>         compressed      ;
+      std::vector<bool>         defined         ;
+      std::vector<format_id>    block_formats   ;
+      std::vector<previous_t>   previous_values ;
+      details::binlog_string_dictionary strings ;
+    };
+
+    // A block is a run of consecutive records, its header records which
+    //  format ids it contains so that queries can skip it
+    struct block_info
+    {
+      offset_t                offset          ;
+      offset_t                size            ;
+      timestamp_t             first_timestamp ;
+      timestamp_t             last_timestamp  ;
+      std::uint32_t           record_count    ;
+      std::vector<format_id>  format_ids      ; // sorted
+
+      bool contains (format_id id) const
+      {
+        return std::binary_search (format_ids.begin (), format_ids.end (), id);
+      }
+    };
+
+    // Reads a binary log from a stream
+    class reader
+    {
+    public:
+      explicit reader (std::FILE * stream)
+        : stream  (stream)
+        , valid   (false)
+        , block_offset (0)
+        , current (0)
+      {
+        TYPESAFE_PRINTF__ASSERT (stream);
+
+        char header[8];
+        valid =
+              details::read_exactly (stream, header, sizeof (header))
+          &&  std::memcmp (header, details::binlog_magic, 4) == 0
+          // Version 2 is version 3 without bf__intern
+          &&  static_cast<std::uint8_t> (header[4]) >= 2
+          &&  static_cast<std::uint8_t> (header[4]) <= stream_version
+          &&  static_cast<std::uint8_t> (header[5]) == sizeof (long double)
+          ;
+      }
+
+      reader (reader const &)             = delete;
+      reader & operator= (reader const &) = delete;
+
+      bool is_valid () const noexcept
+      {
+        return valid;
+      }
+
+      // Reads the next log record, reads the next block when needed
+      bool next (record & r)
+      {
+        while (!next_in_block (r))
+        {
+          if (!read_block ())
+          {
+            return false;
+          }
+        }
+
+        return true;
+      }
+
+      // Reads the next log record in the current block
+      bool next_in_block (record & r)
+      {
+        if (current >= pending.size ())
+        {
+          return false;
+        }
+
+        auto & p      = pending[current++];
+        r.id          = p.id;
+        r.timestamp   = p.timestamp;
+        r.offset      = block_offset;
+        r.payload.assign (payloads.begin () + p.begin, payloads.begin () + p.end);
+
+        return true;
+      }
+
+      // Reads and decodes the block at the current position, the records
+      //  left in the previous block are dropped
+      bool read_block (block_info * info = nullptr)
+      {
+        pending.clear ();
+        payloads.clear ();
+        current = 0;
+
+        if (!valid)
+        {
+          return false;
+        }
+
+        block_offset = details::binlog_tell (stream);
+
+        char head[details::binlog_block_header_size];
+        auto read = std::fread (head, 1, sizeof (head), stream);
+        if (read == 0)
+        {
+          // End of log
+          return false;
+        }
+
+        if (read != sizeof (head) || static_cast<std::uint8_t> (head[0]) != details::binlog_tag_block)
+        {
+          return valid = false;
+        }
+
+        auto flags        = static_cast<std::uint8_t> (head[1]);
+        if (flags & ~details::binlog_known_flags)
+        {
+          return valid = false;
+        }
+
+        auto raw_size     = details::get_u32 (head + 4);
+        auto stored_size  = details::get_u32 (head + 8);
+        auto format_count = details::get_u32 (head + 32);
+
+        block_ids.resize (format_count);
+        for (auto && id : block_ids)
+        {
+          char bytes[4];
+          if (!details::read_exactly (stream, bytes, 4))
+          {
+            return valid = false;
+          }
+          id = details::get_u32 (bytes);
+        }
+
+        stored.resize (stored_size);
+        if (!details::read_exactly (stream, stored.data (), stored.size ()))
+        {
+          return valid = false;
+        }
+
+        if (flags & bf__lz4)
+        {
+#ifdef TYPESAFE_PRINTF__BINLOG_LZ4
+          raw.resize (raw_size);
+          auto size = LZ4_decompress_safe (
+              stored.data ()
+            , raw.data ()
+            , static_cast<int> (stored.size ())
+            , static_cast<int> (raw.size ())
+            );
+          if (size < 0 || static_cast<std::uint32_t> (size) != raw_size)
+          {
+            return valid = false;
+          }
+#else
+          // Compressed blocks requires TYPESAFE_PRINTF__BINLOG_LZ4
+          return valid = false;
+#endif
+        }
+        else
+        {
+          raw.swap (stored);
+        }
+
+        if (raw.size () != raw_size || !decode_block (flags))
+        {
+          return valid = false;
+        }
+
+        if (info)
+        {
+          info->offset          = block_offset;
+          info->size            = details::binlog_tell (stream) - block_offset;
+          info->first_timestamp = details::get_u64 (head + 16);
+          info->last_timestamp  = details::get_u64 (head + 24);
+          info->record_count    = details::get_u32 (head + 12);
+          info->format_ids      = block_ids;
+        }
+
+        return true;
+      }
+
+      // offset must be the offset of a block
+      bool seek (offset_t offset)
+      {
+        pending.clear ();
+        current = 0;
+        return valid && details::binlog_seek (stream, offset);
+      }
+
+      offset_t tell () const
+      {
+        return details::binlog_tell (stream);
+      }
+
+      // Returns false for an id no writer hands out
+      bool define_format (format_id id, std::string format, details::encoded_types_t encoded_types)
+      {
+        if (id >= details::binlog_max_format_id)
+        {
+          return false;
+        }
+
+        if (id >= definitions.size ())
+        {
+          definitions.resize (id + 1, format_definition { std::string (), 0U, false, false });
+        }
+
+        auto & definition         = definitions[id];
+        definition.format         = std::move (format);
+        definition.encoded_types  = encoded_types;
+        definition.is_defined     = true;
+        definition.is_renderable  = !details::has_extension (definition.format.c_str (), details::ext__hexdump);
+        return true;
+      }
+
+      // Returns nullptr if the format id hasn't been defined (yet)
+      format_definition const * find_format (format_id id) const noexcept
+      {
+        return id < definitions.size () && definitions[id].is_defined
+          ? &definitions[id]
+          : nullptr
+          ;
+      }
+
+      std::vector<format_definition> const & formats () const noexcept
+      {
+        return definitions;
+      }
+
+      // Renders r as TS_SNPRINTF would have done it, returns a negative value
+      //  if the record doesn't match its format definition
+      int render (record const & r, char * buffer, std::size_t size)
+      {
+        auto definition = find_format (r.id);
+        if (!definition || !definition->is_renderable)
+        {
+          return -1;
+        }
+
+        details::arg        args[details::max_encoded_types];
+        details::size_type  arg_count = 0;
+
+        if (!details::get_binlog_args (definition->encoded_types, r.payload.data (), r.payload.size (), args, arg_count, wide))
+        {
+          return -1;
+        }
+
+        return details::render (buffer, size, definition->format.c_str (), args, arg_count);
+      }
+
+    private:
+      struct pending_record
+      {
+        format_id     id        ;
+        timestamp_t   timestamp ;
+        std::size_t   begin     ;
+        std::size_t   end       ;
+      };
+
+      using previous_t = std::array<std::uint64_t, details::max_encoded_types>;
+
+      // Splits the block in records, compact payloads are expanded to
+      //  fixed size payloads
+      bool decode_block (std::uint8_t flags)
+      {
+        auto p            = static_cast<char const *> (raw.data ());
+        auto end          = p + raw.size ();
+        auto fits         = [&] (std::size_t n) { return static_cast<std::size_t> (end - p) >= n; };
+        auto timestamp    = timestamp_t ();
+
+        for (auto id : block_ids)
+        {
+          if (id < previous_values.size ())
+          {
+            previous_values[id].fill (0);
+          }
+        }
+
+        strings.clear ();
+        auto dictionary = (flags & bf__intern) ? &strings : nullptr;
+
+        while (p < end)
+        {
+          auto tag = static_cast<std::uint8_t> (*p++);
+
+          if (tag == details::binlog_tag_format)
+          {
+            if (!fits (16))
+            {
+              return false;
+            }
+
+            auto id   = details::get_u32 (p);
+            auto enc  = details::get_u64 (p + 4);
+            auto size = details::get_u32 (p + 12);
+            p += 16;
+
+            if (!fits (size))
+            {
+              return false;
+            }
+
+            if (!define_format (id, std::string (p, p + size), enc))
+            {
+              return false;
+            }
+            p += size;
+          }
+          else if (tag == details::binlog_tag_record && (flags & bf__compact))
+          {
+            std::uint64_t id    = 0;
+            std::uint64_t delta = 0;
+            std::uint64_t size  = 0;
+
+            if (
+                  !details::get_varint (p, end, id)
+              ||  !details::get_varint (p, end, delta)
+              ||  !details::get_varint (p, end, size)
+              ||  !fits (size)
+              )
+            {
+              return false;
+            }
+
+            auto definition = find_format (static_cast<format_id> (id));
+            if (!definition)
+            {
+              return false;
+            }
+
+            if (id >= previous_values.size ())
+            {
+              previous_values.resize (id + 1, previous_t {});
+            }
+
+            timestamp += static_cast<timestamp_t> (details::unzigzag (delta));
+
+            auto begin = payloads.size ();
+            if (!details::expand_compact_payload (definition->encoded_types, p, size, previous_values[id].data (), payloads, dictionary))
+            {
+              return false;
+            }
+            p += size;
+
+            pending.push_back (pending_record { static_cast<format_id> (id), timestamp, begin, payloads.size () });
+          }
+          else if (tag == details::binlog_tag_record)
+          {
+            if (!fits (16))
+            {
+              return false;
+            }
+
+            auto id   = details::get_u32 (p);
+            timestamp = details::get_u64 (p + 4);
+            auto size = details::get_u32 (p + 12);
+            p += 16;
+
+            if (!fits (size))
+            {
+              return false;
+            }
+
+            auto begin = payloads.size ();
+            payloads.insert (payloads.end (), p, p + size);
+            p += size;
+
+            pending.push_back (pending_record { id, timestamp, begin, payloads.size () });
+          }
+          else
+          {
+            return false;
+          }
+        }
+
+        return true;
+      }
+
+      std::FILE *                     stream                          ;
+      bool                            valid                           ;
+      offset_t                        block_offset                    ;
+      std::size_t                     current                         ;
+      std::vector<pending_record>     pending                         ;
+      std::vector<char>               payloads                        ;
+      std::vector<char>               stored                          ;
+      std::vector<char>               raw                             ;
+      std::vector<format_id>          block_ids                       ;
+      std::vector<previous_t>         previous_values                 ;
+      std::vector<format_definition>  definitions                     ;
+      std::vector<std::string>        strings                         ; // The dictionary of the block
+      std::wstring                    wide[details::max_encoded_types];
+    };
+
+    struct block_index
+    {
+      std::vector<block_info> blocks;
+    };
+
+    // Reads the block headers of the log from the current position
+    inline bool build_index (reader & r, block_index & idx)
+    {
+      idx.blocks.clear ();
+
+      block_info info {};
+      while (r.read_block (&info))
+      {
+        idx.blocks.push_back (info);
+      }
+
+      return r.is_valid ();
+    }
+
+    // The index file also holds the format definitions so a query can find
+    //  the format ids before reading any block
+    inline bool save_index (std::FILE * stream, reader const & r, block_index const & idx)
+    {
+      std::vector<char> buffer;
+
+      buffer.insert (buffer.end (), details::binlog_index_magic, details::binlog_index_magic + 4);
+      details::put_u8   (buffer, stream_version);
+      details::put_u8   (buffer, 0);
+      details::put_u8   (buffer, 0);
+      details::put_u8   (buffer, 0);
+
+      auto & formats = r.formats ();
+      details::put_u32  (buffer, static_cast<std::uint32_t> (std::count_if (formats.begin (), formats.end (), [] (format_definition const & f) { return f.is_defined; })));
+      for (auto iter = 0U; iter < formats.size (); ++iter)
+      {
+        auto & f = formats[iter];
+        if (f.is_defined)
+        {
+          details::put_u32  (buffer, iter);
+          details::put_u64  (buffer, f.encoded_types);
+          details::put_u32  (buffer, static_cast<std::uint32_t> (f.format.size ()));
+          buffer.insert (buffer.end (), f.format.begin (), f.format.end ());
+        }
+      }
+
+      details::put_u32  (buffer, static_cast<std::uint32_t> (idx.blocks.size ()));
+      for (auto && block : idx.blocks)
+      {
+        details::put_u64  (buffer, block.offset);
+        details::put_u64  (buffer, block.size);
+        details::put_u64  (buffer, block.first_timestamp);
+        details::put_u64  (buffer, block.last_timestamp);
+        details::put_u32  (buffer, block.record_count);
+        details::put_u32  (buffer, static_cast<std::uint32_t> (block.format_ids.size ()));
+        for (auto id : block.format_ids)
+        {
+          details::put_u32 (buffer, id);
+        }
+      }
+
+      return std::fwrite (buffer.data (), 1, buffer.size (), stream) == buffer.size ();
+    }
+
+    inline bool load_index (std::FILE * stream, reader & r, block_index & idx)
+    {
+      idx.blocks.clear ();
+
+      char bytes[40];
+
+      auto get_u32 = [&] (std::uint32_t & v)
+      {
+        auto result = details::read_exactly (stream, bytes, 4);
+        v = details::get_u32 (bytes);
+        return result;
+      };
+
+      auto get_u64 = [&] (std::uint64_t & v)
+      {
+        auto result = details::read_exactly (stream, bytes, 8);
+        v = details::get_u64 (bytes);
+        return result;
+      };
+
+      if (
+            !details::read_exactly (stream, bytes, 8)
+        ||  std::memcmp (bytes, details::binlog_index_magic, 4) != 0
+        ||  static_cast<std::uint8_t> (bytes[4]) != stream_version
+        )
+      {
+        return false;
+      }
+
+      std::uint32_t format_count = 0;
+      if (!get_u32 (format_count))
+      {
+        return false;
+      }
+
+      for (auto iter = 0U; iter < format_count; ++iter)
+      {
+        std::uint32_t id    = 0;
+        std::uint64_t enc   = 0;
+        std::uint32_t size  = 0;
+        if (!get_u32 (id) || !get_u64 (enc) || !get_u32 (size))
+        {
+          return false;
+        }
+
+        if (size > details::binlog_max_format_size)
+        {
+          return false;
+        }
+
+        std::string format (size, '\0');
+        if (!details::read_exactly (stream, &format[0], size))
+        {
+          return false;
+        }
+
+        if (!r.define_format (id, std::move (format), enc))
+        {
+          return false;
+        }
+      }
+
+      std::uint32_t block_count = 0;
+      if (!get_u32 (block_count))
+      {
+        return false;
+      }
+
+      // Grows as the blocks are read, a corrupt count runs into the end of
+      //  the file instead of allocating
+      for (auto iter = 0U; iter < block_count; ++iter)
+      {
+        idx.blocks.emplace_back ();
+        auto & block = idx.blocks.back ();
+
+        std::uint32_t id_count = 0;
+        if (
+              !get_u64 (block.offset)
+          ||  !get_u64 (block.size)
+          ||  !get_u64 (block.first_timestamp)
+          ||  !get_u64 (block.last_timestamp)
+          ||  !get_u32 (block.record_count)
+          ||  !get_u32 (id_count)
+          ||  id_count > details::binlog_max_format_id
+          )
+        {
+          return false;
+        }
+
+        for (auto id_iter = 0U; id_iter < id_count; ++id_iter)
+        {
+          std::uint32_t id = 0;
+          if (!get_u32 (id))
+          {
+            return false;
+          }
+          block.format_ids.push_back (id);
+        }
+      }
+
+      return true;
+    }
+  }
+}
+
+#endif // TYPESAFE_PRINTF__TSPRINTF_BINLOG_HPP
@@ -0,0 +1,230 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+#ifndef TYPESAFE_PRINTF__TSPRINTF_BOUND_HPP
+#define TYPESAFE_PRINTF__TSPRINTF_BOUND_HPP
+
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tsprintf.hpp"
+#include "tsprintf_engine.hpp"
+
+// TS_BIND renders the first arguments of a format once, later calls only
+//  pass the remaining arguments which are checked against the rest of the
+//  format at compile time
+//
+//  auto request = TS_BIND ("[%s %s:%d] %s took %d ms\n", request_id, peer, port);
+//  request.printf ("lookup", 12);
+//  request.printf ("store" , 47);
+//
+//  The bound arguments can't end inside a conversion, between a * and its
+//  value or between %Hp and its length.
+
+#define TS_BIND(format, ...)                                      \
+  ( (void) TYPESAFE_PRINTF__CHECK_EXTENSIONS (format)             \
+  , typesafe_printf::details::bind_format<                        \
+        typesafe_printf::details::scanner::encode (format)        \
+      , typesafe_printf::details::bind_splits (format)            \
+      > (format, ##__VA_ARGS__)                                   \
+  )
+
+namespace typesafe_printf
+{
+  template<details::encoded_types_t RestEncodedTypes>
+  class bound_format
+  {
+  public:
+    bound_format (std::string prefix, char const * rest) noexcept
+      : prefix_text (std::move (prefix))
+      , rest_format (rest)
+    {
+    }
+
+    // The bound arguments and the literal text following them, rendered
+    std::string const & prefix () const noexcept
+    {
+      return prefix_text;
+    }
+
+    // The format of the remaining arguments
+    char const * rest () const noexcept
+    {
+      return rest_format;
+    }
+
+    template<typename ...TArgs>
+    int snprintf (char * buffer, std::size_t size, TArgs && ...args) const noexcept
+    {
+      (void) details::check_types<RestEncodedTypes> (args...);
+
+      std::array<details::arg, sizeof... (TArgs)> captured;
+      details::make_args<RestEncodedTypes> (captured, std::forward<TArgs> (args)...);
+
+      details::output_buffer output (buffer, size);
+      output.append (prefix_text.data (), prefix_text.size ());
+
+      // %n counts the prefix as well
+      details::index_type pos = 0U;
+      if (!details::render_partial (output, rest_format, pos, captured.data (), static_cast<details::size_type> (captured.size ())) || rest_format[pos] != '\0')
+      {
+        output.finish ();
+        return -1;
+      }
+
+      return output.finish ();
+    }
+
+    template<typename ...TArgs>
+    int fprintf (std::FILE * file, TArgs && ...args) const
+    {
+      char buffer[512];
+
+      auto result = snprintf (buffer, sizeof (buffer), args...);
+      if (result < 0)
+      {
+        return result;
+      }
+
+      if (static_cast<std::size_t> (result) < sizeof (buffer))
+      {
+        return std::fwrite (buffer, 1, result, file) == static_cast<std::size_t> (result) ? result : -1;
+      }
+
+      std::vector<char> large (static_cast<std::size_t> (result) + 1);
+      result = snprintf (large.data (), large.size (), args...);
+
+      return std::fwrite (large.data (), 1, result, file) == static_cast<std::size_t> (result) ? result : -1;
+    }
+
+    template<typename ...TArgs>
+    int printf (TArgs && ...args) const
+    {
+      return fprintf (stdout, std::forward<TArgs> (args)...);
+    }
+
+  private:
+    std::string   prefix_text ;
+    char const *  rest_format ;
+  };
+
+  namespace details
+  {
+    constexpr encoded_types_t leading_types (encoded_types_t encoded_types, size_type count) noexcept
+    {
+      return count * type_id__bits >= sizeof (encoded_types_t) * 8
+        ? encoded_types
+        : encoded_types & ((static_cast<encoded_types_t> (1U) << (count * type_id__bits)) - 1U)
+        ;
+    }
+
+    constexpr encoded_types_t trailing_types (encoded_types_t encoded_types, size_type count) noexcept
+    {
+      return count * type_id__bits >= sizeof (encoded_types_t) * 8
+        ? 0U
+        : encoded_types >> (count * type_id__bits)
+        ;
+    }
+
+    constexpr bool is_malformed (encoded_types_t encoded_types) noexcept
+    {
+      return
+          encoded_types == 0U                                 ? false
+        : (encoded_types & type_id__mask) == tid__error_type  ? true
+        : is_malformed (encoded_types >> type_id__bits)
+        ;
+    }
+
+    // Bit n is set if binding n arguments ends inside a conversion
+    constexpr encoded_types_t bind_splits (char const * format) noexcept
+    {
+      index_type      pos     = 0U;
+      size_type       count   = 0U;
+      encoded_types_t splits  = 0U;
+      segment         s       {} ;
+
+      while (next_segment (format, pos, s))
+      {
+        auto arguments = argument_count (s);
+        for (auto iter = 1U; iter < arguments; ++iter)
+        {
+          if (count + iter < sizeof (encoded_types_t) * 8)
+          {
+            splits |= static_cast<encoded_types_t> (1U) << (count + iter);
+          }
+        }
+        count += arguments;
+      }
+
+      return splits;
+    }
+
+    constexpr bool is_split (encoded_types_t splits, size_type count) noexcept
+    {
+      return count < sizeof (encoded_types_t) * 8 && ((splits >> count) & 1U) != 0U;
+    }
+
+    template<encoded_types_t EncodedTypes, encoded_types_t Splits, typename ...TArgs>
+    inline bound_format<trailing_types (EncodedTypes, sizeof... (TArgs))> bind_format (char const * format, TArgs && ...args)
+    {
+      constexpr auto bound_count = static_cast<size_type> (sizeof... (TArgs));
+
+      static_assert (
+          !is_malformed (EncodedTypes)
+        , "Malformed format string"
+        );
+
+      static_assert (
+          !is_split (Splits, bound_count)
+        , "The bound arguments end between a * or %Hp and the arguments it takes"
+        );
+
+      (void) check_types<leading_types (EncodedTypes, bound_count)> (args...);
+
+      std::array<arg, sizeof... (TArgs)> captured;
+      make_args<leading_types (EncodedTypes, bound_count)> (captured, std::forward<TArgs> (args)...);
+
+      std::string prefix (256, '\0');
+      index_type  pos     = 0U;
+
+      for (;;)
+      {
+        output_buffer output (&prefix.front (), prefix.size ());
+
+        // Can't fail, bind_splits rules out ending inside a conversion
+        pos = 0U;
+        auto rendered = render_partial (output, format, pos, captured.data (), bound_count);
+        TYPESAFE_PRINTF__ASSERT (rendered);
+        (void) rendered;
+
+        auto size = output.finish ();
+        if (static_cast<std::size_t> (size) < prefix.size ())
+        {
+          prefix.resize (static_cast<std::size_t> (size));
+          break;
+        }
+
+        prefix.resize (static_cast<std::size_t> (size) + 1);
+      }
+
+      return bound_format<trailing_types (EncodedTypes, bound_count)> (std::move (prefix), format + pos);
+    }
+  }
+}
+
+#endif // TYPESAFE_PRINTF__TSPRINTF_BOUND_HPP
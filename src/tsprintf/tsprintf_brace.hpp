@@ -0,0 +1,640 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+#ifndef TYPESAFE_PRINTF__TSPRINTF_BRACE_HPP
+#define TYPESAFE_PRINTF__TSPRINTF_BRACE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "tsprintf.hpp"
+#include "tsprintf_engine.hpp"
+#include "tsprintf_rt.hpp"
+
+// std::format style formats. The types come from the arguments, at compile
+//  time the format is translated to a printf format with the length
+//  modifiers the arguments need, that format is checked by check_types like
+//  any other and rendered by the realtime renderer (no snprintf)
+//
+//  auto line = TS_BRACE_FORMAT ("{} took {:.3f} ms ({:#x})", name, elapsed, flags);
+//  TS_BRACE_PRINTF ("{:<10}|{:>8}|{:+d}\n", "left", 42, -7);
+//
+// The spec is [[fill]align][sign]['#']['0'][width]['.' precision][type]
+//  with the printf conversions as types (d o x X c s e E f F g G a A p).
+//  Without a type integers are d (u when unsigned), char is c, floats are
+//  g, bool is true/false and strings are s. Strings and chars are left
+//  aligned like std::format. The fill can only be a space, ^ (center),
+//  argument indexes and nested {} aren't supported. {:x} of a negative
+//  number is the two's complement as in printf
+
+// Returns what snprintf would have returned
+#define TS_BRACE_FORMAT_TO(buffer, buffer_size, format, ...)                                                        \
+  [] (char * typesafe_printf__buffer, std::size_t typesafe_printf__size, auto && ...typesafe_printf__args) noexcept \
+  {                                                                                                                 \
+    TYPESAFE_PRINTF__BRACE_TRANSLATE (format);                                                                      \
+    return typesafe_printf::details::brace_format_to<TYPESAFE_PRINTF__BRACE_CHECKED> (                              \
+        typesafe_printf__buffer                                                                                     \
+      , typesafe_printf__size                                                                                       \
+      , typesafe_printf__brace.chars                                                                                \
+      , std::forward<decltype (typesafe_printf__args)> (typesafe_printf__args)...                                   \
+      );                                                                                                            \
+  } (buffer, buffer_size, ##__VA_ARGS__)
+
+#define TS_BRACE_FORMAT(format, ...)                                                                                \
+  [] (auto && ...typesafe_printf__args)                                                                             \
+  {                                                                                                                 \
+    TYPESAFE_PRINTF__BRACE_TRANSLATE (format);                                                                      \
+    return typesafe_printf::details::brace_format_to_string<TYPESAFE_PRINTF__BRACE_CHECKED> (                       \
+        typesafe_printf__brace.chars                                                                                \
+      , std::forward<decltype (typesafe_printf__args)> (typesafe_printf__args)...                                   \
+      );                                                                                                            \
+  } (__VA_ARGS__)
+
+// Returns the number of chars written or -1
+#define TS_BRACE_FPRINTF(stream, format, ...)                                                                       \
+  [] (std::FILE * typesafe_printf__stream, auto && ...typesafe_printf__args)                                        \
+  {                                                                                                                 \
+    TYPESAFE_PRINTF__BRACE_TRANSLATE (format);                                                                      \
+    return typesafe_printf::details::brace_fprintf<TYPESAFE_PRINTF__BRACE_CHECKED> (                                \
+        typesafe_printf__stream                                                                                     \
+      , typesafe_printf__brace.chars                                                                                \
+      , std::forward<decltype (typesafe_printf__args)> (typesafe_printf__args)...                                   \
+      );                                                                                                            \
+  } (stream, ##__VA_ARGS__)
+
+#define TS_BRACE_PRINTF(format, ...)                                                                                \
+  TS_BRACE_FPRINTF (stdout, format, ##__VA_ARGS__)
+
+// The translation is a static in the lambda so it's done at compile time
+//  once per format and argument types
+#define TYPESAFE_PRINTF__BRACE_TRANSLATE(format)                                                                    \
+  using typesafe_printf__types = typesafe_printf::details::brace_types<                                             \
+    decltype (typesafe_printf::details::brace_type_list (typesafe_printf__args...))>;                               \
+  static constexpr auto typesafe_printf__brace = typesafe_printf::details::brace_translate<sizeof (format) * 4U> (   \
+      format                                                                                                        \
+    , typesafe_printf__types::ids                                                                                   \
+    , typesafe_printf__types::chars                                                                                 \
+    , typesafe_printf__types::count                                                                                 \
+    );                                                                                                              \
+  static_assert (typesafe_printf::details::check_brace<typesafe_printf__brace.problem> (), "")
+
+#define TYPESAFE_PRINTF__BRACE_CHECKED                                                                              \
+    typesafe_printf::details::scanner::encode (typesafe_printf__brace.chars)                                        \
+  , typesafe_printf::details::rt_violation (typesafe_printf__brace.chars)
+
+namespace typesafe_printf
+{
+  namespace details
+  {
+    // The value passed on for an argument, the type of it decides the
+    //  default conversion and the length modifier
+    template<typename T>
+    struct brace_converter
+    {
+      static T const & apply (T const & value) noexcept
+      {
+        return value;
+      }
+    };
+
+    template<>
+    struct brace_converter<char>
+    {
+      static int apply (char value) noexcept
+      {
+        return value;
+      }
+    };
+
+    template<>
+    struct brace_converter<float>
+    {
+      static double apply (float value) noexcept
+      {
+        return value;
+      }
+    };
+
+    template<>
+    struct brace_converter<bool>
+    {
+      static char const * apply (bool value) noexcept
+      {
+        return value ? "true" : "false";
+      }
+    };
+
+    template<>
+    struct brace_converter<std::string>
+    {
+      static char const * apply (std::string const & value) noexcept
+      {
+        return value.c_str ();
+      }
+    };
+
+    template<typename T>
+    struct brace_converter<T *>
+    {
+      static void const * apply (T const * value) noexcept
+      {
+        return value;
+      }
+    };
+
+    template<>
+    struct brace_converter<std::nullptr_t>
+    {
+      static void const * apply (std::nullptr_t) noexcept
+      {
+        return nullptr;
+      }
+    };
+
+    template<>
+    struct brace_converter<char *>
+    {
+      static char const * apply (char const * value) noexcept
+      {
+        return value;
+      }
+    };
+
+    template<>
+    struct brace_converter<char const *>
+    {
+      static char const * apply (char const * value) noexcept
+      {
+        return value;
+      }
+    };
+
+    template<>
+    struct brace_converter<wchar_t *>
+    {
+      static wchar_t const * apply (wchar_t const * value) noexcept
+      {
+        return value;
+      }
+    };
+
+    template<>
+    struct brace_converter<wchar_t const *>
+    {
+      static wchar_t const * apply (wchar_t const * value) noexcept
+      {
+        return value;
+      }
+    };
+
+    template<typename T>
+    inline auto brace_value (T && value) noexcept -> decltype (brace_converter<typename std::decay<T>::type>::apply (value))
+    {
+      return brace_converter<typename std::decay<T>::type>::apply (value);
+    }
+
+    template<typename T>
+    using brace_value_t = typename std::decay<decltype (brace_converter<T>::apply (std::declval<T const &> ()))>::type;
+
+    // The inverse of type_id_map for the types brace_converter passes on
+    template<typename T>
+    struct brace_type_id : std::integral_constant<type_id, tid__error_type>
+    {
+    };
+
+#define TYPESAFE_PRINTF__BRACE_TYPE(type, tid)                      \
+    template<>                                                      \
+    struct brace_type_id<type> : std::integral_constant<type_id, tid> \
+    {                                                               \
+    }
+
+    TYPESAFE_PRINTF__BRACE_TYPE (signed char        , tid__signed_char        );
+    TYPESAFE_PRINTF__BRACE_TYPE (short              , tid__short              );
+    TYPESAFE_PRINTF__BRACE_TYPE (int                , tid__int                );
+    TYPESAFE_PRINTF__BRACE_TYPE (long               , tid__long               );
+    TYPESAFE_PRINTF__BRACE_TYPE (long long          , tid__long_long          );
+    TYPESAFE_PRINTF__BRACE_TYPE (unsigned char      , tid__unsigned_char      );
+    TYPESAFE_PRINTF__BRACE_TYPE (unsigned short     , tid__unsigned_short     );
+    TYPESAFE_PRINTF__BRACE_TYPE (unsigned int       , tid__unsigned_int       );
+    TYPESAFE_PRINTF__BRACE_TYPE (unsigned long      , tid__unsigned_long      );
+    TYPESAFE_PRINTF__BRACE_TYPE (unsigned long long , tid__unsigned_long_long );
+    TYPESAFE_PRINTF__BRACE_TYPE (double             , tid__double             );
+    TYPESAFE_PRINTF__BRACE_TYPE (long double        , tid__long_double        );
+    TYPESAFE_PRINTF__BRACE_TYPE (char const *       , tid__char_p             );
+    TYPESAFE_PRINTF__BRACE_TYPE (wchar_t const *    , tid__wchar_t_p          );
+    TYPESAFE_PRINTF__BRACE_TYPE (void const *       , tid__void_p             );
+
+#undef TYPESAFE_PRINTF__BRACE_TYPE
+
+    // Only used in decltype, collects the argument types
+    template<typename ...TArgs>
+    type_list<typename std::decay<TArgs>::type...> brace_type_list (TArgs && ...args) noexcept;
+
+    template<size_type Index, typename ...TArgs>
+    struct brace_encoder
+    {
+      static constexpr encoded_types_t ids    = 0U;
+      static constexpr encoded_types_t chars  = 0U;
+    };
+
+    template<size_type Index, typename THead, typename ...TTail>
+    struct brace_encoder<Index, THead, TTail...>
+    {
+      using tail = brace_encoder<Index + 1U, TTail...>;
+
+      static constexpr encoded_types_t ids    = scanner::merge_type (tail::ids, Index, brace_type_id<brace_value_t<THead>>::value);
+      // Bit per argument that is a char, those are %c by default
+      static constexpr encoded_types_t chars  = (std::is_same<THead, char>::value ? 1ULL << Index : 0U) | tail::chars;
+    };
+
+    template<typename TList>
+    struct brace_types;
+
+    template<typename ...TArgs>
+    struct brace_types<type_list<TArgs...>>
+    {
+      static constexpr encoded_types_t  ids   = brace_encoder<0U, TArgs...>::ids   ;
+      static constexpr encoded_types_t  chars = brace_encoder<0U, TArgs...>::chars ;
+      static constexpr size_type        count = sizeof... (TArgs)                  ;
+    };
+
+    enum brace_problem
+    {
+      bp__none              ,
+      bp__malformed         ,
+      bp__unsupported_type  ,
+    };
+
+    template<brace_problem Problem>
+    constexpr bool check_brace () noexcept
+    {
+      static_assert (Problem != bp__malformed       , "Malformed brace format string (fill other than space, ^, argument indexes and nested {} aren't supported)");
+      static_assert (Problem != bp__unsupported_type, "Argument type can't be formatted (see argument list)");
+      return true;
+    }
+
+    // The printf format for a brace format, chars is '\0' terminated
+    template<std::size_t Size>
+    struct brace_translation
+    {
+      char            chars[Size] ;
+      brace_problem   problem     ;
+    };
+
+    constexpr bool is_brace_type (char ch) noexcept
+    {
+      return scanner::any_of (ch, "AEFGXacdefgopsx");
+    }
+
+    constexpr bool is_brace_digit (char ch) noexcept
+    {
+      return ch >= '0' && ch <= '9';
+    }
+
+    constexpr char const * brace_length_modifier (type_id tid, char conversion) noexcept
+    {
+      return scanner::any_of (conversion, "diouxX")
+        ? ( tid == tid__signed_char || tid == tid__unsigned_char        ? "hh"
+          : tid == tid__short       || tid == tid__unsigned_short       ? "h"
+          : tid == tid__long        || tid == tid__unsigned_long        ? "l"
+          : tid == tid__long_long   || tid == tid__unsigned_long_long   ? "ll"
+          : ""
+          )
+        : conversion == 's' && tid == tid__wchar_t_p
+        ? "l"
+        : scanner::any_of (conversion, "AEFGaefg") && tid == tid__long_double
+        ? "L"
+        : ""
+        ;
+    }
+
+    template<std::size_t Size>
+    constexpr void brace_put (brace_translation<Size> & t, std::size_t & out, char ch) noexcept
+    {
+      if (out + 1U < Size)
+      {
+        t.chars[out++] = ch;
+      }
+    }
+
+    template<std::size_t Size>
+    constexpr void brace_put (brace_translation<Size> & t, std::size_t & out, char const * s, std::size_t begin, std::size_t end) noexcept
+    {
+      for (auto iter = begin; iter < end; ++iter)
+      {
+        brace_put (t, out, s[iter]);
+      }
+    }
+
+    template<std::size_t Size, std::size_t N>
+    constexpr brace_translation<Size> brace_translate (
+        char const (&format) [N]
+      , encoded_types_t ids
+      , encoded_types_t chars
+      , size_type       count
+      ) noexcept
+    {
+      brace_translation<Size> t       {};
+      std::size_t             out     = 0U;
+      std::size_t             pos     = 0U;
+      size_type               index   = 0U;
+
+      while (pos < N && format[pos] != '\0')
+      {
+        auto ch = format[pos++];
+
+        if (ch == '%')
+        {
+          brace_put (t, out, '%');
+          brace_put (t, out, '%');
+          continue;
+        }
+
+        if (ch == '}')
+        {
+          if (format[pos] == '}')
+          {
+            ++pos;
+            brace_put (t, out, '}');
+          }
+          else
+          {
+            t.problem = bp__malformed;
+          }
+          continue;
+        }
+
+        if (ch != '{')
+        {
+          brace_put (t, out, ch);
+          continue;
+        }
+
+        if (format[pos] == '{')
+        {
+          ++pos;
+          brace_put (t, out, '{');
+          continue;
+        }
+
+        char        align           = '\0';
+        char        sign            = '\0';
+        bool        alternate       = false;
+        bool        zero_pad        = false;
+        std::size_t width_begin     = 0U;
+        std::size_t width_end       = 0U;
+        std::size_t precision_begin = 0U;
+        std::size_t precision_end   = 0U;
+        char        type            = '\0';
+        bool        is_valid        = true;
+
+        if (format[pos] == ':')
+        {
+          ++pos;
+
+          if (format[pos] != '\0' && scanner::any_of (format[pos + 1], "<>^"))
+          {
+            is_valid  = format[pos] == ' ';
+            align     = format[pos + 1];
+            pos       += 2U;
+          }
+          else if (scanner::any_of (format[pos], "<>^"))
+          {
+            align     = format[pos++];
+          }
+
+          if (format[pos] == '+' || format[pos] == '-' || format[pos] == ' ')
+          {
+            sign = format[pos++];
+          }
+
+          if (format[pos] == '#')
+          {
+            alternate = true;
+            ++pos;
+          }
+
+          if (format[pos] == '0')
+          {
+            zero_pad = true;
+            ++pos;
+          }
+
+          width_begin = pos;
+          while (is_brace_digit (format[pos]))
+          {
+            ++pos;
+          }
+          width_end = pos;
+
+          if (format[pos] == '.')
+          {
+            precision_begin = ++pos;
+            while (is_brace_digit (format[pos]))
+            {
+              ++pos;
+            }
+            precision_end = pos;
+            is_valid      = is_valid && precision_end > precision_begin;
+          }
+
+          if (is_brace_type (format[pos]))
+          {
+            type = format[pos++];
+          }
+        }
+
+        if (format[pos] != '}' || align == '^' || !is_valid)
+        {
+          t.problem = bp__malformed;
+          while (pos < N && format[pos] != '\0' && format[pos++] != '}')
+          {
+          }
+          // Keeps the argument count so the other arguments are still checked
+          brace_put (t, out, "%hhs", 0U, 4U);
+          ++index;
+          continue;
+        }
+        ++pos;
+
+        auto tid        = index < count ? type_id_at (ids, index) : tid__illegal;
+        auto is_char    = index < max_encoded_types && (chars & (1ULL << index)) != 0U;
+        auto tc         = get_type_class (tid);
+        ++index;
+
+        if (tid == tid__error_type && t.problem == bp__none)
+        {
+          t.problem = bp__unsupported_type;
+        }
+
+        auto conversion = type;
+        if (conversion == '\0')
+        {
+          conversion =
+              is_char                           ? 'c'
+            : tc == tc__unsigned_integer        ? 'u'
+            : tc == tc__double                  ? 'g'
+            : tc == tc__long_double             ? 'g'
+            : tc == tc__char_p                  ? 's'
+            : tc == tc__wchar_t_p               ? 's'
+            : tc == tc__void_p                  ? 'p'
+            : 'd'
+            ;
+        }
+        else if (conversion == 'd' && tc == tc__unsigned_integer)
+        {
+          conversion = 'u';
+        }
+
+        brace_put (t, out, '%');
+        if (align == '<' || (align == '\0' && width_end > width_begin && (conversion == 's' || conversion == 'c')))
+        {
+          brace_put (t, out, '-');
+        }
+        if (sign == '+' || sign == ' ')
+        {
+          brace_put (t, out, sign);
+        }
+        if (alternate)
+        {
+          brace_put (t, out, '#');
+        }
+        if (zero_pad)
+        {
+          brace_put (t, out, '0');
+        }
+        brace_put (t, out, format, width_begin, width_end);
+        if (precision_end > precision_begin)
+        {
+          brace_put (t, out, '.');
+          brace_put (t, out, format, precision_begin, precision_end);
+        }
+        auto modifier = brace_length_modifier (tid, conversion);
+        while (*modifier != '\0')
+        {
+          brace_put (t, out, *modifier++);
+        }
+        brace_put (t, out, conversion);
+      }
+
+      t.chars[out] = '\0';
+      return t;
+    }
+
+    // {:x} of a signed integer is printed as %x, lets the integer pass as
+    //  the unsigned type of the same size
+    template<type_id Tid, typename T>
+    constexpr auto brace_cast (T value) noexcept -> typename std::conditional<
+        std::is_integral<T>::value && std::is_integral<type_id_map_t<Tid>>::value && sizeof (T) == sizeof (type_id_map_t<Tid>)
+      , type_id_map_t<Tid>
+      , T
+      >::type
+    {
+      return static_cast<typename std::conditional<
+          std::is_integral<T>::value && std::is_integral<type_id_map_t<Tid>>::value && sizeof (T) == sizeof (type_id_map_t<Tid>)
+        , type_id_map_t<Tid>
+        , T
+        >::type> (value);
+    }
+
+    template<encoded_types_t EncodedTypes, std::size_t ...Indices, typename ...TArgs>
+    inline void brace_args (std::array<arg, sizeof... (TArgs)> & captured, std::index_sequence<Indices...>, TArgs && ...args) noexcept
+    {
+      (void) check_types<EncodedTypes> (brace_cast<type_id_at (EncodedTypes, Indices)> (brace_value (args))...);
+      make_args<EncodedTypes> (captured, brace_cast<type_id_at (EncodedTypes, Indices)> (brace_value (args))...);
+    }
+
+    // Use TS_BRACE_FORMAT_TO, it translates and checks the format
+    template<encoded_types_t EncodedTypes, rt_violation_kind Violation, typename ...TArgs>
+    inline int brace_format_to (char * buffer, std::size_t size, char const * format, TArgs && ...args) noexcept
+    {
+      static_assert (check_rt<Violation> (), "");
+
+      std::array<arg, sizeof... (TArgs)> captured;
+      brace_args<EncodedTypes> (captured, std::index_sequence_for<TArgs...> (), std::forward<TArgs> (args)...);
+
+      rt_output output (buffer, size);
+      return rt_render (output, format, captured.data (), static_cast<size_type> (captured.size ()));
+    }
+
+    // Use TS_BRACE_FORMAT, it translates and checks the format
+    template<encoded_types_t EncodedTypes, rt_violation_kind Violation, typename ...TArgs>
+    inline std::string brace_format_to_string (char const * format, TArgs && ...args)
+    {
+      static_assert (check_rt<Violation> (), "");
+
+      std::array<arg, sizeof... (TArgs)> captured;
+      brace_args<EncodedTypes> (captured, std::index_sequence_for<TArgs...> (), std::forward<TArgs> (args)...);
+      auto count = static_cast<size_type> (captured.size ());
+
+      char      buffer[256];
+      rt_output output (buffer, sizeof (buffer));
+      auto      size = rt_render (output, format, captured.data (), count);
+      if (size < 0)
+      {
+        return std::string ();
+      }
+      else if (static_cast<std::size_t> (size) < sizeof (buffer))
+      {
+        return std::string (buffer, static_cast<std::size_t> (size));
+      }
+
+      std::string result (static_cast<std::size_t> (size) + 1U, '\0');
+      rt_output   large_output (&result.front (), result.size ());
+      rt_render (large_output, format, captured.data (), count);
+      result.resize (static_cast<std::size_t> (size));
+      return result;
+    }
+
+    // Use TS_BRACE_FPRINTF, it translates and checks the format
+    template<encoded_types_t EncodedTypes, rt_violation_kind Violation, typename ...TArgs>
+    inline int brace_fprintf (std::FILE * stream, char const * format, TArgs && ...args)
+    {
+      static_assert (check_rt<Violation> (), "");
+
+      std::array<arg, sizeof... (TArgs)> captured;
+      brace_args<EncodedTypes> (captured, std::index_sequence_for<TArgs...> (), std::forward<TArgs> (args)...);
+      auto count = static_cast<size_type> (captured.size ());
+
+      char      buffer[256];
+      rt_output output (buffer, sizeof (buffer));
+      auto      size = rt_render (output, format, captured.data (), count);
+      if (size < 0)
+      {
+        return -1;
+      }
+
+      auto text = static_cast<char const *> (buffer);
+      std::vector<char> large;
+      if (static_cast<std::size_t> (size) >= sizeof (buffer))
+      {
+        large.resize (static_cast<std::size_t> (size) + 1U);
+        rt_output large_output (large.data (), large.size ());
+        rt_render (large_output, format, captured.data (), count);
+        text = large.data ();
+      }
+
+      return std::fwrite (text, 1, static_cast<std::size_t> (size), stream) == static_cast<std::size_t> (size) ? size : -1;
+    }
+  }
+}
+
+#endif // TYPESAFE_PRINTF__TSPRINTF_BRACE_HPP
@@ -0,0 +1,425 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+#ifndef TYPESAFE_PRINTF__TSPRINTF_CONSTEXPR_HPP
+#define TYPESAFE_PRINTF__TSPRINTF_CONSTEXPR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <type_traits>
+#include <utility>
+
+#include "tsprintf.hpp"
+#include "tsprintf_engine.hpp"
+
+// Formats at compile time when all arguments are constant expressions.
+//  Supports integers (%d %i %u %o %x %X), %c and strings (%s) with flags,
+//  width and precision (also *). The output is the same as from TS_SPRINTF.
+//
+//  constexpr auto banner = TS_CONSTEXPR_FORMAT ("%s v%d.%d.%d", "tsprintf", 1, 2, 3);
+//  TS_CONSTEXPR_PRINTF ("%-8s|%08x\n", "schema", 0xBEEFU);
+
+#define TS_CONSTEXPR_FORMAT(format, ...)                                                                                    \
+  ( (void) typesafe_printf::details::check_constexpr_types<typesafe_printf::details::scanner::encode (format)> (__VA_ARGS__) \
+  , typesafe_printf::details::constexpr_format<typesafe_printf::details::constexpr_format_size (format, ##__VA_ARGS__)> (format, ##__VA_ARGS__) \
+  )
+
+#define TS_CONSTEXPR_FPRINTF(stream, format, ...)                                                                           \
+  {                                                                                                                         \
+    static constexpr auto typesafe_printf__text = TS_CONSTEXPR_FORMAT (format, ##__VA_ARGS__);                              \
+    std::fwrite (typesafe_printf__text.c_str (), 1, typesafe_printf__text.size (), stream);                                 \
+  }
+
+#define TS_CONSTEXPR_PRINTF(format, ...)                                                                                    \
+  TS_CONSTEXPR_FPRINTF (stdout, format, ##__VA_ARGS__)
+
+namespace typesafe_printf
+{
+  // A '\0' terminated string of Size chars
+  template<std::size_t Size>
+  struct static_string
+  {
+    char chars[Size + 1];
+
+    constexpr char const * c_str () const noexcept
+    {
+      return chars;
+    }
+
+    constexpr std::size_t size () const noexcept
+    {
+      return Size;
+    }
+  };
+
+  namespace details
+  {
+    constexpr bool is_constexpr_type (type_id tid) noexcept
+    {
+      return
+            tid == tid__error_type  // Reported by check_types
+        ||  tid == tid__char_p
+        ||  (tid != tid__wint_t && get_type_class (tid) == tc__signed_integer)
+        ||  (tid != tid__wint_t && get_type_class (tid) == tc__unsigned_integer)
+        ;
+    }
+
+    constexpr bool are_constexpr_types (encoded_types_t encoded_types) noexcept
+    {
+      return
+          encoded_types == 0U
+        ||  (   is_constexpr_type (static_cast<type_id> (encoded_types & type_id__mask))
+            &&  are_constexpr_types (encoded_types >> type_id__bits)
+            )
+        ;
+    }
+
+    template<encoded_types_t EncodedTypes, typename ...TArgs>
+    constexpr int check_constexpr_types (TArgs && ...args) noexcept
+    {
+      static_assert (
+          are_constexpr_types (EncodedTypes)
+        , "Only integers, chars and strings can be formatted at compile time"
+        );
+      return check_types<EncodedTypes> (std::forward<TArgs> (args)...);
+    }
+
+    struct constexpr_arg
+    {
+      char const *    string    ;
+      std::uintmax_t  magnitude ;
+      bool            negative  ;
+    };
+
+    template<typename T>
+    constexpr typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, constexpr_arg>::type make_constexpr_arg (T value) noexcept
+    {
+      return constexpr_arg
+        {
+          nullptr
+        , value < 0 ? 0U - static_cast<std::uintmax_t> (value) : static_cast<std::uintmax_t> (value)
+        , value < 0
+        };
+    }
+
+    template<typename T>
+    constexpr typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value, constexpr_arg>::type make_constexpr_arg (T value) noexcept
+    {
+      return constexpr_arg { nullptr, value, false };
+    }
+
+    constexpr constexpr_arg make_constexpr_arg (char const * value) noexcept
+    {
+      return constexpr_arg { value, 0U, false };
+    }
+
+    // Other types are reported by check_constexpr_types
+    template<typename T>
+    constexpr typename std::enable_if<!std::is_integral<T>::value && !std::is_convertible<T, char const *>::value, constexpr_arg>::type make_constexpr_arg (T) noexcept
+    {
+      return constexpr_arg { nullptr, 0U, false };
+    }
+
+    // Counts only when out is nullptr
+    struct constexpr_writer
+    {
+      constexpr void put (char ch) noexcept
+      {
+        if (out)
+        {
+          out[size] = ch;
+        }
+        ++size;
+      }
+
+      constexpr void fill (char ch, std::size_t count) noexcept
+      {
+        for (auto iter = 0U; iter < count; ++iter)
+        {
+          put (ch);
+        }
+      }
+
+      char *      out   ;
+      std::size_t size  ;
+    };
+
+    struct constexpr_spec
+    {
+      bool        left_justify  ;
+      bool        plus_sign     ;
+      bool        space_sign    ;
+      bool        alternate     ;
+      bool        zero_pad      ;
+      std::size_t width         ;
+      bool        has_precision ;
+      std::size_t precision     ;
+      char        conversion    ;
+    };
+
+    // * takes the width or precision from args, a negative width is a '-'
+    //  flag and a negative precision is the same as no precision
+    constexpr index_type parse_constexpr_spec (
+        char const *          format
+      , index_type            pos
+      , constexpr_spec &      spec
+      , constexpr_arg const * args
+      , size_type &           count
+      ) noexcept
+    {
+      for (;; ++pos)
+      {
+        switch (format[pos])
+        {
+        case '-': spec.left_justify = true; continue;
+        case '+': spec.plus_sign    = true; continue;
+        case ' ': spec.space_sign   = true; continue;
+        case '#': spec.alternate    = true; continue;
+        case '0': spec.zero_pad     = true; continue;
+        default : break;
+        }
+        break;
+      }
+
+      if (format[pos] == '*')
+      {
+        ++pos;
+        auto & a = args[count++];
+        spec.width        = static_cast<std::size_t> (a.magnitude);
+        spec.left_justify = spec.left_justify || a.negative;
+      }
+
+      while (format[pos] >= '0' && format[pos] <= '9')
+      {
+        spec.width = spec.width * 10 + static_cast<std::size_t> (format[pos++] - '0');
+      }
+
+      if (format[pos] == '.')
+      {
+        ++pos;
+        spec.has_precision = true;
+
+        if (format[pos] == '*')
+        {
+          ++pos;
+          auto & a = args[count++];
+          spec.has_precision  = !a.negative;
+          spec.precision      = a.negative ? 0U : static_cast<std::size_t> (a.magnitude);
+        }
+
+        while (format[pos] >= '0' && format[pos] <= '9')
+        {
+          spec.precision = spec.precision * 10 + static_cast<std::size_t> (format[pos++] - '0');
+        }
+      }
+
+      // The argument type is already known
+      while (format[pos] == 'h' || format[pos] == 'l' || format[pos] == 'j' || format[pos] == 'z' || format[pos] == 't')
+      {
+        ++pos;
+      }
+
+      spec.conversion = format[pos++];
+      return pos;
+    }
+
+    constexpr void constexpr_render_string (constexpr_writer & w, constexpr_spec const & spec, char const * s) noexcept
+    {
+      // Same as glibc
+      if (!s)
+      {
+        s = "(null)";
+      }
+
+      std::size_t length = 0U;
+      while (s[length] != '\0' && (!spec.has_precision || length < spec.precision))
+      {
+        ++length;
+      }
+
+      auto padding = spec.width > length ? spec.width - length : 0U;
+
+      if (!spec.left_justify)
+      {
+        w.fill (' ', padding);
+      }
+
+      for (auto iter = 0U; iter < length; ++iter)
+      {
+        w.put (s[iter]);
+      }
+
+      if (spec.left_justify)
+      {
+        w.fill (' ', padding);
+      }
+    }
+
+    constexpr void constexpr_render_char (constexpr_writer & w, constexpr_spec const & spec, char ch) noexcept
+    {
+      auto padding = spec.width > 1U ? spec.width - 1U : 0U;
+
+      if (!spec.left_justify)
+      {
+        w.fill (' ', padding);
+      }
+
+      w.put (ch);
+
+      if (spec.left_justify)
+      {
+        w.fill (' ', padding);
+      }
+    }
+
+    constexpr void constexpr_render_integer (constexpr_writer & w, constexpr_spec const & spec, constexpr_arg const & a) noexcept
+    {
+      auto is_hex     = spec.conversion == 'x' || spec.conversion == 'X';
+      auto is_signed  = spec.conversion == 'd' || spec.conversion == 'i';
+      auto base       = spec.conversion == 'o' ? 8U : is_hex ? 16U : 10U;
+      auto digit_set  = spec.conversion == 'X' ? "0123456789ABCDEF" : "0123456789abcdef";
+
+      char        digits[24] {};
+      std::size_t digit_count = 0U;
+
+      for (auto v = a.magnitude; v != 0U; v /= base)
+      {
+        digits[digit_count++] = digit_set[v % base];
+      }
+
+      std::size_t min_digits = spec.has_precision ? spec.precision : 1U;
+      if (spec.alternate && spec.conversion == 'o' && min_digits <= digit_count)
+      {
+        min_digits = digit_count + 1U;
+      }
+
+      char sign =
+          !is_signed        ? '\0'
+        : a.negative        ? '-'
+        : spec.plus_sign    ? '+'
+        : spec.space_sign   ? ' '
+        : '\0'
+        ;
+
+      auto prefix = spec.alternate && is_hex && a.magnitude != 0U;
+
+      auto zeros  = min_digits > digit_count ? min_digits - digit_count : 0U;
+      auto length = (sign ? 1U : 0U) + (prefix ? 2U : 0U) + zeros + digit_count;
+
+      if (spec.zero_pad && !spec.left_justify && !spec.has_precision && spec.width > length)
+      {
+        zeros   += spec.width - length;
+        length  =  spec.width;
+      }
+
+      auto padding = spec.width > length ? spec.width - length : 0U;
+
+      if (!spec.left_justify)
+      {
+        w.fill (' ', padding);
+      }
+
+      if (sign)
+      {
+        w.put (sign);
+      }
+
+      if (prefix)
+      {
+        w.put ('0');
+        w.put (spec.conversion);
+      }
+
+      w.fill ('0', zeros);
+
+      while (digit_count > 0U)
+      {
+        w.put (digits[--digit_count]);
+      }
+
+      if (spec.left_justify)
+      {
+        w.fill (' ', padding);
+      }
+    }
+
+    constexpr void constexpr_render (constexpr_writer & w, char const * format, constexpr_arg const * args) noexcept
+    {
+      index_type  pos   = 0U;
+      size_type   count = 0U;
+
+      while (format[pos] != '\0')
+      {
+        if (format[pos] != '%')
+        {
+          w.put (format[pos++]);
+          continue;
+        }
+
+        ++pos;
+
+        if (format[pos] == '%')
+        {
+          w.put (format[pos++]);
+          continue;
+        }
+
+        constexpr_spec spec {};
+        pos = parse_constexpr_spec (format, pos, spec, args, count);
+
+        auto & a = args[count++];
+        switch (spec.conversion)
+        {
+        case 's':
+          constexpr_render_string (w, spec, a.string);
+          break;
+        case 'c':
+          constexpr_render_char (w, spec, static_cast<char> (a.negative ? 0U - a.magnitude : a.magnitude));
+          break;
+        default:
+          constexpr_render_integer (w, spec, a);
+          break;
+        }
+      }
+    }
+
+    template<typename ...TArgs>
+    constexpr std::size_t constexpr_format_size (char const * format, TArgs ...args) noexcept
+    {
+      // The first element keeps the array from being empty
+      constexpr_arg const captured[] = { constexpr_arg { nullptr, 0U, false }, make_constexpr_arg (args)... };
+
+      constexpr_writer w { nullptr, 0U };
+      constexpr_render (w, format, captured + 1);
+      return w.size;
+    }
+
+    template<std::size_t Size, typename ...TArgs>
+    constexpr static_string<Size> constexpr_format (char const * format, TArgs ...args) noexcept
+    {
+      constexpr_arg const captured[] = { constexpr_arg { nullptr, 0U, false }, make_constexpr_arg (args)... };
+
+      static_string<Size> result {};
+
+      constexpr_writer w { result.chars, 0U };
+      constexpr_render (w, format, captured + 1);
+      return result;
+    }
+  }
+}
+
+#endif // TYPESAFE_PRINTF__TSPRINTF_CONSTEXPR_HPP
@@ -0,0 +1,448 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+#ifndef TYPESAFE_PRINTF__TSPRINTF_CSV_HPP
+#define TYPESAFE_PRINTF__TSPRINTF_CSV_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tsprintf.hpp"
+#include "tsprintf_engine.hpp"
+#include "tsprintf_escape.hpp"
+#include "tsprintf_rt.hpp"
+
+// CSV and TSV rows. The schema is a format with a conversion per column, the
+//  rows are checked against it at compile time. Rows are collected in a
+//  large block that is written to the file descriptor with one write when
+//  full, a block only holds whole rows
+//
+//  auto w = TS_CSV_WRITER (fd, csv::cd__csv, "%s,%d,%.3f");
+//  w.header ({ "name", "count", "ratio" });
+//  for (auto & r : results)
+//  {
+//    w.row (r.name, r.count, r.ratio);
+//  }
+//  w.flush ();
+//
+// Text between the conversions of the schema is ignored, the writer puts
+//  the delimiter between the columns and ends rows with \n. Only text
+//  columns (%s, %ls, %c) are scanned for chars that need quoting. CSV
+//  quotes a field with , " \r or \n in it and doubles the ", TSV escapes
+//  tab, newline, carriage return and backslash the C way
+
+// Returns a csv::writer for the schema
+#define TS_CSV_WRITER(fd, dialect, schema)                                                                          \
+  typesafe_printf::csv::writer<typesafe_printf::details::scanner::encode (schema)> (fd, dialect, schema)
+
+namespace typesafe_printf
+{
+  namespace csv
+  {
+    enum dialect
+    {
+      cd__csv ,
+      cd__tsv ,
+    };
+  }
+
+  namespace details
+  {
+    constexpr bool has_chars_written (encoded_types_t encoded_types) noexcept
+    {
+      return
+          encoded_types == 0U                                                                       ? false
+        : get_type_class (static_cast<type_id> (encoded_types & type_id__mask)) == tc__chars_written ? true
+        : has_chars_written (encoded_types >> type_id__bits)
+        ;
+    }
+
+    // Appends the quoted or escaped field to out
+    inline void append_csv_field (std::string & out, char const * begin, char const * end, csv::dialect dialect)
+    {
+      if (dialect == csv::cd__csv)
+      {
+        out += '"';
+        for (; begin < end; ++begin)
+        {
+          if (*begin == '"')
+          {
+            out += '"';
+          }
+          out += *begin;
+        }
+        out += '"';
+        return;
+      }
+
+      for (; begin < end; ++begin)
+      {
+        switch (*begin)
+        {
+        case '\t' : out += "\\t" ; break;
+        case '\n' : out += "\\n" ; break;
+        case '\r' : out += "\\r" ; break;
+        case '\\' : out += "\\\\"; break;
+        default   : out += *begin; break;
+        }
+      }
+    }
+
+    // Renders value like %.*f with precision 0-9 ending at end and returns the
+    //  first char, or nullptr if snprintf has to do it. value * 10^precision
+    //  is rounded once, below 2^40 the error is less than 2^-13 so unless the
+    //  fraction is close to .5 the rounding is the same as for the exact value
+    inline char * format_fixed (char * end, double value, int precision) noexcept
+    {
+      static double const scales[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+
+      auto magnitude  = std::fabs (value) * scales[precision];
+      if (!(magnitude < 1099511627776.0))
+      {
+        return nullptr;
+      }
+
+      auto whole      = std::floor (magnitude);
+      auto fraction   = magnitude - whole;
+      if (std::fabs (fraction - 0.5) < 0.0009765625)
+      {
+        return nullptr;
+      }
+
+      auto m          = static_cast<std::uint64_t> (whole) + (fraction > 0.5 ? 1U : 0U);
+      auto first      = end;
+      for (auto iter = 0; iter < precision; ++iter)
+      {
+        *--first = static_cast<char> ('0' + m % 10U);
+        m /= 10U;
+      }
+
+      if (precision > 0)
+      {
+        *--first = '.';
+      }
+
+      first = format_decimal (first, m);
+
+      // Like printf -0.0001 is -0.000
+      if (std::signbit (value))
+      {
+        *--first = '-';
+      }
+
+      return first;
+    }
+
+    // The precision of a column rendered by format_fixed: %f or %.<0-9>f
+    //  without flags or width, -1 for other columns
+    inline int fixed_precision (char const * format, segment const & s) noexcept
+    {
+      if (s.tid != tid__double || format[s.end - 1] != 'f')
+      {
+        return -1;
+      }
+
+      auto spec = format + s.begin + 1;
+      auto last = format + s.end - 1;
+      if (spec == last)
+      {
+        return 6;
+      }
+
+      if (*spec != '.' || last - spec > 2)
+      {
+        return -1;
+      }
+
+      return spec + 1 == last ? 0 : (*(spec + 1) >= '0' && *(spec + 1) <= '9' ? *(spec + 1) - '0' : -1);
+    }
+
+    struct csv_column
+    {
+      segment s         ;
+      int     precision ; // For format_fixed, -1 if not
+      bool    text      ; // Quoted when needed
+    };
+
+    inline char const * find_csv_special (char const * begin, char const * end, csv::dialect dialect) noexcept
+    {
+      return dialect == csv::cd__csv
+        ? find_any_of (begin, end, ',' , '"' , '\n', '\r')
+        : find_any_of (begin, end, '\t', '\\', '\n', '\r')
+        ;
+    }
+  }
+
+  namespace csv
+  {
+    template<details::encoded_types_t EncodedTypes>
+    class writer
+    {
+      static_assert (
+          !details::has_chars_written (EncodedTypes)
+        , "%n can't be a column"
+        );
+
+    public:
+      writer (int fd, csv::dialect dialect, char const * schema, std::size_t block_size = 1024U * 1024U)
+        : fd          (fd)
+        , dialect     (dialect)
+        , schema      (schema)
+        , block       (block_size > 64U ? block_size : 64U)
+        , used        (0U)
+        , row_start   (0U)
+        , row_count   (0U)
+        , failed      (false)
+      {
+        details::index_type pos = 0U;
+        details::segment    s   {} ;
+        while (details::next_segment (schema, pos, s))
+        {
+          if (!details::is_literal (s))
+          {
+            auto text =
+                  s.tid == details::tid__char_p
+              ||  s.tid == details::tid__wchar_t_p
+              ||  schema[s.end - 1] == 'c'
+              ;
+            columns.push_back (details::csv_column { s, details::fixed_precision (schema, s), text });
+          }
+        }
+      }
+
+      writer (writer && other) noexcept
+        : fd          (other.fd)
+        , dialect     (other.dialect)
+        , schema      (other.schema)
+        , columns     (std::move (other.columns))
+        , block       (std::move (other.block))
+        , used        (other.used)
+        , row_start   (other.row_start)
+        , row_count   (other.row_count)
+        , failed      (other.failed)
+      {
+        other.used      = 0U;
+        other.row_start = 0U;
+      }
+
+      writer (writer const &)             = delete;
+      writer & operator= (writer const &) = delete;
+      writer & operator= (writer &&)      = delete;
+
+      ~writer () noexcept
+      {
+        flush ();
+      }
+
+      // The column names, quoted when needed
+      bool header (std::initializer_list<char const *> names)
+      {
+        row_start = used;
+
+        auto first = true;
+        for (auto name : names)
+        {
+          if (!first)
+          {
+            append (delimiter ());
+          }
+          first = false;
+
+          auto size = std::strlen (name);
+          make_room (size);
+          std::memcpy (block.data () + used, name, size);
+          used += size;
+          quote_if_needed (used - size);
+        }
+
+        return end_row ();
+      }
+
+      // Returns false once a write has failed
+      template<typename ...TArgs>
+      bool row (TArgs && ...args)
+      {
+        (void) details::check_types<EncodedTypes> (args...);
+
+        std::array<details::arg, sizeof... (TArgs)> captured;
+        details::make_args<EncodedTypes> (captured, std::forward<TArgs> (args)...);
+        auto a = captured.data ();
+
+        row_start = used;
+        for (auto iter = 0U; iter < columns.size (); ++iter)
+        {
+          auto const & c = columns[iter];
+          if (iter > 0U)
+          {
+            append (delimiter ());
+          }
+
+          // make_room can move the row to the start of the block
+          auto field = used - row_start;
+          if (!render_column (c, a))
+          {
+            used = row_start;
+            return false;
+          }
+
+          if (c.text)
+          {
+            quote_if_needed (row_start + field);
+          }
+
+          a += details::argument_count (c.s);
+        }
+
+        return end_row ();
+      }
+
+      // Writes the complete rows
+      bool flush () noexcept
+      {
+        if (used > 0U && !failed)
+        {
+          failed = !details::rt_write_all (fd, block.data (), used);
+        }
+        used      = 0U;
+        row_start = 0U;
+        return !failed;
+      }
+
+      std::uint64_t rows () const noexcept
+      {
+        return row_count;
+      }
+
+    private:
+      char delimiter () const noexcept
+      {
+        return dialect == cd__csv ? ',' : '\t';
+      }
+
+      // Makes room for size more chars (and the '\0' of output_buffer) after
+      //  the row being written, writes out the rows before it if needed
+      void make_room (std::size_t size)
+      {
+        if (block.size () - used > size)
+        {
+          return;
+        }
+
+        if (row_start > 0U)
+        {
+          if (!failed)
+          {
+            failed = !details::rt_write_all (fd, block.data (), row_start);
+          }
+          std::memmove (block.data (), block.data () + row_start, used - row_start);
+          used      -= row_start;
+          row_start = 0U;
+        }
+
+        // A row larger than the block
+        if (block.size () - used <= size)
+        {
+          block.resize (2U * (used + size + 1U));
+        }
+      }
+
+      void append (char ch)
+      {
+        make_room (1U);
+        block[used++] = ch;
+      }
+
+      bool end_row ()
+      {
+        append ('\n');
+        ++row_count;
+        return !failed;
+      }
+
+      bool render_column (details::csv_column const & c, details::arg const * a)
+      {
+        if (c.precision >= 0 && a->tid == details::tid__double)
+        {
+          char digits[32];
+          auto end    = digits + sizeof (digits);
+          auto first  = details::format_fixed (end, a->value.double_value, c.precision);
+          if (first)
+          {
+            auto size = static_cast<std::size_t> (end - first);
+            make_room (size);
+            std::memcpy (block.data () + used, first, size);
+            used += size;
+            return true;
+          }
+        }
+
+        for (;;)
+        {
+          auto                    room = block.size () - used;
+          details::output_buffer  output (block.data () + used, room);
+          if (!details::render_segment (output, schema, c.s, a))
+          {
+            return false;
+          }
+
+          if (output.size () < room)
+          {
+            used += output.size ();
+            return true;
+          }
+
+          make_room (output.size ());
+        }
+      }
+
+      // The field starts at begin and ends at used, rare so it can be slow
+      void quote_if_needed (std::size_t begin)
+      {
+        auto first  = block.data () + begin;
+        auto last   = block.data () + used;
+        if (details::find_csv_special (first, last, dialect) == last)
+        {
+          return;
+        }
+
+        std::string field;
+        details::append_csv_field (field, first, last, dialect);
+
+        used = begin;
+        make_room (field.size ());
+        std::memcpy (block.data () + used, field.data (), field.size ());
+        used += field.size ();
+      }
+
+      int                               fd        ;
+      csv::dialect                      dialect   ;
+      char const *                      schema    ;
+      std::vector<details::csv_column>  columns   ;
+      std::vector<char>                 block     ;
+      std::size_t                       used      ;
+      std::size_t                       row_start ;
+      std::uint64_t                     row_count ;
+      bool                              failed    ;
+    };
+  }
+}
+
+#endif // TYPESAFE_PRINTF__TSPRINTF_CSV_HPP
@@ -0,0 +1,448 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+#ifndef TYPESAFE_PRINTF__TSPRINTF_DYNAMIC_HPP
+#define TYPESAFE_PRINTF__TSPRINTF_DYNAMIC_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "tsprintf.hpp"
+#include "tsprintf_engine.hpp"
+
+// Formats that are only known at runtime (translation catalogs, templates
+//  from configuration) can't be checked by check_types. dynamic_snprintf and
+//  friends check them at runtime instead, using the same type_id_map as the
+//  compile time checker: an argument is accepted by a conversion specifier
+//  exactly when TS_SPRINTF would have accepted it.
+//
+// Parsed formats are cached in a lock-free, read-mostly cache keyed by the
+//  format pointer and by a hash of the format text. The cache never frees an
+//  entry and is bounded in size, formats that don't fit are parsed on every
+//  call.
+//
+//  auto result = dynamic_snprintf (buffer, size, catalog.lookup ("greeting"), name, count);
+//  if (result < 0)
+//  {
+//    // The format didn't match the arguments, nothing was written
+//  }
+
+namespace typesafe_printf
+{
+  namespace details
+  {
+    // Bitmask of the type_ids that accepts an argument of type T
+    template<typename T, size_type Tid = 0U>
+    struct accepted_type_ids
+    {
+      enum : std::uint32_t
+      {
+        value =
+            (check_type<T, type_id_map_t<Tid>>::value ? (1U << Tid) : 0U)
+          | accepted_type_ids<T, Tid + 1>::value
+          ,
+      };
+    };
+
+    template<typename T>
+    struct accepted_type_ids<T, type_id__mask + 1>
+    {
+      enum : std::uint32_t
+      {
+        value = 0U,
+      };
+    };
+
+    constexpr type_id first_type_id (std::uint32_t type_ids, size_type tid = 0U) noexcept
+    {
+      return
+          tid > type_id__mask           ? tid__illegal
+        : (type_ids & (1U << tid)) != 0 ? static_cast<type_id> (tid)
+        : first_type_id (type_ids, tid + 1)
+        ;
+    }
+
+    // The accepted type_ids of each argument, the address of masks identifies
+    //  the argument list
+    template<typename ...TArgs>
+    struct dynamic_signature
+    {
+      static std::array<std::uint32_t, sizeof... (TArgs)> const masks;
+    };
+
+    template<typename ...TArgs>
+    std::array<std::uint32_t, sizeof... (TArgs)> const dynamic_signature<TArgs...>::masks
+      {{ accepted_type_ids<TArgs>::value... }};
+
+    // Captures value as the first type it's accepted as, all type_ids accepting
+    //  a type share representation so this is also how any of them reads it.
+    //  The actual tid is filled in when the format has been validated. Fills
+    //  a in place like make_arg
+    template<typename T>
+    inline void make_dynamic_arg (arg & a, T && value) noexcept
+    {
+      using arg_type = typename std::decay<T>::type;
+
+      static_assert (
+          std::is_trivial<arg_type>::value && std::is_standard_layout<arg_type>::value
+        , "Argument must be a POD type (see argument list)"
+        );
+
+      constexpr auto tid = first_type_id (accepted_type_ids<arg_type>::value);
+
+      a     = arg {};
+      a.tid = tid__illegal;
+      arg_storer<type_id_map_t<tid>>::apply (a.value, std::forward<T> (value));
+    }
+
+    constexpr size_type max_validated_signatures  = 4U    ;
+    constexpr size_type format_cache_size         = 1024U ; // Must be a power of 2
+    constexpr size_type format_cache_probes       = 8U    ;
+
+    struct parsed_format
+    {
+      parsed_format ()
+      {
+        for (auto && v : validated)
+        {
+          v.store (nullptr, std::memory_order_relaxed);
+        }
+      }
+
+      parsed_format (parsed_format const &)             = delete;
+      parsed_format & operator= (parsed_format const &) = delete;
+
+      // Remembers a few argument lists this format has been validated against
+      bool is_validated (void const * signature) const noexcept
+      {
+        for (auto && v : validated)
+        {
+          auto s = v.load (std::memory_order_acquire);
+          if (s == signature)
+          {
+            return true;
+          }
+          else if (!s)
+          {
+            return false;
+          }
+        }
+
+        return false;
+      }
+
+      void set_validated (void const * signature) const noexcept
+      {
+        for (auto && v : validated)
+        {
+          void const * expected = nullptr;
+          if (v.compare_exchange_strong (expected, signature, std::memory_order_acq_rel) || expected == signature)
+          {
+            return;
+          }
+        }
+      }
+
+      std::string                       text      ;
+      std::uint64_t                     hash      ;
+      bool                              is_valid  ;
+      std::vector<segment>              segments  ;
+      std::vector<type_id>              types     ;
+      mutable std::atomic<void const *> validated [max_validated_signatures];
+    };
+
+    struct pointer_entry
+    {
+      char const *                    format    ;
+      parsed_format const *           parsed    ;
+    };
+
+    struct format_cache
+    {
+      std::atomic<parsed_format *>    by_content [format_cache_size];
+      std::atomic<pointer_entry *>    by_pointer [format_cache_size];
+    };
+
+    inline format_cache & get_format_cache () noexcept
+    {
+      // Zero initialized before anything runs, entries are leaked on purpose
+      static format_cache cache;
+      return cache;
+    }
+
+    // FNV-1a
+    inline std::uint64_t hash_format (char const * format) noexcept
+    {
+      std::uint64_t hash = 0xCBF29CE484222325ULL;
+      for (; *format; ++format)
+      {
+        hash ^= static_cast<unsigned char> (*format);
+        hash *= 0x100000001B3ULL;
+      }
+      return hash;
+    }
+
+    inline std::uint64_t hash_pointer (void const * p) noexcept
+    {
+      auto hash = static_cast<std::uint64_t> (reinterpret_cast<std::uintptr_t> (p));
+      hash ^= hash >> 33;
+      hash *= 0xFF51AFD7ED558CCDULL;
+      hash ^= hash >> 33;
+      return hash;
+    }
+
+    inline std::unique_ptr<parsed_format> parse_format (char const * format, std::uint64_t hash)
+    {
+      std::unique_ptr<parsed_format> parsed (new parsed_format ());
+
+      parsed->text      = format;
+      parsed->hash      = hash  ;
+      parsed->is_valid  = true  ;
+
+      index_type  pos = 0U;
+      segment     s   {} ;
+
+      while (next_segment (format, pos, s))
+      {
+        parsed->segments.push_back (s);
+        if (!is_literal (s))
+        {
+          parsed->is_valid = parsed->is_valid && s.tid != tid__error_type;
+          parsed->types.insert (parsed->types.end (), s.stars, tid__int);
+          parsed->types.push_back (s.tid);
+          if (has_length_argument (s))
+          {
+            parsed->types.push_back (tid__size_t);
+          }
+        }
+      }
+
+      return parsed;
+    }
+
+    // The pointer only finds candidates, the same pointer may hold another
+    //  text by now (reused buffers) so the text is always compared
+    inline parsed_format const * find_format_by_pointer (format_cache & cache, char const * format) noexcept
+    {
+      auto slot = hash_pointer (format);
+      for (auto iter = 0U; iter < format_cache_probes; ++iter, ++slot)
+      {
+        auto entry = cache.by_pointer[slot & (format_cache_size - 1)].load (std::memory_order_acquire);
+        if (!entry)
+        {
+          return nullptr;
+        }
+        else if (entry->format == format && std::strcmp (entry->parsed->text.c_str (), format) == 0)
+        {
+          return entry->parsed;
+        }
+      }
+
+      return nullptr;
+    }
+
+    inline void add_format_by_pointer (format_cache & cache, char const * format, parsed_format const * parsed)
+    {
+      std::unique_ptr<pointer_entry> entry (new pointer_entry { format, parsed });
+
+      auto slot = hash_pointer (format);
+      for (auto iter = 0U; iter < format_cache_probes; ++iter, ++slot)
+      {
+        pointer_entry * expected = nullptr;
+        if (cache.by_pointer[slot & (format_cache_size - 1)].compare_exchange_strong (expected, entry.get (), std::memory_order_acq_rel))
+        {
+          entry.release ();
+          return;
+        }
+      }
+
+      // Table is full, the pointer is looked up by content instead
+    }
+
+    // Finds or parses format, uncached holds the result when the cache is full
+    inline parsed_format const * find_format (char const * format, std::unique_ptr<parsed_format> & uncached)
+    {
+      auto & cache = get_format_cache ();
+
+      if (auto found = find_format_by_pointer (cache, format))
+      {
+        return found;
+      }
+
+      auto hash = hash_format (format);
+      std::unique_ptr<parsed_format> parsed;
+
+      auto slot = hash;
+      for (auto iter = 0U; iter < format_cache_probes; ++iter, ++slot)
+      {
+        auto & entry  = cache.by_content[slot & (format_cache_size - 1)];
+        auto existing = entry.load (std::memory_order_acquire);
+
+        if (!existing)
+        {
+          if (!parsed)
+          {
+            parsed = parse_format (format, hash);
+          }
+
+          if (entry.compare_exchange_strong (existing, parsed.get (), std::memory_order_acq_rel))
+          {
+            existing = parsed.release ();
+          }
+          // else: another thread got the slot first, existing is what it stored
+        }
+
+        if (existing->hash == hash && existing->text == format)
+        {
+          add_format_by_pointer (cache, format, existing);
+          return existing;
+        }
+      }
+
+      uncached = parsed ? std::move (parsed) : parse_format (format, hash);
+      return uncached.get ();
+    }
+
+    inline int dynamic_mismatch (char * buffer, std::size_t size) noexcept
+    {
+      if (size > 0)
+      {
+        buffer[0] = '\0';
+      }
+      return -1;
+    }
+
+    inline int dynamic_render (
+        char *                buffer
+      , std::size_t           size
+      , char const *          format
+      , std::uint32_t const * masks
+      , void const *          signature
+      , arg *                 args
+      , size_type             arg_count
+      )
+    {
+      TYPESAFE_PRINTF__ASSERT (format);
+
+      std::unique_ptr<parsed_format> uncached;
+      auto parsed = find_format (format, uncached);
+
+      if (!parsed->is_valid || parsed->types.size () != arg_count)
+      {
+        return dynamic_mismatch (buffer, size);
+      }
+
+      if (!parsed->is_validated (signature))
+      {
+        for (auto iter = 0U; iter < arg_count; ++iter)
+        {
+          if ((masks[iter] & (1U << parsed->types[iter])) == 0)
+          {
+            return dynamic_mismatch (buffer, size);
+          }
+        }
+
+        parsed->set_validated (signature);
+      }
+
+      for (auto iter = 0U; iter < arg_count; ++iter)
+      {
+        args[iter].tid = parsed->types[iter];
+      }
+
+      return render (
+          buffer
+        , size
+        , parsed->text.c_str ()
+        , parsed->segments.data ()
+        , static_cast<size_type> (parsed->segments.size ())
+        , args
+        , arg_count
+        );
+    }
+
+    template<typename ...TArgs>
+    inline int capture_and_render (char * buffer, std::size_t size, char const * format, TArgs && ...args)
+    {
+      using signature = dynamic_signature<typename std::decay<TArgs>::type...>;
+
+      std::array<arg, sizeof... (TArgs)> captured;
+      auto index = 0U;
+      using expand = int [];
+      (void) expand { 0, (make_dynamic_arg (captured[index++], std::forward<TArgs> (args)), 0)... };
+
+      return dynamic_render (
+          buffer
+        , size
+        , format
+        , signature::masks.data ()
+        , static_cast<void const *> (&signature::masks)
+        , captured.data ()
+        , static_cast<size_type> (captured.size ())
+        );
+    }
+  }
+
+  // Like snprintf but format is validated against the arguments at runtime,
+  //  returns -1 and writes nothing (but the terminating NUL) on mismatch
+  template<typename ...TArgs>
+  inline int dynamic_snprintf (char * buffer, std::size_t size, char const * format, TArgs && ...args)
+  {
+    return details::capture_and_render (buffer, size, format, std::forward<TArgs> (args)...);
+  }
+
+  // Like fprintf but format is validated against the arguments at runtime,
+  //  returns -1 and writes nothing on mismatch
+  template<typename ...TArgs>
+  inline int dynamic_fprintf (std::FILE * file, char const * format, TArgs && ...args)
+  {
+    char buffer[512];
+
+    auto result = details::capture_and_render (buffer, sizeof (buffer), format, args...);
+    if (result < 0)
+    {
+      return result;
+    }
+
+    if (static_cast<std::size_t> (result) < sizeof (buffer))
+    {
+      return std::fwrite (buffer, 1, result, file) == static_cast<std::size_t> (result) ? result : -1;
+    }
+
+    std::vector<char> large (static_cast<std::size_t> (result) + 1);
+    result = details::capture_and_render (large.data (), large.size (), format, args...);
+
+    return std::fwrite (large.data (), 1, result, file) == static_cast<std::size_t> (result) ? result : -1;
+  }
+
+  // Like printf but format is validated against the arguments at runtime,
+  //  returns -1 and writes nothing on mismatch
+  template<typename ...TArgs>
+  inline int dynamic_printf (char const * format, TArgs && ...args)
+  {
+    return dynamic_fprintf (stdout, format, std::forward<TArgs> (args)...);
+  }
+}
+
+#endif // TYPESAFE_PRINTF__TSPRINTF_DYNAMIC_HPP
@@ -0,0 +1,1242 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+#ifndef TYPESAFE_PRINTF__TSPRINTF_ENGINE_HPP
+#define TYPESAFE_PRINTF__TSPRINTF_ENGINE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#include "tsprintf.hpp"
+#include "tsprintf_escape.hpp"
+#include "tsprintf_hex.hpp"
+#include "tsprintf_timestamp.hpp"
+#include "tsprintf_utf8.hpp"
+
+// The engine renders a format string against a list of type-erased arguments
+//  (details::arg). Each argument carries the type_id the scanner assigned to
+//  it so the engine can hand the value back to snprintf with exactly the type
+//  the conversion specifier expects. This gives the same output as TS_SPRINTF
+//  for arguments that has been captured earlier (binary logs) or formats that
+//  are only known at runtime.
+
+// The macros that render with the engine use this to reject extensions with
+//  options they can't take at compile time, it's an expression so it fits
+//  both the statement and the comma separated macros
+#define TYPESAFE_PRINTF__CHECK_EXTENSIONS(format)                                                                  \
+  typesafe_printf::details::check_extensions<typesafe_printf::details::has_invalid_extension (format)> ()
+
+#define TYPESAFE_PRINTF__RENDER_CASE(key, member)                                                                  \
+  case key:                                                                                                        \
+    return std::snprintf (buffer, size, spec, static_cast<type_id_map_t<key>> (a.value.member))
+
+namespace typesafe_printf
+{
+  namespace details
+  {
+    enum type_class : size_type
+    {
+      tc__invalid                 = 0x0 ,
+      tc__signed_integer          = 0x1 ,
+      tc__unsigned_integer        = 0x2 ,
+      tc__double                  = 0x3 ,
+      tc__long_double             = 0x4 ,
+      tc__char_p                  = 0x5 ,
+      tc__wchar_t_p               = 0x6 ,
+      tc__void_p                  = 0x7 ,
+      tc__chars_written           = 0x8 ,
+    };
+
+    constexpr type_class const type_classes[type_id__mask + 1] =
+    {
+      tc__invalid           , /*tid__illegal            */
+      tc__invalid           , /*tid__error_type         */
+      tc__char_p            , /*tid__char_p             */
+      tc__double            , /*tid__double             */
+      tc__signed_integer    , /*tid__int                */
+      tc__chars_written     , /*tid__int_p              */
+      tc__signed_integer    , /*tid__intmax_t           */
+      tc__chars_written     , /*tid__intmax_t_p         */
+      tc__signed_integer    , /*tid__long               */
+      tc__long_double       , /*tid__long_double        */
+      tc__signed_integer    , /*tid__long_long          */
+      tc__chars_written     , /*tid__long_long_p        */
+      tc__chars_written     , /*tid__long_p             */
+      tc__signed_integer    , /*tid__ptrdiff_t          */
+      tc__chars_written     , /*tid__ptrdiff_t_p        */
+      tc__signed_integer    , /*tid__short              */
+      tc__chars_written     , /*tid__short_p            */
+      tc__signed_integer    , /*tid__signed_char        */
+      tc__chars_written     , /*tid__signed_char_p      */
+      tc__signed_integer    , /*tid__signed_size_t      */
+      tc__chars_written     , /*tid__signed_size_t_p    */
+      tc__unsigned_integer  , /*tid__size_t             */
+      tc__unsigned_integer  , /*tid__uintmax_t          */
+      tc__unsigned_integer  , /*tid__unsigned_char      */
+      tc__unsigned_integer  , /*tid__unsigned_int       */
+      tc__unsigned_integer  , /*tid__unsigned_long      */
+      tc__unsigned_integer  , /*tid__unsigned_long_long */
+      tc__unsigned_integer  , /*tid__unsigned_ptrdiff_t */
+      tc__unsigned_integer  , /*tid__unsigned_short     */
+      tc__void_p            , /*tid__void_p             */
+      tc__wchar_t_p         , /*tid__wchar_t_p          */
+      tc__unsigned_integer  , /*tid__wint_t             */
+    };
+
+    constexpr type_class get_type_class (type_id ti) noexcept
+    {
+      return type_classes[ti & type_id__mask];
+    }
+
+    constexpr type_id type_id_at (encoded_types_t encoded_types, size_type pos) noexcept
+    {
+      return pos < max_encoded_types
+        ? static_cast<type_id> ((encoded_types >> (pos * type_id__bits)) & type_id__mask)
+        : tid__illegal
+        ;
+    }
+
+    union arg_value
+    {
+      std::intmax_t     signed_integer    ;
+      std::uintmax_t    unsigned_integer  ;
+      double            double_value      ;
+      long double       long_double_value ;
+      char const *      char_p            ;
+      wchar_t const *   wchar_t_p         ;
+      void const *      void_p            ;
+      void *            chars_written_p   ;
+    };
+
+    // A type-erased argument, tid is the type_id the format string expects
+    struct arg
+    {
+      type_id           tid   ;
+      arg_value         value ;
+    };
+
+    template<typename T>
+    inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type store (arg_value & v, T value) noexcept
+    {
+      v.signed_integer = value;
+    }
+
+    template<typename T>
+    inline typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type store (arg_value & v, T value) noexcept
+    {
+      v.unsigned_integer = value;
+    }
+
+    // %n arguments
+    template<typename T>
+    inline typename std::enable_if<std::is_integral<T>::value && !std::is_const<T>::value>::type store (arg_value & v, T * value) noexcept
+    {
+      v.chars_written_p = value;
+    }
+
+    inline void store (arg_value & v, double value) noexcept
+    {
+      v.double_value = value;
+    }
+
+    inline void store (arg_value & v, long double value) noexcept
+    {
+      v.long_double_value = value;
+    }
+
+    inline void store (arg_value & v, char const * value) noexcept
+    {
+      v.char_p = value;
+    }
+
+    inline void store (arg_value & v, wchar_t const * value) noexcept
+    {
+      v.wchar_t_p = value;
+    }
+
+    inline void store (arg_value & v, void const * value) noexcept
+    {
+      v.void_p = value;
+    }
+
+    template<typename TExpected>
+    struct arg_storer
+    {
+      template<typename T>
+      static void apply (arg_value & v, T && value) noexcept
+      {
+        store (v, static_cast<TExpected> (value));
+      }
+    };
+
+    // A malformed format is reported by check_types, don't pile up errors here
+    template<>
+    struct arg_storer<error_type>
+    {
+      template<typename T>
+      static void apply (arg_value &, T &&) noexcept
+      {
+      }
+    };
+
+    // Fills a in place, returning arg by value makes g++ note the GCC 4.4
+    //  ABI change for unions with long double in every user
+    template<type_id Tid, typename T>
+    inline void make_arg (arg & a, T && value) noexcept
+    {
+      a     = arg {};
+      a.tid = Tid;
+      arg_storer<type_id_map_t<Tid>>::apply (a.value, std::forward<T> (value));
+    }
+
+    template<encoded_types_t EncodedTypes, std::size_t ...Indices, typename ...TArgs>
+    inline void make_args_impl (arg * args, std::index_sequence<Indices...>, TArgs && ...values) noexcept
+    {
+      using expand = int [];
+      (void) expand { 0, (make_arg<type_id_at (EncodedTypes, Indices)> (args[Indices], std::forward<TArgs> (values)), 0)... };
+    }
+
+    // Captures the arguments of a checked call into captured, relies on
+    //  check_types for the type checking
+    template<encoded_types_t EncodedTypes, typename ...TArgs>
+    inline void make_args (std::array<arg, sizeof... (TArgs)> & captured, TArgs && ...args) noexcept
+    {
+      make_args_impl<EncodedTypes> (captured.data (), std::index_sequence_for<TArgs...> (), std::forward<TArgs> (args)...);
+    }
+
+    // Conversions the engine adds on top of printf, selected with a flag
+    //  that printf doesn't have
+    enum extension : std::uint8_t
+    {
+      ext__none       ,
+      ext__json       , // %Js, the string JSON escaped
+      ext__c_string   , // %Qs, the string escaped as in a C string literal
+      ext__hexdump    , // %Hp, the bytes of a (pointer, std::size_t length) pair in hex
+      ext__timestamp  , // %Tllu, nanoseconds since the epoch as ISO-8601 local time
+    };
+
+    // A format string is split into segments, literal text or a single
+    //  conversion specification (the '%' up to and including the
+    //  conversion specifier). %% becomes a literal segment of one '%'.
+    struct segment
+    {
+      index_type        begin       ;
+      index_type        end         ;
+      type_id           tid         ; // tid__illegal for literal text
+      bool              has_options ; // flags, width or precision
+      size_type         stars       ; // int arguments for * width and precision
+      extension         ext         ;
+    };
+
+
+    constexpr bool is_literal (segment const & s) noexcept
+    {
+      return s.tid == tid__illegal;
+    }
+
+    // %Hp takes a std::size_t length after the pointer
+    constexpr bool has_length_argument (segment const & s) noexcept
+    {
+      return s.ext == ext__hexdump && s.tid == tid__void_p;
+    }
+
+    // The arguments a segment takes, the * arguments come before the value
+    constexpr size_type argument_count (segment const & s) noexcept
+    {
+      return is_literal (s) ? 0U : s.stars + (has_length_argument (s) ? 2U : 1U);
+    }
+    // Mirrors scanner::parse_argument_type but works on a runtime string
+    constexpr scanner::argument_type parse_argument_type (char const * format, index_type & pos) noexcept
+    {
+      switch (format[pos])
+      {
+      case '\0':
+        return scanner::at__invalid;
+      case 'h':
+        ++pos;
+        if (format[pos] == 'h')
+        {
+          ++pos;
+          return scanner::at__hh;
+        }
+        return format[pos] != '\0' ? scanner::at__h : scanner::at__invalid;
+      case 'l':
+        ++pos;
+        if (format[pos] == 'l')
+        {
+          ++pos;
+          return scanner::at__ll;
+        }
+        return format[pos] != '\0' ? scanner::at__l : scanner::at__invalid;
+      case 'j':
+        ++pos;
+        return scanner::at__j;
+      case 'z':
+        ++pos;
+        return scanner::at__z;
+      case 't':
+        ++pos;
+        return scanner::at__t;
+      case 'L':
+        ++pos;
+        return scanner::at__L;
+      default:
+        return scanner::at__none;
+      }
+    }
+
+    // Mirrors scanner::parse_conversion_specifier but works on a runtime string
+    constexpr scanner::conversion_specifier parse_conversion_specifier (char const * format, index_type & pos) noexcept
+    {
+      auto ch = format[pos];
+
+      if (ch == '\0')
+      {
+        return scanner::cs__invalid;
+      }
+
+      ++pos;
+
+      if (ch == 'c')
+      {
+        return scanner::cs__char;
+      }
+      else if (ch == 's')
+      {
+        return scanner::cs__string;
+      }
+      else if (scanner::binary_any_of (ch, scanner::union_of_signed_ints))
+      {
+        return scanner::cs__signed_integer;
+      }
+      else if (scanner::binary_any_of (ch, scanner::union_of_unsigned_ints))
+      {
+        return scanner::cs__unsigned_integer;
+      }
+      else if (scanner::binary_any_of (ch, scanner::union_of_floats))
+      {
+        return scanner::cs__floating_point;
+      }
+      else if (ch == 'n')
+      {
+        return scanner::cs__chars_written;
+      }
+      else if (ch == 'p')
+      {
+        return scanner::cs__pointer;
+      }
+      else
+      {
+        return scanner::cs__invalid;
+      }
+    }
+
+    // Reads the segment starting at pos and moves pos past it,
+    //  returns false at the end of the format string
+    constexpr bool next_segment (char const * format, index_type & pos, segment & s) noexcept
+    {
+      if (format[pos] == '\0')
+      {
+        return false;
+      }
+
+      s.begin = pos;
+
+      if (format[pos] != '%')
+      {
+        while (format[pos] != '\0' && format[pos] != '%')
+        {
+          ++pos;
+        }
+
+        s.end         = pos         ;
+        s.tid         = tid__illegal;
+        s.has_options = false       ;
+        s.stars       = 0U          ;
+        s.ext         = ext__none   ;
+        return true;
+      }
+
+      ++pos;
+
+      s.has_options = false     ;
+      s.stars       = 0U        ;
+      s.ext         = ext__none ;
+
+      // Double %% is an escaped %
+      if (format[pos] == '%')
+      {
+        s.begin = pos         ;
+        s.end   = ++pos       ;
+        s.tid   = tid__illegal;
+        return true;
+      }
+
+      // A lone % at the end is malformed
+      if (format[pos] == '\0')
+      {
+        s.end   = pos             ;
+        s.tid   = tid__error_type ;
+        return true;
+      }
+
+      auto options = pos;
+      while (format[pos] != '\0' && !scanner::binary_any_of (format[pos], scanner::union_of_cs_at))
+      {
+        switch (format[pos])
+        {
+        case '*': ++s.stars               ; break;
+        case 'J': s.ext = ext__json       ; break;
+        case 'Q': s.ext = ext__c_string   ; break;
+        case 'H': s.ext = ext__hexdump    ; break;
+        case 'T': s.ext = ext__timestamp  ; break;
+        default :                           break;
+        }
+        ++pos;
+      }
+      s.has_options = pos != options;
+
+      auto at = parse_argument_type (format, pos);
+      auto cs = at != scanner::at__invalid
+        ? parse_conversion_specifier (format, pos)
+        : scanner::cs__invalid
+        ;
+
+      s.end = pos;
+      s.tid = at != scanner::at__invalid && cs != scanner::cs__invalid
+        ? scanner::get_type_id (at, cs)
+        : tid__error_type
+        ;
+      return true;
+    }
+
+    // Computes the same encoding as scanner::encode for a runtime string
+    constexpr encoded_types_t encode_runtime (char const * format) noexcept
+    {
+      index_type      pos           = 0U;
+      encoded_types_t encoded_types = 0U;
+      size_type       count         = 0U;
+      segment         s             {} ;
+
+      while (next_segment (format, pos, s))
+      {
+        if (!is_literal (s))
+        {
+          for (auto iter = 0U; iter < s.stars; ++iter)
+          {
+            encoded_types = scanner::merge_type (encoded_types, count++, tid__int);
+          }
+          encoded_types = scanner::merge_type (encoded_types, count++, s.tid);
+          if (has_length_argument (s))
+          {
+            encoded_types = scanner::merge_type (encoded_types, count++, tid__size_t);
+          }
+        }
+      }
+
+      return encoded_types;
+    }
+
+    constexpr bool has_extension (char const * format, extension ext) noexcept
+    {
+      index_type  pos = 0U;
+      segment     s   {} ;
+
+      while (next_segment (format, pos, s))
+      {
+        if (!is_literal (s) && s.ext == ext)
+        {
+          return true;
+        }
+      }
+
+      return false;
+    }
+
+    // Collects rendered text, follows snprintf semantics: the output is
+    //  truncated to fit the buffer (including the '\0') but the total
+    //  is the length the untruncated text would have had
+    class output_buffer
+    {
+    public:
+      output_buffer (char * buffer, std::size_t size) noexcept
+        : current   (buffer)
+        , end       (size > 0 ? buffer + size - 1 : buffer)
+        , has_room  (size > 0)
+        , total     (0)
+      {
+      }
+
+      // Space left for snprintf, including the '\0'
+      std::size_t tail_size () const noexcept
+      {
+        return has_room ? static_cast<std::size_t> (end - current) + 1 : 0;
+      }
+
+      char * tail () const noexcept
+      {
+        return has_room ? current : nullptr;
+      }
+
+      // Call after writing written chars to tail ()
+      void commit (std::size_t written) noexcept
+      {
+        auto left = static_cast<std::size_t> (end - current);
+        current += written < left ? written : left;
+        total   += written;
+      }
+
+      void append (char const * s, std::size_t n) noexcept
+      {
+        auto left = static_cast<std::size_t> (end - current);
+        auto copy = n < left ? n : left;
+        std::memcpy (current, s, copy);
+        current += copy ;
+        total   += n    ;
+      }
+
+      void append (char ch) noexcept
+      {
+        if (current < end)
+        {
+          *current++ = ch;
+        }
+        ++total;
+      }
+
+      void fill (char ch, std::size_t n) noexcept
+      {
+        auto left = static_cast<std::size_t> (end - current);
+        auto copy = n < left ? n : left;
+        std::memset (current, ch, copy);
+        current += copy ;
+        total   += n    ;
+      }
+
+      std::size_t size () const noexcept
+      {
+        return total;
+      }
+
+      int finish () noexcept
+      {
+        if (has_room)
+        {
+          *current = '\0';
+        }
+        return static_cast<int> (total);
+      }
+
+    private:
+      char *      current   ;
+      char *      end       ;
+      bool        has_room  ;
+      std::size_t total     ;
+    };
+
+    template<typename T>
+    inline void store_chars_written (void * p, std::size_t written) noexcept
+    {
+      if (p)
+      {
+        *static_cast<T *> (p) = static_cast<T> (written);
+      }
+    }
+
+    // spec must be a '\0' terminated conversion specification
+    inline int render_value (char * buffer, std::size_t size, char const * spec, arg const & a) noexcept
+    {
+      switch (a.tid)
+      {
+        TYPESAFE_PRINTF__RENDER_CASE (tid__char_p             , char_p            );
+        TYPESAFE_PRINTF__RENDER_CASE (tid__double             , double_value      );
+        TYPESAFE_PRINTF__RENDER_CASE (tid__int                , signed_integer    );
+        TYPESAFE_PRINTF__RENDER_CASE (tid__intmax_t           , signed_integer    );
+        TYPESAFE_PRINTF__RENDER_CASE (tid__long               , signed_integer    );
+        TYPESAFE_PRINTF__RENDER_CASE (tid__long_double        , long_double_value );
+        TYPESAFE_PRINTF__RENDER_CASE (tid__long_long          , signed_integer    );
+        TYPESAFE_PRINTF__RENDER_CASE (tid__ptrdiff_t          , signed_integer    );
+        TYPESAFE_PRINTF__RENDER_CASE (tid__short              , signed_integer    );
+        TYPESAFE_PRINTF__RENDER_CASE (tid__signed_char        , signed_integer    );
+        TYPESAFE_PRINTF__RENDER_CASE (tid__signed_size_t      , signed_integer    );
+        TYPESAFE_PRINTF__RENDER_CASE (tid__size_t             , unsigned_integer  );
+        TYPESAFE_PRINTF__RENDER_CASE (tid__uintmax_t          , unsigned_integer  );
+        TYPESAFE_PRINTF__RENDER_CASE (tid__unsigned_char      , unsigned_integer  );
+        TYPESAFE_PRINTF__RENDER_CASE (tid__unsigned_int       , unsigned_integer  );
+        TYPESAFE_PRINTF__RENDER_CASE (tid__unsigned_long      , unsigned_integer  );
+        TYPESAFE_PRINTF__RENDER_CASE (tid__unsigned_long_long , unsigned_integer  );
+        TYPESAFE_PRINTF__RENDER_CASE (tid__unsigned_ptrdiff_t , unsigned_integer  );
+        TYPESAFE_PRINTF__RENDER_CASE (tid__unsigned_short     , unsigned_integer  );
+        TYPESAFE_PRINTF__RENDER_CASE (tid__void_p             , void_p            );
+        TYPESAFE_PRINTF__RENDER_CASE (tid__wchar_t_p          , wchar_t_p         );
+        TYPESAFE_PRINTF__RENDER_CASE (tid__wint_t             , unsigned_integer  );
+      default:
+        return -1;
+      }
+    }
+
+    inline void render_chars_written (arg const & a, std::size_t written) noexcept
+    {
+      switch (a.tid)
+      {
+      case tid__int_p           : store_chars_written<int                 > (a.value.chars_written_p, written); break;
+      case tid__intmax_t_p      : store_chars_written<std::intmax_t       > (a.value.chars_written_p, written); break;
+      case tid__long_long_p     : store_chars_written<long long           > (a.value.chars_written_p, written); break;
+      case tid__long_p          : store_chars_written<long                > (a.value.chars_written_p, written); break;
+      case tid__ptrdiff_t_p     : store_chars_written<std::ptrdiff_t      > (a.value.chars_written_p, written); break;
+      case tid__short_p         : store_chars_written<short               > (a.value.chars_written_p, written); break;
+      case tid__signed_char_p   : store_chars_written<signed char         > (a.value.chars_written_p, written); break;
+      case tid__signed_size_t_p : store_chars_written<ssize_t             > (a.value.chars_written_p, written); break;
+      default                   : break;
+      }
+    }
+
+    // Longest conversion specification the engine accepts, longer ones
+    //  are padded with absurd widths anyway
+    constexpr size_type max_spec_size = 64;
+
+    constexpr char const digit_pairs[] =
+      "00010203040506070809"
+      "10111213141516171819"
+      "20212223242526272829"
+      "30313233343536373839"
+      "40414243444546474849"
+      "50515253545556575859"
+      "60616263646566676869"
+      "70717273747576777879"
+      "80818283848586878889"
+      "90919293949596979899"
+      ;
+
+    // Writes v as decimal digits ending at end, returns the first digit
+    inline char * format_decimal (char * end, std::uintmax_t v) noexcept
+    {
+      while (v >= 100)
+      {
+        auto pair = static_cast<size_type> (v % 100) * 2;
+        v /= 100;
+        *--end = digit_pairs[pair + 1];
+        *--end = digit_pairs[pair    ];
+      }
+
+      if (v >= 10)
+      {
+        auto pair = static_cast<size_type> (v) * 2;
+        *--end = digit_pairs[pair + 1];
+        *--end = digit_pairs[pair    ];
+      }
+      else
+      {
+        *--end = static_cast<char> ('0' + v);
+      }
+
+      return end;
+    }
+
+    // %ls and %lc as UTF-8 regardless of the locale, returns false to let
+    //  snprintf decide about chars UTF-8 can't represent
+    inline bool render_wide (
+        output_buffer &   output
+      , wchar_t const *   begin
+      , wchar_t const *   end
+      , std::size_t       width
+      , bool              left_justify
+      ) noexcept
+    {
+      std::size_t size = 0U;
+      if (!utf8_size (begin, end, size))
+      {
+        return false;
+      }
+
+      auto padding = width > size ? width - size : 0U;
+
+      if (!left_justify)
+      {
+        output.fill (' ', padding);
+      }
+
+      if (output.tail_size () > size)
+      {
+        auto tail = output.tail ();
+        encode_utf8 (tail, tail + size, begin, end);
+        output.commit (size);
+      }
+      else
+      {
+        // Truncated, go through a chunk to not write past the buffer
+        char chunk[256];
+        while (begin < end)
+        {
+          auto chunk_end = encode_utf8 (chunk, chunk + sizeof (chunk), begin, end);
+          output.append (chunk, static_cast<std::size_t> (chunk_end - chunk));
+        }
+      }
+
+      if (left_justify)
+      {
+        output.fill (' ', padding);
+      }
+
+      return true;
+    }
+
+    // Conversions with at most a width and a '-' flag that are simple
+    //  enough to not go through snprintf, returns false to let snprintf do it
+    inline bool render_plain (
+        output_buffer & output
+      , char            conversion
+      , arg const &     a
+      , std::size_t     width
+      , bool            left_justify
+      ) noexcept
+    {
+      char digits[24];
+      auto end = digits + sizeof (digits);
+
+      char const *  text  = nullptr;
+      std::size_t   size  = 0U;
+
+      switch (conversion)
+      {
+      case 'd':
+      case 'i':
+        if (get_type_class (a.tid) != tc__signed_integer)
+        {
+          return false;
+        }
+        {
+          auto v      = a.value.signed_integer;
+          auto first  = format_decimal (end, v < 0 ? 0U - static_cast<std::uintmax_t> (v) : static_cast<std::uintmax_t> (v));
+          if (v < 0)
+          {
+            *--first = '-';
+          }
+          text = first;
+          size = static_cast<std::size_t> (end - first);
+        }
+        break;
+      case 'u':
+        if (get_type_class (a.tid) != tc__unsigned_integer)
+        {
+          return false;
+        }
+        text = format_decimal (end, a.value.unsigned_integer);
+        size = static_cast<std::size_t> (end - text);
+        break;
+      case 's':
+        if (a.tid == tid__wchar_t_p && a.value.wchar_t_p)
+        {
+          return render_wide (output, a.value.wchar_t_p, a.value.wchar_t_p + std::wcslen (a.value.wchar_t_p), width, left_justify);
+        }
+        // snprintf decides how nullptr is rendered
+        if (a.tid != tid__char_p || !a.value.char_p)
+        {
+          return false;
+        }
+        text = a.value.char_p;
+        size = std::strlen (a.value.char_p);
+        break;
+      case 'x':
+      case 'X':
+        if (get_type_class (a.tid) != tc__unsigned_integer)
+        {
+          return false;
+        }
+        text = format_hex (end, a.value.unsigned_integer, conversion == 'X');
+        size = static_cast<std::size_t> (end - text);
+        break;
+      case 'p':
+#ifdef __GLIBC__
+        // glibc renders non-null pointers as %#lx, others differ
+        if (a.tid != tid__void_p || !a.value.void_p)
+        {
+          return false;
+        }
+        {
+          auto first  = format_hex (end, reinterpret_cast<std::uintptr_t> (a.value.void_p), false);
+          *--first    = 'x';
+          *--first    = '0';
+          text        = first;
+          size        = static_cast<std::size_t> (end - first);
+        }
+        break;
+#else
+        return false;
+#endif
+      case 'c':
+        // L'\0' is left to snprintf
+        if (a.tid == tid__wint_t && a.value.unsigned_integer != 0U)
+        {
+          auto ch = static_cast<wchar_t> (a.value.unsigned_integer);
+          return render_wide (output, &ch, &ch + 1, width, left_justify);
+        }
+        if (a.tid != tid__int)
+        {
+          return false;
+        }
+        digits[0] = static_cast<char> (static_cast<unsigned char> (a.value.signed_integer));
+        text = digits;
+        size = 1U;
+        break;
+      default:
+        return false;
+      }
+
+      auto padding = width > size ? width - size : 0U;
+
+      if (!left_justify)
+      {
+        output.fill (' ', padding);
+      }
+
+      output.append (text, size);
+
+      if (left_justify)
+      {
+        output.fill (' ', padding);
+      }
+
+      return true;
+    }
+
+    // Reads a spec (after the '%') that is only an optional '-' and a width
+    inline bool parse_plain_width (char const * spec, std::size_t & width, bool & left_justify) noexcept
+    {
+      left_justify = *spec == '-';
+      if (left_justify)
+      {
+        ++spec;
+      }
+
+      width = 0U;
+      while (*spec >= '0' && *spec <= '9')
+      {
+        // A leading '0' is the zero flag
+        if (width == 0U && *spec == '0')
+        {
+          return false;
+        }
+        width = width * 10U + static_cast<std::size_t> (*spec++ - '0');
+      }
+
+      return scanner::binary_any_of (*spec, scanner::union_of_cs_at);
+    }
+
+    // Copies the conversion specification of s into spec with the * replaced
+    //  by the values in stars. A negative width is a '-' flag, a negative
+    //  precision is the same as no precision
+    inline bool make_spec (char (&spec) [max_spec_size], char const * format, segment const & s, arg const * stars) noexcept
+    {
+      std::size_t size  = 0U;
+      size_type   star  = 0U;
+
+      for (auto pos = s.begin; pos < s.end; ++pos)
+      {
+        if (format[pos] != '*')
+        {
+          if (size + 1U >= max_spec_size)
+          {
+            return false;
+          }
+          spec[size++] = format[pos];
+          continue;
+        }
+
+        auto value = stars[star++].value.signed_integer;
+
+        if (value < 0 && size > 0U && spec[size - 1U] == '.')
+        {
+          --size;
+          continue;
+        }
+
+        char digits[24];
+        auto end    = digits + sizeof (digits);
+        auto first  = format_decimal (end, value < 0 ? 0U - static_cast<std::uintmax_t> (value) : static_cast<std::uintmax_t> (value));
+        if (value < 0)
+        {
+          *--first = '-';
+        }
+
+        auto length = static_cast<std::size_t> (end - first);
+        if (size + length >= max_spec_size)
+        {
+          return false;
+        }
+
+        std::memcpy (spec + size, first, length);
+        size += length;
+      }
+
+      spec[size] = '\0';
+      return true;
+    }
+
+    inline void append_escaped (output_buffer & output, char const * s, escape_kind kind) noexcept
+    {
+      auto end = s + std::strlen (s);
+
+      for (;;)
+      {
+        auto special = find_escape (s, end, kind);
+        output.append (s, static_cast<std::size_t> (special - s));
+
+        if (special == end)
+        {
+          return;
+        }
+
+        char sequence[8];
+        output.append (sequence, escape_sequence (static_cast<unsigned char> (*special), kind, sequence));
+        s = special + 1;
+      }
+    }
+
+    // Writes the bytes directly to the buffer, truncated like snprintf
+    inline void append_hexdump (output_buffer & output, unsigned char const * bytes, std::size_t size) noexcept
+    {
+      auto room   = output.tail_size () > 0U ? output.tail_size () - 1U : 0U;
+      auto whole  = size < room / 2U ? size : room / 2U;
+
+      if (whole > 0U)
+      {
+        hex_encode (output.tail (), bytes, whole);
+      }
+
+      if (whole < size && room % 2U == 1U)
+      {
+        output.tail ()[2U * whole] = lower_hex_digits[bytes[whole] >> 4];
+      }
+
+      output.commit (2U * size);
+    }
+
+    // %T, %T. or %T.N followed by ll and the conversion, N is the number of
+    //  sub-second digits (9 without a precision)
+    constexpr bool parse_timestamp_digits (char const * format, segment const & s, std::size_t & digits) noexcept
+    {
+      auto options = format + s.begin + 2U;
+      auto end     = format + s.end   - 3U;
+
+      if (s.end - s.begin < 5U || format[s.begin + 1U] != 'T' || end[0] != 'l' || end[1] != 'l')
+      {
+        return false;
+      }
+
+      if (options == end)
+      {
+        digits = 9U;
+        return true;
+      }
+
+      if (*options != '.' || end - options > 2)
+      {
+        return false;
+      }
+
+      digits = end - options == 2 ? static_cast<std::size_t> (options[1] - '0') : 0U;
+      return digits <= 9U;
+    }
+
+    // The extensions take no other flags, width or precision, %T only takes
+    //  .N and ll
+    constexpr bool is_valid_extension (char const * format, segment const & s) noexcept
+    {
+      auto        plain   = s.stars == 0U && s.end - s.begin == 3U;
+      std::size_t digits  = 0U;
+
+      switch (s.ext)
+      {
+      case ext__none:
+        return true;
+      case ext__json:
+      case ext__c_string:
+        return plain && s.tid == tid__char_p;
+      case ext__hexdump:
+        return plain && s.tid == tid__void_p;
+      case ext__timestamp:
+        return
+              s.stars == 0U
+          &&  (s.tid == tid__long_long || s.tid == tid__unsigned_long_long)
+          &&  parse_timestamp_digits (format, s, digits)
+          ;
+      default:
+        return false;
+      }
+    }
+
+    constexpr bool has_invalid_extension (char const * format) noexcept
+    {
+      index_type  pos = 0U;
+      segment     s   {} ;
+
+      while (next_segment (format, pos, s))
+      {
+        if (!is_literal (s) && !is_valid_extension (format, s))
+        {
+          return true;
+        }
+      }
+
+      return false;
+    }
+
+    template<bool HasInvalidExtension>
+    constexpr bool check_extensions () noexcept
+    {
+      static_assert (!HasInvalidExtension, "%Js, %Qs and %Hp take no flags, width or precision, %T only takes an optional .N and ll");
+      return true;
+    }
+
+    inline bool render_extension (output_buffer & output, char const * format, segment const & s, arg const * args) noexcept
+    {
+      auto & a = args[0];
+
+      if (!is_valid_extension (format, s))
+      {
+        return false;
+      }
+
+      switch (s.ext)
+      {
+      case ext__json:
+      case ext__c_string:
+        if (a.tid != tid__char_p)
+        {
+          return false;
+        }
+        // nullptr is an empty string
+        if (a.value.char_p)
+        {
+          append_escaped (output, a.value.char_p, s.ext == ext__json ? ek__json : ek__c_string);
+        }
+        return true;
+      case ext__hexdump:
+        if (a.tid != tid__void_p || args[1].tid != tid__size_t)
+        {
+          return false;
+        }
+        // nullptr is empty
+        if (a.value.void_p)
+        {
+          append_hexdump (output, static_cast<unsigned char const *> (a.value.void_p), static_cast<std::size_t> (args[1].value.unsigned_integer));
+        }
+        return true;
+      case ext__timestamp:
+        {
+          std::size_t digits = 0U;
+          if ((a.tid != tid__long_long && a.tid != tid__unsigned_long_long) || !parse_timestamp_digits (format, s, digits))
+          {
+            return false;
+          }
+
+          char buffer[64];
+          auto ns   = a.tid == tid__long_long
+            ? static_cast<long long> (a.value.signed_integer)
+            : static_cast<long long> (a.value.unsigned_integer)
+            ;
+          auto size = format_timestamp (buffer, sizeof (buffer), ns, digits);
+          if (size == 0U)
+          {
+            return false;
+          }
+
+          output.append (buffer, size);
+          return true;
+        }
+      default:
+        return false;
+      }
+    }
+
+    // Renders one conversion segment, args holds argument_count (s) arguments
+    inline bool render_segment (output_buffer & output, char const * format, segment const & s, arg const * args) noexcept
+    {
+      for (auto iter = 0U; iter < s.stars; ++iter)
+      {
+        if (args[iter].tid != tid__int)
+        {
+          return false;
+        }
+      }
+
+      auto & a = args[s.stars];
+
+      if (a.tid != s.tid)
+      {
+        return false;
+      }
+
+      if (get_type_class (a.tid) == tc__chars_written)
+      {
+        render_chars_written (a, output.size ());
+        return true;
+      }
+
+      if (s.ext != ext__none)
+      {
+        return render_extension (output, format, s, args + s.stars);
+      }
+
+      auto conversion = format[s.end - 1];
+
+      if (!s.has_options && render_plain (output, conversion, a, 0U, false))
+      {
+        return true;
+      }
+
+      char spec[max_spec_size];
+      if (!make_spec (spec, format, s, args))
+      {
+        return false;
+      }
+
+      std::size_t width         = 0U   ;
+      bool        left_justify  = false;
+      if (parse_plain_width (spec + 1, width, left_justify) && render_plain (output, conversion, a, width, left_justify))
+      {
+        return true;
+      }
+
+      auto written = render_value (output.tail (), output.tail_size (), spec, a);
+      if (written < 0)
+      {
+        return false;
+      }
+
+      output.commit (static_cast<std::size_t> (written));
+      return true;
+    }
+
+    // Renders format from pos until all args are consumed, continues with the
+    //  literal text up to the next conversion (or the end) and leaves pos
+    //  there. Returns false if args doesn't match the format
+    inline bool render_partial (
+        output_buffer & output
+      , char const *    format
+      , index_type &    pos
+      , arg const *     args
+      , size_type       arg_count
+      ) noexcept
+    {
+      TYPESAFE_PRINTF__ASSERT (format);
+      TYPESAFE_PRINTF__ASSERT (args || arg_count == 0);
+
+      size_type   count = 0U;
+      index_type  begin = pos;
+      segment     s     {} ;
+
+      while (next_segment (format, pos, s))
+      {
+        if (is_literal (s))
+        {
+          output.append (format + s.begin, s.end - s.begin);
+        }
+        else if (count >= arg_count)
+        {
+          pos = begin;
+          return true;
+        }
+        else if (count + argument_count (s) > arg_count || !render_segment (output, format, s, args + count))
+        {
+          return false;
+        }
+        else
+        {
+          count += argument_count (s);
+        }
+
+        begin = pos;
+      }
+
+      return count == arg_count;
+    }
+
+    // Renders format with args, returns what snprintf would have returned or
+    //  a negative value if args doesn't match the format
+    inline int render (
+        char *          buffer
+      , std::size_t     size
+      , char const *    format
+      , arg const *     args
+      , size_type       arg_count
+      ) noexcept
+    {
+      output_buffer output (buffer, size);
+
+      index_type pos = 0U;
+      if (!render_partial (output, format, pos, args, arg_count) || format[pos] != '\0')
+      {
+        output.finish ();
+        return -1;
+      }
+
+      return output.finish ();
+    }
+
+    // As above but with format already split in segments
+    inline int render (
+        char *          buffer
+      , std::size_t     size
+      , char const *    format
+      , segment const * segments
+      , size_type       segment_count
+      , arg const *     args
+      , size_type       arg_count
+      ) noexcept
+    {
+      TYPESAFE_PRINTF__ASSERT (format);
+      TYPESAFE_PRINTF__ASSERT (segments || segment_count == 0);
+      TYPESAFE_PRINTF__ASSERT (args || arg_count == 0);
+
+      output_buffer output (buffer, size);
+
+      size_type count = 0U;
+
+      for (auto iter = 0U; iter < segment_count; ++iter)
+      {
+        auto & s = segments[iter];
+        if (is_literal (s))
+        {
+          output.append (format + s.begin, s.end - s.begin);
+        }
+        else if (count + argument_count (s) > arg_count || !render_segment (output, format, s, args + count))
+        {
+          output.finish ();
+          return -1;
+        }
+        else
+        {
+          count += argument_count (s);
+        }
+      }
+
+      if (count != arg_count)
+      {
+        output.finish ();
+        return -1;
+      }
+
+      return output.finish ();
+    }
+  }
+}
+
+#endif // TYPESAFE_PRINTF__TSPRINTF_ENGINE_HPP
@@ -0,0 +1,252 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+#ifndef TYPESAFE_PRINTF__TSPRINTF_ESCAPE_HPP
+#define TYPESAFE_PRINTF__TSPRINTF_ESCAPE_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define TYPESAFE_PRINTF__ESCAPE_SSE2
+# include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+# define TYPESAFE_PRINTF__ESCAPE_AVX2
+# include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+# include <intrin.h>
+#endif
+
+// Finds the chars in a string that need escaping, 32 (AVX2) or 16 (SSE2)
+//  chars at a time so the clean runs in between can be copied as blocks
+
+namespace typesafe_printf
+{
+  namespace details
+  {
+    enum escape_kind
+    {
+      ek__json      , // " \ and control chars, \uXXXX for the ones without a short form
+      ek__c_string  , // " \ control chars and DEL, \ooo for the ones without a short form
+    };
+
+    constexpr bool needs_escape (unsigned char ch, escape_kind kind) noexcept
+    {
+      return ch < 0x20U || ch == '"' || ch == '\\' || (kind == ek__c_string && ch == 0x7FU);
+    }
+
+    inline std::size_t count_trailing_zeros (std::uint32_t v) noexcept
+    {
+#ifdef _MSC_VER
+      unsigned long index = 0;
+      _BitScanForward (&index, v);
+      return index;
+#else
+      return static_cast<std::size_t> (__builtin_ctz (v));
+#endif
+    }
+
+    // Returns the first char in [begin, end) that needs escaping, or end
+    inline char const * find_escape (char const * begin, char const * end, escape_kind kind) noexcept
+    {
+#ifdef TYPESAFE_PRINTF__ESCAPE_AVX2
+      {
+        auto control    = _mm256_set1_epi8 (0x1F);
+        auto quote      = _mm256_set1_epi8 ('"' );
+        auto backslash  = _mm256_set1_epi8 ('\\');
+        // JSON doesn't escape DEL, compare with the quote again instead
+        auto del        = _mm256_set1_epi8 (kind == ek__c_string ? 0x7F : '"');
+
+        for (; end - begin >= 32; begin += 32)
+        {
+          auto v    = _mm256_loadu_si256 (reinterpret_cast<__m256i const *> (begin));
+          auto hits = _mm256_or_si256 (
+              _mm256_or_si256 (
+                  _mm256_cmpeq_epi8 (_mm256_max_epu8 (v, control), control)
+                , _mm256_cmpeq_epi8 (v, quote)
+                )
+            , _mm256_or_si256 (
+                  _mm256_cmpeq_epi8 (v, backslash)
+                , _mm256_cmpeq_epi8 (v, del)
+                )
+            );
+
+          auto mask = static_cast<std::uint32_t> (_mm256_movemask_epi8 (hits));
+          if (mask != 0)
+          {
+            return begin + count_trailing_zeros (mask);
+          }
+        }
+      }
+#endif
+
+#ifdef TYPESAFE_PRINTF__ESCAPE_SSE2
+      {
+        auto control    = _mm_set1_epi8 (0x1F);
+        auto quote      = _mm_set1_epi8 ('"' );
+        auto backslash  = _mm_set1_epi8 ('\\');
+        auto del        = _mm_set1_epi8 (kind == ek__c_string ? 0x7F : '"');
+
+        for (; end - begin >= 16; begin += 16)
+        {
+          auto v    = _mm_loadu_si128 (reinterpret_cast<__m128i const *> (begin));
+          // max_epu8 (v, 0x1F) == 0x1F is an unsigned v <= 0x1F
+          auto hits = _mm_or_si128 (
+              _mm_or_si128 (
+                  _mm_cmpeq_epi8 (_mm_max_epu8 (v, control), control)
+                , _mm_cmpeq_epi8 (v, quote)
+                )
+            , _mm_or_si128 (
+                  _mm_cmpeq_epi8 (v, backslash)
+                , _mm_cmpeq_epi8 (v, del)
+                )
+            );
+
+          auto mask = static_cast<std::uint32_t> (_mm_movemask_epi8 (hits));
+          if (mask != 0)
+          {
+            return begin + count_trailing_zeros (mask);
+          }
+        }
+      }
+#endif
+
+      for (; begin < end; ++begin)
+      {
+        if (needs_escape (static_cast<unsigned char> (*begin), kind))
+        {
+          return begin;
+        }
+      }
+
+      return end;
+    }
+
+    // Returns the first of the chars a, b, c and d in [begin, end), or end.
+    //  Used for the delimiters and quotes of CSV fields
+    inline char const * find_any_of (char const * begin, char const * end, char a, char b, char c, char d) noexcept
+    {
+#ifdef TYPESAFE_PRINTF__ESCAPE_AVX2
+      {
+        auto va = _mm256_set1_epi8 (a);
+        auto vb = _mm256_set1_epi8 (b);
+        auto vc = _mm256_set1_epi8 (c);
+        auto vd = _mm256_set1_epi8 (d);
+
+        for (; end - begin >= 32; begin += 32)
+        {
+          auto v    = _mm256_loadu_si256 (reinterpret_cast<__m256i const *> (begin));
+          auto hits = _mm256_or_si256 (
+              _mm256_or_si256 (_mm256_cmpeq_epi8 (v, va), _mm256_cmpeq_epi8 (v, vb))
+            , _mm256_or_si256 (_mm256_cmpeq_epi8 (v, vc), _mm256_cmpeq_epi8 (v, vd))
+            );
+
+          auto mask = static_cast<std::uint32_t> (_mm256_movemask_epi8 (hits));
+          if (mask != 0)
+          {
+            return begin + count_trailing_zeros (mask);
+          }
+        }
+      }
+#endif
+
+#ifdef TYPESAFE_PRINTF__ESCAPE_SSE2
+      {
+        auto va = _mm_set1_epi8 (a);
+        auto vb = _mm_set1_epi8 (b);
+        auto vc = _mm_set1_epi8 (c);
+        auto vd = _mm_set1_epi8 (d);
+
+        for (; end - begin >= 16; begin += 16)
+        {
+          auto v    = _mm_loadu_si128 (reinterpret_cast<__m128i const *> (begin));
+          auto hits = _mm_or_si128 (
+              _mm_or_si128 (_mm_cmpeq_epi8 (v, va), _mm_cmpeq_epi8 (v, vb))
+            , _mm_or_si128 (_mm_cmpeq_epi8 (v, vc), _mm_cmpeq_epi8 (v, vd))
+            );
+
+          auto mask = static_cast<std::uint32_t> (_mm_movemask_epi8 (hits));
+          if (mask != 0)
+          {
+            return begin + count_trailing_zeros (mask);
+          }
+        }
+      }
+#endif
+
+      for (; begin < end; ++begin)
+      {
+        auto ch = *begin;
+        if (ch == a || ch == b || ch == c || ch == d)
+        {
+          return begin;
+        }
+      }
+
+      return end;
+    }
+
+    // Writes the escape sequence of ch (which needs escaping) to sequence,
+    //  returns its length
+    inline std::size_t escape_sequence (unsigned char ch, escape_kind kind, char (&sequence) [8]) noexcept
+    {
+      char const hex[] = "0123456789abcdef";
+
+      sequence[0] = '\\';
+
+      switch (ch)
+      {
+      case '"'  : sequence[1] = '"' ; return 2;
+      case '\\' : sequence[1] = '\\'; return 2;
+      case '\b' : sequence[1] = 'b' ; return 2;
+      case '\f' : sequence[1] = 'f' ; return 2;
+      case '\n' : sequence[1] = 'n' ; return 2;
+      case '\r' : sequence[1] = 'r' ; return 2;
+      case '\t' : sequence[1] = 't' ; return 2;
+      default   : break;
+      }
+
+      if (kind == ek__json)
+      {
+        sequence[1] = 'u';
+        sequence[2] = '0';
+        sequence[3] = '0';
+        sequence[4] = hex[ch >> 4];
+        sequence[5] = hex[ch & 0xF];
+        return 6;
+      }
+
+      switch (ch)
+      {
+      case '\a' : sequence[1] = 'a' ; return 2;
+      case '\v' : sequence[1] = 'v' ; return 2;
+      default   : break;
+      }
+
+      // Octal never runs into the chars that follow like \x does
+      sequence[1] = static_cast<char> ('0' + ((ch >> 6) & 0x7));
+      sequence[2] = static_cast<char> ('0' + ((ch >> 3) & 0x7));
+      sequence[3] = static_cast<char> ('0' + ( ch       & 0x7));
+      return 4;
+    }
+  }
+}
+
+#endif // TYPESAFE_PRINTF__TSPRINTF_ESCAPE_HPP
@@ -0,0 +1,85 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+#ifndef TYPESAFE_PRINTF__TSPRINTF_FORMAT_HPP
+#define TYPESAFE_PRINTF__TSPRINTF_FORMAT_HPP
+
+#include <string>
+#include <utility>
+
+#include "tsprintf.hpp"
+#include "tsprintf_engine.hpp"
+
+// Checked formatting through the engine instead of libc. Besides the printf
+//  conversions these support the engine extensions:
+//
+//  %Js   The string JSON escaped (without quotes), nullptr is empty
+//  %Qs   The string escaped as in a C string literal (without quotes)
+//
+//  auto line = TS_FORMAT ("{\"user\":\"%Js\",\"id\":%d}\n", user, id);
+//  auto size = TS_FORMAT_TO (buffer, sizeof (buffer), "name=\"%Qs\"", name);
+
+#define TS_FORMAT(format, ...)                                                                                      \
+  ( (void) typesafe_printf::details::check_types<typesafe_printf::details::scanner::encode (format)> (__VA_ARGS__)  \
+  , (void) TYPESAFE_PRINTF__CHECK_EXTENSIONS (format)                                                               \
+  , typesafe_printf::details::format_to_string<typesafe_printf::details::scanner::encode (format)> (format, ##__VA_ARGS__) \
+  )
+
+// Returns what snprintf would have returned
+#define TS_FORMAT_TO(buffer, buffer_size, format, ...)                                                              \
+  ( (void) typesafe_printf::details::check_types<typesafe_printf::details::scanner::encode (format)> (__VA_ARGS__)  \
+  , (void) TYPESAFE_PRINTF__CHECK_EXTENSIONS (format)                                                               \
+  , typesafe_printf::details::format_to<typesafe_printf::details::scanner::encode (format)> (buffer, buffer_size, format, ##__VA_ARGS__) \
+  )
+
+namespace typesafe_printf
+{
+  namespace details
+  {
+    template<encoded_types_t EncodedTypes, typename ...TArgs>
+    inline int format_to (char * buffer, std::size_t size, char const * format, TArgs && ...args) noexcept
+    {
+      std::array<arg, sizeof... (TArgs)> captured;
+      make_args<EncodedTypes> (captured, std::forward<TArgs> (args)...);
+      return render (buffer, size, format, captured.data (), static_cast<size_type> (captured.size ()));
+    }
+
+    template<encoded_types_t EncodedTypes, typename ...TArgs>
+    inline std::string format_to_string (char const * format, TArgs && ...args)
+    {
+      std::array<arg, sizeof... (TArgs)> captured;
+      make_args<EncodedTypes> (captured, std::forward<TArgs> (args)...);
+
+      char buffer[256];
+      auto size = render (buffer, sizeof (buffer), format, captured.data (), static_cast<size_type> (captured.size ()));
+      if (size < 0)
+      {
+        return std::string ();
+      }
+      else if (static_cast<std::size_t> (size) < sizeof (buffer))
+      {
+        return std::string (buffer, static_cast<std::size_t> (size));
+      }
+
+      std::string result (static_cast<std::size_t> (size) + 1, '\0');
+      render (&result.front (), result.size (), format, captured.data (), static_cast<size_type> (captured.size ()));
+      result.resize (static_cast<std::size_t> (size));
+      return result;
+    }
+  }
+}
+
+#endif // TYPESAFE_PRINTF__TSPRINTF_FORMAT_HPP
@@ -0,0 +1,124 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+#ifndef TYPESAFE_PRINTF__TSPRINTF_HEX_HPP
+#define TYPESAFE_PRINTF__TSPRINTF_HEX_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define TYPESAFE_PRINTF__HEX_SSE2
+# include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+# define TYPESAFE_PRINTF__HEX_AVX2
+# include <immintrin.h>
+#endif
+
+// Hex encoding of byte buffers, 32 (AVX2) or 16 (SSE2) bytes at a time. The
+//  nibbles are turned into ASCII with a compare and two adds instead of a
+//  table lookup per nibble
+
+namespace typesafe_printf
+{
+  namespace details
+  {
+    constexpr char const lower_hex_digits[] = "0123456789abcdef";
+    constexpr char const upper_hex_digits[] = "0123456789ABCDEF";
+
+    // Writes v as hex digits ending at end, returns the first digit
+    inline char * format_hex (char * end, std::uintmax_t v, bool upper_case) noexcept
+    {
+      auto digits = upper_case ? upper_hex_digits : lower_hex_digits;
+
+      do
+      {
+        *--end = digits[v & 0xFU];
+        v >>= 4;
+      }
+      while (v != 0U);
+
+      return end;
+    }
+
+#ifdef TYPESAFE_PRINTF__HEX_SSE2
+    // '0' + n for n < 10, 'a' + n - 10 otherwise
+    inline __m128i hex_ascii (__m128i nibbles) noexcept
+    {
+      auto letters = _mm_and_si128 (_mm_cmpgt_epi8 (nibbles, _mm_set1_epi8 (9)), _mm_set1_epi8 ('a' - '0' - 10));
+      return _mm_add_epi8 (_mm_add_epi8 (nibbles, _mm_set1_epi8 ('0')), letters);
+    }
+#endif
+
+#ifdef TYPESAFE_PRINTF__HEX_AVX2
+    inline __m256i hex_ascii (__m256i nibbles) noexcept
+    {
+      auto letters = _mm256_and_si256 (_mm256_cmpgt_epi8 (nibbles, _mm256_set1_epi8 (9)), _mm256_set1_epi8 ('a' - '0' - 10));
+      return _mm256_add_epi8 (_mm256_add_epi8 (nibbles, _mm256_set1_epi8 ('0')), letters);
+    }
+#endif
+
+    // Writes 2 * size lower case hex digits to out
+    inline void hex_encode (char * out, unsigned char const * bytes, std::size_t size) noexcept
+    {
+#ifdef TYPESAFE_PRINTF__HEX_AVX2
+      {
+        auto mask = _mm256_set1_epi8 (0x0F);
+
+        for (; size >= 32U; size -= 32U, bytes += 32, out += 64)
+        {
+          auto v    = _mm256_loadu_si256 (reinterpret_cast<__m256i const *> (bytes));
+          auto high = hex_ascii (_mm256_and_si256 (_mm256_srli_epi16 (v, 4), mask));
+          auto low  = hex_ascii (_mm256_and_si256 (v, mask));
+
+          // unpack works within each 128 bit lane, put the lanes back in order
+          auto first  = _mm256_unpacklo_epi8 (high, low);
+          auto second = _mm256_unpackhi_epi8 (high, low);
+
+          _mm256_storeu_si256 (reinterpret_cast<__m256i *> (out)      , _mm256_permute2x128_si256 (first, second, 0x20));
+          _mm256_storeu_si256 (reinterpret_cast<__m256i *> (out + 32) , _mm256_permute2x128_si256 (first, second, 0x31));
+        }
+      }
+#endif
+
+#ifdef TYPESAFE_PRINTF__HEX_SSE2
+      {
+        auto mask = _mm_set1_epi8 (0x0F);
+
+        for (; size >= 16U; size -= 16U, bytes += 16, out += 32)
+        {
+          auto v    = _mm_loadu_si128 (reinterpret_cast<__m128i const *> (bytes));
+          auto high = hex_ascii (_mm_and_si128 (_mm_srli_epi16 (v, 4), mask));
+          auto low  = hex_ascii (_mm_and_si128 (v, mask));
+
+          _mm_storeu_si128 (reinterpret_cast<__m128i *> (out)     , _mm_unpacklo_epi8 (high, low));
+          _mm_storeu_si128 (reinterpret_cast<__m128i *> (out + 16), _mm_unpackhi_epi8 (high, low));
+        }
+      }
+#endif
+
+      for (; size > 0U; --size, ++bytes)
+      {
+        *out++ = lower_hex_digits[*bytes >> 4  ];
+        *out++ = lower_hex_digits[*bytes & 0xFU];
+      }
+    }
+  }
+}
+
+#endif // TYPESAFE_PRINTF__TSPRINTF_HEX_HPP
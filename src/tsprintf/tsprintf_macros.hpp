@@ -0,0 +1,59 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+#ifndef TYPESAFE_PRINTF__TSPRINTF_MACROS_HPP
+#define TYPESAFE_PRINTF__TSPRINTF_MACROS_HPP
+
+// Only the macros, for code that imports the tsprintf module (macros can't
+//  be exported from a module). tsprintf.hpp includes this
+
+// The macros call printf, fprintf and snprintf
+#include <cstdio>
+
+#define TS_PRINTF(format, ...)                                                                                    \
+  (void) typesafe_printf::details::check_types<typesafe_printf::details::scanner::encode (format)> (__VA_ARGS__); \
+  static_assert (                                                                                                 \
+      !typesafe_printf::details::scanner::has_engine_extension (format)                                           \
+    , "%Js, %Qs, %Hp and %T need the engine, use TS_FORMAT_TO or TS_WRITEV"                                    \
+    );                                                                                                            \
+  printf (format, ##__VA_ARGS__)
+
+// Uses snprintf internally, sprintf is more error-prone
+#define TS_FPRINTF(stream, format, ...)                                                                           \
+  (void) typesafe_printf::details::check_types<typesafe_printf::details::scanner::encode (format)> (__VA_ARGS__); \
+  static_assert (                                                                                                 \
+      !typesafe_printf::details::scanner::has_engine_extension (format)                                           \
+    , "%Js, %Qs, %Hp and %T need the engine, use TS_FORMAT_TO or TS_WRITEV"                                    \
+    );                                                                                                            \
+  fprintf (stream, format, ##__VA_ARGS__)
+
+#define TS_SPRINTF(buffer, format, ...)                                                                           \
+  (void) typesafe_printf::details::check_types<typesafe_printf::details::scanner::encode (format)> (__VA_ARGS__); \
+  static_assert (                                                                                                 \
+      !typesafe_printf::details::scanner::has_engine_extension (format)                                           \
+    , "%Js, %Qs, %Hp and %T need the engine, use TS_FORMAT_TO or TS_WRITEV"                                    \
+    );                                                                                                            \
+  snprintf (buffer, typesafe_printf::details::buffer_extent<decltype(buffer)>::value, format, ##__VA_ARGS__)
+
+#define TS_SNPRINTF(buffer, buffer_size, format, ...)                                                             \
+  (void) typesafe_printf::details::check_types<typesafe_printf::details::scanner::encode (format)> (__VA_ARGS__); \
+  static_assert (                                                                                                 \
+      !typesafe_printf::details::scanner::has_engine_extension (format)                                           \
+    , "%Js, %Qs, %Hp and %T need the engine, use TS_FORMAT_TO or TS_WRITEV"                                    \
+    );                                                                                                            \
+  snprintf (buffer, buffer_size, format, ##__VA_ARGS__)
+
+#endif // TYPESAFE_PRINTF__TSPRINTF_MACROS_HPP
@@ -0,0 +1,455 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+#ifndef TYPESAFE_PRINTF__TSPRINTF_METRICS_HPP
+#define TYPESAFE_PRINTF__TSPRINTF_METRICS_HPP
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "tsprintf.hpp"
+#include "tsprintf_engine.hpp"
+#include "tsprintf_rt.hpp"
+
+// Prometheus and OpenMetrics text exposition. The labels of a series are
+//  a checked format rendered once when the series is created, a scrape only
+//  appends the rendered prefix and the value to a buffer that keeps its
+//  capacity between scrapes
+//
+//  metrics::family requests ("http_requests_total", metrics::mt__counter, "Requests handled");
+//  auto ok = TS_METRIC_SERIES (requests, "{method=\"%s\",code=\"%d\"}", "get", 200);
+//
+//  metrics::writer w;
+//  w.clear ();
+//  w.family (requests);
+//  w.sample (ok, ok_count);
+//  auto const & text = w.finish ();
+//
+// The labels format is the rest of the sample name, "_bucket{le=\"0.5\"}"
+//  or "_sum" for the samples of histograms and summaries. %s label values
+//  are escaped
+
+// Returns a metrics::series
+#define TS_METRIC_SERIES(family, labels, ...)                                                                       \
+  ( (void) typesafe_printf::details::check_types<typesafe_printf::details::scanner::encode (labels)> (__VA_ARGS__)  \
+  , typesafe_printf::details::make_series<typesafe_printf::details::scanner::encode (labels)> (family, labels, ##__VA_ARGS__) \
+  )
+
+namespace typesafe_printf
+{
+  namespace metrics
+  {
+    enum metric_type
+    {
+      mt__counter   ,
+      mt__gauge     ,
+      mt__histogram ,
+      mt__summary   ,
+      mt__untyped   ,
+    };
+
+    enum exposition_format
+    {
+      ef__prometheus  ,
+      ef__openmetrics ,
+    };
+  }
+
+  namespace details
+  {
+    // Prometheus escapes \ and newline in help, OpenMetrics " as well. Label
+    //  values escape all three in both
+    inline void append_metric_escaped (std::string & out, char const * s, bool escape_quote)
+    {
+      for (; *s != '\0'; ++s)
+      {
+        switch (*s)
+        {
+        case '\\':
+          out += "\\\\";
+          break;
+        case '\n':
+          out += "\\n";
+          break;
+        case '"':
+          if (escape_quote)
+          {
+            out += "\\\"";
+            break;
+          }
+          out += '"';
+          break;
+        default:
+          out += *s;
+          break;
+        }
+      }
+    }
+
+    inline void append_metric_header (std::string & out, char const * name, std::size_t name_size, char const * type, char const * help, metrics::exposition_format format)
+    {
+      if (*help != '\0')
+      {
+        out += "# HELP ";
+        out.append (name, name_size);
+        out += ' ';
+        append_metric_escaped (out, help, format == metrics::ef__openmetrics);
+        out += '\n';
+      }
+
+      out += "# TYPE ";
+      out.append (name, name_size);
+      out += ' ';
+      out += type;
+      out += '\n';
+    }
+
+    constexpr bool is_metric_name_char (char ch, bool is_first) noexcept
+    {
+      return
+            (ch >= 'a' && ch <= 'z')
+        ||  (ch >= 'A' && ch <= 'Z')
+        ||  ch == '_'
+        ||  ch == ':'
+        ||  (!is_first && ch >= '0' && ch <= '9')
+        ;
+    }
+
+    constexpr bool has_wide_strings (encoded_types_t encoded_types) noexcept
+    {
+      return
+          encoded_types == 0U                                 ? false
+        : (encoded_types & type_id__mask) == tid__wchar_t_p   ? true
+        : has_wide_strings (encoded_types >> type_id__bits)
+        ;
+    }
+
+    // Integers up to 2^53 are written without a fraction or exponent
+    TYPESAFE_PRINTF__CONSTANT double max_exact_integer = 9007199254740992.0;
+  }
+
+  namespace metrics
+  {
+    // The HELP and TYPE lines of a metric, rendered for both formats
+    class family
+    {
+    public:
+      family (char const * name, metric_type type, char const * help = "")
+        : family_name (name)
+      {
+        TYPESAFE_PRINTF__ASSERT (*name != '\0');
+        for (auto iter = name; *iter != '\0'; ++iter)
+        {
+          TYPESAFE_PRINTF__ASSERT (details::is_metric_name_char (*iter, iter == name));
+        }
+
+        static char const * const prometheus_types[]  = { "counter", "gauge", "histogram", "summary", "untyped" };
+        static char const * const openmetrics_types[] = { "counter", "gauge", "histogram", "summary", "unknown" };
+
+        details::append_metric_header (prometheus_header, name, family_name.size (), prometheus_types[type], help, ef__prometheus);
+
+        // OpenMetrics names the family without the _total of the samples
+        auto name_size = family_name.size ();
+        if (type == mt__counter && name_size > 6U && family_name.compare (name_size - 6U, 6U, "_total") == 0)
+        {
+          name_size -= 6U;
+        }
+        details::append_metric_header (openmetrics_header, name, name_size, openmetrics_types[type], help, ef__openmetrics);
+      }
+
+      std::string const & name () const noexcept
+      {
+        return family_name;
+      }
+
+      std::string const & header (exposition_format format) const noexcept
+      {
+        return format == ef__openmetrics ? openmetrics_header : prometheus_header;
+      }
+
+    private:
+      std::string family_name         ;
+      std::string prometheus_header   ;
+      std::string openmetrics_header  ;
+    };
+
+    // The sample name and labels of a series followed by a space, create it
+    //  with TS_METRIC_SERIES
+    class series
+    {
+    public:
+      explicit series (std::string prefix) noexcept
+        : text (std::move (prefix))
+      {
+      }
+
+      std::string const & prefix () const noexcept
+      {
+        return text;
+      }
+
+    private:
+      std::string text;
+    };
+
+    // Collects a scrape in one buffer, clear keeps the capacity so a scrape
+    //  of a warmed up writer doesn't allocate
+    class writer
+    {
+    public:
+      explicit writer (exposition_format format = ef__prometheus, std::size_t capacity = 64U * 1024U)
+        : format (format)
+      {
+        buffer.reserve (capacity);
+      }
+
+      void clear () noexcept
+      {
+        buffer.clear ();
+      }
+
+      void family (metrics::family const & f)
+      {
+        buffer += f.header (format);
+      }
+
+      template<typename T>
+      typename std::enable_if<std::is_integral<T>::value>::type sample (series const & s, T value)
+      {
+        buffer += s.prefix ();
+        append_integer (value);
+        buffer += '\n';
+      }
+
+      void sample (series const & s, double value)
+      {
+        buffer += s.prefix ();
+        append_double (value);
+        buffer += '\n';
+      }
+
+      // The timestamp is in milliseconds for Prometheus and seconds for
+      //  OpenMetrics, the caller picks the unit
+      template<typename T, typename TTimestamp>
+      void sample (series const & s, T value, TTimestamp timestamp)
+      {
+        buffer += s.prefix ();
+        append_value (value);
+        buffer += ' ';
+        append_value (timestamp);
+        buffer += '\n';
+      }
+
+      // Ends the scrape, OpenMetrics wants # EOF last
+      std::string const & finish ()
+      {
+        if (format == ef__openmetrics)
+        {
+          buffer += "# EOF\n";
+        }
+        return buffer;
+      }
+
+      std::string const & text () const noexcept
+      {
+        return buffer;
+      }
+
+    private:
+      template<typename T>
+      typename std::enable_if<std::is_integral<T>::value>::type append_value (T value)
+      {
+        append_integer (value);
+      }
+
+      void append_value (double value)
+      {
+        append_double (value);
+      }
+
+      template<typename T>
+      typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type append_integer (T value)
+      {
+        char digits[24];
+        auto end    = digits + sizeof (digits);
+        auto first  = details::format_decimal (end, value < 0 ? 0U - static_cast<std::uintmax_t> (value) : static_cast<std::uintmax_t> (value));
+        if (value < 0)
+        {
+          *--first = '-';
+        }
+        buffer.append (first, static_cast<std::size_t> (end - first));
+      }
+
+      template<typename T>
+      typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type append_integer (T value)
+      {
+        char digits[24];
+        auto end    = digits + sizeof (digits);
+        auto first  = details::format_decimal (end, static_cast<std::uintmax_t> (value));
+        buffer.append (first, static_cast<std::size_t> (end - first));
+      }
+
+      // m with the decimal point decimals digits from the right
+      void append_fixed (std::int64_t m, int decimals)
+      {
+        char digits[48];
+        auto end    = digits + sizeof (digits);
+        auto first  = details::format_decimal (end, m < 0 ? 0U - static_cast<std::uint64_t> (m) : static_cast<std::uint64_t> (m));
+        while (end - first <= decimals)
+        {
+          *--first = '0';
+        }
+
+        if (m < 0)
+        {
+          buffer += '-';
+        }
+        buffer.append (first, static_cast<std::size_t> (end - first - decimals));
+        buffer += '.';
+        buffer.append (end - decimals, static_cast<std::size_t> (decimals));
+      }
+
+      void append_double (double value)
+      {
+        if (value != value)
+        {
+          buffer += "NaN";
+          return;
+        }
+
+        if (value - value != 0.0)
+        {
+          buffer += value > 0.0 ? "+Inf" : "-Inf";
+          return;
+        }
+
+        // Counters and most gauges are whole numbers
+        if (value >= -details::max_exact_integer && value <= details::max_exact_integer && static_cast<double> (static_cast<std::int64_t> (value)) == value)
+        {
+          append_integer (static_cast<std::int64_t> (value));
+          return;
+        }
+
+        // Values like 0.125 or 12.345 are m / 10^k with m below 2^53. Both are
+        //  exact doubles so the division rounds to the double nearest to the
+        //  decimal, if that is value the decimal reads back as value
+        auto scale = 1.0;
+        for (auto decimals = 1; decimals <= 15; ++decimals)
+        {
+          scale *= 10.0;
+          auto scaled = value * scale;
+          if (scaled < -details::max_exact_integer || scaled > details::max_exact_integer)
+          {
+            break;
+          }
+
+          auto m = static_cast<std::int64_t> (scaled < 0.0 ? scaled - 0.5 : scaled + 0.5);
+          if (static_cast<double> (m) / scale == value)
+          {
+            append_fixed (m, decimals);
+            return;
+          }
+        }
+
+        // %.17g always reads back. In the range above a value with 15 digits
+        //  would have been found already, outside of it (1e300, 2.5e-20)
+        //  %.15g is tried first to keep the output short
+        auto magnitude  = value < 0.0 ? -value : value;
+        auto try_short  = magnitude < 1e-5 || magnitude >= 1e15;
+
+        char digits[32];
+        details::rt_spec spec {};
+        spec.conversion = 'g';
+        spec.precision  = try_short ? 15 : 17;
+        for (;;)
+        {
+          details::rt_output output (digits, sizeof (digits));
+          details::rt_double (output, spec, value);
+          output.finish ();
+          if (spec.precision == 17 || std::strtod (digits, nullptr) == value)
+          {
+            break;
+          }
+          spec.precision = 17;
+        }
+
+        buffer += digits;
+      }
+
+      exposition_format format ;
+      std::string       buffer ;
+    };
+  }
+
+  namespace details
+  {
+    template<encoded_types_t EncodedTypes, typename ...TArgs>
+    inline metrics::series make_series (metrics::family const & f, char const * labels, TArgs && ...args)
+    {
+      static_assert (
+          !has_wide_strings (EncodedTypes)
+        , "Label values must be char strings"
+        );
+
+      std::array<arg, sizeof... (TArgs)> captured;
+      make_args<EncodedTypes> (captured, std::forward<TArgs> (args)...);
+      auto count = static_cast<size_type> (captured.size ());
+
+      // The escaped label values, the array doesn't move them
+      std::string escaped[sizeof... (TArgs) + 1];
+      for (auto iter = 0U; iter < count; ++iter)
+      {
+        auto & a = captured[iter];
+        if (a.tid == tid__char_p && a.value.char_p)
+        {
+          append_metric_escaped (escaped[iter], a.value.char_p, true);
+          a.value.char_p = escaped[iter].c_str ();
+        }
+      }
+
+      std::string prefix  = f.name ();
+      auto        offset  = prefix.size ();
+      prefix.resize (offset + 64U);
+      for (;;)
+      {
+        auto room = prefix.size () - offset;
+        auto size = render (&prefix[offset], room, labels, captured.data (), count);
+        TYPESAFE_PRINTF__ASSERT (size >= 0);
+        if (size < 0)
+        {
+          size = 0;
+        }
+
+        if (static_cast<std::size_t> (size) < room)
+        {
+          prefix.resize (offset + static_cast<std::size_t> (size));
+          break;
+        }
+
+        prefix.resize (offset + static_cast<std::size_t> (size) + 1U);
+      }
+
+      prefix += ' ';
+      return metrics::series (std::move (prefix));
+    }
+  }
+}
+
+#endif // TYPESAFE_PRINTF__TSPRINTF_METRICS_HPP
@@ -0,0 +1,35 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+
+#ifndef TYPESAFE_PRINTF__TSPRINTF_PCH_HPP
+#define TYPESAFE_PRINTF__TSPRINTF_PCH_HPP
+
+// The headers a logging translation unit uses, for a precompiled header:
+//
+//  g++ -x c++-header tsprintf_pch.hpp -o tsprintf_pch.hpp.gch
+//  g++ -include tsprintf_pch.hpp ...
+//
+//  clang++ -x c++-header tsprintf_pch.hpp -o tsprintf_pch.hpp.pch
+//  clang++ -include-pch tsprintf_pch.hpp.pch ...
+//
+// The format checks still happen where the macros are expanded
+
+#include "tsprintf.hpp"
+#include "tsprintf_binlog.hpp"
+#include "tsprintf_format.hpp"
+
+#endif // TYPESAFE_PRINTF__TSPRINTF_PCH_HPP
@@ -0,0 +1,635 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+#ifndef TYPESAFE_PRINTF__TSPRINTF_RECORDER_HPP
+#define TYPESAFE_PRINTF__TSPRINTF_RECORDER_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cwchar>
+#include <utility>
+
+#include "tsprintf.hpp"
+#include "tsprintf_engine.hpp"
+#include "tsprintf_rt.hpp"
+
+// The flight recorder keeps the latest log records of every thread in memory.
+//  TS_RECORD stores the format pointer, a timestamp and the captured
+//  arguments in a per-thread ring that overwrites its oldest records, nothing
+//  is rendered until the rings are dumped:
+//
+//  typesafe_printf::recorder::dump_on_crash ();   // SIGSEGV, SIGABRT, ... dump to stderr
+//
+//  TS_RECORD ("Accepted %s:%d\n", host, port);
+//
+//  typesafe_printf::recorder::dump (stderr);      // On demand
+//
+// Strings are copied, truncated to TYPESAFE_PRINTF__RECORDER_MAX_STRING chars.
+//  The ring of a thread that has exited is kept, with its records, until a
+//  new thread takes it over.
+//
+// Dumps don't allocate and write each ring under its lock. A dump from a
+//  signal handler skips the ring of a thread interrupted while recording.
+//  Records are rendered like TS_SNPRINTF_RT so dumps are async-signal-safe,
+//  which is why %Lf (long double) and %T are rejected at compile time.
+
+#ifndef TYPESAFE_PRINTF__RECORDER_MAX_STRING
+# define TYPESAFE_PRINTF__RECORDER_MAX_STRING 256
+#endif
+
+#define TS_RECORD(format, ...)                                                                                      \
+  (void) typesafe_printf::details::check_types<typesafe_printf::details::scanner::encode (format)> (__VA_ARGS__);   \
+  (void) TYPESAFE_PRINTF__CHECK_EXTENSIONS (format);                                                                \
+  static_assert (                                                                                                   \
+      !typesafe_printf::details::has_extension (format, typesafe_printf::details::ext__hexdump)                     \
+    , "%Hp can't be used in the flight recorder, only the pointer would be stored"                                  \
+    );                                                                                                              \
+  static_assert (typesafe_printf::details::check_rt<typesafe_printf::details::rt_violation (format)> (), "");       \
+  typesafe_printf::recorder::record<typesafe_printf::details::scanner::encode (format)> (format, ##__VA_ARGS__)
+
+namespace typesafe_printf
+{
+  namespace recorder
+  {
+    constexpr std::size_t default_ring_size = 64U << 10;
+  }
+
+  namespace details
+  {
+    constexpr std::size_t recorder_max_string = TYPESAFE_PRINTF__RECORDER_MAX_STRING;
+
+    // Records are 8 byte aligned in the ring. When the next record doesn't
+    //  fit at the end of the ring the end is padded, a padding is only a
+    //  size smaller than a header or a header with a null format
+    struct recorder_header
+    {
+      std::uint32_t     size      ; // Including the header
+      std::uint32_t     arg_count ;
+      char const *      format    ;
+      std::uint64_t     timestamp ;
+    };
+
+    constexpr std::size_t recorder_align (std::size_t size) noexcept
+    {
+      return (size + 7U) & ~static_cast<std::size_t> (7U);
+    }
+
+    // Ring sizes are powers of two so positions wrap with a mask
+    inline std::size_t recorder_capacity (std::size_t size) noexcept
+    {
+      std::size_t capacity = 64U;
+      while (capacity < size)
+      {
+        capacity <<= 1;
+      }
+      return capacity;
+    }
+
+    constexpr std::size_t recorder_string_size (std::size_t chars, std::size_t char_size) noexcept
+    {
+      return recorder_align ((chars + 1U) * char_size);
+    }
+
+    template<typename TChar>
+    inline std::size_t recorder_length (TChar const * s) noexcept
+    {
+      auto size = std::size_t ();
+      while (size < recorder_max_string && s[size] != 0)
+      {
+        ++size;
+      }
+      return size;
+    }
+
+    class recorder_ring
+    {
+    public:
+      explicit recorder_ring (std::size_t size)
+        : next      (nullptr)
+        , in_use    (true)
+        , storage   (new std::uint64_t[recorder_capacity (size) / 8U])
+        , capacity  (recorder_capacity (size))
+        , head      (0U)
+        , tail      (0U)
+        , busy      (false)
+      {
+      }
+
+      recorder_ring (recorder_ring const &)             = delete;
+      recorder_ring & operator= (recorder_ring const &) = delete;
+
+      ~recorder_ring () noexcept
+      {
+        delete [] storage;
+      }
+
+      bool try_lock () noexcept
+      {
+        return !busy.exchange (true, std::memory_order_acquire);
+      }
+
+      void lock () noexcept
+      {
+        while (!try_lock ())
+        {
+        }
+      }
+
+      void unlock () noexcept
+      {
+        busy.store (false, std::memory_order_release);
+      }
+
+      // Requires the lock, returns nullptr if the record is larger than the
+      //  ring. The oldest records are dropped to make room
+      char * reserve (std::size_t size) noexcept
+      {
+        if (size > capacity)
+        {
+          return nullptr;
+        }
+
+        auto offset = (head & (capacity - 1U));
+        if (offset + size > capacity)
+        {
+          // Pads to the end, there might not be room for a whole header
+          drop_until (head + capacity - offset);
+          recorder_header pad { static_cast<std::uint32_t> (capacity - offset), 0U, nullptr, 0U };
+          std::memcpy (bytes () + offset, &pad, pad.size < sizeof (pad) ? sizeof (pad.size) : sizeof (pad));
+          head    += pad.size;
+          offset  = 0U;
+        }
+
+        drop_until (head + size);
+
+        head += size;
+        return bytes () + offset;
+      }
+
+      // Requires the lock, calls visit with each record from the oldest
+      template<typename TVisitor>
+      void visit (TVisitor && visitor) const
+      {
+        for (auto pos = tail; pos < head; pos += size_at (pos))
+        {
+          auto offset = (pos & (capacity - 1U));
+          if (size_at (pos) < sizeof (recorder_header))
+          {
+            continue;
+          }
+
+          recorder_header header;
+          std::memcpy (&header, bytes () + offset, sizeof (header));
+          if (header.format)
+          {
+            visitor (header, bytes () + offset + sizeof (recorder_header));
+          }
+        }
+      }
+
+      recorder_ring *               next      ;
+      std::atomic<bool>             in_use    ;
+
+    private:
+      char * bytes () const noexcept
+      {
+        return reinterpret_cast<char *> (storage);
+      }
+
+      std::uint32_t size_at (std::uint64_t pos) const noexcept
+      {
+        std::uint32_t size;
+        std::memcpy (&size, bytes () + (pos & (capacity - 1U)), sizeof (size));
+        return size;
+      }
+
+      // Drops records until end - tail fits the ring
+      void drop_until (std::uint64_t end) noexcept
+      {
+        while (end - tail > capacity)
+        {
+          tail += size_at (tail);
+        }
+      }
+
+      std::uint64_t *               storage   ;
+      std::size_t                   capacity  ;
+      std::uint64_t                 head      ; // Written bytes since the start, the ring holds [tail, head)
+      std::uint64_t                 tail      ;
+      std::atomic<bool>             busy      ;
+    };
+
+    struct recorder_registry
+    {
+      std::atomic<recorder_ring *>  rings     ;
+      std::atomic<std::size_t>      ring_size ;
+      std::atomic<int>              dump_fd   ;
+    };
+
+    inline recorder_registry & get_recorder_registry () noexcept
+    {
+      static recorder_registry registry { {nullptr}, {recorder::default_ring_size}, {2} };
+      return registry;
+    }
+
+    // Takes over the ring of an exited thread or adds a new ring. Rings are
+    //  never freed so dumps can walk the list without a lock
+    inline recorder_ring * acquire_recorder_ring ()
+    {
+      auto & registry = get_recorder_registry ();
+
+      for (auto ring = registry.rings.load (std::memory_order_acquire); ring; ring = ring->next)
+      {
+        auto expected = false;
+        if (ring->in_use.compare_exchange_strong (expected, true, std::memory_order_acq_rel))
+        {
+          return ring;
+        }
+      }
+
+      auto ring   = new recorder_ring (registry.ring_size.load (std::memory_order_relaxed));
+      ring->next  = registry.rings.load (std::memory_order_relaxed);
+      while (!registry.rings.compare_exchange_weak (ring->next, ring, std::memory_order_release, std::memory_order_relaxed))
+      {
+      }
+
+      return ring;
+    }
+
+    class recorder_thread
+    {
+    public:
+      recorder_thread () noexcept
+        : ring (nullptr)
+      {
+      }
+
+      recorder_thread (recorder_thread const &)             = delete;
+      recorder_thread & operator= (recorder_thread const &) = delete;
+
+      ~recorder_thread () noexcept
+      {
+        if (ring)
+        {
+          ring->in_use.store (false, std::memory_order_release);
+        }
+      }
+
+      recorder_ring & get ()
+      {
+        if (!ring)
+        {
+          ring = acquire_recorder_ring ();
+        }
+        return *ring;
+      }
+
+    private:
+      recorder_ring * ring;
+    };
+
+    inline recorder_ring & get_recorder_ring ()
+    {
+      static thread_local recorder_thread thread;
+      return thread.get ();
+    }
+
+    inline std::size_t recorder_strings_size (arg const * args, size_type arg_count) noexcept
+    {
+      std::size_t size = 0U;
+      for (auto iter = 0U; iter < arg_count; ++iter)
+      {
+        auto & a = args[iter];
+        if (a.tid == tid__char_p && a.value.char_p)
+        {
+          size += recorder_string_size (recorder_length (a.value.char_p), sizeof (char));
+        }
+        else if (a.tid == tid__wchar_t_p && a.value.wchar_t_p)
+        {
+          size += recorder_string_size (recorder_length (a.value.wchar_t_p), sizeof (wchar_t));
+        }
+      }
+      return size;
+    }
+
+    template<typename TChar>
+    inline char * recorder_copy_string (char * out, TChar const * s) noexcept
+    {
+      auto length = recorder_length (s);
+      std::memcpy (out, s, length * sizeof (TChar));
+      std::memset (out + length * sizeof (TChar), 0, recorder_string_size (length, sizeof (TChar)) - length * sizeof (TChar));
+      return out + recorder_string_size (length, sizeof (TChar));
+    }
+
+    constexpr bool has_strings (encoded_types_t encoded_types, size_type pos = 0U) noexcept
+    {
+      return
+          type_id_at (encoded_types, pos) == tid__illegal ? false
+        : type_id_at (encoded_types, pos) == tid__char_p || type_id_at (encoded_types, pos) == tid__wchar_t_p ? true
+        : has_strings (encoded_types, pos + 1U)
+        ;
+    }
+
+    // The argument count and whether there are strings to copy are known at
+    //  compile time, calls without strings are a fixed size copy
+    template<encoded_types_t EncodedTypes, std::size_t ArgCount>
+    inline void recorder_store (char const * format, std::array<arg, ArgCount> const & args) noexcept
+    {
+      using namespace std::chrono;
+
+      constexpr auto arg_count  = static_cast<size_type> (ArgCount);
+      constexpr auto args_size  = recorder_align (ArgCount * sizeof (arg));
+      constexpr auto strings    = has_strings (EncodedTypes);
+
+      auto timestamp  = static_cast<std::uint64_t> (duration_cast<nanoseconds> (system_clock::now ().time_since_epoch ()).count ());
+      auto size       = sizeof (recorder_header) + args_size + (strings ? recorder_strings_size (args.data (), arg_count) : 0U);
+
+      recorder_ring * ring;
+      try
+      {
+        ring = &get_recorder_ring ();
+      }
+      catch (...)
+      {
+        return;
+      }
+
+      ring->lock ();
+
+      auto out = ring->reserve (size);
+      if (out)
+      {
+        recorder_header header { static_cast<std::uint32_t> (size), static_cast<std::uint32_t> (arg_count), format, timestamp };
+        std::memcpy (out, &header, sizeof (header));
+        out += sizeof (header);
+
+        std::memcpy (out, args.data (), ArgCount * sizeof (arg));
+        out += args_size;
+
+        for (auto iter = 0U; strings && iter < arg_count; ++iter)
+        {
+          auto & a = args[iter];
+          if (a.tid == tid__char_p && a.value.char_p)
+          {
+            out = recorder_copy_string (out, a.value.char_p);
+          }
+          else if (a.tid == tid__wchar_t_p && a.value.wchar_t_p)
+          {
+            out = recorder_copy_string (out, a.value.wchar_t_p);
+          }
+        }
+      }
+
+      ring->unlock ();
+    }
+
+    // Renders a record into output, the strings are pointed back into the
+    //  copies stored after the arguments
+    inline int render_recorded (rt_output & output, recorder_header const & header, char const * payload) noexcept
+    {
+      arg args[max_encoded_types];
+      auto arg_count = header.arg_count < max_encoded_types ? header.arg_count : max_encoded_types;
+      std::memcpy (args, payload, arg_count * sizeof (arg));
+
+      auto strings = payload + recorder_align (header.arg_count * sizeof (arg));
+      for (auto iter = 0U; iter < arg_count; ++iter)
+      {
+        auto & a = args[iter];
+        if (a.tid == tid__char_p && a.value.char_p)
+        {
+          a.value.char_p  = strings;
+          strings         += recorder_string_size (std::strlen (strings), sizeof (char));
+        }
+        else if (a.tid == tid__wchar_t_p && a.value.wchar_t_p)
+        {
+          a.value.wchar_t_p = reinterpret_cast<wchar_t const *> (strings);
+          strings           += recorder_string_size (std::wcslen (a.value.wchar_t_p), sizeof (wchar_t));
+        }
+        else if (get_type_class (a.tid) == tc__chars_written)
+        {
+          // The variable is long gone
+          a.value.chars_written_p = nullptr;
+        }
+      }
+
+      return rt_render (output, header.format, args, static_cast<size_type> (arg_count));
+    }
+
+    // 2015-06-21T14:03:07.123456789Z, without localtime so it works in a
+    //  signal handler. Returns the length (30)
+    inline std::size_t format_utc_timestamp (char (&buffer) [32], std::uint64_t ns) noexcept
+    {
+      auto seconds  = ns / 1000000000U;
+      auto fraction = ns % 1000000000U;
+      auto days     = static_cast<long long> (seconds / 86400U);
+      auto time     = seconds % 86400U;
+
+      // Days to civil date (proleptic Gregorian), 1970-01-01 is day 0
+      auto z        = days + 719468;
+      auto era      = z / 146097;
+      auto doe      = z - era * 146097;
+      auto yoe      = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+      auto doy      = doe - (365 * yoe + yoe / 4 - yoe / 100);
+      auto mp       = (5 * doy + 2) / 153;
+      auto day      = doy - (153 * mp + 2) / 5 + 1;
+      auto month    = mp < 10 ? mp + 3 : mp - 9;
+      auto year     = yoe + era * 400 + (month <= 2 ? 1 : 0);
+
+      auto put = [&buffer] (std::size_t pos, std::size_t digits, unsigned long long value)
+      {
+        for (auto iter = digits; iter > 0U; --iter, value /= 10U)
+        {
+          buffer[pos + iter - 1U] = static_cast<char> ('0' + value % 10U);
+        }
+      };
+
+      std::memcpy (buffer, "0000-00-00T00:00:00.000000000Z", 31);
+      put (0 , 4, static_cast<unsigned long long> (year)  );
+      put (5 , 2, static_cast<unsigned long long> (month) );
+      put (8 , 2, static_cast<unsigned long long> (day)   );
+      put (11, 2, time / 3600U                            );
+      put (14, 2, time / 60U % 60U                        );
+      put (17, 2, time % 60U                              );
+      put (20, 9, fraction                                );
+
+      return 30U;
+    }
+
+    // Calls write (text, size) with every record of every ring, each thread
+    //  in a section of its own. Returns the number of records
+    template<typename TWrite>
+    inline std::size_t dump_rings (TWrite && write, bool wait) noexcept
+    {
+      auto & registry = get_recorder_registry ();
+
+      std::size_t records = 0U;
+      auto        thread  = 0U;
+      char        line[1024];
+
+      for (auto ring = registry.rings.load (std::memory_order_acquire); ring; ring = ring->next, ++thread)
+      {
+        auto locked = false;
+        for (auto spin = 0; !locked && (wait || spin < 1000); ++spin)
+        {
+          locked = ring->try_lock ();
+        }
+
+        if (!locked)
+        {
+          auto size = TS_SNPRINTF_RT (line, sizeof (line), "--- recorder ring %u is busy, skipped\n", thread);
+          write (line, static_cast<std::size_t> (size));
+          continue;
+        }
+
+        char header[64];
+        auto header_size = TS_SNPRINTF_RT (header, sizeof (header), "--- recorder ring %u\n", thread);
+        write (header, static_cast<std::size_t> (header_size));
+
+        ring->visit ([&] (recorder_header const & h, char const * payload)
+          {
+            char timestamp[32];
+            write (timestamp, format_utc_timestamp (timestamp, h.timestamp));
+            write (" ", 1U);
+
+            rt_output output (line, sizeof (line));
+            auto size = render_recorded (output, h, payload);
+            if (size < 0)
+            {
+              static char const mismatch[] = "(arguments don't match the format)\n";
+              write (mismatch, sizeof (mismatch) - 1U);
+            }
+            else
+            {
+              // Longer lines are truncated
+              auto length = static_cast<std::size_t> (size) < sizeof (line) ? static_cast<std::size_t> (size) : sizeof (line) - 1U;
+              write (line, length);
+              if (length == 0U || line[length - 1U] != '\n')
+              {
+                write ("\n", 1U);
+              }
+            }
+
+            ++records;
+          });
+
+        ring->unlock ();
+      }
+
+      return records;
+    }
+
+    inline void dump_on_signal_handler (int signal)
+    {
+      auto fd = get_recorder_registry ().dump_fd.load (std::memory_order_relaxed);
+      dump_rings ([fd] (char const * text, std::size_t size) { rt_write_all (fd, text, size); }, false);
+      (void) signal;
+    }
+
+    // The handler is reset to the default before this runs, raising the
+    //  signal again terminates the process as it would have
+    inline void dump_on_crash_handler (int signal)
+    {
+      dump_on_signal_handler (signal);
+      std::raise (signal);
+    }
+  }
+
+  namespace recorder
+  {
+    // Applies to rings created after the call, call it before the first
+    //  TS_RECORD
+    inline void set_ring_size (std::size_t size) noexcept
+    {
+      details::get_recorder_registry ().ring_size.store (size, std::memory_order_relaxed);
+    }
+
+    // Use TS_RECORD, it checks the arguments
+    template<details::encoded_types_t EncodedTypes, typename ...TArgs>
+    void record (char const * format, TArgs && ...args) noexcept
+    {
+      std::array<details::arg, sizeof... (TArgs)> captured;
+      details::make_args<EncodedTypes> (captured, std::forward<TArgs> (args)...);
+      details::recorder_store<EncodedTypes> (format, captured);
+    }
+
+    // Renders all rings, returns the number of records
+    inline std::size_t dump (std::FILE * stream) noexcept
+    {
+      TYPESAFE_PRINTF__ASSERT (stream);
+      return details::dump_rings ([stream] (char const * text, std::size_t size) { std::fwrite (text, 1, size, stream); }, true);
+    }
+
+    inline std::size_t dump (int fd) noexcept
+    {
+      return details::dump_rings ([fd] (char const * text, std::size_t size) { details::rt_write_all (fd, text, size); }, true);
+    }
+
+    // Dumps the rings to fd when the process crashes or aborts (SIGSEGV,
+    //  SIGBUS, SIGFPE, SIGILL and SIGABRT, failed asserts included)
+    inline bool dump_on_crash (int fd = 2) noexcept
+    {
+      details::get_recorder_registry ().dump_fd.store (fd, std::memory_order_relaxed);
+
+      int const signals[] =
+        {
+          SIGSEGV ,
+          SIGFPE  ,
+          SIGILL  ,
+          SIGABRT ,
+#ifdef SIGBUS
+          SIGBUS  ,
+#endif
+        };
+
+      auto result = true;
+      for (auto signal : signals)
+      {
+#ifdef _WIN32
+        result = std::signal (signal, &details::dump_on_crash_handler) != SIG_ERR && result;
+#else
+        struct sigaction action {};
+        action.sa_handler = &details::dump_on_crash_handler;
+        action.sa_flags   = SA_RESETHAND;
+        sigemptyset (&action.sa_mask);
+        result = sigaction (signal, &action, nullptr) == 0 && result;
+#endif
+      }
+
+      return result;
+    }
+
+#ifndef _WIN32
+    // Dumps the rings to fd every time signal is raised, like SIGUSR1
+    inline bool dump_on_signal (int signal, int fd = 2) noexcept
+    {
+      details::get_recorder_registry ().dump_fd.store (fd, std::memory_order_relaxed);
+
+      struct sigaction action {};
+      action.sa_handler = &details::dump_on_signal_handler;
+      action.sa_flags   = SA_RESTART;
+      sigemptyset (&action.sa_mask);
+      return sigaction (signal, &action, nullptr) == 0;
+    }
+#endif
+  }
+}
+
+#endif // TYPESAFE_PRINTF__TSPRINTF_RECORDER_HPP
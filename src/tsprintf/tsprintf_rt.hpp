@@ -0,0 +1,1143 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+#ifndef TYPESAFE_PRINTF__TSPRINTF_RT_HPP
+#define TYPESAFE_PRINTF__TSPRINTF_RT_HPP
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#ifdef _WIN32
+# include <io.h>
+#else
+# include <unistd.h>
+#endif
+
+#include "tsprintf.hpp"
+#include "tsprintf_engine.hpp"
+
+// Formatting for realtime threads and signal handlers. The TS_*_RT macros
+//  render every conversion themselves (floats included), they never call
+//  snprintf, malloc or anything that takes a lock or reads the locale. The
+//  only libc call is write in TS_DPRINTF_RT, so they are async-signal-safe
+//
+//  TS_SNPRINTF_RT (buffer, sizeof (buffer), "underrun after %.3f ms\n", elapsed);
+//  TS_SPRINTF_RT (buffer, "%d frames", count);
+//  TS_DPRINTF_RT (2, "fatal signal %d at %p\n", sig, address);
+//
+// The output matches glibc in the C locale, except that %#g keeps its
+//  trailing zeros when rounding adds a digit (glibc prints 1.e+03 for
+//  %#.3g of 999.5). %Lf (long double) and %T (local time) are rejected at
+//  compile time, %ls and %lc are written as UTF-8
+
+// Returns what snprintf would have returned
+#define TS_SNPRINTF_RT(buffer, buffer_size, format, ...)                                                           \
+  ( (void) typesafe_printf::details::check_types<typesafe_printf::details::scanner::encode (format)> (__VA_ARGS__)  \
+  , (void) TYPESAFE_PRINTF__CHECK_EXTENSIONS (format)                                                               \
+  , typesafe_printf::details::rt_snprintf<                                                                          \
+        typesafe_printf::details::scanner::encode (format)                                                          \
+      , typesafe_printf::details::rt_violation (format)                                                             \
+      > (buffer, buffer_size, format, ##__VA_ARGS__)                                                                \
+  )
+
+#define TS_SPRINTF_RT(buffer, format, ...)                                                                          \
+  TS_SNPRINTF_RT (buffer, typesafe_printf::details::buffer_extent<decltype(buffer)>::value, format, ##__VA_ARGS__)
+
+// Returns the number of chars written or -1, errno is left as it was
+#define TS_DPRINTF_RT(fd, format, ...)                                                                              \
+  ( (void) typesafe_printf::details::check_types<typesafe_printf::details::scanner::encode (format)> (__VA_ARGS__)  \
+  , (void) TYPESAFE_PRINTF__CHECK_EXTENSIONS (format)                                                               \
+  , typesafe_printf::details::rt_dprintf<                                                                           \
+        typesafe_printf::details::scanner::encode (format)                                                          \
+      , typesafe_printf::details::rt_violation (format)                                                             \
+      > (fd, format, ##__VA_ARGS__)                                                                                 \
+  )
+
+namespace typesafe_printf
+{
+  namespace details
+  {
+    enum rt_violation_kind
+    {
+      rv__none        ,
+      rv__long_double ,
+      rv__timestamp   ,
+    };
+
+    // What in format the realtime path can't do, checked at compile time
+    constexpr rt_violation_kind rt_violation (char const * format) noexcept
+    {
+      index_type  pos = 0U;
+      segment     s   {} ;
+
+      while (next_segment (format, pos, s))
+      {
+        if (s.tid == tid__long_double)
+        {
+          return rv__long_double;
+        }
+        if (!is_literal (s) && s.ext == ext__timestamp)
+        {
+          return rv__timestamp;
+        }
+      }
+
+      return rv__none;
+    }
+
+    // Writes all of [text, text + size), doesn't touch errno
+    inline bool rt_write_all (int fd, char const * text, std::size_t size) noexcept
+    {
+      auto saved  = errno;
+      auto result = true;
+
+      while (size > 0U)
+      {
+#ifdef _WIN32
+        auto written = _write (fd, text, size < 0x40000000U ? static_cast<unsigned> (size) : 0x40000000U);
+#else
+        auto written = ::write (fd, text, size);
+#endif
+        if (written < 0)
+        {
+          if (errno == EINTR)
+          {
+            continue;
+          }
+          result = false;
+          break;
+        }
+
+        text += written;
+        size -= static_cast<std::size_t> (written);
+      }
+
+      errno = saved;
+      return result;
+    }
+
+    // Truncates to the caller's buffer like snprintf or, with a file
+    //  descriptor, writes the buffer out each time it fills up
+    class rt_output
+    {
+    public:
+      rt_output (char * buffer, std::size_t size) noexcept
+        : current   (buffer)
+        , end       (size > 0U ? buffer + size - 1 : buffer)
+        , begin     (buffer)
+        , fd        (-1)
+        , to_fd     (false)
+        , has_room  (size > 0U)
+        , total     (0U)
+        , failed    (false)
+      {
+      }
+
+      rt_output (int fd, char * buffer, std::size_t size) noexcept
+        : current   (buffer)
+        , end       (buffer + size)
+        , begin     (buffer)
+        , fd        (fd)
+        , to_fd     (true)
+        , has_room  (false)
+        , total     (0U)
+        , failed    (false)
+      {
+      }
+
+      rt_output (rt_output const &)             = delete;
+      rt_output & operator= (rt_output const &) = delete;
+
+      void append (char const * s, std::size_t n) noexcept
+      {
+        total += n;
+        for (;;)
+        {
+          auto left = static_cast<std::size_t> (end - current);
+          auto copy = n < left ? n : left;
+          std::memcpy (current, s, copy);
+          current += copy ;
+          s       += copy ;
+          n       -= copy ;
+
+          if (n == 0U || !to_fd)
+          {
+            return;
+          }
+
+          flush ();
+        }
+      }
+
+      void append (char ch) noexcept
+      {
+        append (&ch, 1U);
+      }
+
+      void fill (char ch, std::size_t n) noexcept
+      {
+        char chunk[32];
+        std::memset (chunk, ch, sizeof (chunk));
+
+        for (; n > sizeof (chunk); n -= sizeof (chunk))
+        {
+          append (chunk, sizeof (chunk));
+        }
+        append (chunk, n);
+      }
+
+      std::size_t size () const noexcept
+      {
+        return total;
+      }
+
+      int finish () noexcept
+      {
+        if (to_fd)
+        {
+          flush ();
+          return failed ? -1 : static_cast<int> (total);
+        }
+
+        if (has_room)
+        {
+          *current = '\0';
+        }
+        return static_cast<int> (total);
+      }
+
+    private:
+      void flush () noexcept
+      {
+        if (!rt_write_all (fd, begin, static_cast<std::size_t> (current - begin)))
+        {
+          failed = true;
+        }
+        current = begin;
+      }
+
+      char *        current   ;
+      char *        end       ;
+      char *        begin     ;
+      int           fd        ;
+      bool          to_fd     ;
+      bool          has_room  ;
+      std::size_t   total     ;
+      bool          failed    ;
+    };
+
+    struct rt_spec
+    {
+      bool          left_justify  ;
+      bool          plus          ;
+      bool          space         ;
+      bool          alternate     ;
+      bool          zero_pad      ;
+      std::size_t   width         ;
+      int           precision     ; // -1 without a precision
+      char          conversion    ;
+    };
+
+    inline int rt_parse_number (char const * format, index_type & pos) noexcept
+    {
+      auto value = 0;
+      while (format[pos] >= '0' && format[pos] <= '9')
+      {
+        value = value * 10 + (format[pos++] - '0');
+      }
+      return value;
+    }
+
+    // The flags, width and precision of s with the * replaced by the values
+    //  in stars
+    inline void rt_parse_spec (rt_spec & spec, char const * format, segment const & s, arg const * stars) noexcept
+    {
+      spec              = rt_spec {};
+      spec.precision    = -1;
+      spec.conversion   = format[s.end - 1];
+
+      auto pos = s.begin + 1U;
+      for (;; ++pos)
+      {
+        switch (format[pos])
+        {
+        case '-': spec.left_justify = true; continue;
+        case '+': spec.plus         = true; continue;
+        case ' ': spec.space        = true; continue;
+        case '#': spec.alternate    = true; continue;
+        case '0': spec.zero_pad     = true; continue;
+        default : break;
+        }
+        break;
+      }
+
+      if (format[pos] == '*')
+      {
+        auto value = static_cast<long long> (stars++->value.signed_integer);
+        ++pos;
+        if (value < 0)
+        {
+          spec.left_justify = true;
+          value             = -value;
+        }
+        spec.width = static_cast<std::size_t> (value);
+      }
+      else
+      {
+        spec.width = static_cast<std::size_t> (rt_parse_number (format, pos));
+      }
+
+      if (format[pos] == '.')
+      {
+        ++pos;
+        if (format[pos] == '*')
+        {
+          auto value      = stars->value.signed_integer;
+          spec.precision  = value < 0 ? -1 : static_cast<int> (value);
+        }
+        else
+        {
+          spec.precision = rt_parse_number (format, pos);
+        }
+      }
+    }
+
+    // Pads the prefix (sign, 0x) and the body to the width of spec, body
+    //  writes body_size chars
+    template<typename TBody>
+    inline void rt_field (
+        rt_output &     output
+      , rt_spec const & spec
+      , char const *    prefix
+      , std::size_t     prefix_size
+      , std::size_t     body_size
+      , bool            zero_pad
+      , TBody &&        body
+      ) noexcept
+    {
+      auto size     = prefix_size + body_size;
+      auto padding  = spec.width > size ? spec.width - size : 0U;
+
+      if (!spec.left_justify && !zero_pad)
+      {
+        output.fill (' ', padding);
+      }
+
+      output.append (prefix, prefix_size);
+
+      if (!spec.left_justify && zero_pad)
+      {
+        output.fill ('0', padding);
+      }
+
+      body ();
+
+      if (spec.left_justify)
+      {
+        output.fill (' ', padding);
+      }
+    }
+
+    inline std::size_t rt_sign (char (&prefix) [4], bool negative, rt_spec const & spec) noexcept
+    {
+      if (negative)
+      {
+        prefix[0] = '-';
+      }
+      else if (spec.plus)
+      {
+        prefix[0] = '+';
+      }
+      else if (spec.space)
+      {
+        prefix[0] = ' ';
+      }
+      else
+      {
+        return 0U;
+      }
+      return 1U;
+    }
+
+    inline void rt_integer (rt_output & output, rt_spec const & spec, std::uintmax_t v, bool negative) noexcept
+    {
+      char digits[32];
+      auto end    = digits + sizeof (digits);
+      auto first  = end;
+
+      switch (spec.conversion)
+      {
+      case 'o':
+        do
+        {
+          *--first = static_cast<char> ('0' + (v & 0x7U));
+          v >>= 3;
+        }
+        while (v != 0U);
+        break;
+      case 'x':
+      case 'X':
+        first = format_hex (end, v, spec.conversion == 'X');
+        break;
+      default:
+        first = format_decimal (end, v);
+        break;
+      }
+
+      auto size = static_cast<std::size_t> (end - first);
+      auto zero = size == 1U && *first == '0';
+
+      // An explicit zero precision prints no digits for zero
+      if (spec.precision == 0 && zero)
+      {
+        size = 0U;
+      }
+
+      auto zeros = spec.precision > 0 && static_cast<std::size_t> (spec.precision) > size
+        ? static_cast<std::size_t> (spec.precision) - size
+        : 0U
+        ;
+
+      if (spec.conversion == 'o' && spec.alternate && zeros == 0U && (size == 0U || *first != '0'))
+      {
+        zeros = 1U;
+      }
+
+      char        prefix[4];
+      std::size_t prefix_size = 0U;
+
+      if (spec.conversion == 'd' || spec.conversion == 'i')
+      {
+        prefix_size = rt_sign (prefix, negative, spec);
+      }
+      else if ((spec.conversion == 'x' || spec.conversion == 'X') && spec.alternate && !zero)
+      {
+        prefix[0]   = '0';
+        prefix[1]   = spec.conversion;
+        prefix_size = 2U;
+      }
+
+      rt_field (output, spec, prefix, prefix_size, zeros + size, spec.zero_pad && spec.precision < 0, [&] ()
+        {
+          output.fill ('0', zeros);
+          output.append (first, size);
+        });
+    }
+
+    inline void rt_text (rt_output & output, rt_spec const & spec, char const * text, std::size_t size) noexcept
+    {
+      rt_field (output, spec, nullptr, 0U, size, false, [&] ()
+        {
+          output.append (text, size);
+        });
+    }
+
+    // At most limit chars of s, strlen isn't on the async-signal-safe list
+    template<typename TChar>
+    inline std::size_t rt_length (TChar const * s, std::size_t limit) noexcept
+    {
+      std::size_t size = 0U;
+      while (size < limit && s[size] != 0)
+      {
+        ++size;
+      }
+      return size;
+    }
+
+    // The whole UTF-8 chars of s that fit in limit bytes, the same as
+    //  glibc's precision for %ls
+    inline bool rt_wide (rt_output & output, rt_spec const & spec, wchar_t const * s, std::size_t limit) noexcept
+    {
+      auto          end       = s + rt_length (s, static_cast<std::size_t> (-1));
+      auto          clip      = s;
+      std::size_t   size      = 0U;
+
+      while (clip < end)
+      {
+        auto          next        = clip;
+        std::uint32_t code_point  = 0U;
+        if (!decode_wide (next, end, code_point))
+        {
+          return false;
+        }
+
+        auto char_size = utf8_sequence_size (code_point);
+        if (limit - size < char_size)
+        {
+          break;
+        }
+
+        size  += char_size;
+        clip  = next;
+      }
+
+      rt_field (output, spec, nullptr, 0U, size, false, [&] ()
+        {
+          char chunk[64];
+          auto begin = s;
+          while (begin < clip)
+          {
+            auto chunk_end = encode_utf8 (chunk, chunk + sizeof (chunk), begin, clip);
+            output.append (chunk, static_cast<std::size_t> (chunk_end - chunk));
+          }
+        });
+
+      return true;
+    }
+
+    // Up to 767 significant digits (the exact value of the smallest
+    //  subnormal), 86 limbs of 9 decimal digits
+    constexpr size_type rt_max_limbs = 90U;
+    constexpr size_type rt_max_digits = rt_max_limbs * 9U;
+
+    // The exact decimal value of a double, 0.digits * 10^point. count is 0
+    //  for zero and the digits have no trailing zeros
+    struct rt_decimal
+    {
+      char  digits[rt_max_digits] ;
+      int   count                 ;
+      int   point                 ;
+
+      char digit (int index) const noexcept
+      {
+        return index >= 0 && index < count ? digits[index] : '0';
+      }
+    };
+
+    struct rt_bignum
+    {
+      std::uint32_t limbs[rt_max_limbs] ; // base 10^9, least significant first
+      size_type     count               ;
+
+      void multiply (std::uint32_t factor) noexcept
+      {
+        std::uint64_t carry = 0U;
+        for (auto iter = 0U; iter < count; ++iter)
+        {
+          auto product  = static_cast<std::uint64_t> (limbs[iter]) * factor + carry;
+          limbs[iter]   = static_cast<std::uint32_t> (product % 1000000000U);
+          carry         = product / 1000000000U;
+        }
+
+        while (carry > 0U)
+        {
+          TYPESAFE_PRINTF__ASSERT (count < rt_max_limbs);
+          limbs[count++] = static_cast<std::uint32_t> (carry % 1000000000U);
+          carry /= 1000000000U;
+        }
+      }
+    };
+
+    inline void rt_trim (rt_decimal & d) noexcept
+    {
+      while (d.count > 0 && d.digits[d.count - 1] == '0')
+      {
+        --d.count;
+      }
+    }
+
+    // m * 2^e exactly, as 5^-e * m / 10^-e when e is negative
+    inline void rt_to_decimal (rt_decimal & d, std::uint64_t m, int e) noexcept
+    {
+      d.count = 0;
+      d.point = 0;
+
+      if (m == 0U)
+      {
+        return;
+      }
+
+      while ((m & 1U) == 0U)
+      {
+        m >>= 1;
+        ++e;
+      }
+
+      rt_bignum b;
+      b.count = 0U;
+      for (; m > 0U; m /= 1000000000U)
+      {
+        b.limbs[b.count++] = static_cast<std::uint32_t> (m % 1000000000U);
+      }
+
+      if (e >= 0)
+      {
+        for (auto left = e; left > 0; left -= 29)
+        {
+          b.multiply (static_cast<std::uint32_t> (1U) << (left < 29 ? left : 29));
+        }
+      }
+      else
+      {
+        for (auto left = -e; left > 0; left -= 13)
+        {
+          auto factor = static_cast<std::uint32_t> (1U);
+          for (auto iter = 0; iter < (left < 13 ? left : 13); ++iter)
+          {
+            factor *= 5U;
+          }
+          b.multiply (factor);
+        }
+      }
+
+      char  limb[16];
+      auto  limb_end = limb + sizeof (limb);
+      for (auto iter = b.count; iter-- > 0U;)
+      {
+        auto first = format_decimal (limb_end, b.limbs[iter]);
+        if (iter + 1U < b.count)
+        {
+          while (limb_end - first < 9)
+          {
+            *--first = '0';
+          }
+        }
+        auto size = static_cast<int> (limb_end - first);
+        std::memcpy (d.digits + d.count, first, static_cast<std::size_t> (size));
+        d.count += size;
+      }
+
+      d.point = e >= 0 ? d.count : d.count + e;
+      rt_trim (d);
+    }
+
+    // Rounds to keep significant digits, half to even like glibc
+    inline void rt_round (rt_decimal & d, int keep) noexcept
+    {
+      if (keep >= d.count)
+      {
+        return;
+      }
+
+      if (keep < 0)
+      {
+        d.count = 0;
+        return;
+      }
+
+      auto next   = d.digits[keep];
+      auto odd    = keep > 0 && (d.digits[keep - 1] - '0') % 2 == 1;
+      auto up     = next > '5' || (next == '5' && (d.count > keep + 1 || odd));
+
+      d.count = keep;
+      if (!up)
+      {
+        rt_trim (d);
+        return;
+      }
+
+      for (auto iter = keep - 1; iter >= 0; --iter)
+      {
+        if (d.digits[iter] != '9')
+        {
+          ++d.digits[iter];
+          rt_trim (d);
+          return;
+        }
+        d.digits[iter] = '0';
+      }
+
+      // All nines, or keep is 0 and the value rounds up to the next power of 10
+      d.digits[0] = '1';
+      d.count     = 1;
+      ++d.point;
+    }
+
+    // Writes the digits from (including zeros outside the significant digits)
+    inline void rt_digits (rt_output & output, rt_decimal const & d, int from, std::size_t size) noexcept
+    {
+      char chunk[64];
+      while (size > 0U)
+      {
+        auto n = size < sizeof (chunk) ? size : sizeof (chunk);
+        for (auto iter = 0U; iter < n; ++iter)
+        {
+          chunk[iter] = d.digit (from++);
+        }
+        output.append (chunk, n);
+        size -= n;
+      }
+    }
+
+    inline void rt_fixed (rt_output & output, rt_spec const & spec, char const * prefix, std::size_t prefix_size, rt_decimal const & d, int precision) noexcept
+    {
+      auto integer_size = d.point > 0 ? static_cast<std::size_t> (d.point) : 1U;
+      auto has_point    = precision > 0 || spec.alternate;
+      auto size         = integer_size + (has_point ? 1U + static_cast<std::size_t> (precision) : 0U);
+
+      rt_field (output, spec, prefix, prefix_size, size, spec.zero_pad, [&] ()
+        {
+          if (d.point > 0)
+          {
+            rt_digits (output, d, 0, integer_size);
+          }
+          else
+          {
+            output.append ('0');
+          }
+
+          if (has_point)
+          {
+            output.append ('.');
+            rt_digits (output, d, d.point, static_cast<std::size_t> (precision));
+          }
+        });
+    }
+
+    inline void rt_exponent (rt_output & output, rt_spec const & spec, char const * prefix, std::size_t prefix_size, rt_decimal const & d, int precision, bool upper_case) noexcept
+    {
+      auto exponent = d.count > 0 ? d.point - 1 : 0;
+
+      char  tail[8];
+      auto  tail_end  = tail + sizeof (tail);
+      auto  first     = format_decimal (tail_end, static_cast<std::uintmax_t> (exponent < 0 ? -exponent : exponent));
+      if (tail_end - first < 2)
+      {
+        *--first = '0';
+      }
+      *--first = exponent < 0 ? '-' : '+';
+      *--first = upper_case ? 'E' : 'e';
+
+      auto tail_size  = static_cast<std::size_t> (tail_end - first);
+      auto has_point  = precision > 0 || spec.alternate;
+      auto size       = 1U + (has_point ? 1U + static_cast<std::size_t> (precision) : 0U) + tail_size;
+
+      rt_field (output, spec, prefix, prefix_size, size, spec.zero_pad, [&] ()
+        {
+          output.append (d.digit (0));
+          if (has_point)
+          {
+            output.append ('.');
+            rt_digits (output, d, 1, static_cast<std::size_t> (precision));
+          }
+          output.append (first, tail_size);
+        });
+    }
+
+    // %a, the leading digit is 1 for normal values and 0 for subnormals
+    inline void rt_hex_float (rt_output & output, rt_spec const & spec, char const * sign, std::size_t sign_size, std::uint64_t bits) noexcept
+    {
+      auto upper_case = spec.conversion == 'A';
+      auto biased     = static_cast<int> ((bits >> 52) & 0x7FFU);
+      auto fraction   = bits & ((static_cast<std::uint64_t> (1U) << 52) - 1U);
+      auto lead       = static_cast<unsigned> (biased == 0 ? 0U : 1U);
+      auto exponent   = biased == 0 ? (fraction == 0U ? 0 : -1022) : biased - 1023;
+      auto nibbles    = 13;
+
+      if (spec.precision < 0)
+      {
+        while (nibbles > 0 && (fraction & 0xFU) == 0U)
+        {
+          fraction >>= 4;
+          --nibbles;
+        }
+      }
+      else if (spec.precision < 13)
+      {
+        auto shift  = 4 * (13 - spec.precision);
+        auto rest   = fraction & ((static_cast<std::uint64_t> (1U) << shift) - 1U);
+        auto half   = static_cast<std::uint64_t> (1U) << (shift - 1);
+        fraction    >>= shift;
+        nibbles     = spec.precision;
+
+        auto odd = nibbles == 0 ? (lead & 1U) != 0U : (fraction & 1U) != 0U;
+        if (rest > half || (rest == half && odd))
+        {
+          ++fraction;
+          if (fraction >> (4 * nibbles) != 0U)
+          {
+            fraction = 0U;
+            ++lead;
+          }
+        }
+      }
+
+      char prefix[8];
+      std::memcpy (prefix, sign, sign_size);
+      prefix[sign_size]       = '0';
+      prefix[sign_size + 1U]  = upper_case ? 'X' : 'x';
+
+      char  digits[16];
+      auto  digits_end  = digits + sizeof (digits);
+      auto  digits_size = static_cast<std::size_t> (nibbles);
+      auto  first       = digits_end;
+      for (auto iter = 0; iter < nibbles; ++iter)
+      {
+        *--first = (upper_case ? upper_hex_digits : lower_hex_digits)[fraction & 0xFU];
+        fraction >>= 4;
+      }
+
+      auto zeros = spec.precision > nibbles ? static_cast<std::size_t> (spec.precision - nibbles) : 0U;
+
+      char  tail[8];
+      auto  tail_end  = tail + sizeof (tail);
+      auto  tail_first= format_decimal (tail_end, static_cast<std::uintmax_t> (exponent < 0 ? -exponent : exponent));
+      *--tail_first   = exponent < 0 ? '-' : '+';
+      *--tail_first   = upper_case ? 'P' : 'p';
+      auto tail_size  = static_cast<std::size_t> (tail_end - tail_first);
+
+      auto has_point  = digits_size + zeros > 0U || spec.alternate;
+      auto size       = 1U + (has_point ? 1U : 0U) + digits_size + zeros + tail_size;
+
+      rt_field (output, spec, prefix, sign_size + 2U, size, spec.zero_pad, [&] ()
+        {
+          output.append ((upper_case ? upper_hex_digits : lower_hex_digits)[lead]);
+          if (has_point)
+          {
+            output.append ('.');
+          }
+          output.append (first, digits_size);
+          output.fill ('0', zeros);
+          output.append (tail_first, tail_size);
+        });
+    }
+
+    inline void rt_double (rt_output & output, rt_spec const & spec, double value) noexcept
+    {
+      std::uint64_t bits = 0U;
+      static_assert (sizeof (bits) == sizeof (value), "double is expected to be IEEE 754 binary64");
+      std::memcpy (&bits, &value, sizeof (bits));
+
+      auto upper_case = spec.conversion == 'F' || spec.conversion == 'E' || spec.conversion == 'G' || spec.conversion == 'A';
+      auto negative   = (bits >> 63) != 0U;
+      auto biased     = static_cast<int> ((bits >> 52) & 0x7FFU);
+      auto fraction   = bits & ((static_cast<std::uint64_t> (1U) << 52) - 1U);
+
+      char  sign[4];
+      auto  sign_size = rt_sign (sign, negative, spec);
+
+      if (biased == 0x7FF)
+      {
+        auto text = fraction != 0U
+          ? (upper_case ? "NAN" : "nan")
+          : (upper_case ? "INF" : "inf")
+          ;
+        rt_field (output, spec, sign, sign_size, 3U, false, [&] ()
+          {
+            output.append (text, 3U);
+          });
+        return;
+      }
+
+      if (spec.conversion == 'a' || spec.conversion == 'A')
+      {
+        rt_hex_float (output, spec, sign, sign_size, bits);
+        return;
+      }
+
+      rt_decimal d;
+      if (biased == 0)
+      {
+        rt_to_decimal (d, fraction, -1074);
+      }
+      else
+      {
+        rt_to_decimal (d, fraction | (static_cast<std::uint64_t> (1U) << 52), biased - 1075);
+      }
+
+      auto precision = spec.precision < 0 ? 6 : spec.precision;
+
+      switch (spec.conversion)
+      {
+      case 'f':
+      case 'F':
+        rt_round (d, d.point + precision);
+        rt_fixed (output, spec, sign, sign_size, d, precision);
+        break;
+      case 'e':
+      case 'E':
+        rt_round (d, precision + 1);
+        rt_exponent (output, spec, sign, sign_size, d, precision, upper_case);
+        break;
+      default:
+        {
+          // %g picks %e or %f from the exponent after rounding to precision
+          //  significant digits, then drops the trailing zeros
+          auto significant = precision == 0 ? 1 : precision;
+          rt_round (d, significant);
+
+          auto exponent = d.count > 0 ? d.point - 1 : 0;
+          if (exponent < significant && exponent >= -4)
+          {
+            auto digits   = significant - 1 - exponent;
+            auto present  = d.count - d.point > 0 ? d.count - d.point : 0;
+            rt_fixed (output, spec, sign, sign_size, d, spec.alternate || present > digits ? digits : present);
+          }
+          else
+          {
+            auto digits   = significant - 1;
+            auto present  = d.count > 1 ? d.count - 1 : 0;
+            rt_exponent (output, spec, sign, sign_size, d, spec.alternate || present > digits ? digits : present, upper_case);
+          }
+        }
+        break;
+      }
+    }
+
+    inline void rt_escaped (rt_output & output, char const * s, escape_kind kind) noexcept
+    {
+      auto end = s + rt_length (s, static_cast<std::size_t> (-1));
+
+      for (;;)
+      {
+        auto special = find_escape (s, end, kind);
+        output.append (s, static_cast<std::size_t> (special - s));
+
+        if (special == end)
+        {
+          return;
+        }
+
+        char sequence[8];
+        output.append (sequence, escape_sequence (static_cast<unsigned char> (*special), kind, sequence));
+        s = special + 1;
+      }
+    }
+
+    inline void rt_hexdump (rt_output & output, unsigned char const * bytes, std::size_t size) noexcept
+    {
+      char chunk[128];
+      while (size > 0U)
+      {
+        auto n = size < sizeof (chunk) / 2U ? size : sizeof (chunk) / 2U;
+        hex_encode (chunk, bytes, n);
+        output.append (chunk, 2U * n);
+        bytes += n;
+        size  -= n;
+      }
+    }
+
+    // Renders one conversion segment, args holds argument_count (s) arguments
+    inline bool rt_render_segment (rt_output & output, char const * format, segment const & s, arg const * args) noexcept
+    {
+      for (auto iter = 0U; iter < s.stars; ++iter)
+      {
+        if (args[iter].tid != tid__int)
+        {
+          return false;
+        }
+      }
+
+      auto & a = args[s.stars];
+
+      if (a.tid != s.tid)
+      {
+        return false;
+      }
+
+      if (get_type_class (a.tid) == tc__chars_written)
+      {
+        render_chars_written (a, output.size ());
+        return true;
+      }
+
+      if (s.ext != ext__none)
+      {
+        if (!is_valid_extension (format, s))
+        {
+          return false;
+        }
+
+        switch (s.ext)
+        {
+        case ext__json:
+        case ext__c_string:
+          if (a.value.char_p)
+          {
+            rt_escaped (output, a.value.char_p, s.ext == ext__json ? ek__json : ek__c_string);
+          }
+          return true;
+        case ext__hexdump:
+          if (args[1].tid != tid__size_t)
+          {
+            return false;
+          }
+          if (a.value.void_p)
+          {
+            rt_hexdump (output, static_cast<unsigned char const *> (a.value.void_p), static_cast<std::size_t> (args[1].value.unsigned_integer));
+          }
+          return true;
+        default:
+          return false;
+        }
+      }
+
+      rt_spec spec;
+      rt_parse_spec (spec, format, s, args);
+
+      auto limit = spec.precision < 0 ? static_cast<std::size_t> (-1) : static_cast<std::size_t> (spec.precision);
+
+      switch (spec.conversion)
+      {
+      case 'd':
+      case 'i':
+        {
+          auto v = a.value.signed_integer;
+          rt_integer (output, spec, v < 0 ? 0U - static_cast<std::uintmax_t> (v) : static_cast<std::uintmax_t> (v), v < 0);
+        }
+        return true;
+      case 'u':
+      case 'o':
+      case 'x':
+      case 'X':
+        rt_integer (output, spec, a.value.unsigned_integer, false);
+        return true;
+      case 'c':
+        if (a.tid == tid__wint_t)
+        {
+          auto ch = static_cast<wchar_t> (a.value.unsigned_integer);
+          if (ch == L'\0')
+          {
+            rt_text (output, spec, "", 1U);
+            return true;
+          }
+          wchar_t text[] = { ch, L'\0' };
+          spec.precision = -1;
+          return rt_wide (output, spec, text, static_cast<std::size_t> (-1));
+        }
+        {
+          auto ch = static_cast<char> (static_cast<unsigned char> (a.value.signed_integer));
+          rt_text (output, spec, &ch, 1U);
+        }
+        return true;
+      case 's':
+        if (a.tid == tid__wchar_t_p ? !a.value.wchar_t_p : !a.value.char_p)
+        {
+          // glibc prints (null) unless the precision is too short for it
+          rt_text (output, spec, "(null)", limit >= 6U ? 6U : 0U);
+          return true;
+        }
+        if (a.tid == tid__wchar_t_p)
+        {
+          return rt_wide (output, spec, a.value.wchar_t_p, limit);
+        }
+        rt_text (output, spec, a.value.char_p, rt_length (a.value.char_p, limit));
+        return true;
+      case 'p':
+        if (!a.value.void_p)
+        {
+          rt_text (output, spec, "(nil)", 5U);
+          return true;
+        }
+        {
+          // Like %#lx, with the sign flags of %d
+          char prefix[4];
+          auto prefix_size        = rt_sign (prefix, false, spec);
+          prefix[prefix_size++]   = '0';
+          prefix[prefix_size++]   = 'x';
+
+          char digits[24];
+          auto end    = digits + sizeof (digits);
+          auto first  = format_hex (end, reinterpret_cast<std::uintptr_t> (a.value.void_p), false);
+          auto size   = static_cast<std::size_t> (end - first);
+          rt_field (output, spec, prefix, prefix_size, size, spec.zero_pad, [&] ()
+            {
+              output.append (first, size);
+            });
+        }
+        return true;
+      case 'f':
+      case 'F':
+      case 'e':
+      case 'E':
+      case 'g':
+      case 'G':
+      case 'a':
+      case 'A':
+        if (a.tid != tid__double)
+        {
+          return false;
+        }
+        rt_double (output, spec, a.value.double_value);
+        return true;
+      default:
+        return false;
+      }
+    }
+
+    inline int rt_render (rt_output & output, char const * format, arg const * args, size_type arg_count) noexcept
+    {
+      size_type   count = 0U;
+      index_type  pos   = 0U;
+      segment     s     {} ;
+
+      while (next_segment (format, pos, s))
+      {
+        if (is_literal (s))
+        {
+          output.append (format + s.begin, s.end - s.begin);
+        }
+        else if (count + argument_count (s) > arg_count || !rt_render_segment (output, format, s, args + count))
+        {
+          output.finish ();
+          return -1;
+        }
+        else
+        {
+          count += argument_count (s);
+        }
+      }
+
+      if (count != arg_count || format[pos] != '\0')
+      {
+        output.finish ();
+        return -1;
+      }
+
+      return output.finish ();
+    }
+
+    template<rt_violation_kind Violation>
+    constexpr bool check_rt () noexcept
+    {
+      static_assert (Violation != rv__long_double , "long double can't be formatted without snprintf, use double");
+      static_assert (Violation != rv__timestamp   , "%T needs localtime which isn't async-signal-safe");
+      return true;
+    }
+
+    // Use TS_SNPRINTF_RT, it checks the arguments
+    template<encoded_types_t EncodedTypes, rt_violation_kind Violation, typename ...TArgs>
+    inline int rt_snprintf (char * buffer, std::size_t size, char const * format, TArgs && ...args) noexcept
+    {
+      static_assert (check_rt<Violation> (), "");
+
+      std::array<arg, sizeof... (TArgs)> captured;
+      make_args<EncodedTypes> (captured, std::forward<TArgs> (args)...);
+
+      rt_output output (buffer, size);
+      return rt_render (output, format, captured.data (), static_cast<size_type> (captured.size ()));
+    }
+
+    // Use TS_DPRINTF_RT, it checks the arguments
+    template<encoded_types_t EncodedTypes, rt_violation_kind Violation, typename ...TArgs>
+    inline int rt_dprintf (int fd, char const * format, TArgs && ...args) noexcept
+    {
+      static_assert (check_rt<Violation> (), "");
+
+      char      buffer[256];
+      std::array<arg, sizeof... (TArgs)> captured;
+      make_args<EncodedTypes> (captured, std::forward<TArgs> (args)...);
+
+      rt_output output (fd, buffer, sizeof (buffer));
+      return rt_render (output, format, captured.data (), static_cast<size_type> (captured.size ()));
+    }
+  }
+}
+
+#endif // TYPESAFE_PRINTF__TSPRINTF_RT_HPP
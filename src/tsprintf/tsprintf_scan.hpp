@@ -0,0 +1,850 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+#ifndef TYPESAFE_PRINTF__TSPRINTF_SCAN_HPP
+#define TYPESAFE_PRINTF__TSPRINTF_SCAN_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "tsprintf.hpp"
+#include "tsprintf_engine.hpp"
+
+// The scanf counterpart of TS_SNPRINTF. The format is checked at compile
+//  time against the pointers passed and the input is parsed without libc
+//  sscanf (no locale, no format parsing per conversion for the numbers)
+//
+//  int   id    ;
+//  char  name[32];
+//  auto  count = TS_SSCANF (line, "%d %31s", &id, name);
+//
+// Differences from sscanf:
+//  %s needs a width, the buffer must have room for width + 1 chars
+//  %[ and %ls/%lc aren't supported
+//  An integer that doesn't fit its type and a '-' for an unsigned
+//   conversion are matching failures, like std::from_chars
+//  TS_FSCANF scans one line (up to and including the '\n') of the stream
+
+#define TYPESAFE_PRINTF__INPUT_TYPE_MAP(key, value) \
+  template<>                                        \
+  struct input_type_id_map<key>                     \
+  {                                                 \
+    using type = value;                             \
+  }
+
+#define TYPESAFE_PRINTF__STORE_CASE(key)                                                                           \
+  case key:                                                                                                        \
+    return store_integer (static_cast<input_type_id_map_t<key>> (target), negative, magnitude)
+
+#define TS_SSCANF(input, format, ...)                                                                                           \
+  ( (void) typesafe_printf::details::check_input_types<typesafe_printf::details::input_scanner::encode (format)> (__VA_ARGS__)  \
+  , typesafe_printf::details::scan_string (input, format, ##__VA_ARGS__)                                                        \
+  )
+
+#define TS_FSCANF(stream, format, ...)                                                                                          \
+  ( (void) typesafe_printf::details::check_input_types<typesafe_printf::details::input_scanner::encode (format)> (__VA_ARGS__)  \
+  , typesafe_printf::details::scan_line (stream, format, ##__VA_ARGS__)                                                         \
+  )
+
+namespace typesafe_printf
+{
+  namespace details
+  {
+    // What a scanf conversion stores to, the %n row is shared with printf
+    enum input_type_id : size_type
+    {
+      itid__illegal               = 0x00  ,
+      itid__error_type            = 0x01  ,
+      itid__char_p                = 0x02  ,
+      itid__double_p              = 0x03  ,
+      itid__float_p               = 0x04  ,
+      itid__int_p                 = 0x05  ,
+      itid__intmax_t_p            = 0x06  ,
+      itid__long_double_p         = 0x07  ,
+      itid__long_long_p           = 0x08  ,
+      itid__long_p                = 0x09  ,
+      itid__ptrdiff_t_p           = 0x0A  ,
+      itid__short_p               = 0x0B  ,
+      itid__signed_char_p         = 0x0C  ,
+      itid__signed_size_t_p       = 0x0D  ,
+      itid__size_t_p              = 0x0E  ,
+      itid__uintmax_t_p           = 0x0F  ,
+      itid__unsigned_char_p       = 0x10  ,
+      itid__unsigned_int_p        = 0x11  ,
+      itid__unsigned_long_long_p  = 0x12  ,
+      itid__unsigned_long_p       = 0x13  ,
+      itid__unsigned_ptrdiff_t_p  = 0x14  ,
+      itid__unsigned_short_p      = 0x15  ,
+      itid__void_pp               = 0x16  ,
+    };
+
+    template<encoded_types_t encoded_types>
+    struct input_type_id_map
+    {
+      using type = error_type;
+    };
+
+    TYPESAFE_PRINTF__INPUT_TYPE_MAP (itid__char_p               , char *                );
+    TYPESAFE_PRINTF__INPUT_TYPE_MAP (itid__double_p             , double *              );
+    TYPESAFE_PRINTF__INPUT_TYPE_MAP (itid__float_p              , float *               );
+    TYPESAFE_PRINTF__INPUT_TYPE_MAP (itid__int_p                , int *                 );
+    TYPESAFE_PRINTF__INPUT_TYPE_MAP (itid__intmax_t_p           , std::intmax_t *       );
+    TYPESAFE_PRINTF__INPUT_TYPE_MAP (itid__long_double_p        , long double *         );
+    TYPESAFE_PRINTF__INPUT_TYPE_MAP (itid__long_long_p          , long long *           );
+    TYPESAFE_PRINTF__INPUT_TYPE_MAP (itid__long_p               , long *                );
+    TYPESAFE_PRINTF__INPUT_TYPE_MAP (itid__ptrdiff_t_p          , std::ptrdiff_t *      );
+    TYPESAFE_PRINTF__INPUT_TYPE_MAP (itid__short_p              , short *               );
+    TYPESAFE_PRINTF__INPUT_TYPE_MAP (itid__signed_char_p        , signed char *         );
+    TYPESAFE_PRINTF__INPUT_TYPE_MAP (itid__signed_size_t_p      , ssize_t *             );
+    TYPESAFE_PRINTF__INPUT_TYPE_MAP (itid__size_t_p             , std::size_t *         );
+    TYPESAFE_PRINTF__INPUT_TYPE_MAP (itid__uintmax_t_p          , std::uintmax_t *      );
+    TYPESAFE_PRINTF__INPUT_TYPE_MAP (itid__unsigned_char_p      , unsigned char *       );
+    TYPESAFE_PRINTF__INPUT_TYPE_MAP (itid__unsigned_int_p       , unsigned int *        );
+    TYPESAFE_PRINTF__INPUT_TYPE_MAP (itid__unsigned_long_long_p , unsigned long long *  );
+    TYPESAFE_PRINTF__INPUT_TYPE_MAP (itid__unsigned_long_p      , unsigned long *       );
+    TYPESAFE_PRINTF__INPUT_TYPE_MAP (itid__unsigned_ptrdiff_t_p , uptrdiff_t *          );
+    TYPESAFE_PRINTF__INPUT_TYPE_MAP (itid__unsigned_short_p     , unsigned short *      );
+    TYPESAFE_PRINTF__INPUT_TYPE_MAP (itid__void_pp              , void **               );
+
+    template<encoded_types_t encoded_types>
+    using input_type_id_map_t = typename input_type_id_map<encoded_types>::type;
+
+    namespace input_scanner
+    {
+      using scanner::conversion_specifier__count;
+      using scanner::argument_type__count;
+
+      // Table from: http://en.cppreference.com/w/cpp/io/c/fscanf
+      constexpr input_type_id const input_type_ids[conversion_specifier__count][argument_type__count] =
+      {
+//                    hh                      h                       (none)                  l                       ll                          j                   z                       t                           L
+/*c               */{ itid__error_type      , itid__error_type      , itid__char_p          , itid__error_type      , itid__error_type          , itid__error_type  , itid__error_type      , itid__error_type          , itid__error_type    },
+/*s               */{ itid__error_type      , itid__error_type      , itid__char_p          , itid__error_type      , itid__error_type          , itid__error_type  , itid__error_type      , itid__error_type          , itid__error_type    },
+/*d/i             */{ itid__signed_char_p   , itid__short_p         , itid__int_p           , itid__long_p          , itid__long_long_p         , itid__intmax_t_p  , itid__signed_size_t_p , itid__ptrdiff_t_p         , itid__error_type    },
+/*o/x/X/u         */{ itid__unsigned_char_p , itid__unsigned_short_p, itid__unsigned_int_p  , itid__unsigned_long_p , itid__unsigned_long_long_p, itid__uintmax_t_p , itid__size_t_p        , itid__unsigned_ptrdiff_t_p, itid__error_type    },
+/*f/F/e/E/a/A/g/G */{ itid__error_type      , itid__error_type      , itid__float_p         , itid__double_p        , itid__error_type          , itid__error_type  , itid__error_type      , itid__error_type          , itid__long_double_p },
+/*n               */{ itid__signed_char_p   , itid__short_p         , itid__int_p           , itid__long_p          , itid__long_long_p         , itid__intmax_t_p  , itid__signed_size_t_p , itid__ptrdiff_t_p         , itid__error_type    },
+/*p               */{ itid__error_type      , itid__error_type      , itid__void_pp         , itid__error_type      , itid__error_type          , itid__error_type  , itid__error_type      , itid__error_type          , itid__error_type    },
+//                    hh                      h                       (none)                  l                       ll                          j                   z                       t                           L
+      };
+
+      constexpr input_type_id get_input_type_id (scanner::argument_type at, scanner::conversion_specifier cs) noexcept
+      {
+        return cs < conversion_specifier__count && at < argument_type__count
+          ? input_type_ids[cs][at]
+          : itid__error_type
+          ;
+      }
+
+      constexpr encoded_types_t merge_type (encoded_types_t ec, size_type count, input_type_id ti) noexcept
+      {
+        return count < max_encoded_types
+          ? ((ti & type_id__mask) << (count * type_id__bits)) | (~(type_id__mask << (count * type_id__bits)) & ec)
+          : ec
+          ;
+      }
+
+      constexpr bool is_space (char ch) noexcept
+      {
+        return ch == ' ' || (ch >= '\t' && ch <= '\r');
+      }
+
+      // A conversion specification of a scanf format, [*][width][length]conversion
+      struct input_spec
+      {
+        bool                            suppress    ;
+        std::size_t                     width       ; // 0 if there is none
+        input_type_id                   tid         ;
+        scanner::conversion_specifier   cs          ;
+        char                            conversion  ;
+      };
+
+      // Reads the spec after the '%' and moves pos past it, tid is
+      //  itid__error_type if the spec is malformed
+      constexpr void parse_input_spec (char const * format, index_type & pos, input_spec & spec) noexcept
+      {
+        spec.suppress   = format[pos] == '*';
+        spec.width      = 0U;
+        spec.tid        = itid__error_type;
+        spec.cs         = scanner::cs__invalid;
+        spec.conversion = '\0';
+
+        if (spec.suppress)
+        {
+          ++pos;
+        }
+
+        while (format[pos] >= '0' && format[pos] <= '9')
+        {
+          spec.width = spec.width * 10U + static_cast<std::size_t> (format[pos] - '0');
+          ++pos;
+        }
+
+        auto at = parse_argument_type (format, pos);
+        if (at == scanner::at__invalid)
+        {
+          return;
+        }
+
+        spec.conversion = format[pos];
+        spec.cs         = parse_conversion_specifier (format, pos);
+        spec.tid        = get_input_type_id (at, spec.cs);
+
+        // An unbounded %s is a buffer overflow waiting to happen
+        if (spec.cs == scanner::cs__string && spec.width == 0U)
+        {
+          spec.tid = itid__error_type;
+        }
+      }
+
+      constexpr encoded_types_t encode (char const * format) noexcept
+      {
+        index_type      pos           = 0U;
+        encoded_types_t encoded_types = 0U;
+        size_type       count         = 0U;
+        input_spec      spec          {} ;
+
+        while (format[pos] != '\0')
+        {
+          if (format[pos++] != '%')
+          {
+            continue;
+          }
+
+          // Double %% matches a %
+          if (format[pos] == '%')
+          {
+            ++pos;
+            continue;
+          }
+
+          parse_input_spec (format, pos, spec);
+
+          if (spec.tid == itid__error_type || !spec.suppress)
+          {
+            encoded_types = merge_type (encoded_types, count++, spec.tid);
+          }
+        }
+
+        return encoded_types;
+      }
+    }
+
+    template<size_type Pos, typename TArg, typename TExpected>
+    struct input_error_reporter
+    {
+      static_assert (
+          !std::is_same<error_type, TExpected>::value
+        , "Malformed format string"
+        );
+      static_assert (
+          std::is_same<TArg, TExpected>::value
+        , "Type mismatch between format string and provided argument"
+        );
+
+      using type = TExpected;
+    };
+
+    // Flat like type_checker
+    template<bool IsCountMatching, encoded_types_t EncodedTypes, typename TIndices, typename ...TArgs>
+    struct input_type_checker;
+
+    template<encoded_types_t EncodedTypes, typename TIndices, typename ...TArgs>
+    struct input_type_checker<false, EncodedTypes, TIndices, TArgs...>
+    {
+      static_assert (
+          encoded_count (EncodedTypes) <= sizeof... (TArgs)
+        , "Too few arguments passed to ts_scanf (see format string)"
+        );
+      static_assert (
+          encoded_count (EncodedTypes) >= sizeof... (TArgs)
+        , "Too many arguments passed to ts_scanf (see format string)"
+        );
+
+      enum
+      {
+        zero = 0,
+      };
+    };
+
+    template<encoded_types_t EncodedTypes, std::size_t ...Indices, typename ...TArgs>
+    struct input_type_checker<true, EncodedTypes, std::index_sequence<Indices...>, TArgs...>
+    {
+      using type = type_list<
+          typename input_error_reporter<
+              Indices
+            , typename std::decay<TArgs>::type
+            , input_type_id_map_t<(EncodedTypes >> (Indices * type_id__bits)) & type_id__mask>
+            >::type...
+        >;
+
+      enum
+      {
+        zero = 0,
+      };
+    };
+
+    template<encoded_types_t EncodedTypes, typename ...TArgs>
+    constexpr int check_input_types (TArgs && ...) noexcept
+    {
+      static_assert (
+          sizeof... (TArgs) <= details::max_encoded_types
+        , "Too many arguments passed to ts_scanf (max_encoded_types is the upper limit)"
+        );
+      return input_type_checker<
+          encoded_count (EncodedTypes) == sizeof... (TArgs)
+        , EncodedTypes
+        , std::index_sequence_for<TArgs...>
+        , TArgs...
+        >::zero;
+    }
+
+    inline unsigned digit_value (char ch) noexcept
+    {
+      return
+          ch >= '0' && ch <= '9' ? static_cast<unsigned> (ch - '0')
+        : ch >= 'a' && ch <= 'z' ? static_cast<unsigned> (ch - 'a' + 10)
+        : ch >= 'A' && ch <= 'Z' ? static_cast<unsigned> (ch - 'A' + 10)
+        : 36U
+        ;
+    }
+
+    // Parses [+-][0x]digits from [s, end), base 0 detects the base from the
+    //  prefix like strtol. Fails on overflow but still consumes all digits
+    inline bool parse_integer (
+        char const * &    s
+      , char const *      end
+      , unsigned          base
+      , bool &            negative
+      , std::uintmax_t &  magnitude
+      ) noexcept
+    {
+      auto p = s;
+
+      negative = false;
+      if (p < end && (*p == '+' || *p == '-'))
+      {
+        negative = *p == '-';
+        ++p;
+      }
+
+      auto has_hex_prefix = end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X') && digit_value (p[2]) < 16U;
+
+      if (base == 0U)
+      {
+        base = has_hex_prefix ? 16U : (p < end && *p == '0' ? 8U : 10U);
+      }
+
+      if (base == 16U && has_hex_prefix)
+      {
+        p += 2;
+      }
+
+      auto constexpr max_value  = std::numeric_limits<std::uintmax_t>::max ();
+      auto first                = p;
+      auto overflow             = false;
+
+      magnitude = 0U;
+      for (; p < end; ++p)
+      {
+        auto digit = digit_value (*p);
+        if (digit >= base)
+        {
+          break;
+        }
+
+        overflow  = overflow || magnitude > (max_value - digit) / base;
+        magnitude = magnitude * base + digit;
+      }
+
+      if (p == first)
+      {
+        return false;
+      }
+
+      s = p;
+      return !overflow;
+    }
+
+    template<typename T>
+    inline typename std::enable_if<std::is_signed<T>::value, bool>::type store_integer (T * target, bool negative, std::uintmax_t magnitude) noexcept
+    {
+      auto limit = static_cast<std::uintmax_t> (std::numeric_limits<T>::max ()) + (negative ? 1U : 0U);
+      if (magnitude > limit)
+      {
+        return false;
+      }
+
+      // Negates without overflowing on the minimum value
+      *target = negative && magnitude > 0U
+        ? static_cast<T> (-static_cast<std::intmax_t> (magnitude - 1U) - 1)
+        : static_cast<T> (magnitude)
+        ;
+      return true;
+    }
+
+    template<typename T>
+    inline typename std::enable_if<!std::is_signed<T>::value, bool>::type store_integer (T * target, bool negative, std::uintmax_t magnitude) noexcept
+    {
+      if (negative || magnitude > std::numeric_limits<T>::max ())
+      {
+        return false;
+      }
+
+      *target = static_cast<T> (magnitude);
+      return true;
+    }
+
+    inline bool store_integer (void * target, input_type_id tid, bool negative, std::uintmax_t magnitude) noexcept
+    {
+      switch (tid)
+      {
+        TYPESAFE_PRINTF__STORE_CASE (itid__int_p                );
+        TYPESAFE_PRINTF__STORE_CASE (itid__intmax_t_p           );
+        TYPESAFE_PRINTF__STORE_CASE (itid__long_long_p          );
+        TYPESAFE_PRINTF__STORE_CASE (itid__long_p               );
+        TYPESAFE_PRINTF__STORE_CASE (itid__ptrdiff_t_p          );
+        TYPESAFE_PRINTF__STORE_CASE (itid__short_p              );
+        TYPESAFE_PRINTF__STORE_CASE (itid__signed_char_p        );
+        TYPESAFE_PRINTF__STORE_CASE (itid__signed_size_t_p      );
+        TYPESAFE_PRINTF__STORE_CASE (itid__size_t_p             );
+        TYPESAFE_PRINTF__STORE_CASE (itid__uintmax_t_p          );
+        TYPESAFE_PRINTF__STORE_CASE (itid__unsigned_char_p      );
+        TYPESAFE_PRINTF__STORE_CASE (itid__unsigned_int_p       );
+        TYPESAFE_PRINTF__STORE_CASE (itid__unsigned_long_long_p );
+        TYPESAFE_PRINTF__STORE_CASE (itid__unsigned_long_p      );
+        TYPESAFE_PRINTF__STORE_CASE (itid__unsigned_ptrdiff_t_p );
+        TYPESAFE_PRINTF__STORE_CASE (itid__unsigned_short_p     );
+      default:
+        return false;
+      }
+    }
+
+    constexpr double const exact_powers_of_ten[] =
+    {
+      1e0 , 1e1 , 1e2 , 1e3 , 1e4 , 1e5 , 1e6 , 1e7 , 1e8 , 1e9 , 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+
+    // The longest token strtod could accept from [s, end)
+    inline char const * floating_token_end (char const * s, char const * end) noexcept
+    {
+      auto p = s;
+      while (p < end && (digit_value (*p) < 36U || *p == '.' || *p == '+' || *p == '-' || *p == '(' || *p == ')' || *p == '_'))
+      {
+        ++p;
+      }
+      return p;
+    }
+
+    template<typename T>
+    inline T parse_fallback (char const * token, char ** token_end) noexcept;
+
+    template<>
+    inline float parse_fallback<float> (char const * token, char ** token_end) noexcept
+    {
+      return std::strtof (token, token_end);
+    }
+
+    template<>
+    inline double parse_fallback<double> (char const * token, char ** token_end) noexcept
+    {
+      return std::strtod (token, token_end);
+    }
+
+    template<>
+    inline long double parse_fallback<long double> (char const * token, char ** token_end) noexcept
+    {
+      return std::strtold (token, token_end);
+    }
+
+    // Decimal numbers with at most 19 significant digits whose mantissa and
+    //  power of ten are both exact in T are a single correctly rounded
+    //  multiplication or division (Clinger's fast path). Hex floats, inf,
+    //  nan and everything else goes to strtod on a copy of the token
+    template<typename T>
+    inline bool parse_floating (char const * & s, char const * end, T * target) noexcept
+    {
+      // long double has more digits than the powers of ten table (except
+      //  where it is the same as double) so it always goes to strtold
+      auto constexpr mantissa_bits  = std::numeric_limits<T>::digits;
+      auto constexpr has_fast_path  = mantissa_bits <= 53;
+      auto constexpr max_mantissa   = static_cast<std::uint64_t> (1U) << (has_fast_path ? mantissa_bits : 0);
+      auto constexpr max_exact_pow  = mantissa_bits == 24 ? 10 : 22;
+
+      auto p = s;
+
+      auto negative = p < end && *p == '-';
+      if (p < end && (*p == '+' || *p == '-'))
+      {
+        ++p;
+      }
+
+      auto is_hex = end - p > 1 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X');
+
+      std::uint64_t mantissa    = 0U;
+      int           exponent    = 0 ;
+      int           significant = 0 ;
+      int           digits      = 0 ;
+
+      for (; p < end && *p >= '0' && *p <= '9'; ++p, ++digits)
+      {
+        if (mantissa > 0U || *p != '0')
+        {
+          mantissa = mantissa * 10U + static_cast<std::uint64_t> (*p - '0');
+          ++significant;
+        }
+      }
+
+      if (p < end && *p == '.')
+      {
+        for (++p; p < end && *p >= '0' && *p <= '9'; ++p, ++digits)
+        {
+          if (mantissa > 0U || *p != '0')
+          {
+            mantissa = mantissa * 10U + static_cast<std::uint64_t> (*p - '0');
+            ++significant;
+          }
+          --exponent;
+        }
+      }
+
+      // 1e and 1e+ only consume the 1
+      if (digits > 0 && end - p > 1 && (*p == 'e' || *p == 'E'))
+      {
+        auto q = p + 1;
+
+        auto negative_exponent = *q == '-';
+        if (*q == '+' || *q == '-')
+        {
+          ++q;
+        }
+
+        if (q < end && *q >= '0' && *q <= '9')
+        {
+          auto value = 0;
+          for (; q < end && *q >= '0' && *q <= '9'; ++q)
+          {
+            value = value < 100000 ? value * 10 + (*q - '0') : value;
+          }
+          exponent += negative_exponent ? -value : value;
+          p = q;
+        }
+      }
+
+      auto is_fast =
+            has_fast_path
+        &&  !is_hex
+        &&  digits > 0
+        &&  significant <= 19
+        &&  mantissa <= max_mantissa
+        &&  exponent >= -max_exact_pow
+        &&  exponent <= max_exact_pow
+        ;
+
+      if (is_fast)
+      {
+        auto value = static_cast<T> (mantissa);
+        value = exponent < 0
+          ? value / static_cast<T> (exact_powers_of_ten[-exponent])
+          : value * static_cast<T> (exact_powers_of_ten[exponent])
+          ;
+        *target = negative ? -value : value;
+        s = p;
+        return true;
+      }
+
+      char token[128];
+      auto size = static_cast<std::size_t> (floating_token_end (s, end) - s);
+      if (size == 0U || size >= sizeof (token))
+      {
+        return false;
+      }
+
+      std::memcpy (token, s, size);
+      token[size] = '\0';
+
+      char * token_end = nullptr;
+      auto value = parse_fallback<T> (token, &token_end);
+      if (token_end == token)
+      {
+        return false;
+      }
+
+      *target = value;
+      s += token_end - token;
+      return true;
+    }
+
+    enum scan_result
+    {
+      sr__success           ,
+      sr__matching_failure  ,
+      sr__input_failure     , // The input ended
+    };
+
+    // Scans input against format and stores to the count pointers in args,
+    //  returns what sscanf would have returned
+    inline int scan (char const * input, std::size_t input_size, char const * format, void * const * args, size_type count) noexcept
+    {
+      using input_scanner::is_space;
+
+      auto        s         = input;
+      auto        end       = input + input_size;
+      index_type  pos       = 0U;
+      size_type   arg_index = 0U;
+      int         assigned  = 0 ;
+      auto        result    = sr__success;
+
+      auto skip_space = [&s, end] ()
+      {
+        while (s < end && is_space (*s))
+        {
+          ++s;
+        }
+      };
+
+      while (result == sr__success && format[pos] != '\0')
+      {
+        auto ch = format[pos++];
+
+        if (is_space (ch))
+        {
+          skip_space ();
+          continue;
+        }
+
+        if (ch != '%' || format[pos] == '%')
+        {
+          if (ch == '%')
+          {
+            ++pos;
+            skip_space ();
+          }
+
+          result = s == end ? sr__input_failure : (*s == ch ? sr__success : sr__matching_failure);
+          s += result == sr__success ? 1 : 0;
+          continue;
+        }
+
+        input_scanner::input_spec spec {};
+        input_scanner::parse_input_spec (format, pos, spec);
+
+        if (spec.tid == itid__error_type || (!spec.suppress && arg_index >= count))
+        {
+          result = sr__matching_failure;
+          break;
+        }
+
+        auto target = spec.suppress ? nullptr : args[arg_index++];
+
+        if (spec.cs == scanner::cs__chars_written)
+        {
+          if (target)
+          {
+            store_integer (target, spec.tid, false, static_cast<std::uintmax_t> (s - input));
+          }
+          continue;
+        }
+
+        // Only %c reads whitespace
+        if (spec.cs != scanner::cs__char)
+        {
+          skip_space ();
+        }
+
+        if (s == end)
+        {
+          result = sr__input_failure;
+          break;
+        }
+
+        auto limit  = spec.width > 0U && spec.width < static_cast<std::size_t> (end - s) ? s + spec.width : end;
+        auto stored = true;
+
+        switch (spec.cs)
+        {
+        case scanner::cs__char:
+          {
+            auto size = spec.width > 0U ? spec.width : 1U;
+            if (static_cast<std::size_t> (end - s) < size)
+            {
+              result = sr__input_failure;
+              break;
+            }
+            if (target)
+            {
+              std::memcpy (target, s, size);
+            }
+            s += size;
+          }
+          break;
+        case scanner::cs__string:
+          {
+            auto first = s;
+            while (s < limit && !is_space (*s))
+            {
+              ++s;
+            }
+            if (target)
+            {
+              auto buffer = static_cast<char *> (target);
+              std::memcpy (buffer, first, static_cast<std::size_t> (s - first));
+              buffer[s - first] = '\0';
+            }
+          }
+          break;
+        case scanner::cs__signed_integer:
+        case scanner::cs__unsigned_integer:
+        case scanner::cs__pointer:
+          {
+            auto base =
+                spec.conversion == 'i'                                                    ? 0U
+              : spec.conversion == 'o'                                                    ? 8U
+              : spec.conversion == 'x' || spec.conversion == 'X' || spec.conversion == 'p'  ? 16U
+              : 10U
+              ;
+
+            bool            negative  = false;
+            std::uintmax_t  magnitude = 0U;
+            if (!parse_integer (s, limit, base, negative, magnitude))
+            {
+              result = sr__matching_failure;
+              break;
+            }
+
+            if (spec.cs == scanner::cs__pointer)
+            {
+              stored = !negative && magnitude <= std::numeric_limits<std::uintptr_t>::max ();
+              if (stored && target)
+              {
+                *static_cast<void **> (target) = reinterpret_cast<void *> (static_cast<std::uintptr_t> (magnitude));
+              }
+            }
+            else if (target)
+            {
+              stored = store_integer (target, spec.tid, negative, magnitude);
+            }
+          }
+          break;
+        case scanner::cs__floating_point:
+          switch (spec.tid)
+          {
+          case itid__float_p:
+            {
+              float value = 0;
+              stored = parse_floating (s, limit, &value);
+              if (stored && target)
+              {
+                *static_cast<float *> (target) = value;
+              }
+            }
+            break;
+          case itid__double_p:
+            {
+              double value = 0;
+              stored = parse_floating (s, limit, &value);
+              if (stored && target)
+              {
+                *static_cast<double *> (target) = value;
+              }
+            }
+            break;
+          default:
+            {
+              long double value = 0;
+              stored = parse_floating (s, limit, &value);
+              if (stored && target)
+              {
+                *static_cast<long double *> (target) = value;
+              }
+            }
+            break;
+          }
+          break;
+        default:
+          result = sr__matching_failure;
+          break;
+        }
+
+        if (!stored)
+        {
+          result = sr__matching_failure;
+        }
+        else if (result == sr__success && target)
+        {
+          ++assigned;
+        }
+      }
+
+      return result == sr__input_failure && assigned == 0 ? EOF : assigned;
+    }
+
+    template<typename ...TArgs>
+    inline int scan_string (char const * input, char const * format, TArgs ...args) noexcept
+    {
+      std::array<void *, sizeof... (TArgs)> pointers {{ static_cast<void *> (args)... }};
+      return scan (input, std::strlen (input), format, pointers.data (), static_cast<size_type> (pointers.size ()));
+    }
+
+    template<typename ...TArgs>
+    inline int scan_string (std::string const & input, char const * format, TArgs ...args) noexcept
+    {
+      std::array<void *, sizeof... (TArgs)> pointers {{ static_cast<void *> (args)... }};
+      return scan (input.data (), input.size (), format, pointers.data (), static_cast<size_type> (pointers.size ()));
+    }
+
+    // Reads a line including the '\n', returns false at the end of the stream
+    inline bool read_line (std::FILE * stream, std::string & line)
+    {
+      char buffer[512];
+
+      line.clear ();
+      while (std::fgets (buffer, sizeof (buffer), stream))
+      {
+        line.append (buffer);
+        if (!line.empty () && line.back () == '\n')
+        {
+          break;
+        }
+      }
+
+      return !line.empty ();
+    }
+
+    template<typename ...TArgs>
+    inline int scan_line (std::FILE * stream, char const * format, TArgs ...args)
+    {
+      std::string line;
+      if (!read_line (stream, line))
+      {
+        return EOF;
+      }
+
+      return scan_string (line, format, args...);
+    }
+  }
+}
+
+#endif // TYPESAFE_PRINTF__TSPRINTF_SCAN_HPP
@@ -0,0 +1,797 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+#ifndef TYPESAFE_PRINTF__TSPRINTF_SHM_HPP
+#define TYPESAFE_PRINTF__TSPRINTF_SHM_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tsprintf.hpp"
+#include "tsprintf_binlog.hpp"
+#include "tsprintf_engine.hpp"
+
+// A log ring in POSIX shared memory. A consumer process (tslogd) creates the
+//  ring, application processes attach to it and only enqueue the format id,
+//  a timestamp and the raw arguments (the binary log payload). Formatting,
+//  compression and I/O happen in the consumer, records enqueued before an
+//  application crashes are still written.
+//
+//  typesafe_printf::shm::producer log ("/myapp-log");
+//  TS_SHM_LOG (log, "Accepted %s:%d\n", host, port);
+//
+// The ring is a bounded multi-producer queue of 64 byte slots (Vyukov), a
+//  record takes as many consecutive slots as it needs. A full ring drops
+//  the record and counts it, producers never wait for the consumer.
+//
+// Format strings are registered in a table in the shared memory the first
+//  time a process uses them. The ring outlives the consumer: a consumer that
+//  finds a valid ring reuses it and continues with the records enqueued while
+//  none was running, the producers keep their mapping. A producer created
+//  before the ring exists attaches on a later record. Removing the ring
+//  (consumer::remove) orphans the producers attached to it.
+//
+// A producer that dies between reserving and publishing its slots stalls
+//  the consumer for stall_timeout, then the slots are skipped. A producer
+//  that was only paused for that long (SIGSTOP, a debugger, swapping) finds
+//  its slots skipped when it publishes, its record is dropped and counted.
+//  Its copy into the slots can't be undone though: if they have been handed
+//  out again it can damage the record of another producer, which is then
+//  rendered with wrong values or rejected as invalid. Keep stall_timeout well
+//  above the longest pause producers should survive.
+//
+//  Layout (native byte order, the ring is local to the machine):
+//    header            : magic version slot_count format_capacity text_capacity tail head dropped
+//                        format_count text_used
+//    formats           : { ready text_offset size encoded_types }[format_capacity]
+//    slots             : { sequence data[56] }[slot_count]
+//    text              : bytes[text_capacity]
+//
+//  Record in the data of consecutive slots:
+//    u16:magic u16:slots u32:pid u32:format_id u32:payload_size u64:timestamp payload[payload_size]
+
+#define TS_SHM_LOG(producer, format, ...)                                                                         \
+  (void) typesafe_printf::details::check_types<typesafe_printf::details::scanner::encode (format)> (__VA_ARGS__); \
+  (void) TYPESAFE_PRINTF__CHECK_EXTENSIONS (format);                                                              \
+  static_assert (                                                                                                 \
+      !typesafe_printf::details::has_extension (format, typesafe_printf::details::ext__hexdump)                   \
+    , "%Hp can't be used in shared memory logs, only the pointer would be stored"                                 \
+    );                                                                                                            \
+  (producer).log<typesafe_printf::details::scanner::encode (format)> (                                            \
+      TYPESAFE_PRINTF__BINLOG_FORMAT_ID (format)                                                                  \
+    , ##__VA_ARGS__                                                                                               \
+    )
+
+namespace typesafe_printf
+{
+  namespace shm
+  {
+    constexpr std::uint32_t default_slot_count      = 1U << 16  ; // 4 MB of slots
+    constexpr std::uint32_t default_format_capacity = 4096U     ;
+    constexpr std::uint32_t default_text_capacity   = 1U << 20  ;
+
+    struct record
+    {
+      std::uint32_t         pid         ;
+      std::uint32_t         format_id   ; // Index in the shared format table
+      binlog::timestamp_t   timestamp   ;
+      std::vector<char>     payload     ; // The binary log payload, fixed size layout
+    };
+  }
+
+  namespace details
+  {
+    constexpr char const    shm_magic[8]        = "TSSHM01" ;
+    constexpr std::uint32_t shm_version         = 1U        ;
+    constexpr std::uint16_t shm_record_magic    = 0x5254U   ; // "TR"
+    constexpr std::size_t   shm_slot_data_size  = 56U       ;
+    constexpr std::size_t   shm_record_header   = 24U       ;
+    constexpr std::uint32_t shm_no_format       = 0xFFFFFFFFU;
+    constexpr std::size_t   shm_format_cache    = 4096U     ;
+
+    static_assert (ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "The ring needs address-free atomics");
+
+    struct shm_slot
+    {
+      std::atomic<std::uint64_t>  sequence  ;
+      char                        data[shm_slot_data_size];
+    };
+
+    struct shm_format
+    {
+      std::atomic<std::uint32_t>  ready         ;
+      std::uint32_t               text_offset   ;
+      std::uint32_t               size          ;
+      std::uint32_t               padding       ;
+      std::uint64_t               encoded_types ;
+    };
+
+    struct shm_header
+    {
+      char                                    magic[8]        ;
+      std::uint32_t                           version         ;
+      std::uint32_t                           slot_count      ;
+      std::uint32_t                           format_capacity ;
+      std::uint32_t                           text_capacity   ;
+
+      alignas (64) std::atomic<std::uint64_t> tail            ; // Next position a producer reserves
+      alignas (64) std::atomic<std::uint64_t> head            ; // Next position the consumer reads
+      std::atomic<std::uint64_t>              dropped         ;
+      alignas (64) std::atomic<std::uint32_t> format_count    ;
+      std::atomic<std::uint32_t>              text_used       ;
+    };
+
+    constexpr std::size_t shm_size (std::uint32_t slot_count, std::uint32_t format_capacity, std::uint32_t text_capacity) noexcept
+    {
+      return
+          sizeof (shm_header)
+        + format_capacity * sizeof (shm_format)
+        + slot_count      * sizeof (shm_slot)
+        + text_capacity
+        ;
+    }
+
+    // A mapping of the shared memory, both ends use it
+    class shm_mapping
+    {
+    public:
+      shm_mapping () noexcept
+        : base    (nullptr)
+        , size    (0U)
+        , header  (nullptr)
+        , formats (nullptr)
+        , slots   (nullptr)
+        , text    (nullptr)
+      {
+      }
+
+      shm_mapping (shm_mapping const &)             = delete;
+      shm_mapping & operator= (shm_mapping const &) = delete;
+
+      ~shm_mapping () noexcept
+      {
+        unmap ();
+      }
+
+      void unmap () noexcept
+      {
+        if (base)
+        {
+          ::munmap (base, size);
+        }
+        base    = nullptr;
+        size    = 0U;
+        header  = nullptr;
+      }
+
+      bool map (int fd, std::size_t mapping_size) noexcept
+      {
+        auto mapped = ::mmap (nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED)
+        {
+          return false;
+        }
+
+        base  = static_cast<char *> (mapped);
+        size  = mapping_size;
+        return true;
+      }
+
+      // Points the parts into the mapping, the header must be valid
+      void locate () noexcept
+      {
+        header  = reinterpret_cast<shm_header *> (base);
+        formats = reinterpret_cast<shm_format *> (base + sizeof (shm_header));
+        slots   = reinterpret_cast<shm_slot *> (formats + header->format_capacity);
+        text    = reinterpret_cast<char *> (slots + header->slot_count);
+      }
+
+      shm_slot & slot (std::uint64_t pos) const noexcept
+      {
+        return slots[pos & (header->slot_count - 1U)];
+      }
+
+      // Copies between a record and the data of the slots from pos
+      void write (std::uint64_t pos, std::size_t offset, char const * bytes, std::size_t count) const noexcept
+      {
+        while (count > 0U)
+        {
+          auto & s      = slot (pos + offset / shm_slot_data_size);
+          auto   within = offset % shm_slot_data_size;
+          auto   chunk  = shm_slot_data_size - within < count ? shm_slot_data_size - within : count;
+          std::memcpy (s.data + within, bytes, chunk);
+          bytes   += chunk;
+          offset  += chunk;
+          count   -= chunk;
+        }
+      }
+
+      void read (std::uint64_t pos, std::size_t offset, char * bytes, std::size_t count) const noexcept
+      {
+        while (count > 0U)
+        {
+          auto & s      = slot (pos + offset / shm_slot_data_size);
+          auto   within = offset % shm_slot_data_size;
+          auto   chunk  = shm_slot_data_size - within < count ? shm_slot_data_size - within : count;
+          std::memcpy (bytes, s.data + within, chunk);
+          bytes   += chunk;
+          offset  += chunk;
+          count   -= chunk;
+        }
+      }
+
+      char *        base    ;
+      std::size_t   size    ;
+      shm_header *  header  ;
+      shm_format *  formats ;
+      shm_slot *    slots   ;
+      char *        text    ;
+    };
+
+    // Maps the ring name if it exists and has been initialized
+    inline bool shm_map_existing (shm_mapping & m, char const * name) noexcept
+    {
+      auto fd = ::shm_open (name, O_RDWR, 0);
+      if (fd < 0)
+      {
+        return false;
+      }
+
+      struct stat info {};
+      if (
+            ::fstat (fd, &info) == 0
+        &&  static_cast<std::size_t> (info.st_size) >= sizeof (shm_header)
+        &&  m.map (fd, static_cast<std::size_t> (info.st_size))
+        )
+      {
+        auto header = reinterpret_cast<shm_header const *> (m.base);
+        if (
+              std::memcmp (header->magic, shm_magic, sizeof (shm_magic)) == 0
+          &&  header->version == shm_version
+          &&  header->slot_count >= 2U
+          &&  (header->slot_count & (header->slot_count - 1U)) == 0U
+          &&  shm_size (header->slot_count, header->format_capacity, header->text_capacity) <= m.size
+          )
+        {
+          m.locate ();
+        }
+        else
+        {
+          m.unmap ();
+        }
+      }
+
+      ::close (fd);
+      return m.header != nullptr;
+    }
+
+    inline std::uint32_t shm_slots_for (std::size_t record_size) noexcept
+    {
+      return static_cast<std::uint32_t> ((record_size + shm_slot_data_size - 1U) / shm_slot_data_size);
+    }
+
+    // Finds or adds format in the shared table, returns shm_no_format when
+    //  the table is full. Two processes adding the same format at the same
+    //  time get different ids which is harmless
+    // The table can be left corrupt or half written by an earlier process,
+    //  an entry is only used if its text is inside the mapping
+    inline bool shm_format_in_bounds (shm_mapping const & m, shm_format const & f) noexcept
+    {
+      return static_cast<std::uint64_t> (f.text_offset) + f.size <= m.header->text_capacity;
+    }
+
+    inline std::uint32_t shm_register_format (shm_mapping const & m, char const * format, encoded_types_t encoded_types) noexcept
+    {
+      auto & header = *m.header;
+      auto   size   = std::strlen (format);
+
+      auto count = header.format_count.load (std::memory_order_acquire);
+      count = count < header.format_capacity ? count : header.format_capacity;
+      for (auto iter = 0U; iter < count; ++iter)
+      {
+        auto & f = m.formats[iter];
+        if (
+              f.ready.load (std::memory_order_acquire) != 0U
+          &&  f.encoded_types == encoded_types
+          &&  f.size == size
+          &&  shm_format_in_bounds (m, f)
+          &&  std::memcmp (m.text + f.text_offset, format, size) == 0
+          )
+        {
+          return iter;
+        }
+      }
+
+      auto id = header.format_count.fetch_add (1U, std::memory_order_acq_rel);
+      if (id >= header.format_capacity)
+      {
+        return shm_no_format;
+      }
+
+      auto offset = header.text_used.fetch_add (static_cast<std::uint32_t> (size), std::memory_order_acq_rel);
+      if (offset + size > header.text_capacity)
+      {
+        return shm_no_format;
+      }
+
+      auto & f = m.formats[id];
+      std::memcpy (m.text + offset, format, size);
+      f.text_offset   = offset;
+      f.size          = static_cast<std::uint32_t> (size);
+      f.encoded_types = encoded_types;
+      f.ready.store (1U, std::memory_order_release);
+
+      return id;
+    }
+  }
+
+  namespace shm
+  {
+    // How often a producer without a ring looks for it
+    constexpr std::chrono::milliseconds attach_interval (100);
+
+    // Attaches to a ring created by a consumer. Thread-safe, use one
+    //  producer per process
+    class producer
+    {
+    public:
+      explicit producer (char const * name)
+        : name        (name)
+        , pid         (static_cast<std::uint32_t> (::getpid ()))
+        , ids         (new std::atomic<std::uint32_t>[details::shm_format_cache])
+        , attached    (nullptr)
+        , next_attach (0)
+      {
+        TYPESAFE_PRINTF__ASSERT (name);
+
+        for (auto iter = 0U; iter < details::shm_format_cache; ++iter)
+        {
+          ids[iter].store (details::shm_no_format, std::memory_order_relaxed);
+        }
+
+        attach ();
+      }
+
+      producer (producer const &)             = delete;
+      producer & operator= (producer const &) = delete;
+
+      // True once the producer is attached to the ring
+      bool is_valid () const noexcept
+      {
+        return attached.load (std::memory_order_acquire) != nullptr;
+      }
+
+      // Attaches to the ring if it exists, records do this by themselves at
+      //  most every attach_interval
+      bool attach ()
+      {
+        if (is_valid ())
+        {
+          return true;
+        }
+
+        std::lock_guard<std::mutex> guard (attach_lock);
+        if (!owned)
+        {
+          std::unique_ptr<details::shm_mapping> mapping (new details::shm_mapping ());
+          if (!details::shm_map_existing (*mapping, name.c_str ()))
+          {
+            return false;
+          }
+          owned = std::move (mapping);
+          attached.store (owned.get (), std::memory_order_release);
+        }
+
+        return true;
+      }
+
+      // Use TS_SHM_LOG, it checks the arguments. Returns false if the
+      //  record was dropped
+      template<details::encoded_types_t EncodedTypes, typename ...TArgs>
+      bool log (binlog::format_id id, TArgs && ...args)
+      {
+        std::array<details::arg, sizeof... (TArgs)> captured;
+        details::make_args<EncodedTypes> (captured, std::forward<TArgs> (args)...);
+        return write_record (id, binlog::now (), captured.data (), static_cast<details::size_type> (captured.size ()));
+      }
+
+      bool write_record (binlog::format_id id, binlog::timestamp_t timestamp, details::arg const * args, details::size_type arg_count)
+      {
+        auto m = current_mapping ();
+        if (!m)
+        {
+          return false;
+        }
+
+        auto & mapping  = *m;
+        auto shared_id  = shared_format_id (mapping, id);
+        if (shared_id == details::shm_no_format)
+        {
+          return drop (mapping);
+        }
+
+        static thread_local std::vector<char> payload;
+        payload.clear ();
+        for (auto iter = 0U; iter < arg_count; ++iter)
+        {
+          details::put_binlog_arg (payload, args[iter]);
+        }
+
+        auto & header     = *mapping.header;
+        auto   size       = details::shm_record_header + payload.size ();
+        auto   slot_count = details::shm_slots_for (size);
+        if (slot_count > header.slot_count / 2U)
+        {
+          return drop (mapping);
+        }
+
+        // Reserves slot_count slots, the consumer frees slots in order so
+        //  the last one being free means they all are
+        auto pos = header.tail.load (std::memory_order_relaxed);
+        for (;;)
+        {
+          auto last     = pos + slot_count - 1U;
+          auto sequence = mapping.slot (last).sequence.load (std::memory_order_acquire);
+          auto diff     = static_cast<std::int64_t> (sequence - last);
+          if (diff == 0)
+          {
+            if (header.tail.compare_exchange_weak (pos, pos + slot_count, std::memory_order_relaxed))
+            {
+              break;
+            }
+          }
+          else if (diff < 0)
+          {
+            return drop (mapping);
+          }
+          else
+          {
+            pos = header.tail.load (std::memory_order_relaxed);
+          }
+        }
+
+        char record_header[details::shm_record_header];
+        auto magic        = details::shm_record_magic;
+        auto slots        = static_cast<std::uint16_t> (slot_count);
+        auto payload_size = static_cast<std::uint32_t> (payload.size ());
+        std::memcpy (record_header + 0 , &magic       , 2);
+        std::memcpy (record_header + 2 , &slots       , 2);
+        std::memcpy (record_header + 4 , &pid         , 4);
+        std::memcpy (record_header + 8 , &shared_id   , 4);
+        std::memcpy (record_header + 12, &payload_size, 4);
+        std::memcpy (record_header + 16, &timestamp   , 8);
+
+        mapping.write (pos, 0U, record_header, sizeof (record_header));
+        mapping.write (pos, sizeof (record_header), payload.data (), payload.size ());
+
+        // The consumer may have skipped the slots while this producer was
+        //  paused, publishing them anyway would move them back a lap and the
+        //  ring would look full forever
+        auto lost = false;
+        for (auto iter = 0U; iter < slot_count; ++iter)
+        {
+          auto expected = pos + iter;
+          if (!mapping.slot (pos + iter).sequence.compare_exchange_strong (expected, pos + iter + 1U, std::memory_order_release, std::memory_order_relaxed))
+          {
+            lost = true;
+          }
+        }
+
+        return lost ? drop (mapping) : true;
+      }
+
+    private:
+      details::shm_mapping const * current_mapping ()
+      {
+        auto m = attached.load (std::memory_order_acquire);
+        if (m)
+        {
+          return m;
+        }
+
+        // One thread looks for the ring every attach_interval
+        auto now  = std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+        auto next = next_attach.load (std::memory_order_relaxed);
+        if (now < next || !next_attach.compare_exchange_strong (next, now + std::chrono::nanoseconds (attach_interval).count (), std::memory_order_relaxed))
+        {
+          return nullptr;
+        }
+
+        return attach () ? attached.load (std::memory_order_acquire) : nullptr;
+      }
+
+      static bool drop (details::shm_mapping const & mapping) noexcept
+      {
+        mapping.header->dropped.fetch_add (1U, std::memory_order_relaxed);
+        return false;
+      }
+
+      std::uint32_t shared_format_id (details::shm_mapping const & mapping, binlog::format_id id)
+      {
+        if (id < details::shm_format_cache)
+        {
+          auto cached = ids[id].load (std::memory_order_relaxed);
+          if (cached != details::shm_no_format)
+          {
+            return cached;
+          }
+        }
+
+        details::binlog_registered_format registered;
+        {
+          auto & registry = details::get_binlog_format_registry ();
+          std::lock_guard<std::mutex> guard (registry.lock);
+          TYPESAFE_PRINTF__ASSERT (id < registry.formats.size ());
+          registered = registry.formats[id];
+        }
+
+        auto shared_id = details::shm_register_format (mapping, registered.format, registered.encoded_types);
+        if (id < details::shm_format_cache && shared_id != details::shm_no_format)
+        {
+          ids[id].store (shared_id, std::memory_order_relaxed);
+        }
+
+        return shared_id;
+      }
+
+      std::string                                     name        ;
+      std::uint32_t                                   pid         ;
+      std::unique_ptr<std::atomic<std::uint32_t> []>  ids         ; // Process format id to shared format id
+      std::mutex                                      attach_lock ;
+      std::unique_ptr<details::shm_mapping>           owned       ;
+      std::atomic<details::shm_mapping const *>       attached    ; // owned once mapped
+      std::atomic<std::int64_t>                       next_attach ; // Nanoseconds of steady_clock
+    };
+
+    // Creates the ring, or reuses a valid one as it is, and reads records
+    //  from it. One consumer per ring at a time, the ring stays when the
+    //  consumer is destroyed
+    class consumer
+    {
+    public:
+      explicit consumer (
+          char const *    name
+        , std::uint32_t   slot_count      = default_slot_count
+        , std::uint32_t   format_capacity = default_format_capacity
+        , std::uint32_t   text_capacity   = default_text_capacity
+        )
+        : name            (name)
+        , stall_timeout   (std::chrono::seconds (1))
+        , stalled         (false)
+      {
+        TYPESAFE_PRINTF__ASSERT (name);
+        // The slot positions wrap with a mask
+        TYPESAFE_PRINTF__ASSERT (slot_count >= 2U && (slot_count & (slot_count - 1U)) == 0U);
+
+        // Continues with the records in the ring of an earlier consumer
+        if (details::shm_map_existing (mapping, name))
+        {
+          return;
+        }
+
+        // A ring that was never completely initialized is replaced
+        ::shm_unlink (name);
+
+        auto fd = ::shm_open (name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0)
+        {
+          return;
+        }
+
+        auto size = details::shm_size (slot_count, format_capacity, text_capacity);
+        if (::ftruncate (fd, static_cast<off_t> (size)) == 0 && mapping.map (fd, size))
+        {
+          auto header = new (mapping.base) details::shm_header ();
+          header->version         = details::shm_version;
+          header->slot_count      = slot_count;
+          header->format_capacity = format_capacity;
+          header->text_capacity   = text_capacity;
+          header->tail.store          (0U, std::memory_order_relaxed);
+          header->head.store          (0U, std::memory_order_relaxed);
+          header->dropped.store       (0U, std::memory_order_relaxed);
+          header->format_count.store  (0U, std::memory_order_relaxed);
+          header->text_used.store     (0U, std::memory_order_relaxed);
+
+          mapping.locate ();
+
+          for (auto iter = 0U; iter < format_capacity; ++iter)
+          {
+            new (&mapping.formats[iter]) details::shm_format ();
+            mapping.formats[iter].ready.store (0U, std::memory_order_relaxed);
+          }
+
+          for (auto iter = 0U; iter < slot_count; ++iter)
+          {
+            new (&mapping.slots[iter]) details::shm_slot ();
+            mapping.slots[iter].sequence.store (iter, std::memory_order_relaxed);
+          }
+
+          // Producers check the magic last
+          std::atomic_thread_fence (std::memory_order_release);
+          std::memcpy (header->magic, details::shm_magic, sizeof (details::shm_magic));
+        }
+
+        ::close (fd);
+      }
+
+      consumer (consumer const &)             = delete;
+      consumer & operator= (consumer const &) = delete;
+
+      // Removes the name of the ring, producers attached to it keep writing
+      //  to a ring no consumer will read
+      bool remove () noexcept
+      {
+        return ::shm_unlink (name.c_str ()) == 0;
+      }
+
+      bool is_valid () const noexcept
+      {
+        return mapping.header != nullptr;
+      }
+
+      // Records dropped by producers because the ring or the format table
+      //  was full
+      std::uint64_t dropped () const noexcept
+      {
+        return is_valid () ? mapping.header->dropped.load (std::memory_order_relaxed) : 0U;
+      }
+
+      // Reads the next record, returns false if there is none yet
+      bool next (shm::record & r)
+      {
+        if (!is_valid ())
+        {
+          return false;
+        }
+
+        auto & header = *mapping.header;
+
+        for (;;)
+        {
+          auto pos      = header.head.load (std::memory_order_relaxed);
+          auto sequence = mapping.slot (pos).sequence.load (std::memory_order_acquire);
+
+          if (sequence != pos + 1U)
+          {
+            if (header.tail.load (std::memory_order_relaxed) != pos && is_stalled ())
+            {
+              skip (pos, 1U);
+              continue;
+            }
+            return false;
+          }
+
+          char record_header[details::shm_record_header];
+          mapping.read (pos, 0U, record_header, sizeof (record_header));
+
+          std::uint16_t magic         ;
+          std::uint16_t slots         ;
+          std::uint32_t payload_size  ;
+          std::memcpy (&magic         , record_header + 0 , 2);
+          std::memcpy (&slots         , record_header + 2 , 2);
+          std::memcpy (&payload_size  , record_header + 12, 4);
+
+          // Left behind by a stalled producer
+          if (
+                magic != details::shm_record_magic
+            ||  slots == 0U
+            ||  slots > header.slot_count / 2U
+            ||  details::shm_slots_for (details::shm_record_header + payload_size) != slots
+            )
+          {
+            skip (pos, 1U);
+            continue;
+          }
+
+          auto published = 1U;
+          while (published < slots && mapping.slot (pos + published).sequence.load (std::memory_order_acquire) == pos + published + 1U)
+          {
+            ++published;
+          }
+
+          if (published < slots)
+          {
+            if (is_stalled ())
+            {
+              skip (pos, published);
+              continue;
+            }
+            return false;
+          }
+
+          std::memcpy (&r.pid       , record_header + 4 , 4);
+          std::memcpy (&r.format_id , record_header + 8 , 4);
+          std::memcpy (&r.timestamp , record_header + 16, 8);
+          r.payload.resize (payload_size);
+          mapping.read (pos, details::shm_record_header, r.payload.data (), payload_size);
+
+          skip (pos, slots);
+          return true;
+        }
+      }
+
+      // The format of a record, returns false if format_id isn't in the
+      //  table
+      bool format (std::uint32_t format_id, std::string & text, details::encoded_types_t & encoded_types) const
+      {
+        if (!is_valid () || format_id >= mapping.header->format_capacity)
+        {
+          return false;
+        }
+
+        auto & f = mapping.formats[format_id];
+        if (f.ready.load (std::memory_order_acquire) == 0U || !details::shm_format_in_bounds (mapping, f))
+        {
+          return false;
+        }
+
+        text.assign (mapping.text + f.text_offset, f.size);
+        encoded_types = f.encoded_types;
+        return true;
+      }
+
+      void set_stall_timeout (std::chrono::milliseconds timeout) noexcept
+      {
+        stall_timeout = timeout;
+      }
+
+    private:
+      // Frees count slots from pos for the next lap
+      void skip (std::uint64_t pos, std::uint32_t count) noexcept
+      {
+        auto & header = *mapping.header;
+        for (auto iter = 0U; iter < count; ++iter)
+        {
+          mapping.slot (pos + iter).sequence.store (pos + iter + header.slot_count, std::memory_order_release);
+        }
+        header.head.store (pos + count, std::memory_order_relaxed);
+        stalled = false;
+      }
+
+      bool is_stalled () noexcept
+      {
+        auto now = std::chrono::steady_clock::now ();
+        if (!stalled)
+        {
+          stalled       = true;
+          stalled_since = now;
+          return false;
+        }
+        return now - stalled_since >= stall_timeout;
+      }
+
+      std::string                             name          ;
+      details::shm_mapping                    mapping       ;
+      std::chrono::milliseconds               stall_timeout ;
+      bool                                    stalled       ;
+      std::chrono::steady_clock::time_point   stalled_since ;
+    };
+  }
+}
+
+#endif // TYPESAFE_PRINTF__TSPRINTF_SHM_HPP
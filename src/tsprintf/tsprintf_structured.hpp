@@ -0,0 +1,595 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+#ifndef TYPESAFE_PRINTF__TSPRINTF_STRUCTURED_HPP
+#define TYPESAFE_PRINTF__TSPRINTF_STRUCTURED_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "tsprintf.hpp"
+#include "tsprintf_engine.hpp"
+#include "tsprintf_rt.hpp"
+
+// Structured logging. Arguments wrapped in TS_FIELD carry a field name, the
+//  same checked call renders as the printf text, as a JSON object or as a
+//  logfmt line. The rendered text is the msg field
+//
+//  TS_STRUCTURED_FPRINTF (stdout, om__json, "Accepted %s:%d\n", TS_FIELD ("peer", peer), TS_FIELD ("port", port));
+//
+//  Accepted 10.0.0.1:8080                                  om__text
+//  {"msg":"Accepted 10.0.0.1:8080","peer":"10.0.0.1","port":8080}  om__json
+//  msg="Accepted 10.0.0.1:8080" peer=10.0.0.1 port=8080    om__logfmt
+//
+// The encoder of a field is picked at compile time from the type the format
+//  expects: integers and doubles are numbers (NaN and infinities are null),
+//  strings (also %c, %lc and %ls) are strings, pointers are 0x strings, %Hp
+//  is the hex of the bytes and %T the rendered timestamp. Arguments without
+//  a name only show up in msg
+
+// name must be a string literal
+#define TS_FIELD(name, value) \
+  typesafe_printf::details::make_field ("" name, value)
+
+// Returns the text, the JSON object or the logfmt line (without a newline),
+//  an empty string if the format fails
+#define TS_STRUCTURED_FORMAT(mode, format, ...)                                                                     \
+  ( (void) TYPESAFE_PRINTF__CHECK_EXTENSIONS (format)                                                               \
+  , typesafe_printf::details::structured_format<typesafe_printf::details::scanner::encode (format)> (mode, format, ##__VA_ARGS__) \
+  )
+
+// Writes one line, returns the number of chars written or -1
+#define TS_STRUCTURED_FPRINTF(stream, mode, format, ...)                                                            \
+  ( (void) TYPESAFE_PRINTF__CHECK_EXTENSIONS (format)                                                               \
+  , typesafe_printf::details::structured_fprintf<typesafe_printf::details::scanner::encode (format)> (stream, mode, format, ##__VA_ARGS__) \
+  )
+
+namespace typesafe_printf
+{
+  enum output_mode
+  {
+    om__text    ,
+    om__json    ,
+    om__logfmt  ,
+  };
+
+  namespace details
+  {
+    template<typename T>
+    struct field
+    {
+      char const *  name  ;
+      T             value ;
+    };
+
+    template<typename T>
+    inline field<typename std::decay<T>::type> make_field (char const * name, T && value) noexcept
+    {
+      return field<typename std::decay<T>::type> { name, std::forward<T> (value) };
+    }
+
+    template<typename T>
+    struct is_field : std::false_type
+    {
+    };
+
+    template<typename T>
+    struct is_field<field<T>> : std::true_type
+    {
+    };
+
+    template<typename T>
+    inline T const & field_value (field<T> const & f) noexcept
+    {
+      return f.value;
+    }
+
+    template<typename T>
+    inline typename std::enable_if<!is_field<typename std::decay<T>::type>::value, T &&>::type field_value (T && value) noexcept
+    {
+      return std::forward<T> (value);
+    }
+
+    template<typename T>
+    inline char const * field_name (field<T> const & f) noexcept
+    {
+      return f.name;
+    }
+
+    template<typename T>
+    inline char const * field_name (T const &) noexcept
+    {
+      return nullptr;
+    }
+
+    inline void append_structured_escaped (std::string & out, char const * s, std::size_t size, escape_kind kind)
+    {
+      auto end = s + size;
+
+      for (;;)
+      {
+        auto special = find_escape (s, end, kind);
+        out.append (s, static_cast<std::size_t> (special - s));
+
+        if (special == end)
+        {
+          return;
+        }
+
+        char sequence[8];
+        out.append (sequence, escape_sequence (static_cast<unsigned char> (*special), kind, sequence));
+        s = special + 1;
+      }
+    }
+
+    // logfmt leaves simple values unquoted
+    inline bool is_bare_logfmt (char const * s, std::size_t size) noexcept
+    {
+      if (size == 0U)
+      {
+        return false;
+      }
+
+      for (auto iter = 0U; iter < size; ++iter)
+      {
+        auto ch = static_cast<unsigned char> (s[iter]);
+        if (ch <= ' ' || ch == '=' || ch == '"' || ch == '\\' || ch == 0x7F)
+        {
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+    inline void append_structured_string (std::string & out, output_mode mode, char const * s, std::size_t size)
+    {
+      if (mode == om__logfmt && is_bare_logfmt (s, size))
+      {
+        out.append (s, size);
+        return;
+      }
+
+      out += '"';
+      append_structured_escaped (out, s, size, mode == om__json ? ek__json : ek__c_string);
+      out += '"';
+    }
+
+    inline void append_structured_null (std::string & out, output_mode mode)
+    {
+      if (mode == om__json)
+      {
+        out += "null";
+      }
+    }
+
+    inline void append_structured_key (std::string & out, output_mode mode, char const * name)
+    {
+      if (mode == om__json)
+      {
+        out += ",\"";
+        append_structured_escaped (out, name, std::strlen (name), ek__json);
+        out += "\":";
+      }
+      else
+      {
+        out += ' ';
+        out += name;
+        out += '=';
+      }
+    }
+
+    // The shortest of %.15g, %.16g and %.17g that reads back as value.
+    //  rt_double ignores the locale so the decimal point is always a '.',
+    //  strtod only picks the precision: if the locale makes it misread the
+    //  digits the output is %.17g which always reads back
+    inline void append_structured_double (std::string & out, output_mode mode, double value)
+    {
+      if (value != value || value - value != 0.0)
+      {
+        if (mode == om__json)
+        {
+          out += "null";
+        }
+        else
+        {
+          out += value != value ? "NaN" : value > 0.0 ? "+Inf" : "-Inf";
+        }
+        return;
+      }
+
+      char digits[32];
+      rt_spec spec {};
+      spec.conversion = 'g';
+      for (spec.precision = 15; ; ++spec.precision)
+      {
+        rt_output output (digits, sizeof (digits));
+        rt_double (output, spec, value);
+        output.finish ();
+        if (spec.precision == 17 || std::strtod (digits, nullptr) == value)
+        {
+          break;
+        }
+      }
+
+      out += digits;
+    }
+
+    inline void append_structured_wide (std::string & out, output_mode mode, wchar_t const * s)
+    {
+      std::size_t size  = 0U;
+      auto        end   = s + std::wcslen (s);
+      if (!utf8_size (s, end, size))
+      {
+        append_structured_null (out, mode);
+        return;
+      }
+
+      std::string utf8 (size, '\0');
+      if (size > 0U)
+      {
+        encode_utf8 (&utf8.front (), utf8.data () + size, s, end);
+      }
+      append_structured_string (out, mode, utf8.data (), utf8.size ());
+    }
+
+    // Renders the conversion as the engine does, for the extensions
+    inline void append_structured_rendered (std::string & out, output_mode mode, char const * format, segment const & s, arg const * args)
+    {
+      char          buffer[256];
+      output_buffer output (buffer, sizeof (buffer));
+      if (!render_segment (output, format, s, args))
+      {
+        append_structured_null (out, mode);
+        return;
+      }
+
+      auto size = output.size ();
+      if (size < sizeof (buffer))
+      {
+        append_structured_string (out, mode, buffer, size);
+        return;
+      }
+
+      std::vector<char> large (size + 1U);
+      output_buffer     large_output (large.data (), large.size ());
+      render_segment (large_output, format, s, args);
+      append_structured_string (out, mode, large.data (), size);
+    }
+
+    // One encoder per type class, picked from the type the format expects
+    // args are the arguments of segment s, the field is args[index]. The
+    //  value comes after the * arguments, %Hp has its length after it
+    template<type_class TypeClass>
+    struct field_encoder
+    {
+      static void apply (std::string &, output_mode, char const *, segment const &, arg const *, size_type)
+      {
+      }
+    };
+
+    template<>
+    struct field_encoder<tc__signed_integer>
+    {
+      static void apply (std::string & out, output_mode mode, char const * format, segment const & s, arg const * args, size_type index)
+      {
+        auto v        = args[index].value.signed_integer;
+        auto is_value = index == s.stars;
+
+        if (is_value && s.ext != ext__none)
+        {
+          append_structured_rendered (out, mode, format, s, args);
+          return;
+        }
+
+        if (is_value && format[s.end - 1] == 'c')
+        {
+          auto ch = static_cast<char> (static_cast<unsigned char> (v));
+          append_structured_string (out, mode, &ch, 1U);
+          return;
+        }
+
+        char digits[24];
+        auto end    = digits + sizeof (digits);
+        auto first  = format_decimal (end, v < 0 ? 0U - static_cast<std::uintmax_t> (v) : static_cast<std::uintmax_t> (v));
+        if (v < 0)
+        {
+          *--first = '-';
+        }
+        out.append (first, static_cast<std::size_t> (end - first));
+      }
+    };
+
+    template<>
+    struct field_encoder<tc__unsigned_integer>
+    {
+      static void apply (std::string & out, output_mode mode, char const * format, segment const & s, arg const * args, size_type index)
+      {
+        auto v        = args[index].value.unsigned_integer;
+        auto is_value = index == s.stars;
+
+        if (is_value && s.ext != ext__none)
+        {
+          append_structured_rendered (out, mode, format, s, args);
+          return;
+        }
+
+        if (args[index].tid == tid__wint_t)
+        {
+          wchar_t text[] = { static_cast<wchar_t> (v), L'\0' };
+          append_structured_wide (out, mode, text);
+          return;
+        }
+
+        char digits[24];
+        auto end    = digits + sizeof (digits);
+        auto first  = format_decimal (end, v);
+        out.append (first, static_cast<std::size_t> (end - first));
+      }
+    };
+
+    template<>
+    struct field_encoder<tc__double>
+    {
+      static void apply (std::string & out, output_mode mode, char const *, segment const &, arg const * args, size_type index)
+      {
+        append_structured_double (out, mode, args[index].value.double_value);
+      }
+    };
+
+    // JSON numbers are doubles anyway
+    template<>
+    struct field_encoder<tc__long_double>
+    {
+      static void apply (std::string & out, output_mode mode, char const *, segment const &, arg const * args, size_type index)
+      {
+        append_structured_double (out, mode, static_cast<double> (args[index].value.long_double_value));
+      }
+    };
+
+    template<>
+    struct field_encoder<tc__char_p>
+    {
+      static void apply (std::string & out, output_mode mode, char const *, segment const &, arg const * args, size_type index)
+      {
+        auto s = args[index].value.char_p;
+        if (s)
+        {
+          append_structured_string (out, mode, s, std::strlen (s));
+        }
+        else
+        {
+          append_structured_null (out, mode);
+        }
+      }
+    };
+
+    template<>
+    struct field_encoder<tc__wchar_t_p>
+    {
+      static void apply (std::string & out, output_mode mode, char const *, segment const &, arg const * args, size_type index)
+      {
+        auto s = args[index].value.wchar_t_p;
+        if (s)
+        {
+          append_structured_wide (out, mode, s);
+        }
+        else
+        {
+          append_structured_null (out, mode);
+        }
+      }
+    };
+
+    template<>
+    struct field_encoder<tc__void_p>
+    {
+      static void apply (std::string & out, output_mode mode, char const * format, segment const & s, arg const * args, size_type index)
+      {
+        auto p = args[index].value.void_p;
+        if (!p)
+        {
+          append_structured_null (out, mode);
+        }
+        else if (s.ext != ext__none)
+        {
+          append_structured_rendered (out, mode, format, s, args);
+        }
+        else
+        {
+          char digits[24];
+          auto end    = digits + sizeof (digits);
+          auto first  = format_hex (end, reinterpret_cast<std::uintptr_t> (p), false);
+          *--first    = 'x';
+          *--first    = '0';
+          append_structured_string (out, mode, first, static_cast<std::size_t> (end - first));
+        }
+      }
+    };
+
+    // The segment each argument belongs to and the index of its first argument
+    inline bool map_structured_segments (char const * format, segment * segments, size_type * firsts, size_type arg_count) noexcept
+    {
+      size_type   count = 0U;
+      index_type  pos   = 0U;
+      segment     s     {} ;
+
+      while (next_segment (format, pos, s))
+      {
+        if (is_literal (s))
+        {
+          continue;
+        }
+
+        if (count + argument_count (s) > arg_count)
+        {
+          return false;
+        }
+
+        auto first = count;
+        for (auto iter = 0U; iter < argument_count (s); ++iter)
+        {
+          segments[count] = s     ;
+          firsts[count]   = first ;
+          ++count;
+        }
+      }
+
+      return count == arg_count;
+    }
+
+    using field_encoder_t = void (*) (std::string &, output_mode, char const *, segment const &, arg const *, size_type);
+
+    template<encoded_types_t EncodedTypes, std::size_t ...Indices>
+    inline void append_structured_fields (
+        std::string &           out
+      , output_mode             mode
+      , char const *            format
+      , segment const *         segments
+      , size_type const *       firsts
+      , arg const *             args
+      , char const * const *    names
+      , std::index_sequence<Indices...>
+      )
+    {
+      auto append_field = [&] (size_type index, type_class tc, field_encoder_t encoder)
+      {
+        // %n has nothing to show
+        if (names[index] && tc != tc__chars_written)
+        {
+          append_structured_key (out, mode, names[index]);
+          encoder (out, mode, format, segments[index], args + firsts[index], index - firsts[index]);
+        }
+      };
+
+      int expand[] =
+      {
+          0
+        , (append_field (static_cast<size_type> (Indices), get_type_class (type_id_at (EncodedTypes, Indices)), &field_encoder<get_type_class (type_id_at (EncodedTypes, Indices))>::apply), 0)...
+      };
+      (void) expand;
+      // Unused without arguments
+      (void) append_field;
+    }
+
+    // Renders into out, false if the format fails. An empty line is valid
+    //  in om__text so the result can't tell
+    template<encoded_types_t EncodedTypes, typename ...TArgs>
+    inline bool structured_format_into (std::string & out, output_mode mode, char const * format, TArgs && ...args)
+    {
+      (void) check_types<EncodedTypes> (field_value (args)...);
+
+      std::array<arg, sizeof... (TArgs)> captured;
+      make_args<EncodedTypes> (captured, field_value (std::forward<TArgs> (args))...);
+
+      char const *  names[]   = { field_name (args)..., nullptr };
+      auto          count     = static_cast<size_type> (captured.size ());
+
+      std::string message (256, '\0');
+      for (;;)
+      {
+        auto size = render (&message.front (), message.size (), format, captured.data (), count);
+        if (size < 0)
+        {
+          return false;
+        }
+
+        if (static_cast<std::size_t> (size) < message.size ())
+        {
+          message.resize (static_cast<std::size_t> (size));
+          break;
+        }
+
+        message.resize (static_cast<std::size_t> (size) + 1U);
+      }
+
+      if (mode == om__text)
+      {
+        out = std::move (message);
+        return true;
+      }
+
+      segment   segments[sizeof... (TArgs) + 1];
+      size_type firsts[sizeof... (TArgs) + 1];
+      if (!map_structured_segments (format, segments, firsts, count))
+      {
+        return false;
+      }
+
+      // The line ends where the log record ends
+      if (!message.empty () && message.back () == '\n')
+      {
+        message.pop_back ();
+      }
+
+      out.clear ();
+      out.reserve (message.size () + 32U * (sizeof... (TArgs) + 1U));
+
+      if (mode == om__json)
+      {
+        out += "{\"msg\":";
+        append_structured_string (out, mode, message.data (), message.size ());
+        append_structured_fields<EncodedTypes> (out, mode, format, segments, firsts, captured.data (), names, std::index_sequence_for<TArgs...> ());
+        out += '}';
+      }
+      else
+      {
+        out += "msg=";
+        append_structured_string (out, mode, message.data (), message.size ());
+        append_structured_fields<EncodedTypes> (out, mode, format, segments, firsts, captured.data (), names, std::index_sequence_for<TArgs...> ());
+      }
+
+      return true;
+    }
+
+    template<encoded_types_t EncodedTypes, typename ...TArgs>
+    inline std::string structured_format (output_mode mode, char const * format, TArgs && ...args)
+    {
+      std::string out;
+      if (!structured_format_into<EncodedTypes> (out, mode, format, std::forward<TArgs> (args)...))
+      {
+        return std::string ();
+      }
+
+      return out;
+    }
+
+    template<encoded_types_t EncodedTypes, typename ...TArgs>
+    inline int structured_fprintf (std::FILE * stream, output_mode mode, char const * format, TArgs && ...args)
+    {
+      std::string line;
+      if (!structured_format_into<EncodedTypes> (line, mode, format, std::forward<TArgs> (args)...))
+      {
+        return -1;
+      }
+
+      if (mode != om__text)
+      {
+        line += '\n';
+      }
+
+      return std::fwrite (line.data (), 1, line.size (), stream) == line.size () ? static_cast<int> (line.size ()) : -1;
+    }
+  }
+}
+
+#endif // TYPESAFE_PRINTF__TSPRINTF_STRUCTURED_HPP
@@ -0,0 +1,147 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+#ifndef TYPESAFE_PRINTF__TSPRINTF_TIMESTAMP_HPP
+#define TYPESAFE_PRINTF__TSPRINTF_TIMESTAMP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+
+// ISO-8601 local time of a nanosecond count since the epoch. The date and
+//  time down to the second and the UTC offset are cached per thread, only
+//  the sub-second digits are formatted when the second hasn't changed
+
+namespace typesafe_printf
+{
+  // Nanoseconds since the epoch, the argument %Tllu expects
+  inline unsigned long long timestamp_ns (::timespec const & ts) noexcept
+  {
+    return
+        static_cast<unsigned long long> (ts.tv_sec) * 1000000000ULL
+      + static_cast<unsigned long long> (ts.tv_nsec)
+      ;
+  }
+
+  namespace details
+  {
+    struct timestamp_prefix
+    {
+      long long   second      = -1  ;
+      std::size_t date_size   = 0U  ;
+      std::size_t zone_size   = 0U  ;
+      char        date[32]          ; // 2015-06-21T14:03:07
+      char        zone[8]           ; // +02:00
+    };
+
+    inline bool to_local_time (long long second, std::tm & local) noexcept
+    {
+      auto t = static_cast<std::time_t> (second);
+#ifdef _MSC_VER
+      return localtime_s (&local, &t) == 0;
+#else
+      return localtime_r (&t, &local) != nullptr;
+#endif
+    }
+
+    inline bool update_timestamp_prefix (timestamp_prefix & prefix, long long second) noexcept
+    {
+      std::tm local {};
+      if (!to_local_time (second, local))
+      {
+        return false;
+      }
+
+      prefix.date_size = std::strftime (prefix.date, sizeof (prefix.date), "%Y-%m-%dT%H:%M:%S", &local);
+
+      // strftime gives +0200, ISO-8601 wants +02:00 to go with the extended date
+      char zone[16];
+      auto zone_size = std::strftime (zone, sizeof (zone), "%z", &local);
+      if (zone_size == 5U)
+      {
+        prefix.zone[0]    = zone[0];
+        prefix.zone[1]    = zone[1];
+        prefix.zone[2]    = zone[2];
+        prefix.zone[3]    = ':'    ;
+        prefix.zone[4]    = zone[3];
+        prefix.zone[5]    = zone[4];
+        prefix.zone_size  = 6U     ;
+      }
+      else
+      {
+        prefix.zone_size  = 0U     ;
+      }
+
+      prefix.second = prefix.date_size > 0U ? second : -1;
+      return prefix.date_size > 0U;
+    }
+
+    // Formats ns as 2015-06-21T14:03:07.123456789+02:00 with digits (0-9)
+    //  sub-second digits, returns the length or 0 if it doesn't fit
+    inline std::size_t format_timestamp (char * buffer, std::size_t size, long long ns, std::size_t digits) noexcept
+    {
+      static thread_local timestamp_prefix prefix;
+
+      // Rounds towards negative infinity so times before 1970 keep a
+      //  positive fraction
+      auto second   = ns / 1000000000LL;
+      auto fraction = ns % 1000000000LL;
+      if (fraction < 0)
+      {
+        --second;
+        fraction += 1000000000LL;
+      }
+
+      if (prefix.second != second && !update_timestamp_prefix (prefix, second))
+      {
+        return 0U;
+      }
+
+      auto total = prefix.date_size + (digits > 0U ? digits + 1U : 0U) + prefix.zone_size;
+      if (total > size)
+      {
+        return 0U;
+      }
+
+      auto out = buffer;
+
+      std::memcpy (out, prefix.date, prefix.date_size);
+      out += prefix.date_size;
+
+      if (digits > 0U)
+      {
+        *out = '.';
+        for (auto iter = 9U; iter > digits; --iter)
+        {
+          fraction /= 10;
+        }
+        for (auto iter = digits; iter > 0U; --iter)
+        {
+          out[iter] = static_cast<char> ('0' + fraction % 10);
+          fraction /= 10;
+        }
+        out += digits + 1U;
+      }
+
+      std::memcpy (out, prefix.zone, prefix.zone_size);
+
+      return total;
+    }
+  }
+}
+
+#endif // TYPESAFE_PRINTF__TSPRINTF_TIMESTAMP_HPP
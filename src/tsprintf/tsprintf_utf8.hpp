@@ -0,0 +1,242 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+#ifndef TYPESAFE_PRINTF__TSPRINTF_UTF8_HPP
+#define TYPESAFE_PRINTF__TSPRINTF_UTF8_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cwchar>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define TYPESAFE_PRINTF__UTF8_SSE2
+# include <emmintrin.h>
+#endif
+
+// wchar_t (UTF-32, or UTF-16 where wchar_t is 16 bits) to UTF-8 without
+//  going through wcrtomb and the locale. Runs of ASCII are narrowed 8 chars
+//  at a time
+
+namespace typesafe_printf
+{
+  namespace details
+  {
+    // Skips the ASCII chars at the start of [s, end)
+    inline wchar_t const * skip_ascii (wchar_t const * s, wchar_t const * end) noexcept
+    {
+#ifdef TYPESAFE_PRINTF__UTF8_SSE2
+      auto zero = _mm_setzero_si128 ();
+# if WCHAR_MAX > 0xFFFF
+      auto mask = _mm_set1_epi32 (~0x7F);
+
+      for (; end - s >= 8; s += 8)
+      {
+        auto first  = _mm_loadu_si128 (reinterpret_cast<__m128i const *> (s)    );
+        auto second = _mm_loadu_si128 (reinterpret_cast<__m128i const *> (s + 4));
+        auto high   = _mm_and_si128 (_mm_or_si128 (first, second), mask);
+        if (_mm_movemask_epi8 (_mm_cmpeq_epi32 (high, zero)) != 0xFFFF)
+        {
+          break;
+        }
+      }
+# else
+      auto mask = _mm_set1_epi16 (static_cast<short> (~0x7F));
+
+      for (; end - s >= 8; s += 8)
+      {
+        auto high = _mm_and_si128 (_mm_loadu_si128 (reinterpret_cast<__m128i const *> (s)), mask);
+        if (_mm_movemask_epi8 (_mm_cmpeq_epi16 (high, zero)) != 0xFFFF)
+        {
+          break;
+        }
+      }
+# endif
+#endif
+
+      while (s < end && *s >= 0 && *s < 0x80)
+      {
+        ++s;
+      }
+
+      return s;
+    }
+
+    // Narrows whole blocks of 8 ASCII chars, stops at the first block with
+    //  anything else or when out has less than 8 chars of room
+    inline wchar_t const * narrow_ascii (char * & out, char const * out_end, wchar_t const * s, wchar_t const * end) noexcept
+    {
+#ifdef TYPESAFE_PRINTF__UTF8_SSE2
+      auto zero = _mm_setzero_si128 ();
+# if WCHAR_MAX > 0xFFFF
+      auto mask = _mm_set1_epi32 (~0x7F);
+
+      for (; end - s >= 8 && out_end - out >= 8; s += 8, out += 8)
+      {
+        auto first  = _mm_loadu_si128 (reinterpret_cast<__m128i const *> (s)    );
+        auto second = _mm_loadu_si128 (reinterpret_cast<__m128i const *> (s + 4));
+        auto high   = _mm_and_si128 (_mm_or_si128 (first, second), mask);
+        if (_mm_movemask_epi8 (_mm_cmpeq_epi32 (high, zero)) != 0xFFFF)
+        {
+          break;
+        }
+
+        // All values are below 0x80 so the packs don't saturate
+        auto words = _mm_packs_epi32 (first, second);
+        _mm_storel_epi64 (reinterpret_cast<__m128i *> (out), _mm_packus_epi16 (words, words));
+      }
+# else
+      auto mask = _mm_set1_epi16 (static_cast<short> (~0x7F));
+
+      for (; end - s >= 8 && out_end - out >= 8; s += 8, out += 8)
+      {
+        auto words  = _mm_loadu_si128 (reinterpret_cast<__m128i const *> (s));
+        auto high   = _mm_and_si128 (words, mask);
+        if (_mm_movemask_epi8 (_mm_cmpeq_epi16 (high, zero)) != 0xFFFF)
+        {
+          break;
+        }
+
+        _mm_storel_epi64 (reinterpret_cast<__m128i *> (out), _mm_packus_epi16 (words, words));
+      }
+# endif
+#else
+      (void) out;
+      (void) out_end;
+      (void) end;
+#endif
+
+      return s;
+    }
+
+    // Decodes the code point at s and moves s past it (a surrogate pair
+    //  where wchar_t is 16 bits). Fails on unpaired surrogates and values
+    //  past U+10FFFF, wcrtomb rejects those as well
+    inline bool decode_wide (wchar_t const * & s, wchar_t const * end, std::uint32_t & code_point) noexcept
+    {
+#if WCHAR_MAX > 0xFFFF
+      (void) end;
+      code_point = static_cast<std::uint32_t> (*s++);
+#else
+      code_point = static_cast<std::uint16_t> (*s++);
+      if (code_point >= 0xD800U && code_point <= 0xDBFFU && s < end)
+      {
+        auto low = static_cast<std::uint16_t> (*s);
+        if (low >= 0xDC00U && low <= 0xDFFFU)
+        {
+          code_point = 0x10000U + ((code_point - 0xD800U) << 10) + (low - 0xDC00U);
+          ++s;
+        }
+      }
+#endif
+
+      return code_point < 0xD800U || (code_point > 0xDFFFU && code_point <= 0x10FFFFU);
+    }
+
+    constexpr std::size_t utf8_sequence_size (std::uint32_t code_point) noexcept
+    {
+      return
+          code_point < 0x80U    ? 1U
+        : code_point < 0x800U   ? 2U
+        : code_point < 0x10000U ? 3U
+        : 4U
+        ;
+    }
+
+    inline std::size_t encode_code_point (char * out, std::uint32_t code_point) noexcept
+    {
+      auto size = utf8_sequence_size (code_point);
+
+      switch (size)
+      {
+      case 1:
+        out[0] = static_cast<char> (code_point);
+        break;
+      case 2:
+        out[0] = static_cast<char> (0xC0U | (code_point >> 6));
+        out[1] = static_cast<char> (0x80U | (code_point & 0x3FU));
+        break;
+      case 3:
+        out[0] = static_cast<char> (0xE0U | (code_point >> 12));
+        out[1] = static_cast<char> (0x80U | ((code_point >> 6) & 0x3FU));
+        out[2] = static_cast<char> (0x80U | (code_point & 0x3FU));
+        break;
+      default:
+        out[0] = static_cast<char> (0xF0U | (code_point >> 18));
+        out[1] = static_cast<char> (0x80U | ((code_point >> 12) & 0x3FU));
+        out[2] = static_cast<char> (0x80U | ((code_point >> 6) & 0x3FU));
+        out[3] = static_cast<char> (0x80U | (code_point & 0x3FU));
+        break;
+      }
+
+      return size;
+    }
+
+    // The UTF-8 size of [s, end), returns false if it has chars UTF-8 can't
+    //  represent
+    inline bool utf8_size (wchar_t const * s, wchar_t const * end, std::size_t & size) noexcept
+    {
+      size = 0U;
+
+      for (;;)
+      {
+        auto ascii_end = skip_ascii (s, end);
+        size  += static_cast<std::size_t> (ascii_end - s);
+        s     = ascii_end;
+
+        if (s == end)
+        {
+          return true;
+        }
+
+        std::uint32_t code_point = 0U;
+        if (!decode_wide (s, end, code_point))
+        {
+          return false;
+        }
+
+        size += utf8_sequence_size (code_point);
+      }
+    }
+
+    // Encodes the whole chars of [s, end) that fit in [out, out_end) and
+    //  moves s past them, returns the end of the encoded text
+    inline char * encode_utf8 (char * out, char const * out_end, wchar_t const * & s, wchar_t const * end) noexcept
+    {
+      while (s < end)
+      {
+        s = narrow_ascii (out, out_end, s, end);
+        if (s == end)
+        {
+          break;
+        }
+
+        auto          next        = s;
+        std::uint32_t code_point  = 0U;
+        if (!decode_wide (next, end, code_point) || static_cast<std::size_t> (out_end - out) < utf8_sequence_size (code_point))
+        {
+          break;
+        }
+
+        out += encode_code_point (out, code_point);
+        s   = next;
+      }
+
+      return out;
+    }
+  }
+}
+
+#endif // TYPESAFE_PRINTF__TSPRINTF_UTF8_HPP
@@ -0,0 +1,289 @@
+// ----------------------------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------------------------
+
+#ifndef TYPESAFE_PRINTF__TSPRINTF_WRITEV_HPP
+#define TYPESAFE_PRINTF__TSPRINTF_WRITEV_HPP
+
+#include <cerrno>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+# include <io.h>
+#else
+# include <sys/uio.h>
+# include <unistd.h>
+#endif
+
+#include "tsprintf.hpp"
+#include "tsprintf_engine.hpp"
+
+// TS_WRITEV writes a checked call to a file descriptor without copying the
+//  format literals. Each literal run becomes an iovec pointing into the
+//  format string, only the conversions are rendered into a scratch area on
+//  the stack and the whole call is submitted with one writev
+//
+//  TS_WRITEV (fd, "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n\r\n", body.size ());
+//
+// Returns the number of chars written or -1. Where writev isn't available
+//  (Windows) the iovecs are written one by one with _write. Output that
+//  needs more iovecs than fit on the stack or a conversion that doesn't fit
+//  the scratch area is written in several writev calls
+
+#define TS_WRITEV(fd, format, ...)                                                                                  \
+  ( (void) typesafe_printf::details::check_types<typesafe_printf::details::scanner::encode (format)> (__VA_ARGS__)  \
+  , (void) TYPESAFE_PRINTF__CHECK_EXTENSIONS (format)                                                               \
+  , typesafe_printf::details::writev_format<typesafe_printf::details::scanner::encode (format)> (fd, format, ##__VA_ARGS__) \
+  )
+
+namespace typesafe_printf
+{
+  namespace details
+  {
+#ifdef _WIN32
+    struct iovec
+    {
+      void *        iov_base  ;
+      std::size_t   iov_len   ;
+    };
+#else
+    using ::iovec;
+#endif
+
+    // Writes all of iov, picks up where a partial write left off
+    inline bool write_all (int fd, iovec * iov, int count) noexcept
+    {
+#ifdef _WIN32
+      for (auto iter = 0; iter < count; ++iter)
+      {
+        auto text = static_cast<char const *> (iov[iter].iov_base);
+        auto left = iov[iter].iov_len;
+        while (left > 0U)
+        {
+          auto chunk    = left < 0x40000000U ? static_cast<unsigned> (left) : 0x40000000U;
+          auto written  = _write (fd, text, chunk);
+          if (written < 0)
+          {
+            return false;
+          }
+          text += written;
+          left -= static_cast<std::size_t> (written);
+        }
+      }
+      return true;
+#else
+      while (count > 0)
+      {
+        auto written = ::writev (fd, iov, count);
+        if (written < 0)
+        {
+          if (errno == EINTR)
+          {
+            continue;
+          }
+          return false;
+        }
+
+        auto left = static_cast<std::size_t> (written);
+        while (count > 0 && left >= iov->iov_len)
+        {
+          left -= iov->iov_len;
+          ++iov;
+          --count;
+        }
+
+        if (count > 0)
+        {
+          iov->iov_base = static_cast<char *> (iov->iov_base) + left;
+          iov->iov_len  -= left;
+        }
+      }
+      return true;
+#endif
+    }
+
+    class iovec_writer
+    {
+    public:
+      explicit iovec_writer (int fd) noexcept
+        : fd      (fd)
+        , count   (0)
+        , used    (0U)
+        , total   (0U)
+        , failed  (false)
+      {
+      }
+
+      iovec_writer (iovec_writer const &)             = delete;
+      iovec_writer & operator= (iovec_writer const &) = delete;
+
+      // text must stay valid until the next flush
+      void add (char const * text, std::size_t size) noexcept
+      {
+        if (size == 0U)
+        {
+          return;
+        }
+
+        if (count == max_iovecs)
+        {
+          flush ();
+        }
+
+        iov[count].iov_base = const_cast<char *> (text);
+        iov[count].iov_len  = size;
+        ++count;
+        total += size;
+      }
+
+      // Renders a conversion into the scratch area and adds it, a conversion
+      //  that doesn't fit in the scratch area goes through the heap
+      bool add_conversion (char const * format, segment const & s, arg const * args)
+      {
+        if (get_type_class (s.tid) == tc__chars_written)
+        {
+          // render_segment only knows about the chars in its own buffer
+          for (auto iter = 0U; iter < s.stars; ++iter)
+          {
+            if (args[iter].tid != tid__int)
+            {
+              return false;
+            }
+          }
+          if (args[s.stars].tid != s.tid)
+          {
+            return false;
+          }
+          render_chars_written (args[s.stars], total);
+          return true;
+        }
+
+        // add mustn't flush once the conversion is in the scratch area
+        if (count == max_iovecs)
+        {
+          flush ();
+        }
+
+        std::size_t size = 0U;
+        for (;;)
+        {
+          output_buffer output (scratch + used, sizeof (scratch) - used);
+          if (!render_segment (output, format, s, args))
+          {
+            return false;
+          }
+
+          size = output.size ();
+          if (used + size < sizeof (scratch))
+          {
+            add (scratch + used, size);
+            used += size;
+            return true;
+          }
+
+          if (used == 0U)
+          {
+            break;
+          }
+
+          // Frees the scratch area and tries again
+          flush ();
+        }
+
+        std::vector<char> large (size + 1U);
+        output_buffer output (large.data (), large.size ());
+        render_segment (output, format, s, args);
+        add (large.data (), output.size ());
+        flush ();
+        return true;
+      }
+
+      void flush () noexcept
+      {
+        if (count > 0 && !write_all (fd, iov, count))
+        {
+          failed = true;
+        }
+        count = 0   ;
+        used  = 0U  ;
+      }
+
+      int finish () noexcept
+      {
+        flush ();
+        return failed ? -1 : static_cast<int> (total);
+      }
+
+    private:
+      // Well below IOV_MAX on every system that has writev
+      static constexpr int max_iovecs = 64;
+
+      int           fd                  ;
+      int           count               ;
+      std::size_t   used                ;
+      std::size_t   total               ;
+      bool          failed              ;
+      iovec         iov[max_iovecs]     ;
+      char          scratch[512]        ;
+    };
+
+    inline int writev_render (int fd, char const * format, arg const * args, size_type arg_count)
+    {
+      TYPESAFE_PRINTF__ASSERT (format);
+      TYPESAFE_PRINTF__ASSERT (args || arg_count == 0);
+
+      iovec_writer  writer  (fd);
+      size_type     count   = 0U;
+      index_type    pos     = 0U;
+      segment       s       {} ;
+
+      while (next_segment (format, pos, s))
+      {
+        if (is_literal (s))
+        {
+          writer.add (format + s.begin, s.end - s.begin);
+        }
+        else if (count + argument_count (s) > arg_count || !writer.add_conversion (format, s, args + count))
+        {
+          return -1;
+        }
+        else
+        {
+          count += argument_count (s);
+        }
+      }
+
+      if (count != arg_count || format[pos] != '\0')
+      {
+        return -1;
+      }
+
+      return writer.finish ();
+    }
+
+    // Use TS_WRITEV, it checks the arguments
+    template<encoded_types_t EncodedTypes, typename ...TArgs>
+    int writev_format (int fd, char const * format, TArgs && ...args)
+    {
+      std::array<arg, sizeof... (TArgs)> captured;
+      make_args<EncodedTypes> (captured, std::forward<TArgs> (args)...);
+      return writev_render (fd, format, captured.data (), static_cast<size_type> (captured.size ()));
+    }
+  }
+}
+
+#endif // TYPESAFE_PRINTF__TSPRINTF_WRITEV_HPP